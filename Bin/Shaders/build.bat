@@ -1,2 +1,4 @@
 %VULKAN_SDK%\Bin\glslc.exe shader.vert -o vertexshader.spv
-%VULKAN_SDK%\Bin\glslc.exe shader.frag -o fragmentshader.spv
\ No newline at end of file
+%VULKAN_SDK%\Bin\glslc.exe -DCOMPACT_VERTEX shader.vert -o compactvertexshader.spv
+%VULKAN_SDK%\Bin\glslc.exe shader.frag -o fragmentshader.spv
+%VULKAN_SDK%\Bin\glslc.exe feedback.frag -o feedbackshader.spv
\ No newline at end of file
@@ -1,2 +1,4 @@
 %VULKAN_SDK%\Bin\glslc.exe ./Shaders/shader.vert -o ./Shaders/vertexshader.spv
-%VULKAN_SDK%\Bin\glslc.exe ./Shaders/shader.frag -o ./Shaders/fragmentshader.spv
\ No newline at end of file
+%VULKAN_SDK%\Bin\glslc.exe -DCOMPACT_VERTEX ./Shaders/shader.vert -o ./Shaders/compactvertexshader.spv
+%VULKAN_SDK%\Bin\glslc.exe ./Shaders/shader.frag -o ./Shaders/fragmentshader.spv
+%VULKAN_SDK%\Bin\glslc.exe ./Shaders/feedback.frag -o ./Shaders/feedbackshader.spv
\ No newline at end of file
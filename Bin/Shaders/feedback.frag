@@ -0,0 +1,44 @@
+#version 450
+
+layout(location = 0) out uint outPage;
+layout(location = 0) in vec3 vert;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+
+layout(set = 1, binding = 0) uniform FragmentBuffer {
+	vec3 lightPos;
+	float constantFalloff;
+	vec3 lightColor;
+	float linearFalloff;
+	float quadraticFalloff;
+	vec4 virtualRect;
+	// x coarsest level, y 1 when the texture is virtual, z level bias for the lower resolution
+	vec4 virtualInfo;
+} lightBuffer;
+
+layout(set = 2, binding = 1) uniform usampler2D indirection;
+
+// VirtualTexture::PageSize and NoPage
+const float PageSize = 128.0f;
+const uint NoPage = 0xFFFFFFFFu;
+
+// Writes the page of the virtual texture shader.frag samples at this pixel,
+// packed the way VirtualTexture reads it: x, y and level in 12, 12 and 8 bits.
+void main() {
+	if (lightBuffer.virtualInfo.y == 0.0f)
+	{
+		// still drawn, it hides the virtual surfaces behind it
+		outPage = NoPage;
+		return;
+	}
+
+	vec2 virtualPages = vec2(textureSize(indirection, 0));
+	vec2 texel = (lightBuffer.virtualRect.xy + fract(texCoord) * lightBuffer.virtualRect.zw) * virtualPages * PageSize;
+
+	vec2 dx = dFdx(texCoord) * lightBuffer.virtualRect.zw * virtualPages * PageSize;
+	vec2 dy = dFdy(texCoord) * lightBuffer.virtualRect.zw * virtualPages * PageSize;
+	float level = clamp(floor(0.5f * log2(max(dot(dx, dx), dot(dy, dy))) + lightBuffer.virtualInfo.z), 0.0f, lightBuffer.virtualInfo.x);
+
+	uvec2 page = uvec2(texel / (PageSize * exp2(level)));
+	outPage = page.x | (page.y << 12) | (uint(level) << 24);
+}
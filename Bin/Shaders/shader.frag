@@ -11,9 +11,53 @@ layout(set = 1, binding = 0) uniform FragmentBuffer {
 	vec3 lightColor;
 	float linearFalloff;
 	float quadraticFalloff;
+	// virtual texture: xy offset and zw size of the texture in it, x of info the
+	// coarsest level, y 1 when the mesh's texture is virtual
+	vec4 virtualRect;
+	vec4 virtualInfo;
+	// atlas page: xy offset and zw size of the texture in it, all zero when the texture isn't packed
+	vec4 atlasRect;
 } lightBuffer;
 
 layout(set = 1, binding = 1) uniform sampler2D texSampler;
+layout(set = 2, binding = 0) uniform sampler2D pageCache;
+layout(set = 2, binding = 1) uniform usampler2D indirection;
+
+// VirtualTexture::PageSize and PageBorder
+const float PageSize = 128.0f;
+const float PageBorder = 4.0f;
+
+vec4 SampleVirtual(vec2 uv)
+{
+	vec2 virtualPages = vec2(textureSize(indirection, 0));
+	// the texture's block is whole pages, fract keeps repeating coordinates inside it
+	vec2 texel = (lightBuffer.virtualRect.xy + fract(uv) * lightBuffer.virtualRect.zw) * virtualPages * PageSize;
+
+	// from the unwrapped coordinates, fract jumps at the seams
+	vec2 dx = dFdx(uv) * lightBuffer.virtualRect.zw * virtualPages * PageSize;
+	vec2 dy = dFdy(uv) * lightBuffer.virtualRect.zw * virtualPages * PageSize;
+	float level = clamp(floor(0.5f * log2(max(dot(dx, dx), dot(dy, dy)))), 0.0f, lightBuffer.virtualInfo.x);
+
+	uvec4 entry = texelFetch(indirection, ivec2(texel / (PageSize * exp2(level))), int(level));
+	if (entry.a == 0u)
+	{
+		// not even the pinned level is in yet
+		return texture(texSampler, uv);
+	}
+
+	// the entry may point at a coarser page than the one asked for
+	vec2 levelTexel = texel / exp2(float(entry.b));
+	vec2 inPage = levelTexel - floor(levelTexel / PageSize) * PageSize;
+	vec2 cacheTexel = vec2(entry.rg) * (PageSize + 2.0f * PageBorder) + PageBorder + inPage;
+	return textureLod(pageCache, cacheTexel / vec2(textureSize(pageCache, 0)), 0.0f);
+}
+
+vec4 SampleAtlas(vec2 uv)
+{
+	// the page holds a padded copy of the texture, fract keeps repeating coordinates inside it
+	vec2 atlasUV = lightBuffer.atlasRect.xy + fract(uv) * lightBuffer.atlasRect.zw;
+	return textureGrad(texSampler, atlasUV, dFdx(uv) * lightBuffer.atlasRect.zw, dFdy(uv) * lightBuffer.atlasRect.zw);
+}
 
 void main() {
 	vec3 toLight = lightBuffer.lightPos - vert; 
@@ -27,7 +71,19 @@ void main() {
 
 	float lightIntensity = attenuation * max(0.0f, dot(normal, normalize(toLight)));
 
-	vec4 texColor = texture(texSampler, texCoord);
+	vec4 texColor;
+	if (lightBuffer.virtualInfo.y != 0.0f)
+	{
+		texColor = SampleVirtual(texCoord);
+	}
+	else if (lightBuffer.atlasRect.z != 0.0f)
+	{
+		texColor = SampleAtlas(texCoord);
+	}
+	else
+	{
+		texColor = texture(texSampler, texCoord);
+	}
 	vec4 diffuseColor = vec4(lightBuffer.lightColor, 1.0f) * texColor;
 	vec4 ambient = diffuseColor * 0.1f;
 
@@ -1,7 +1,13 @@
 #version 450
 
+// compiled a second time with COMPACT_VERTEX for meshes stored as CompactVertex
+#ifdef COMPACT_VERTEX
+layout(location = 0) in vec4 packedPos;
+layout(location = 1) in vec2 packedNormal;
+#else
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 normal;
+#endif
 layout(location = 2) in vec2 texCoord;
 layout(location = 0) out vec3 vert;
 layout(location = 1) out vec3 fNormal;
@@ -12,9 +18,26 @@ layout(set = 0, binding = 0) uniform MVP {
 	mat4 view;
 	mat4 projection;
 	mat4 modelViewProjection;
+	vec4 positionOffset;
+	vec4 positionScale;
 } mvp;
 
+#ifdef COMPACT_VERTEX
+vec3 OctahedronDecode(vec2 encoded)
+{
+	vec3 n = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -fold : fold;
+	n.y += n.y >= 0.0f ? -fold : fold;
+	return normalize(n);
+}
+#endif
+
 void main() {
+#ifdef COMPACT_VERTEX
+	vec3 pos = mvp.positionOffset.xyz + packedPos.xyz * mvp.positionScale.xyz;
+	vec3 normal = OctahedronDecode(packedNormal);
+#endif
 	gl_Position = mvp.modelViewProjection * vec4(pos, 1.0f);
 	vert = pos;
 	fNormal = normal;
@@ -0,0 +1,156 @@
+#include "AssimpImporter.h"
+
+#include <cassert>
+#include <cstring>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include "ImportedScene.h"
+#include "JobSystem.h"
+#include "Logger.h"
+#include "MappedIOSystem.h"
+#include "exception/RendererException.h"
+
+static void ConvertMesh(const aiMesh* mesh, Vertex* vertices, uint32_t* indices, ImportedMesh& importedMesh);
+static void AppendNode(const aiNode* node, ImportedScene& imported);
+
+void AssimpImporter::Import(const char* path, ImportedScene& imported)
+{
+    Assimp::Importer imp;
+    // the importer takes ownership and deletes it with itself
+    MappedIOSystem* ioSystem = new MappedIOSystem();
+    imp.SetIOHandler(ioSystem);
+
+    const aiScene* scene = imp.ReadFile(path, ImportFlags);
+
+    MappedIOSystem::Stats ioStats = ioSystem->GetStats();
+    Logger::Debug("Assimp I/O for %s: %u opens, %u mappings (%llu bytes), %llu bytes read, %u failed opens\n",
+        path, ioStats.opens, ioStats.mappings, (unsigned long long)ioStats.bytesMapped,
+        (unsigned long long)ioStats.bytesRead, ioStats.failedOpens);
+
+    if (!scene)
+    {
+        Logger::Error("Failed to import model: %s: %s\n", path, imp.GetErrorString());
+        throw RendererException("Failed to load a model. Check console for extra info.");
+    }
+
+    // every mesh gets its own range of one shared vertex and index array
+    // so the data can be written out to the mesh cache as two contiguous blobs
+    std::vector<size_t> vertexOffsets(scene->mNumMeshes);
+    std::vector<size_t> indexOffsets(scene->mNumMeshes);
+    size_t totalVertices = 0;
+    size_t totalIndices = 0;
+    for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+    {
+        vertexOffsets[i] = totalVertices;
+        indexOffsets[i] = totalIndices;
+        totalVertices += scene->mMeshes[i]->mNumVertices;
+        totalIndices += scene->mMeshes[i]->mNumFaces * 3;
+    }
+
+    imported.vertexStorage.resize(totalVertices);
+    imported.indexStorage.resize(totalIndices);
+    imported.meshes.resize(scene->mNumMeshes);
+
+    // the ranges are disjoint, so each mesh is converted by its own job
+    JobSystem::Get()->ParallelFor(scene->mNumMeshes, 1, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            ConvertMesh(
+                scene->mMeshes[i],
+                imported.vertexStorage.data() + vertexOffsets[i],
+                imported.indexStorage.data() + indexOffsets[i],
+                imported.meshes[i]
+            );
+        }
+    });
+
+    // strings are collected first, the pointers are only taken once the storage stops growing
+    std::vector<int32_t> materialString(scene->mNumMaterials, -1);
+    for (uint32_t i = 0; i < scene->mNumMaterials; i++)
+    {
+        aiString texPath;
+        if (scene->mMaterials[i]->GetTexture(aiTextureType_DIFFUSE, 0, &texPath) == aiReturn_SUCCESS)
+        {
+            materialString[i] = (int32_t)imported.stringStorage.size();
+            imported.stringStorage.emplace_back(texPath.C_Str());
+        }
+    }
+
+    imported.materials.resize(scene->mNumMaterials);
+    for (uint32_t i = 0; i < scene->mNumMaterials; i++)
+    {
+        if (materialString[i] >= 0)
+        {
+            imported.materials[i].diffuseTexture = imported.stringStorage[materialString[i]].c_str();
+        }
+    }
+
+    AppendNode(scene->mRootNode, imported);
+}
+
+static void ConvertMesh(const aiMesh* mesh, Vertex* vertices, uint32_t* indices, ImportedMesh& importedMesh)
+{
+    const uint32_t vertCount = mesh->mNumVertices;
+    const uint32_t faceCount = mesh->mNumFaces * 3;
+
+    for (uint32_t j = 0; j < vertCount; j++)
+    {
+        vertices[j].pos = *reinterpret_cast<glm::vec3*>(&mesh->mVertices[j]);
+        if (mesh->mNormals)
+        {
+            vertices[j].normal = *reinterpret_cast<glm::vec3*>(&mesh->mNormals[j]);
+        }
+        else
+        {
+            vertices[j].normal = glm::vec3(0.0f);
+        }
+
+        if (mesh->mTextureCoords[0])
+        {
+            memcpy(&vertices[j].texCoord, &mesh->mTextureCoords[0][j], 2 * sizeof(float));
+        }
+        else
+        {
+            vertices[j].texCoord = glm::vec2(0.0f);
+        }
+    }
+
+    uint32_t currentIndex = 0;
+    for (uint32_t k = 0; k < mesh->mNumFaces; k++)
+    {
+        assert(mesh->mFaces[k].mNumIndices == 3 && "Expected 3 indices per face.");
+        indices[currentIndex++] = mesh->mFaces[k].mIndices[0];
+        indices[currentIndex++] = mesh->mFaces[k].mIndices[1];
+        indices[currentIndex++] = mesh->mFaces[k].mIndices[2];
+    }
+
+    importedMesh.vertices = vertices;
+    importedMesh.numVertices = vertCount;
+    importedMesh.indices = indices;
+    importedMesh.numIndices = faceCount;
+    importedMesh.materialIndex = mesh->mMaterialIndex;
+}
+
+static void AppendNode(const aiNode* node, ImportedScene& imported)
+{
+    ImportedNode importedNode;
+    // aiMatrix4x4 is row-major, glm is column-major
+    importedNode.transform = glm::transpose(*(glm::mat4*)&node->mTransformation);
+    importedNode.firstMesh = (uint32_t)imported.nodeMeshes.size();
+    importedNode.numMeshes = node->mNumMeshes;
+    importedNode.numChildren = node->mNumChildren;
+    imported.nodes.push_back(importedNode);
+
+    for (uint32_t i = 0; i < node->mNumMeshes; i++)
+    {
+        imported.nodeMeshes.push_back(node->mMeshes[i]);
+    }
+
+    for (uint32_t i = 0; i < node->mNumChildren; i++)
+    {
+        AppendNode(node->mChildren[i], imported);
+    }
+}
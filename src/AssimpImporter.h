@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+#include <assimp/postprocess.h>
+
+struct ImportedScene;
+
+class AssimpImporter
+{
+public:
+    static constexpr uint32_t ImportFlags = aiProcess_Triangulate | aiProcess_ConvertToLeftHanded |
+        aiProcess_GenNormals | aiProcess_JoinIdenticalVertices;
+
+    // Throws a RendererException when Assimp cannot read the file.
+    static void Import(const char* path, ImportedScene& imported);
+};
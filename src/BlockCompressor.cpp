@@ -0,0 +1,554 @@
+#include "BlockCompressor.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+#include "JobSystem.h"
+
+namespace
+{
+	constexpr uint32_t BlockTexels = 16;
+	// rough number of blocks one job encodes
+	constexpr uint32_t BlocksPerJob = 256;
+
+	const float s_BC1Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	const int s_BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Writes fields LSB first, the order every BCn block uses.
+	class BitWriter
+	{
+	public:
+		void Write(uint64_t value, uint32_t count)
+		{
+			const uint32_t word = m_Position >> 6;
+			const uint32_t shift = m_Position & 63;
+			m_Words[word] |= value << shift;
+			if (shift + count > 64)
+			{
+				m_Words[word + 1] |= value >> (64 - shift);
+			}
+			m_Position += count;
+		}
+
+		void CopyTo(uint8_t* output, uint32_t bytes) const { memcpy(output, m_Words, bytes); }
+
+	private:
+		uint64_t m_Words[2] = {};
+		uint32_t m_Position = 0;
+	};
+
+	__m128i PaletteEntry(int r, int g, int b, int a)
+	{
+		return _mm_setr_epi16((short)r, (short)g, (short)b, (short)a, (short)r, (short)g, (short)b, (short)a);
+	}
+
+	__m128i Select(__m128i mask, __m128i a, __m128i b)
+	{
+		return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+	// Squared distances of four RGBA8 texels to one palette entry built by PaletteEntry.
+	__m128i Distances(__m128i texels, __m128i entry)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i low = _mm_sub_epi16(_mm_unpacklo_epi8(texels, zero), entry);
+		__m128i high = _mm_sub_epi16(_mm_unpackhi_epi8(texels, zero), entry);
+		// per texel: r*r + g*g and b*b + a*a in adjacent lanes
+		low = _mm_madd_epi16(low, low);
+		high = _mm_madd_epi16(high, high);
+		__m128 even = _mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high), _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high), _MM_SHUFFLE(3, 1, 3, 1));
+		return _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+	}
+
+	// Picks the closest palette entry for every texel of the block, returns the summed squared error.
+	uint32_t SelectIndices(const __m128i* block, const __m128i* palette, uint32_t paletteSize, uint8_t* indices)
+	{
+		__m128i total = _mm_setzero_si128();
+
+		for (uint32_t group = 0; group < 4; group++)
+		{
+			__m128i best = Distances(block[group], palette[0]);
+			__m128i bestIndex = _mm_setzero_si128();
+
+			for (uint32_t i = 1; i < paletteSize; i++)
+			{
+				__m128i distance = Distances(block[group], palette[i]);
+				__m128i closer = _mm_cmplt_epi32(distance, best);
+				best = Select(closer, distance, best);
+				bestIndex = Select(closer, _mm_set1_epi32((int)i), bestIndex);
+			}
+
+			total = _mm_add_epi32(total, best);
+
+			alignas(16) uint32_t lanes[4];
+			_mm_store_si128((__m128i*)lanes, bestIndex);
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				indices[group * 4 + i] = (uint8_t)lanes[i];
+			}
+		}
+
+		alignas(16) uint32_t lanes[4];
+		_mm_store_si128((__m128i*)lanes, total);
+		return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+
+	void LoadBlock(const uint8_t* texels, __m128i mask, __m128i* block)
+	{
+		for (uint32_t group = 0; group < 4; group++)
+		{
+			block[group] = _mm_and_si128(_mm_load_si128((const __m128i*)(texels + group * 16)), mask);
+		}
+	}
+
+	// Endpoints at the extremes of the texels projected on the block's principal axis,
+	// pulled in by inset of the range since the extremes are rarely worth an exact hit.
+	void FitEndpoints(const uint8_t* texels, uint32_t channels, float inset, float* start, float* end)
+	{
+		float mean[4] = {};
+		float low[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+		float high[4] = {};
+
+		for (uint32_t i = 0; i < BlockTexels; i++)
+		{
+			for (uint32_t c = 0; c < channels; c++)
+			{
+				float value = texels[i * 4 + c];
+				mean[c] += value;
+				low[c] = std::min(low[c], value);
+				high[c] = std::max(high[c], value);
+			}
+		}
+
+		float covariance[4][4] = {};
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			mean[c] /= BlockTexels;
+		}
+		for (uint32_t i = 0; i < BlockTexels; i++)
+		{
+			float delta[4];
+			for (uint32_t c = 0; c < channels; c++)
+			{
+				delta[c] = texels[i * 4 + c] - mean[c];
+			}
+			for (uint32_t a = 0; a < channels; a++)
+			{
+				for (uint32_t b = a; b < channels; b++)
+				{
+					covariance[a][b] += delta[a] * delta[b];
+				}
+			}
+		}
+		for (uint32_t a = 0; a < channels; a++)
+		{
+			for (uint32_t b = 0; b < a; b++)
+			{
+				covariance[a][b] = covariance[b][a];
+			}
+		}
+
+		// power iteration, seeded with the bounding box diagonal which is usually close already
+		float axis[4] = {};
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			axis[c] = high[c] - low[c];
+		}
+		for (uint32_t iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			float largest = 0.0f;
+			for (uint32_t a = 0; a < channels; a++)
+			{
+				for (uint32_t b = 0; b < channels; b++)
+				{
+					next[a] += covariance[a][b] * axis[b];
+				}
+				largest = std::max(largest, std::fabs(next[a]));
+			}
+			if (largest < 1e-6f)
+			{
+				break;
+			}
+			for (uint32_t c = 0; c < channels; c++)
+			{
+				axis[c] = next[c] / largest;
+			}
+		}
+
+		float length = 0.0f;
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			length += axis[c] * axis[c];
+		}
+		length = std::sqrt(length);
+
+		float minProjection = 0.0f;
+		float maxProjection = 0.0f;
+		if (length > 1e-6f)
+		{
+			for (uint32_t c = 0; c < channels; c++)
+			{
+				axis[c] /= length;
+			}
+			minProjection = FLT_MAX;
+			maxProjection = -FLT_MAX;
+			for (uint32_t i = 0; i < BlockTexels; i++)
+			{
+				float projection = 0.0f;
+				for (uint32_t c = 0; c < channels; c++)
+				{
+					projection += (texels[i * 4 + c] - mean[c]) * axis[c];
+				}
+				minProjection = std::min(minProjection, projection);
+				maxProjection = std::max(maxProjection, projection);
+			}
+			float pull = (maxProjection - minProjection) * inset;
+			minProjection += pull;
+			maxProjection -= pull;
+		}
+
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			start[c] = std::clamp(mean[c] + axis[c] * minProjection, 0.0f, 255.0f);
+			end[c] = std::clamp(mean[c] + axis[c] * maxProjection, 0.0f, 255.0f);
+		}
+	}
+
+	// Least squares endpoints for fixed indices, weights[index] is the interpolation
+	// factor towards end. False if every texel uses the same weight.
+	bool RefineEndpoints(const uint8_t* texels, uint32_t channels, const uint8_t* indices, const float* weights, float* start, float* end)
+	{
+		float aa = 0.0f;
+		float ab = 0.0f;
+		float bb = 0.0f;
+		float startSum[4] = {};
+		float endSum[4] = {};
+
+		for (uint32_t i = 0; i < BlockTexels; i++)
+		{
+			const float b = weights[indices[i]];
+			const float a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (uint32_t c = 0; c < channels; c++)
+			{
+				startSum[c] += a * texels[i * 4 + c];
+				endSum[c] += b * texels[i * 4 + c];
+			}
+		}
+
+		const float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-4f)
+		{
+			return false;
+		}
+
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			start[c] = std::clamp((bb * startSum[c] - ab * endSum[c]) / determinant, 0.0f, 255.0f);
+			end[c] = std::clamp((aa * endSum[c] - ab * startSum[c]) / determinant, 0.0f, 255.0f);
+		}
+		return true;
+	}
+
+	int Quantize(float value, int maximum)
+	{
+		return std::clamp((int)(value * maximum / 255.0f + 0.5f), 0, maximum);
+	}
+
+	uint16_t To565(const float* color)
+	{
+		return (uint16_t)((Quantize(color[0], 31) << 11) | (Quantize(color[1], 63) << 5) | Quantize(color[2], 31));
+	}
+
+	void From565(uint16_t color, int* rgb)
+	{
+		const int r = (color >> 11) & 31;
+		const int g = (color >> 5) & 63;
+		const int b = color & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	// Four colour mode needs the first endpoint to compare greater, equal endpoints
+	// fall back to a single entry.
+	uint32_t SelectBC1Indices(const __m128i* block, uint16_t& color0, uint16_t& color1, uint8_t* indices)
+	{
+		if (color0 < color1)
+		{
+			std::swap(color0, color1);
+		}
+
+		int start[3];
+		int end[3];
+		From565(color0, start);
+		From565(color1, end);
+
+		__m128i palette[4];
+		palette[0] = PaletteEntry(start[0], start[1], start[2], 0);
+		palette[1] = PaletteEntry(end[0], end[1], end[2], 0);
+		palette[2] = PaletteEntry((2 * start[0] + end[0]) / 3, (2 * start[1] + end[1]) / 3, (2 * start[2] + end[2]) / 3, 0);
+		palette[3] = PaletteEntry((start[0] + 2 * end[0]) / 3, (start[1] + 2 * end[1]) / 3, (start[2] + 2 * end[2]) / 3, 0);
+
+		return SelectIndices(block, palette, color0 == color1 ? 1 : 4, indices);
+	}
+
+	// Single channel block: two 8 bit endpoints, eight levels and 3 bit indices.
+	void EncodeBC4(const uint8_t* texels, uint32_t channel, uint8_t* output)
+	{
+		int low = 255;
+		int high = 0;
+		for (uint32_t i = 0; i < BlockTexels; i++)
+		{
+			low = std::min<int>(low, texels[i * 4 + channel]);
+			high = std::max<int>(high, texels[i * 4 + channel]);
+		}
+
+		// the greater endpoint first selects the eight level mode
+		uint64_t bits = (uint64_t)high | ((uint64_t)low << 8);
+
+		const int range = high - low;
+		if (range > 0)
+		{
+			for (uint32_t i = 0; i < BlockTexels; i++)
+			{
+				// position between the endpoints, then the code: 0 and 1 are the endpoints, 2..7 the steps in between
+				const int step = ((high - texels[i * 4 + channel]) * 14 + range) / (range * 2);
+				const uint64_t code = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+				bits |= code << (16 + 3 * i);
+			}
+		}
+
+		memcpy(output, &bits, 8);
+	}
+
+	struct BC7Endpoints
+	{
+		int start[4];
+		int end[4];
+		int startBit;
+		int endBit;
+	};
+
+	// Quantizes to 7 bits plus the shared p-bit and returns the error of the best indices.
+	uint32_t EvaluateBC7(const __m128i* block, const float* start, const float* end, int startBit, int endBit, BC7Endpoints& endpoints, uint8_t* indices)
+	{
+		endpoints.startBit = startBit;
+		endpoints.endBit = endBit;
+
+		int startColor[4];
+		int endColor[4];
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			endpoints.start[c] = std::clamp((int)((start[c] - startBit) * 0.5f + 0.5f), 0, 127);
+			endpoints.end[c] = std::clamp((int)((end[c] - endBit) * 0.5f + 0.5f), 0, 127);
+			startColor[c] = (endpoints.start[c] << 1) | startBit;
+			endColor[c] = (endpoints.end[c] << 1) | endBit;
+		}
+
+		__m128i palette[16];
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			int color[4];
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				color[c] = ((64 - s_BC7Weights[i]) * startColor[c] + s_BC7Weights[i] * endColor[c] + 32) >> 6;
+			}
+			palette[i] = PaletteEntry(color[0], color[1], color[2], color[3]);
+		}
+
+		return SelectIndices(block, palette, 16, indices);
+	}
+
+	uint32_t FindBC7Endpoints(const __m128i* block, const float* start, const float* end, BC7Endpoints& best, uint8_t* bestIndices)
+	{
+		uint32_t bestError = UINT32_MAX;
+		for (int pBits = 0; pBits < 4; pBits++)
+		{
+			BC7Endpoints endpoints;
+			uint8_t indices[BlockTexels];
+			uint32_t error = EvaluateBC7(block, start, end, pBits & 1, pBits >> 1, endpoints, indices);
+			if (error < bestError)
+			{
+				bestError = error;
+				best = endpoints;
+				memcpy(bestIndices, indices, BlockTexels);
+			}
+		}
+		return bestError;
+	}
+
+	void EncodeBlock(BlockCompressor::Format format, const uint8_t* texels, uint8_t* output)
+	{
+		switch (format)
+		{
+		case BlockCompressor::Format::BC1: BlockCompressor::EncodeBC1(texels, output); break;
+		case BlockCompressor::Format::BC3: BlockCompressor::EncodeBC3(texels, output); break;
+		case BlockCompressor::Format::BC5: BlockCompressor::EncodeBC5(texels, output); break;
+		case BlockCompressor::Format::BC7: BlockCompressor::EncodeBC7(texels, output); break;
+		}
+	}
+}
+
+uint32_t BlockCompressor::GetBlockBytes(Format format)
+{
+	return format == Format::BC1 ? 8 : 16;
+}
+
+uint64_t BlockCompressor::GetCompressedSize(Format format, uint32_t width, uint32_t height)
+{
+	return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * GetBlockBytes(format);
+}
+
+void BlockCompressor::Compress(Format format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* output)
+{
+	const uint32_t blocksX = (width + 3) / 4;
+	const uint32_t blocksY = (height + 3) / 4;
+	const uint32_t blockBytes = GetBlockBytes(format);
+
+	auto encodeRows = [=](uint32_t begin, uint32_t end, uint32_t)
+	{
+		alignas(16) uint8_t texels[BlockTexels * 4];
+
+		for (uint32_t blockY = begin; blockY < end; blockY++)
+		{
+			for (uint32_t blockX = 0; blockX < blocksX; blockX++)
+			{
+				for (uint32_t i = 0; i < BlockTexels; i++)
+				{
+					const uint32_t x = std::min(blockX * 4 + (i & 3), width - 1);
+					const uint32_t y = std::min(blockY * 4 + (i >> 2), height - 1);
+					memcpy(texels + i * 4, rgba + ((uint64_t)y * width + x) * 4, 4);
+				}
+
+				EncodeBlock(format, texels, output + ((uint64_t)blockY * blocksX + blockX) * blockBytes);
+			}
+		}
+	};
+
+	JobSystem* jobSystem = JobSystem::Get();
+	if (jobSystem && blocksY > 1)
+	{
+		jobSystem->ParallelFor(blocksY, std::max(1u, BlocksPerJob / blocksX), encodeRows);
+	}
+	else
+	{
+		encodeRows(0, blocksY, 0);
+	}
+}
+
+void BlockCompressor::EncodeBC1(const uint8_t* texels, uint8_t* output)
+{
+	__m128i block[4];
+	LoadBlock(texels, _mm_set1_epi32(0x00FFFFFF), block);
+
+	float start[3];
+	float end[3];
+	FitEndpoints(texels, 3, 1.0f / 16.0f, start, end);
+
+	uint16_t color0 = To565(start);
+	uint16_t color1 = To565(end);
+	uint8_t indices[BlockTexels];
+	uint32_t error = SelectBC1Indices(block, color0, color1, indices);
+
+	if (error > 0 && color0 != color1 && RefineEndpoints(texels, 3, indices, s_BC1Weights, start, end))
+	{
+		uint16_t refined0 = To565(start);
+		uint16_t refined1 = To565(end);
+		uint8_t refinedIndices[BlockTexels];
+		uint32_t refinedError = SelectBC1Indices(block, refined0, refined1, refinedIndices);
+		if (refinedError < error)
+		{
+			color0 = refined0;
+			color1 = refined1;
+			memcpy(indices, refinedIndices, BlockTexels);
+		}
+	}
+
+	uint32_t bits = 0;
+	for (uint32_t i = 0; i < BlockTexels; i++)
+	{
+		bits |= (uint32_t)indices[i] << (i * 2);
+	}
+
+	memcpy(output, &color0, 2);
+	memcpy(output + 2, &color1, 2);
+	memcpy(output + 4, &bits, 4);
+}
+
+void BlockCompressor::EncodeBC3(const uint8_t* texels, uint8_t* output)
+{
+	EncodeBC4(texels, 3, output);
+	EncodeBC1(texels, output + 8);
+}
+
+void BlockCompressor::EncodeBC5(const uint8_t* texels, uint8_t* output)
+{
+	EncodeBC4(texels, 0, output);
+	EncodeBC4(texels, 1, output + 8);
+}
+
+void BlockCompressor::EncodeBC7(const uint8_t* texels, uint8_t* output)
+{
+	__m128i block[4];
+	LoadBlock(texels, _mm_set1_epi32(-1), block);
+
+	float start[4];
+	float end[4];
+	FitEndpoints(texels, 4, 1.0f / 64.0f, start, end);
+
+	BC7Endpoints endpoints;
+	uint8_t indices[BlockTexels];
+	uint32_t error = FindBC7Endpoints(block, start, end, endpoints, indices);
+
+	float weights[16];
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		weights[i] = s_BC7Weights[i] / 64.0f;
+	}
+
+	if (error > 0 && RefineEndpoints(texels, 4, indices, weights, start, end))
+	{
+		BC7Endpoints refined;
+		uint8_t refinedIndices[BlockTexels];
+		if (FindBC7Endpoints(block, start, end, refined, refinedIndices) < error)
+		{
+			endpoints = refined;
+			memcpy(indices, refinedIndices, BlockTexels);
+		}
+	}
+
+	// the first index is stored without its top bit, swapping the endpoints mirrors the weights
+	if (indices[0] >= 8)
+	{
+		std::swap(endpoints.start, endpoints.end);
+		std::swap(endpoints.startBit, endpoints.endBit);
+		for (uint32_t i = 0; i < BlockTexels; i++)
+		{
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	BitWriter writer;
+	writer.Write(1 << 6, 7);
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		writer.Write(endpoints.start[c], 7);
+		writer.Write(endpoints.end[c], 7);
+	}
+	writer.Write(endpoints.startBit, 1);
+	writer.Write(endpoints.endBit, 1);
+	writer.Write(indices[0], 3);
+	for (uint32_t i = 1; i < BlockTexels; i++)
+	{
+		writer.Write(indices[i], 4);
+	}
+	writer.CopyTo(output, 16);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+// CPU encoder for the BCn block formats the texture cooker writes. Each 4x4 block
+// is fitted along the principal axis of its texels, indices are picked with SSE2
+// and the endpoints get one least squares refinement. Compress splits the block
+// rows of an image over the job system when there is one.
+class BlockCompressor
+{
+public:
+	enum class Format
+	{
+		// opaque RGB, 4 bits per texel
+		BC1,
+		// RGB plus an independently coded alpha channel, 8 bits per texel
+		BC3,
+		// two independent channels, used for tangent space normal maps
+		BC5,
+		// RGBA, mode 6 only: one subset, 7 bit endpoints with p-bits and 4 bit indices
+		BC7,
+	};
+
+	static uint32_t GetBlockBytes(Format format);
+	static uint64_t GetCompressedSize(Format format, uint32_t width, uint32_t height);
+
+	// rgba is tightly packed, output must hold GetCompressedSize bytes. Partial blocks
+	// at the right and bottom edges repeat the last row and column.
+	static void Compress(Format format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* output);
+
+	// 16 RGBA8 texels in row order in, one block out.
+	static void EncodeBC1(const uint8_t* texels, uint8_t* output);
+	static void EncodeBC3(const uint8_t* texels, uint8_t* output);
+	static void EncodeBC5(const uint8_t* texels, uint8_t* output);
+	static void EncodeBC7(const uint8_t* texels, uint8_t* output);
+};
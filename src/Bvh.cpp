@@ -0,0 +1,724 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include <emmintrin.h>
+
+namespace
+{
+	constexpr uint32_t Bins = 16;
+	// below this the splits fall back to the median, which bounds the depth
+	constexpr uint32_t MaxSahDepth = 48;
+
+	const Bvh::Bounds EmptyBounds = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+
+	Bvh::Bounds Union(const Bvh::Bounds& a, const Bvh::Bounds& b)
+	{
+		return { glm::min(a.minimum, b.minimum), glm::max(a.maximum, b.maximum) };
+	}
+
+	// half the surface area, the factor cancels out of every ratio
+	float Area(const Bvh::Bounds& bounds)
+	{
+		const glm::vec3 extent = glm::max(bounds.maximum - bounds.minimum, glm::vec3(0.0f));
+		return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+
+	bool OutsideFrustum(const Bvh::Bounds& bounds, const glm::vec4 planes[6])
+	{
+		for (uint32_t i = 0; i < 6; i++)
+		{
+			const glm::vec3 corner(
+				planes[i].x >= 0.0f ? bounds.maximum.x : bounds.minimum.x,
+				planes[i].y >= 0.0f ? bounds.maximum.y : bounds.minimum.y,
+				planes[i].z >= 0.0f ? bounds.maximum.z : bounds.minimum.z);
+			if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool Overlaps(const Bvh::Bounds& a, const Bvh::Bounds& b)
+	{
+		return a.minimum.x <= b.maximum.x && a.minimum.y <= b.maximum.y && a.minimum.z <= b.maximum.z &&
+			a.maximum.x >= b.minimum.x && a.maximum.y >= b.minimum.y && a.maximum.z >= b.minimum.z;
+	}
+
+	// Nodes still to visit. Builds keep the depth low, rotations can only deepen the
+	// tree a little, so the heap is hardly ever touched.
+	template<typename Entry>
+	class TraversalStack
+	{
+	public:
+		void Push(const Entry& entry)
+		{
+			if (m_Size < LocalSize)
+				m_Local[m_Size] = entry;
+			else
+				m_Overflow.push_back(entry);
+			m_Size++;
+		}
+
+		bool Pop(Entry& entry)
+		{
+			if (m_Size == 0)
+				return false;
+
+			m_Size--;
+			if (m_Size < LocalSize)
+			{
+				entry = m_Local[m_Size];
+			}
+			else
+			{
+				entry = m_Overflow.back();
+				m_Overflow.pop_back();
+			}
+			return true;
+		}
+
+	private:
+		static constexpr uint32_t LocalSize = 64;
+
+		Entry m_Local[LocalSize];
+		std::vector<Entry> m_Overflow;
+		uint32_t m_Size = 0;
+	};
+
+	struct RayEntry
+	{
+		uint32_t node;
+		float distance;
+	};
+}
+
+void Bvh::Build(const Bounds* items, uint32_t numItems)
+{
+	m_ItemBounds.assign(items, items + numItems);
+	m_LeafItems.resize(numItems);
+	std::iota(m_LeafItems.begin(), m_LeafItems.end(), 0);
+	m_ItemLeaves.assign(numItems, InvalidIndex);
+	m_Centroids.resize(numItems);
+	for (uint32_t i = 0; i < numItems; i++)
+	{
+		m_Centroids[i] = (items[i].minimum + items[i].maximum) * 0.5f;
+	}
+
+	// a binary tree with up to MaxLeafItems per leaf has fewer nodes than items
+	m_Nodes.clear();
+	m_Nodes.reserve(std::max(numItems, 1u));
+	const uint32_t root = AddNode(InvalidIndex);
+	if (numItems <= MaxLeafItems)
+	{
+		BuildChild(root, 0, 0, numItems, 1);
+	}
+	else
+	{
+		const uint32_t middle = Split(0, numItems, 0);
+		BuildChild(root, 0, 0, middle, 1);
+		BuildChild(root, 1, middle, numItems - middle, 1);
+	}
+
+	m_Centroids.clear();
+	m_Centroids.shrink_to_fit();
+}
+
+uint32_t Bvh::AddNode(uint32_t parent)
+{
+	Node node;
+	for (uint32_t child = 0; child < 2; child++)
+	{
+		SetChildBounds(node, child, EmptyBounds);
+		node.children[child] = InvalidIndex;
+		node.counts[child] = 0;
+	}
+	node.parent = parent;
+	m_Nodes.push_back(node);
+	return static_cast<uint32_t>(m_Nodes.size() - 1);
+}
+
+void Bvh::BuildChild(uint32_t node, uint32_t child, uint32_t first, uint32_t count, uint32_t depth)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	if (count <= MaxLeafItems)
+	{
+		m_Nodes[node].children[child] = first;
+		m_Nodes[node].counts[child] = count;
+		SetChildBounds(m_Nodes[node], child, GetLeafBounds(first, count));
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			m_ItemLeaves[m_LeafItems[i]] = node * 2 + child;
+		}
+		return;
+	}
+
+	// split before adding the node, the recursion below moves m_Nodes around
+	const uint32_t middle = Split(first, count, depth);
+	const uint32_t index = AddNode(node);
+	m_Nodes[node].children[child] = index;
+	BuildChild(index, 0, first, middle - first, depth + 1);
+	BuildChild(index, 1, middle, first + count - middle, depth + 1);
+	SetChildBounds(m_Nodes[node], child, GetNodeBounds(index));
+}
+
+uint32_t Bvh::Split(uint32_t first, uint32_t count, uint32_t depth)
+{
+	uint32_t* items = m_LeafItems.data() + first;
+
+	Bounds centroidBounds = { m_Centroids[items[0]], m_Centroids[items[0]] };
+	for (uint32_t i = 1; i < count; i++)
+	{
+		centroidBounds.minimum = glm::min(centroidBounds.minimum, m_Centroids[items[i]]);
+		centroidBounds.maximum = glm::max(centroidBounds.maximum, m_Centroids[items[i]]);
+	}
+	const glm::vec3 extent = centroidBounds.maximum - centroidBounds.minimum;
+
+	// The cost of a split is the area of either side times its items. Every axis is
+	// binned, the split planes are between the bins.
+	float bestCost = FLT_MAX;
+	uint32_t bestAxis = 0;
+	uint32_t bestBin = 0;
+	for (uint32_t axis = 0; axis < 3 && depth < MaxSahDepth; axis++)
+	{
+		if (!(extent[axis] > 0.0f))
+		{
+			continue;
+		}
+
+		Bounds binBounds[Bins];
+		uint32_t binCounts[Bins] = {};
+		std::fill(std::begin(binBounds), std::end(binBounds), EmptyBounds);
+		const float scale = Bins / extent[axis];
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const uint32_t bin = std::min((uint32_t)((m_Centroids[items[i]][axis] - centroidBounds.minimum[axis]) * scale), Bins - 1);
+			binBounds[bin] = Union(binBounds[bin], m_ItemBounds[items[i]]);
+			binCounts[bin]++;
+		}
+
+		// areas and counts left of every plane, then the right side walking back
+		float leftAreas[Bins - 1];
+		uint32_t leftCounts[Bins - 1];
+		Bounds side = EmptyBounds;
+		uint32_t sideCount = 0;
+		for (uint32_t i = 0; i < Bins - 1; i++)
+		{
+			side = Union(side, binBounds[i]);
+			sideCount += binCounts[i];
+			leftAreas[i] = Area(side);
+			leftCounts[i] = sideCount;
+		}
+
+		side = EmptyBounds;
+		sideCount = 0;
+		for (uint32_t i = Bins - 1; i > 0; i--)
+		{
+			side = Union(side, binBounds[i]);
+			sideCount += binCounts[i];
+			if (leftCounts[i - 1] == 0 || sideCount == 0)
+			{
+				continue;
+			}
+
+			const float cost = leftAreas[i - 1] * leftCounts[i - 1] + Area(side) * sideCount;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = i - 1;
+			}
+		}
+	}
+
+	if (bestCost == FLT_MAX)
+	{
+		// no plane separates the centroids, or the tree got too deep: halve along the longest axis
+		const uint32_t axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+		std::nth_element(items, items + count / 2, items + count, [this, axis](uint32_t a, uint32_t b)
+		{
+			return m_Centroids[a][axis] < m_Centroids[b][axis];
+		});
+		return first + count / 2;
+	}
+
+	const float scale = Bins / extent[bestAxis];
+	const float minimum = centroidBounds.minimum[bestAxis];
+	uint32_t* middle = std::partition(items, items + count, [&](uint32_t item)
+	{
+		return std::min((uint32_t)((m_Centroids[item][bestAxis] - minimum) * scale), Bins - 1) <= bestBin;
+	});
+	return first + (uint32_t)(middle - items);
+}
+
+Bvh::Bounds Bvh::GetChildBounds(const Node& node, uint32_t child) const
+{
+	return {
+		glm::vec3(node.bounds[0][child], node.bounds[1][child], node.bounds[2][child]),
+		glm::vec3(node.bounds[0][child + 2], node.bounds[1][child + 2], node.bounds[2][child + 2])
+	};
+}
+
+void Bvh::SetChildBounds(Node& node, uint32_t child, const Bounds& bounds)
+{
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		node.bounds[axis][child] = bounds.minimum[axis];
+		node.bounds[axis][child + 2] = bounds.maximum[axis];
+	}
+}
+
+Bvh::Bounds Bvh::GetLeafBounds(uint32_t first, uint32_t count) const
+{
+	Bounds bounds = EmptyBounds;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		bounds = Union(bounds, m_ItemBounds[m_LeafItems[i]]);
+	}
+	return bounds;
+}
+
+Bvh::Bounds Bvh::GetNodeBounds(uint32_t node) const
+{
+	return Union(GetChildBounds(m_Nodes[node], 0), GetChildBounds(m_Nodes[node], 1));
+}
+
+void Bvh::Refit(const uint32_t* items, const Bounds* bounds, uint32_t numItems)
+{
+	std::vector<uint32_t> refitted;
+	for (uint32_t i = 0; i < numItems; i++)
+	{
+		m_ItemBounds[items[i]] = bounds[i];
+	}
+
+	for (uint32_t i = 0; i < numItems; i++)
+	{
+		const uint32_t leaf = m_ItemLeaves[items[i]];
+		uint32_t node = leaf / 2;
+		const uint32_t child = leaf % 2;
+		SetChildBounds(m_Nodes[node], child, GetLeafBounds(m_Nodes[node].children[child], m_Nodes[node].counts[child]));
+
+		// up to where the boxes stay the same, the ones above it do as well
+		for (;;)
+		{
+			refitted.push_back(node);
+			const uint32_t parent = m_Nodes[node].parent;
+			if (parent == InvalidIndex)
+			{
+				break;
+			}
+
+			Node& parentNode = m_Nodes[parent];
+			const uint32_t slot = parentNode.counts[0] == 0 && parentNode.children[0] == node ? 0 : 1;
+			const Bounds before = GetChildBounds(parentNode, slot);
+			const Bounds after = GetNodeBounds(node);
+			SetChildBounds(parentNode, slot, after);
+			if (memcmp(&before, &after, sizeof(Bounds)) == 0)
+			{
+				break;
+			}
+			node = parent;
+		}
+	}
+
+	// a rotation keeps the node's own box, nothing above it changes
+	std::sort(refitted.begin(), refitted.end());
+	refitted.erase(std::unique(refitted.begin(), refitted.end()), refitted.end());
+	for (uint32_t node : refitted)
+	{
+		Rotate(node);
+	}
+}
+
+void Bvh::AttachChild(uint32_t node, uint32_t child)
+{
+	const Node& attached = m_Nodes[node];
+	if (attached.counts[child] > 0)
+	{
+		const uint32_t first = attached.children[child];
+		for (uint32_t i = first; i < first + attached.counts[child]; i++)
+		{
+			m_ItemLeaves[m_LeafItems[i]] = node * 2 + child;
+		}
+	}
+	else if (attached.children[child] != InvalidIndex)
+	{
+		m_Nodes[attached.children[child]].parent = node;
+	}
+}
+
+void Bvh::Rotate(uint32_t node)
+{
+	// Swapping a child with one of its sibling's children changes only the sibling's
+	// box, the swap that shrinks it the most is taken.
+	float bestGain = 0.0f;
+	uint32_t bestChild = 0;
+	uint32_t bestGrandchild = 0;
+	const Node& rotated = m_Nodes[node];
+	for (uint32_t child = 0; child < 2; child++)
+	{
+		const uint32_t sibling = 1 - child;
+		if (rotated.counts[sibling] > 0 || rotated.children[sibling] == InvalidIndex ||
+			(rotated.counts[child] == 0 && rotated.children[child] == InvalidIndex))
+		{
+			continue;
+		}
+
+		const Node& siblingNode = m_Nodes[rotated.children[sibling]];
+		const float siblingArea = Area(GetChildBounds(rotated, sibling));
+		const Bounds childBounds = GetChildBounds(rotated, child);
+		for (uint32_t grandchild = 0; grandchild < 2; grandchild++)
+		{
+			const float gain = siblingArea - Area(Union(childBounds, GetChildBounds(siblingNode, 1 - grandchild)));
+			if (gain > bestGain)
+			{
+				bestGain = gain;
+				bestChild = child;
+				bestGrandchild = grandchild;
+			}
+		}
+	}
+
+	if (bestGain <= 0.0f)
+	{
+		return;
+	}
+
+	const uint32_t sibling = 1 - bestChild;
+	const uint32_t siblingIndex = m_Nodes[node].children[sibling];
+	Node& parentNode = m_Nodes[node];
+	Node& siblingNode = m_Nodes[siblingIndex];
+
+	const Bounds childBounds = GetChildBounds(parentNode, bestChild);
+	SetChildBounds(parentNode, bestChild, GetChildBounds(siblingNode, bestGrandchild));
+	SetChildBounds(siblingNode, bestGrandchild, childBounds);
+	std::swap(parentNode.children[bestChild], siblingNode.children[bestGrandchild]);
+	std::swap(parentNode.counts[bestChild], siblingNode.counts[bestGrandchild]);
+	SetChildBounds(parentNode, sibling, GetNodeBounds(siblingIndex));
+
+	AttachChild(node, bestChild);
+	AttachChild(siblingIndex, bestGrandchild);
+}
+
+bool Bvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float& maxDistance, const RayFunction& hit) const
+{
+	if (m_Nodes.empty())
+	{
+		return false;
+	}
+
+	// Per axis the distances to both children's slabs, { near0, near1, far0, far1 }
+	// once the halves are swapped for a negative direction. A zero direction gets a
+	// tiny one so nothing turns into a NaN.
+	__m128 origins[3];
+	__m128 inverses[3];
+	bool negative[3];
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		const float component = std::abs(direction[axis]) > 1e-20f ? direction[axis] : std::copysign(1e-20f, direction[axis]);
+		origins[axis] = _mm_set1_ps(origin[axis]);
+		inverses[axis] = _mm_set1_ps(1.0f / component);
+		negative[axis] = component < 0.0f;
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	bool found = false;
+	TraversalStack<RayEntry> stack;
+	uint32_t node = 0;
+	for (;;)
+	{
+		const Node& current = m_Nodes[node];
+		__m128 nearDistances = zero;
+		__m128 farDistances = _mm_set1_ps(FLT_MAX);
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			__m128 distances = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(current.bounds[axis]), origins[axis]), inverses[axis]);
+			if (negative[axis])
+				distances = _mm_shuffle_ps(distances, distances, _MM_SHUFFLE(1, 0, 3, 2));
+			nearDistances = _mm_max_ps(nearDistances, distances);
+			farDistances = _mm_min_ps(farDistances, distances);
+		}
+		farDistances = _mm_movehl_ps(farDistances, farDistances);
+		const __m128 entered = _mm_and_ps(_mm_cmple_ps(nearDistances, farDistances), _mm_cmplt_ps(nearDistances, _mm_set1_ps(maxDistance)));
+		const int mask = _mm_movemask_ps(entered) & 3;
+
+		float nears[4];
+		_mm_storeu_ps(nears, nearDistances);
+		const uint32_t firstChild = mask == 3 && nears[1] < nears[0] ? 1 : 0;
+
+		// leaves right away, nearest first; the nodes are visited after them
+		uint32_t nextNodes[2];
+		float nextDistances[2];
+		uint32_t numNext = 0;
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			const uint32_t child = firstChild ^ i;
+			if (!(mask & (1 << child)) || nears[child] >= maxDistance)
+			{
+				continue;
+			}
+
+			if (current.counts[child] == 0)
+			{
+				nextNodes[numNext] = current.children[child];
+				nextDistances[numNext] = nears[child];
+				numNext++;
+				continue;
+			}
+
+			const uint32_t first = current.children[child];
+			for (uint32_t item = first; item < first + current.counts[child]; item++)
+			{
+				const float distance = hit(m_LeafItems[item], maxDistance);
+				if (distance < maxDistance)
+				{
+					maxDistance = distance;
+					found = true;
+				}
+			}
+		}
+
+		if (numNext == 2)
+		{
+			stack.Push({ nextNodes[1], nextDistances[1] });
+		}
+		if (numNext > 0 && nextDistances[0] < maxDistance)
+		{
+			node = nextNodes[0];
+			continue;
+		}
+
+		RayEntry entry;
+		bool popped = false;
+		while (stack.Pop(entry))
+		{
+			if (entry.distance < maxDistance)
+			{
+				popped = true;
+				break;
+			}
+		}
+		if (!popped)
+		{
+			return found;
+		}
+		node = entry.node;
+	}
+}
+
+void Bvh::QueryBox(const Bounds& box, std::vector<uint32_t>& items) const
+{
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	// child minimum <= query maximum and child maximum >= query minimum in one
+	// comparison, with the maxima's side negated
+	const __m128 sign = _mm_setr_ps(1.0f, 1.0f, -1.0f, -1.0f);
+	__m128 limits[3];
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		limits[axis] = _mm_setr_ps(box.maximum[axis], box.maximum[axis], -box.minimum[axis], -box.minimum[axis]);
+	}
+
+	TraversalStack<uint32_t> stack;
+	uint32_t node = 0;
+	do
+	{
+		const Node& current = m_Nodes[node];
+		__m128 overlap = _mm_cmple_ps(_mm_mul_ps(_mm_loadu_ps(current.bounds[0]), sign), limits[0]);
+		overlap = _mm_and_ps(overlap, _mm_cmple_ps(_mm_mul_ps(_mm_loadu_ps(current.bounds[1]), sign), limits[1]));
+		overlap = _mm_and_ps(overlap, _mm_cmple_ps(_mm_mul_ps(_mm_loadu_ps(current.bounds[2]), sign), limits[2]));
+		const int mask = _mm_movemask_ps(overlap);
+
+		for (uint32_t child = 0; child < 2; child++)
+		{
+			if ((mask & (5 << child)) != (5 << child))
+			{
+				continue;
+			}
+
+			if (current.counts[child] == 0)
+			{
+				stack.Push(current.children[child]);
+				continue;
+			}
+
+			const uint32_t first = current.children[child];
+			for (uint32_t i = first; i < first + current.counts[child]; i++)
+			{
+				if (Overlaps(m_ItemBounds[m_LeafItems[i]], box))
+				{
+					items.push_back(m_LeafItems[i]);
+				}
+			}
+		}
+	} while (stack.Pop(node));
+}
+
+void Bvh::QueryFrustum(const glm::vec4 planes[6], std::vector<uint32_t>& items) const
+{
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	__m128 normals[6][3];
+	__m128 distances[6];
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			normals[i][axis] = _mm_set1_ps(planes[i][axis]);
+		}
+		distances[i] = _mm_set1_ps(planes[i].w);
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	TraversalStack<uint32_t> stack;
+	uint32_t node = 0;
+	do
+	{
+		// Per plane both children's corner furthest along the normal and the one
+		// furthest against it, in the low lanes: behind with the first outside, in
+		// front with the second entirely inside.
+		const Node& current = m_Nodes[node];
+		__m128 minimums[3];
+		__m128 maximums[3];
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			minimums[axis] = _mm_loadu_ps(current.bounds[axis]);
+			maximums[axis] = _mm_movehl_ps(minimums[axis], minimums[axis]);
+		}
+
+		__m128 outside = _mm_setzero_ps();
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+		for (uint32_t i = 0; i < 6; i++)
+		{
+			__m128 outer = distances[i];
+			__m128 inner = distances[i];
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				const bool positive = planes[i][axis] >= 0.0f;
+				outer = _mm_add_ps(outer, _mm_mul_ps(normals[i][axis], positive ? maximums[axis] : minimums[axis]));
+				inner = _mm_add_ps(inner, _mm_mul_ps(normals[i][axis], positive ? minimums[axis] : maximums[axis]));
+			}
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(outer, zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(inner, zero));
+		}
+		const int outsideMask = _mm_movemask_ps(outside);
+		const int insideMask = _mm_movemask_ps(inside);
+
+		for (uint32_t child = 0; child < 2; child++)
+		{
+			const uint32_t count = current.counts[child];
+			if ((outsideMask & (1 << child)) || (count == 0 && current.children[child] == InvalidIndex))
+			{
+				continue;
+			}
+
+			if (insideMask & (1 << child))
+			{
+				AppendSubtree(node, child, items);
+			}
+			else if (count == 0)
+			{
+				stack.Push(current.children[child]);
+			}
+			else
+			{
+				const uint32_t first = current.children[child];
+				for (uint32_t i = first; i < first + count; i++)
+				{
+					if (!OutsideFrustum(m_ItemBounds[m_LeafItems[i]], planes))
+					{
+						items.push_back(m_LeafItems[i]);
+					}
+				}
+			}
+		}
+	} while (stack.Pop(node));
+}
+
+void Bvh::AppendSubtree(uint32_t node, uint32_t child, std::vector<uint32_t>& items) const
+{
+	const Node& current = m_Nodes[node];
+	if (current.counts[child] > 0)
+	{
+		const uint32_t first = current.children[child];
+		items.insert(items.end(), m_LeafItems.begin() + first, m_LeafItems.begin() + first + current.counts[child]);
+	}
+	else if (current.children[child] != InvalidIndex)
+	{
+		AppendSubtree(current.children[child], 0, items);
+		AppendSubtree(current.children[child], 1, items);
+	}
+}
+
+bool Bvh::IntersectRay(const Bounds& box, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance)
+{
+	float nearDistance = 0.0f;
+	float farDistance = maxDistance;
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		const float component = std::abs(direction[axis]) > 1e-20f ? direction[axis] : std::copysign(1e-20f, direction[axis]);
+		float a = (box.minimum[axis] - origin[axis]) / component;
+		float b = (box.maximum[axis] - origin[axis]) / component;
+		if (a > b)
+			std::swap(a, b);
+		nearDistance = std::max(nearDistance, a);
+		farDistance = std::min(farDistance, b);
+	}
+	distance = nearDistance;
+	return nearDistance <= farDistance && nearDistance < maxDistance;
+}
+
+Bvh::Bounds Bvh::Transform(const Bounds& box, const glm::mat4& transform)
+{
+	// the corners spread from the center along every column, by their absolute values
+	const glm::vec3 center = (box.minimum + box.maximum) * 0.5f;
+	const glm::vec3 extent = (box.maximum - box.minimum) * 0.5f;
+	const glm::vec3 worldCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtent(0.0f);
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		const glm::vec3 column = glm::vec3(transform[axis]);
+		worldExtent += glm::vec3(std::abs(column.x), std::abs(column.y), std::abs(column.z)) * extent[axis];
+	}
+	return { worldCenter - worldExtent, worldCenter + worldExtent };
+}
+
+float Bvh::GetCost() const
+{
+	if (m_Nodes.empty())
+	{
+		return 0.0f;
+	}
+
+	const float rootArea = Area(GetNodeBounds(0));
+	if (!(rootArea > 0.0f))
+	{
+		return 0.0f;
+	}
+
+	float cost = 0.0f;
+	for (uint32_t node = 0; node < m_Nodes.size(); node++)
+	{
+		cost += Area(GetNodeBounds(node));
+		for (uint32_t child = 0; child < 2; child++)
+		{
+			cost += Area(GetChildBounds(m_Nodes[node], child)) * m_Nodes[node].counts[child];
+		}
+	}
+	return cost / rootArea;
+}
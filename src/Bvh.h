@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "VkStructs.h"
+
+// Bounding volume hierarchy over axis-aligned boxes, built with the surface area
+// heuristic over binned centroids (Wald: On fast Construction of SAH-based Bounding
+// Volume Hierarchies). A node holds the boxes of its two children with an axis of
+// both in one SSE register, so a query tests both children at once and only visits
+// the nodes whose box it touches.
+//
+// Moving items are refitted: their leaf's box and the ones above it grow or shrink
+// in place, and the refitted nodes try the tree rotations of Kopta et al. (Fast,
+// Effective BVH Updates for Animated Scenes) to win back what refitting loses of
+// the SAH cost. Items that move far for long still want a Build() now and then.
+class Bvh
+{
+public:
+	struct Bounds
+	{
+		glm::vec3 minimum;
+		glm::vec3 maximum;
+	};
+
+	// Called for the items of the leaves the ray enters, roughly nearest first. Returns
+	// the distance the ray hits the item at, or maxDistance when it misses it; zero
+	// ends the query, which is all a line of sight test needs.
+	using RayFunction = std::function<float(uint32_t item, float maxDistance)>;
+
+	static constexpr uint32_t MaxLeafItems = 4;
+	static constexpr uint32_t InvalidIndex = UINT32_MAX;
+
+public:
+	// Items are numbered as in the array, every query reports them by that index.
+	void Build(const Bounds* items, uint32_t numItems);
+	// Sets the boxes of the items that moved and refits the tree around them.
+	void Refit(const uint32_t* items, const Bounds* bounds, uint32_t numItems);
+
+	// Distances are in units of direction's length. Returns false when nothing was hit
+	// before maxDistance, which holds the nearest hit's distance otherwise.
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float& maxDistance, const RayFunction& hit) const;
+	// Appends the items whose box overlaps the query box.
+	void QueryBox(const Bounds& box, std::vector<uint32_t>& items) const;
+	// Appends the items whose box isn't behind one of the planes, see FrustumCuller::ExtractPlanes.
+	void QueryFrustum(const glm::vec4 planes[6], std::vector<uint32_t>& items) const;
+
+	// Where the ray enters the box within [0, maxDistance], false when it misses it.
+	static bool IntersectRay(const Bounds& box, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance);
+	// encloses the box transformed by the matrix
+	static Bounds Transform(const Bounds& box, const glm::mat4& transform);
+
+	uint32_t GetItemCount() const { return static_cast<uint32_t>(m_ItemBounds.size()); }
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_Nodes.size()); }
+	const Bounds& GetItemBounds(uint32_t item) const { return m_ItemBounds[item]; }
+	// SAH cost relative to the root's area, one per node visited and per item tested
+	float GetCost() const;
+
+private:
+	struct Node
+	{
+		// per axis the children's minimum then their maximum, { min0, min1, max0, max1 }
+		float bounds[3][4];
+		// a node when counts[i] is zero, otherwise the first of the leaf's items in
+		// m_LeafItems; InvalidIndex with a zero count for a missing child
+		uint32_t children[2];
+		uint32_t counts[2];
+		uint32_t parent;
+	};
+
+	uint32_t AddNode(uint32_t parent);
+	void BuildChild(uint32_t node, uint32_t child, uint32_t first, uint32_t count, uint32_t depth);
+	uint32_t Split(uint32_t first, uint32_t count, uint32_t depth);
+	Bounds GetChildBounds(const Node& node, uint32_t child) const;
+	void SetChildBounds(Node& node, uint32_t child, const Bounds& bounds);
+	Bounds GetLeafBounds(uint32_t first, uint32_t count) const;
+	Bounds GetNodeBounds(uint32_t node) const;
+	// points what hangs off the child at the node, after moving it there
+	void AttachChild(uint32_t node, uint32_t child);
+	void Rotate(uint32_t node);
+	void AppendSubtree(uint32_t node, uint32_t child, std::vector<uint32_t>& items) const;
+
+private:
+	std::vector<Node> m_Nodes;
+	std::vector<Bounds> m_ItemBounds;
+	// leaves' items, every leaf a run of them
+	std::vector<uint32_t> m_LeafItems;
+	// per item the node and child (node * 2 + child) of its leaf
+	std::vector<uint32_t> m_ItemLeaves;
+	// of the items' boxes, while building
+	std::vector<glm::vec3> m_Centroids;
+};
@@ -0,0 +1,502 @@
+#include "BvhBenchmark.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <filesystem>
+#include <vector>
+
+#include "Bvh.h"
+#include "FrustumCuller.h"
+#include "ImportedScene.h"
+#include "JobSystem.h"
+#include "Logger.h"
+#include "ObjImporter.h"
+#include "SceneHierarchy.h"
+#include "Timer.h"
+#include "TriangleBvh.h"
+
+namespace
+{
+	constexpr uint32_t Rays = 100000;
+	constexpr uint32_t BoxQueries = 10000;
+	constexpr uint32_t FrustumQueries = 1000;
+	// the scans are slow, they run on the first queries only
+	constexpr uint32_t ScannedQueries = 200;
+	constexpr uint32_t GeneratedInstances = 200000;
+	// of the instances, moved before the refit
+	constexpr uint32_t MovedPerMille = 10;
+
+	const char* const s_SponzaPath = "./Models/Sponza/sponza.obj";
+
+	class Random
+	{
+	public:
+		float Next()
+		{
+			m_State = m_State * 1664525u + 1013904223u;
+			return (m_State >> 8) / 16777216.0f;
+		}
+
+		glm::vec3 NextPoint(const Bvh::Bounds& bounds)
+		{
+			const glm::vec3 t(Next(), Next(), Next());
+			return bounds.minimum + (bounds.maximum - bounds.minimum) * t;
+		}
+
+		glm::vec3 NextDirection()
+		{
+			for (;;)
+			{
+				const glm::vec3 direction(Next() * 2.0f - 1.0f, Next() * 2.0f - 1.0f, Next() * 2.0f - 1.0f);
+				const float length = glm::length(direction);
+				if (length > 0.01f && length <= 1.0f)
+				{
+					return direction / length;
+				}
+			}
+		}
+
+	private:
+		uint32_t m_State = 0x2545F491u;
+	};
+
+	struct Frustum
+	{
+		glm::vec4 planes[6];
+	};
+
+	struct Timings
+	{
+		float bvhSeconds = 0.0f;
+		float scanSeconds = 0.0f;
+		bool matches = true;
+	};
+
+	template<typename Function>
+	float Measure(Function function)
+	{
+		Timer timer;
+		timer.Reset();
+		function();
+		timer.Tick();
+		return timer.GetDeltaTime();
+	}
+
+	Bvh::Bounds GetSceneBounds(const std::vector<Bvh::Bounds>& bounds)
+	{
+		Bvh::Bounds scene = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+		for (const Bvh::Bounds& box : bounds)
+		{
+			scene.minimum = glm::min(scene.minimum, box.minimum);
+			scene.maximum = glm::max(scene.maximum, box.maximum);
+		}
+		return scene;
+	}
+
+	bool OutsideFrustum(const Bvh::Bounds& bounds, const glm::vec4 planes[6])
+	{
+		for (uint32_t i = 0; i < 6; i++)
+		{
+			const glm::vec3 corner(
+				planes[i].x >= 0.0f ? bounds.maximum.x : bounds.minimum.x,
+				planes[i].y >= 0.0f ? bounds.maximum.y : bounds.minimum.y,
+				planes[i].z >= 0.0f ? bounds.maximum.z : bounds.minimum.z);
+			if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// the instances' world boxes in node order, like Scene lays them out
+	void GetInstanceBounds(const ImportedScene& imported, std::vector<Bvh::Bounds>& bounds, std::vector<glm::mat4>& transforms,
+		std::vector<uint32_t>& meshes)
+	{
+		SceneHierarchy hierarchy;
+		hierarchy.Build(imported);
+		hierarchy.UpdateWorldTransforms();
+
+		for (uint32_t node = 0; node < hierarchy.GetNodeCount(); node++)
+		{
+			const SceneHierarchy::MeshRange& range = hierarchy.GetMeshRange(node);
+			for (uint32_t i = range.firstMesh; i < range.firstMesh + range.numMeshes; i++)
+			{
+				const uint32_t mesh = hierarchy.GetNodeMeshes()[i];
+				const MeshBounds& meshBounds = imported.meshes[mesh].bounds;
+				bounds.push_back(Bvh::Transform({ meshBounds.minimum, meshBounds.maximum }, hierarchy.GetWorldTransform(node)));
+				transforms.push_back(hierarchy.GetWorldTransform(node));
+				meshes.push_back(mesh);
+			}
+		}
+	}
+
+	// Boxes of every size from a hundredth to a tenth of the scene's, a city's worth of clutter.
+	void GenerateInstanceBounds(uint32_t count, std::vector<Bvh::Bounds>& bounds)
+	{
+		Random random;
+		const float sceneSize = 1000.0f;
+		const Bvh::Bounds scene = { glm::vec3(0.0f), glm::vec3(sceneSize) };
+		bounds.resize(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const glm::vec3 center = random.NextPoint(scene);
+			const glm::vec3 extent = glm::vec3(random.Next(), random.Next(), random.Next()) * sceneSize * 0.001f *
+				std::pow(10.0f, random.Next() * 2.0f);
+			bounds[i] = { center - extent, center + extent };
+		}
+	}
+
+	void GenerateFrusta(const Bvh::Bounds& scene, uint32_t count, std::vector<Frustum>& frusta)
+	{
+		Random random;
+		const float farPlane = glm::length(scene.maximum - scene.minimum);
+		const glm::mat4 projection = glm::perspectiveFovLH(45.0f, 16.0f, 9.0f, farPlane * 0.0001f, farPlane);
+		frusta.resize(count);
+		for (Frustum& frustum : frusta)
+		{
+			const glm::vec3 position = random.NextPoint(scene);
+			const glm::vec3 direction = random.NextDirection();
+			const glm::vec3 up = std::abs(direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+			FrustumCuller::ExtractPlanes(projection * glm::lookAtLH(position, position + direction, up), frustum.planes);
+		}
+	}
+
+	Timings TimeRays(const Bvh& bvh, const std::vector<Bvh::Bounds>& bounds)
+	{
+		const Bvh::Bounds scene = GetSceneBounds(bounds);
+		const float maxDistance = glm::length(scene.maximum - scene.minimum);
+		std::vector<glm::vec3> origins(Rays);
+		std::vector<glm::vec3> directions(Rays);
+		Random random;
+		for (uint32_t i = 0; i < Rays; i++)
+		{
+			origins[i] = random.NextPoint(scene);
+			directions[i] = random.NextDirection();
+		}
+
+		std::vector<float> bvhDistances(Rays, maxDistance);
+		Timings timings;
+		timings.bvhSeconds = Measure([&]()
+		{
+			for (uint32_t i = 0; i < Rays; i++)
+			{
+				bvh.Raycast(origins[i], directions[i], bvhDistances[i], [&](uint32_t item, float distance)
+				{
+					float hitDistance = distance;
+					return Bvh::IntersectRay(bvh.GetItemBounds(item), origins[i], directions[i], distance, hitDistance) ? hitDistance : distance;
+				});
+			}
+		}) / Rays;
+
+		std::vector<float> scanDistances(ScannedQueries, maxDistance);
+		timings.scanSeconds = Measure([&]()
+		{
+			for (uint32_t i = 0; i < ScannedQueries; i++)
+			{
+				for (const Bvh::Bounds& box : bounds)
+				{
+					float distance;
+					if (Bvh::IntersectRay(box, origins[i], directions[i], scanDistances[i], distance))
+					{
+						scanDistances[i] = distance;
+					}
+				}
+			}
+		}) / ScannedQueries;
+
+		for (uint32_t i = 0; i < ScannedQueries; i++)
+		{
+			timings.matches = timings.matches && bvhDistances[i] == scanDistances[i];
+		}
+		return timings;
+	}
+
+	Timings TimeBoxes(const Bvh& bvh, const std::vector<Bvh::Bounds>& bounds)
+	{
+		const Bvh::Bounds scene = GetSceneBounds(bounds);
+		std::vector<Bvh::Bounds> queries(BoxQueries);
+		Random random;
+		for (Bvh::Bounds& query : queries)
+		{
+			// a twentieth of the scene across, about a room
+			const glm::vec3 center = random.NextPoint(scene);
+			const glm::vec3 extent = (scene.maximum - scene.minimum) * 0.025f;
+			query = { center - extent, center + extent };
+		}
+
+		std::vector<std::vector<uint32_t>> bvhItems(BoxQueries);
+		Timings timings;
+		timings.bvhSeconds = Measure([&]()
+		{
+			for (uint32_t i = 0; i < BoxQueries; i++)
+			{
+				bvh.QueryBox(queries[i], bvhItems[i]);
+			}
+		}) / BoxQueries;
+
+		std::vector<std::vector<uint32_t>> scanItems(ScannedQueries);
+		timings.scanSeconds = Measure([&]()
+		{
+			for (uint32_t i = 0; i < ScannedQueries; i++)
+			{
+				for (uint32_t item = 0; item < bounds.size(); item++)
+				{
+					const Bvh::Bounds& box = bounds[item];
+					if (box.minimum.x <= queries[i].maximum.x && box.minimum.y <= queries[i].maximum.y && box.minimum.z <= queries[i].maximum.z &&
+						box.maximum.x >= queries[i].minimum.x && box.maximum.y >= queries[i].minimum.y && box.maximum.z >= queries[i].minimum.z)
+					{
+						scanItems[i].push_back(item);
+					}
+				}
+			}
+		}) / ScannedQueries;
+
+		for (uint32_t i = 0; i < ScannedQueries; i++)
+		{
+			std::sort(bvhItems[i].begin(), bvhItems[i].end());
+			timings.matches = timings.matches && bvhItems[i] == scanItems[i];
+		}
+		return timings;
+	}
+
+	Timings TimeFrusta(const Bvh& bvh, const std::vector<Bvh::Bounds>& bounds)
+	{
+		std::vector<Frustum> frusta;
+		GenerateFrusta(GetSceneBounds(bounds), FrustumQueries, frusta);
+
+		std::vector<std::vector<uint32_t>> bvhItems(FrustumQueries);
+		Timings timings;
+		timings.bvhSeconds = Measure([&]()
+		{
+			for (uint32_t i = 0; i < FrustumQueries; i++)
+			{
+				bvh.QueryFrustum(frusta[i].planes, bvhItems[i]);
+			}
+		}) / FrustumQueries;
+
+		const uint32_t scanned = std::min(ScannedQueries, FrustumQueries);
+		std::vector<std::vector<uint32_t>> scanItems(scanned);
+		timings.scanSeconds = Measure([&]()
+		{
+			for (uint32_t i = 0; i < scanned; i++)
+			{
+				for (uint32_t item = 0; item < bounds.size(); item++)
+				{
+					if (!OutsideFrustum(bounds[item], frusta[i].planes))
+					{
+						scanItems[i].push_back(item);
+					}
+				}
+			}
+		}) / scanned;
+
+		for (uint32_t i = 0; i < scanned; i++)
+		{
+			std::sort(bvhItems[i].begin(), bvhItems[i].end());
+			timings.matches = timings.matches && bvhItems[i] == scanItems[i];
+		}
+		return timings;
+	}
+
+	void Report(const char* name, const Timings& timings)
+	{
+		Logger::Info("  %-7s bvh %9.2f us  scan %9.2f us  speedup %7.1fx%s\n", name,
+			timings.bvhSeconds * 1e6f, timings.scanSeconds * 1e6f,
+			timings.bvhSeconds > 0.0f ? timings.scanSeconds / timings.bvhSeconds : 0.0f,
+			timings.matches ? "" : "  (results differ)");
+	}
+
+	void RunInstanceQueries(const char* name, std::vector<Bvh::Bounds>& bounds)
+	{
+		Bvh bvh;
+		const float buildSeconds = Measure([&]() { bvh.Build(bounds.data(), (uint32_t)bounds.size()); });
+		Logger::Info("%s: %zu instances, build %.2f ms, %u nodes, SAH cost %.1f\n", name, bounds.size(),
+			buildSeconds * 1000.0f, bvh.GetNodeCount(), bvh.GetCost());
+
+		Report("rays", TimeRays(bvh, bounds));
+		Report("boxes", TimeBoxes(bvh, bounds));
+		Report("frusta", TimeFrusta(bvh, bounds));
+
+		// Moved by up to a hundredth of the scene, then refitted against built anew.
+		const Bvh::Bounds scene = GetSceneBounds(bounds);
+		const glm::vec3 step = (scene.maximum - scene.minimum) * 0.01f;
+		std::vector<uint32_t> moved(std::max((uint32_t)bounds.size() / 1000 * MovedPerMille, 1u));
+		std::vector<Bvh::Bounds> movedBounds(moved.size());
+		Random random;
+		for (uint32_t i = 0; i < moved.size(); i++)
+		{
+			moved[i] = std::min((uint32_t)(random.Next() * bounds.size()), (uint32_t)bounds.size() - 1);
+			const glm::vec3 offset = (glm::vec3(random.Next(), random.Next(), random.Next()) * 2.0f - 1.0f) * step;
+			movedBounds[i] = { bounds[moved[i]].minimum + offset, bounds[moved[i]].maximum + offset };
+			bounds[moved[i]] = movedBounds[i];
+		}
+
+		const float refitSeconds = Measure([&]() { bvh.Refit(moved.data(), movedBounds.data(), (uint32_t)moved.size()); });
+		const float refitCost = bvh.GetCost();
+		const Timings refitRays = TimeRays(bvh, bounds);
+		const float rebuildSeconds = Measure([&]() { bvh.Build(bounds.data(), (uint32_t)bounds.size()); });
+		Logger::Info("  refit %zu moved %.3f ms, SAH cost %.1f, rays %.2f us%s; rebuild %.2f ms, SAH cost %.1f\n", moved.size(),
+			refitSeconds * 1000.0f, refitCost, refitRays.bvhSeconds * 1e6f, refitRays.matches ? "" : " (results differ)",
+			rebuildSeconds * 1000.0f, bvh.GetCost());
+	}
+
+	// Rays against Sponza's triangles, through the instance BVH into every mesh's
+	// triangle BVH in object space, like Scene::Raycast, against scanning them all.
+	void RunTriangleQueries(const ImportedScene& imported, const std::vector<Bvh::Bounds>& bounds,
+		const std::vector<glm::mat4>& transforms, const std::vector<uint32_t>& meshes)
+	{
+		std::vector<TriangleBvh> triangleBvhs(imported.meshes.size());
+		uint32_t numTriangles = 0;
+		const float buildSeconds = Measure([&]()
+		{
+			JobSystem::Get()->ParallelFor((uint32_t)imported.meshes.size(), 1, [&](uint32_t begin, uint32_t end, uint32_t)
+			{
+				for (uint32_t i = begin; i < end; i++)
+				{
+					const ImportedMesh& mesh = imported.meshes[i];
+					triangleBvhs[i].Build(mesh.vertices, mesh.indices, mesh.numIndices,
+						imported.indexRanges.data() + mesh.firstIndexRange, mesh.numIndexRanges / std::max(mesh.numLods, 1u));
+				}
+			});
+		});
+		for (const TriangleBvh& triangleBvh : triangleBvhs)
+		{
+			numTriangles += triangleBvh.GetTriangleCount();
+		}
+		Logger::Info("  triangle BVHs of %u triangles built in %.2f ms on %u workers\n", numTriangles,
+			buildSeconds * 1000.0f, JobSystem::Get()->GetWorkerCount());
+
+		Bvh bvh;
+		bvh.Build(bounds.data(), (uint32_t)bounds.size());
+		const Bvh::Bounds scene = GetSceneBounds(bounds);
+		const float maxDistance = glm::length(scene.maximum - scene.minimum);
+		std::vector<glm::mat4> inverses(transforms.size());
+		for (uint32_t i = 0; i < transforms.size(); i++)
+		{
+			inverses[i] = glm::inverse(transforms[i]);
+		}
+
+		std::vector<glm::vec3> origins(Rays);
+		std::vector<glm::vec3> directions(Rays);
+		Random random;
+		for (uint32_t i = 0; i < Rays; i++)
+		{
+			origins[i] = random.NextPoint(scene);
+			directions[i] = random.NextDirection();
+		}
+
+		auto castRay = [&](uint32_t ray, uint32_t instance, float distance)
+		{
+			float boxDistance;
+			if (!Bvh::IntersectRay(bounds[instance], origins[ray], directions[ray], distance, boxDistance))
+			{
+				return distance;
+			}
+			const glm::vec3 origin = glm::vec3(inverses[instance] * glm::vec4(origins[ray], 1.0f));
+			const glm::vec3 direction = glm::vec3(inverses[instance] * glm::vec4(directions[ray], 0.0f));
+			uint32_t triangle;
+			triangleBvhs[meshes[instance]].Raycast(origin, direction, distance, triangle);
+			return distance;
+		};
+
+		Timings timings;
+		std::vector<float> bvhDistances(Rays, maxDistance);
+		timings.bvhSeconds = Measure([&]()
+		{
+			for (uint32_t i = 0; i < Rays; i++)
+			{
+				bvh.Raycast(origins[i], directions[i], bvhDistances[i], [&](uint32_t instance, float distance)
+				{
+					return castRay(i, instance, distance);
+				});
+			}
+		}) / Rays;
+
+		// every triangle of every instance, in world space
+		const uint32_t scanned = ScannedQueries / 10;
+		std::vector<float> scanDistances(scanned, maxDistance);
+		timings.scanSeconds = Measure([&]()
+		{
+			for (uint32_t i = 0; i < scanned; i++)
+			{
+				for (uint32_t instance = 0; instance < meshes.size(); instance++)
+				{
+					const ImportedMesh& mesh = imported.meshes[meshes[instance]];
+					const IndexRange wholeMesh = { 0, mesh.numIndices, 0 };
+					const uint32_t numRanges = mesh.numIndexRanges / std::max(mesh.numLods, 1u);
+					const IndexRange* ranges = numRanges > 0 ? imported.indexRanges.data() + mesh.firstIndexRange : &wholeMesh;
+					for (uint32_t r = 0; r < std::max(numRanges, 1u); r++)
+					{
+						for (uint32_t index = ranges[r].firstIndex; index + 2 < ranges[r].firstIndex + ranges[r].numIndices; index += 3)
+						{
+							glm::vec3 corners[3];
+							for (uint32_t corner = 0; corner < 3; corner++)
+							{
+								corners[corner] = glm::vec3(transforms[instance] *
+									glm::vec4(mesh.vertices[ranges[r].vertexOffset + mesh.indices[index + corner]].pos, 1.0f));
+							}
+
+							const glm::vec3 edge1 = corners[1] - corners[0];
+							const glm::vec3 edge2 = corners[2] - corners[0];
+							const glm::vec3 p = glm::cross(directions[i], edge2);
+							const float determinant = glm::dot(edge1, p);
+							if (std::abs(determinant) < 1e-12f)
+								continue;
+							const glm::vec3 t = origins[i] - corners[0];
+							const float u = glm::dot(t, p) / determinant;
+							const glm::vec3 q = glm::cross(t, edge1);
+							const float v = glm::dot(directions[i], q) / determinant;
+							const float distance = glm::dot(edge2, q) / determinant;
+							if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && distance >= 0.0f && distance < scanDistances[i])
+								scanDistances[i] = distance;
+						}
+					}
+				}
+			}
+		}) / scanned;
+
+		// the two transform the rays differently, the distances agree up to rounding
+		for (uint32_t i = 0; i < scanned; i++)
+		{
+			timings.matches = timings.matches && std::abs(bvhDistances[i] - scanDistances[i]) <= 1e-3f * std::max(1.0f, scanDistances[i]);
+		}
+		Report("hits", timings);
+	}
+}
+
+void BvhBenchmark::Run()
+{
+	// the OBJ importer splits its work over the job system, the engine isn't created in this mode
+	JobSystem jobSystem;
+
+	Logger::Info("BVH benchmark, %u rays, %u boxes, %u frusta, scans over the first %u\n",
+		Rays, BoxQueries, FrustumQueries, ScannedQueries);
+
+	if (std::filesystem::exists(s_SponzaPath))
+	{
+		ImportedScene imported;
+		if (ObjImporter::Import(s_SponzaPath, imported))
+		{
+			std::vector<Bvh::Bounds> bounds;
+			std::vector<glm::mat4> transforms;
+			std::vector<uint32_t> meshes;
+			GetInstanceBounds(imported, bounds, transforms, meshes);
+			RunTriangleQueries(imported, bounds, transforms, meshes);
+			RunInstanceQueries(s_SponzaPath, bounds);
+		}
+		else
+		{
+			Logger::Error("%s: import failed, skipped\n", s_SponzaPath);
+		}
+	}
+	else
+	{
+		Logger::Info("%s: not found, skipped\n", s_SponzaPath);
+	}
+
+	std::vector<Bvh::Bounds> bounds;
+	GenerateInstanceBounds(GeneratedInstances, bounds);
+	RunInstanceQueries("generated", bounds);
+}
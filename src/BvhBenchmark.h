@@ -0,0 +1,13 @@
+#pragma once
+
+// Times Bvh ray, box and frustum queries over mesh instance boxes against scanning
+// every box, on Sponza and on a generated scene of many instances, checks that both
+// find the same, and times refitting moved instances against a rebuild. On Sponza
+// the rays are also cast against the triangles, through a TriangleBvh per mesh and
+// by scanning every triangle. Runs without a window or device, main() calls it when
+// the executable is started with --benchmark-bvh.
+class BvhBenchmark
+{
+public:
+	static void Run();
+};
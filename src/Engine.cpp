@@ -5,19 +5,52 @@
 #include "Scene.h"
 #include "event/EventManager.h"
 
+namespace
+{
+	TextureLoader::Settings GetTextureLoaderSettings(const TextureStreamer& streamer)
+	{
+		TextureLoader::Settings settings;
+		// texture files only come with their smallest levels, the streamer loads the rest
+		settings.streamedInitialSize = streamer.GetSettings().initialSize;
+		return settings;
+	}
+}
+
 Engine::Engine(uint16_t width, uint16_t height)
 	:
 	m_Window(width, height, "Stimply Engine", m_ImGuiManager),
-	m_Renderer(width, height, &m_Window, m_ImGuiManager)
+	m_Renderer(width, height, &m_Window, m_ImGuiManager),
+	m_TextureCache(GetTextureLoaderSettings(m_TextureStreamer))
 {
 	m_Mesh = new Scene("./Models/Sponza/sponza.obj");
 	
 	Logger::Debug("Scene created!\n");
+
+	TextureCache::Stats textureStats = m_TextureCache.GetStats();
+	Logger::Info("Textures: %u requested, %u unique, %.2f MB uploaded, %.2f MB saved by sharing\n",
+		textureStats.requested, textureStats.unique,
+		textureStats.uniqueBytes / (1024.0 * 1024.0), textureStats.bytesSaved / (1024.0 * 1024.0));
+
+	TextureAtlas::Stats atlasStats = m_TextureAtlas.GetStats();
+	Logger::Info("Texture atlases: %u textures packed into %u pages, %u of %u lookups hit\n",
+		atlasStats.entries, atlasStats.pages, atlasStats.hits, atlasStats.lookups);
+
 	m_Renderer.AddScene(m_Mesh);
 	EventManager::RegisterListener(EVENT_KEY_PRESSED, this);
 }
 
 Engine::~Engine() {
+	TextureStreamer::Stats streamingStats = m_TextureStreamer.GetStats();
+	Logger::Info("Texture streaming: %u textures, %.2f MB resident, %u levels raised, %u dropped, %.2f MB streamed, last budget bias %u\n",
+		streamingStats.textures, streamingStats.residentBytes / (1024.0 * 1024.0),
+		streamingStats.raised, streamingStats.dropped, streamingStats.bytesStreamed / (1024.0 * 1024.0),
+		streamingStats.budgetBias);
+
+	VirtualTexture::Stats virtualStats = m_VirtualTexture.GetStats();
+	Logger::Info("Virtual texturing: %u textures, %u pages resident (%u pinned), %llu pages loaded, %llu evicted, %u missing in the last feedback\n",
+		virtualStats.textures, virtualStats.residentPages, virtualStats.pinnedPages,
+		(unsigned long long)virtualStats.pagesLoaded, (unsigned long long)virtualStats.pagesEvicted, virtualStats.missingPages);
+
 	delete m_Mesh;
 	m_ImGuiManager.Shutdown();
 	EventManager::ClearAllListeners();
@@ -32,6 +65,12 @@ void Engine::Run() {
 	while (m_Window.ProcessMessages()) {
 		float deltaTime = m_Window.GetDeltaTime();
 		m_Renderer.BeginFrame(deltaTime);
+
+		VkViewport viewport;
+		VkRect2D scissor;
+		m_Renderer.GetViewportAndScissor(viewport, scissor);
+		m_TextureStreamer.Update(m_Renderer.m_Projection, viewport.height);
+
 		m_Renderer.RenderFrame(deltaTime);
 		m_Renderer.EndFrame();
 	}
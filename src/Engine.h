@@ -1,7 +1,12 @@
 #pragma once
 
+#include "JobSystem.h"
 #include "Window.h"
 #include "Renderer.h"
+#include "TextureAtlas.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "VirtualTexture.h"
 #include "event/IEventListener.h"
 
 class Engine : public IEventListener {
@@ -13,9 +18,19 @@ public:
 	void OnEvent(EventCode code, const Event& event) override;
 
 private:
+	// declared first so the workers exist before, and outlive, everything that submits to them
+	JobSystem m_JobSystem;
 	ImGuiManager m_ImGuiManager;
 	Window m_Window;
 	Renderer m_Renderer;
+	// after the renderer, it checks the device can sample the formats of the pages it hands out
+	TextureAtlas m_TextureAtlas;
+	// after the renderer, so the cached images are released while the device is alive,
+	// and the streamer before the cache, which hands its textures back on the way out
+	TextureStreamer m_TextureStreamer;
+	TextureCache m_TextureCache;
+	// after the renderer as well, the meshes give their virtual textures back before it goes
+	VirtualTexture m_VirtualTexture;
 	class Scene* m_Mesh;
 	bool m_ShowingMouse = false;
 };
@@ -0,0 +1,137 @@
+#include "FrustumCuller.h"
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+#if defined(__AVX__)
+	typedef __m256 Floats;
+	inline Floats Load(const float* values) { return _mm256_loadu_ps(values); }
+	inline Floats Set(float value) { return _mm256_set1_ps(value); }
+	inline Floats Add(Floats a, Floats b) { return _mm256_add_ps(a, b); }
+	inline Floats Mul(Floats a, Floats b) { return _mm256_mul_ps(a, b); }
+	inline Floats And(Floats a, Floats b) { return _mm256_and_ps(a, b); }
+	inline Floats GreaterEqual(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	inline Floats True() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+	inline int Mask(Floats a) { return _mm256_movemask_ps(a); }
+#else
+	typedef __m128 Floats;
+	inline Floats Load(const float* values) { return _mm_loadu_ps(values); }
+	inline Floats Set(float value) { return _mm_set1_ps(value); }
+	inline Floats Add(Floats a, Floats b) { return _mm_add_ps(a, b); }
+	inline Floats Mul(Floats a, Floats b) { return _mm_mul_ps(a, b); }
+	inline Floats And(Floats a, Floats b) { return _mm_and_ps(a, b); }
+	inline Floats GreaterEqual(Floats a, Floats b) { return _mm_cmpge_ps(a, b); }
+	inline Floats True() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+	inline int Mask(Floats a) { return _mm_movemask_ps(a); }
+#endif
+}
+
+void FrustumCuller::ExtractPlanes(const glm::mat4& matrix, glm::vec4 planes[6])
+{
+	// the rows of the matrix are the clip coordinates' equations, w plus or minus x, y and z
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		const uint32_t row = i / 2;
+		const float sign = i % 2 == 0 ? 1.0f : -1.0f;
+		glm::vec4 plane(
+			matrix[0][3] + sign * matrix[0][row],
+			matrix[1][3] + sign * matrix[1][row],
+			matrix[2][3] + sign * matrix[2][row],
+			matrix[3][3] + sign * matrix[3][row]);
+		const float length = glm::length(glm::vec3(plane));
+		planes[i] = length > 0.0f ? plane / length : plane;
+	}
+}
+
+void FrustumCuller::Resize(uint32_t count)
+{
+	const uint32_t padded = (count + Width - 1) / Width * Width;
+	m_CenterX.resize(padded);
+	m_CenterY.resize(padded);
+	m_CenterZ.resize(padded);
+	m_ExtentX.resize(padded);
+	m_ExtentY.resize(padded);
+	m_ExtentZ.resize(padded);
+}
+
+void FrustumCuller::SetBounds(uint32_t index, const MeshBounds& bounds, const glm::mat4& transform)
+{
+	// the box's corners spread from its center along every column, by the absolute values
+	const glm::vec3 center = (bounds.minimum + bounds.maximum) * 0.5f;
+	const glm::vec3 extent = (bounds.maximum - bounds.minimum) * 0.5f;
+	const glm::vec3 worldCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtent(0.0f);
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		const glm::vec3 column = glm::vec3(transform[axis]);
+		worldExtent += glm::vec3(std::abs(column.x), std::abs(column.y), std::abs(column.z)) * extent[axis];
+	}
+
+	m_CenterX[index] = worldCenter.x;
+	m_CenterY[index] = worldCenter.y;
+	m_CenterZ[index] = worldCenter.z;
+	m_ExtentX[index] = worldExtent.x;
+	m_ExtentY[index] = worldExtent.y;
+	m_ExtentZ[index] = worldExtent.z;
+}
+
+uint32_t FrustumCuller::Cull(const glm::vec4 planes[6], uint32_t begin, uint32_t end, uint8_t* visible) const
+{
+	// A box is behind a plane when even its corner furthest along the normal is, that
+	// corner is the center plus the extent weighted by the normal's absolute values.
+	Floats normals[6][3];
+	Floats absNormals[6][3];
+	Floats distances[6];
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			normals[i][axis] = Set(planes[i][axis]);
+			absNormals[i][axis] = Set(std::abs(planes[i][axis]));
+		}
+		distances[i] = Set(planes[i].w);
+	}
+	const Floats zero = Set(0.0f);
+
+	uint32_t numVisible = 0;
+	for (uint32_t block = begin / Width; block * Width < end; block++)
+	{
+		const uint32_t first = block * Width;
+		const Floats centerX = Load(&m_CenterX[first]);
+		const Floats centerY = Load(&m_CenterY[first]);
+		const Floats centerZ = Load(&m_CenterZ[first]);
+		const Floats extentX = Load(&m_ExtentX[first]);
+		const Floats extentY = Load(&m_ExtentY[first]);
+		const Floats extentZ = Load(&m_ExtentZ[first]);
+
+		Floats inside = True();
+		for (uint32_t i = 0; i < 6; i++)
+		{
+			Floats distance = Add(Mul(normals[i][0], centerX), Mul(normals[i][1], centerY));
+			distance = Add(distance, Add(Mul(normals[i][2], centerZ), distances[i]));
+			Floats radius = Add(Mul(absNormals[i][0], extentX), Mul(absNormals[i][1], extentY));
+			radius = Add(radius, Mul(absNormals[i][2], extentZ));
+			inside = And(inside, GreaterEqual(Add(distance, radius), zero));
+		}
+
+		const int mask = Mask(inside);
+		for (uint32_t lane = 0; lane < Width; lane++)
+		{
+			const uint32_t index = first + lane;
+			if (index < begin || index >= end)
+			{
+				continue;
+			}
+			visible[index - begin] = (mask >> lane) & 1;
+			numVisible += visible[index - begin];
+		}
+	}
+	return numVisible;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "VkStructs.h"
+
+// World space bounds of the mesh instances as a struct of arrays, boxes as their
+// center and half extent, tested against the frustum a SIMD register of boxes at
+// a time: eight with AVX when the build enables it, four with SSE otherwise. A box
+// is outside when it lies behind one of the planes, which keeps a few boxes near
+// the frustum's edges that are outside of it all the same.
+class FrustumCuller
+{
+public:
+#if defined(__AVX__)
+	static constexpr uint32_t Width = 8;
+#else
+	static constexpr uint32_t Width = 4;
+#endif
+
+public:
+	// Inward facing planes (normal, distance) of -w <= x, y, z <= w in the space the
+	// matrix maps from, normalized so distances compare against lengths there. The near
+	// plane only keeps too much with a zero to one depth range.
+	static void ExtractPlanes(const glm::mat4& matrix, glm::vec4 planes[6]);
+
+	// Keeps the bounds of the first count instances that are already there.
+	void Resize(uint32_t count);
+	// Encloses the transformed box in an axis-aligned one.
+	void SetBounds(uint32_t index, const MeshBounds& bounds, const glm::mat4& transform);
+	// Writes whether each box of [begin, end) is inside to visible[i - begin] and
+	// returns how many are. Only reads the bounds, ranges cull in parallel.
+	uint32_t Cull(const glm::vec4 planes[6], uint32_t begin, uint32_t end, uint8_t* visible) const;
+
+	glm::vec3 GetCenter(uint32_t index) const { return glm::vec3(m_CenterX[index], m_CenterY[index], m_CenterZ[index]); }
+	glm::vec3 GetExtent(uint32_t index) const { return glm::vec3(m_ExtentX[index], m_ExtentY[index], m_ExtentZ[index]); }
+
+private:
+	// padded to a multiple of Width
+	std::vector<float> m_CenterX;
+	std::vector<float> m_CenterY;
+	std::vector<float> m_CenterZ;
+	std::vector<float> m_ExtentX;
+	std::vector<float> m_ExtentY;
+	std::vector<float> m_ExtentZ;
+};
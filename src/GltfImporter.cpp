@@ -0,0 +1,741 @@
+#include "GltfImporter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <emmintrin.h>
+
+#include "ImportedScene.h"
+#include "JobSystem.h"
+#include "Json.h"
+#include "Logger.h"
+#include "MeshOptimizer.h"
+
+namespace
+{
+	constexpr uint32_t GlbMagic = 0x46546C67; // "glTF"
+	constexpr uint32_t GlbVersion = 2;
+	constexpr uint32_t ChunkJson = 0x4E4F534A;
+	constexpr uint32_t ChunkBin = 0x004E4942;
+	constexpr uint32_t ModeTriangles = 4;
+
+	enum ComponentType : uint32_t
+	{
+		COMPONENT_BYTE = 5120,
+		COMPONENT_UNSIGNED_BYTE = 5121,
+		COMPONENT_SHORT = 5122,
+		COMPONENT_UNSIGNED_SHORT = 5123,
+		COMPONENT_UNSIGNED_INT = 5125,
+		COMPONENT_FLOAT = 5126,
+	};
+
+	struct GlbHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t length;
+	};
+
+	struct GlbChunkHeader
+	{
+		uint32_t length;
+		uint32_t type;
+	};
+
+	struct Accessor
+	{
+		const uint8_t* data = nullptr;
+		uint32_t count = 0;
+		uint32_t stride = 0;
+		uint32_t componentType = 0;
+		uint32_t components = 0;
+		bool normalized = false;
+
+		bool IsValid() const { return data != nullptr; }
+	};
+
+	struct Primitive
+	{
+		Accessor position;
+		Accessor normal;
+		Accessor texCoord;
+		Accessor indices;
+		uint32_t materialIndex = 0;
+		// vertices are read straight from the BIN chunk
+		bool zeroCopy = false;
+		uint32_t numIndices = 0;
+	};
+
+	uint32_t ComponentSize(uint32_t componentType)
+	{
+		switch (componentType)
+		{
+		case COMPONENT_BYTE:
+		case COMPONENT_UNSIGNED_BYTE: return 1;
+		case COMPONENT_SHORT:
+		case COMPONENT_UNSIGNED_SHORT: return 2;
+		case COMPONENT_UNSIGNED_INT:
+		case COMPONENT_FLOAT: return 4;
+		default: return 0;
+		}
+	}
+
+	uint32_t ComponentCount(const std::string& type)
+	{
+		if (type == "SCALAR") return 1;
+		if (type == "VEC2") return 2;
+		if (type == "VEC3") return 3;
+		if (type == "VEC4") return 4;
+		if (type == "MAT4") return 16;
+		return 0;
+	}
+
+	bool ResolveAccessor(const JsonValue& json, const uint8_t* bin, uint64_t binSize, uint32_t index, Accessor& out)
+	{
+		const JsonValue& accessor = json["accessors"][index];
+		if (!accessor.IsObject() || accessor.Has("sparse"))
+		{
+			return false;
+		}
+
+		const JsonValue& view = json["bufferViews"][accessor["bufferView"].AsIndex()];
+		if (!view.IsObject() || view["buffer"].AsIndex() != 0)
+		{
+			return false;
+		}
+
+		uint32_t componentType = accessor["componentType"].AsIndex(0);
+		uint32_t components = ComponentCount(accessor["type"].AsString());
+		uint32_t count = accessor["count"].AsIndex(0);
+		uint32_t componentSize = ComponentSize(componentType);
+		uint32_t elementSize = componentSize * components;
+		if (elementSize == 0 || count == 0)
+		{
+			return false;
+		}
+
+		uint64_t viewOffset = (uint64_t)view["byteOffset"].AsNumber(0.0);
+		uint64_t viewLength = (uint64_t)view["byteLength"].AsNumber(0.0);
+		uint64_t accessorOffset = (uint64_t)accessor["byteOffset"].AsNumber(0.0);
+		uint32_t stride = view["byteStride"].AsIndex(elementSize);
+
+		if (stride < elementSize ||
+			viewOffset + viewLength > binSize ||
+			accessorOffset + (uint64_t)(count - 1) * stride + elementSize > viewLength ||
+			(viewOffset + accessorOffset) % componentSize != 0)
+		{
+			return false;
+		}
+
+		out.data = bin + viewOffset + accessorOffset;
+		out.count = count;
+		out.stride = stride;
+		out.componentType = componentType;
+		out.components = components;
+		out.normalized = accessor["normalized"].AsBool();
+		return true;
+	}
+
+	// True when the three attributes are one Vertex-shaped interleaved stream.
+	bool MatchesVertexLayout(const Primitive& primitive)
+	{
+		const Accessor& position = primitive.position;
+		const Accessor& normal = primitive.normal;
+		const Accessor& texCoord = primitive.texCoord;
+
+		return normal.IsValid() && texCoord.IsValid() &&
+			position.stride == sizeof(Vertex) && normal.stride == sizeof(Vertex) && texCoord.stride == sizeof(Vertex) &&
+			normal.componentType == COMPONENT_FLOAT && texCoord.componentType == COMPONENT_FLOAT &&
+			normal.count == position.count && texCoord.count == position.count &&
+			normal.data == position.data + offsetof(Vertex, normal) &&
+			texCoord.data == position.data + offsetof(Vertex, texCoord) &&
+			reinterpret_cast<uintptr_t>(position.data) % alignof(Vertex) == 0;
+	}
+
+	float ReadNormalized(const uint8_t* data, uint32_t componentType)
+	{
+		switch (componentType)
+		{
+		case COMPONENT_UNSIGNED_BYTE: return *data / 255.0f;
+		case COMPONENT_UNSIGNED_SHORT:
+		{
+			uint16_t value;
+			memcpy(&value, data, sizeof(value));
+			return value / 65535.0f;
+		}
+		case COMPONENT_FLOAT:
+		{
+			float value;
+			memcpy(&value, data, sizeof(value));
+			return value;
+		}
+		default: return 0.0f;
+		}
+	}
+
+	// Gathers the strided attribute streams into Vertex. Each vertex is assembled
+	// in two registers, [px py pz nx] and [ny nz u v]. The 16 byte loads of the
+	// vec3 attributes read 4 bytes into the next element, so the last vertex goes
+	// through the scalar path.
+	void ConvertVertices(const Primitive& primitive, Vertex* vertices)
+	{
+		const Accessor& position = primitive.position;
+		const Accessor& normal = primitive.normal;
+		const Accessor& texCoord = primitive.texCoord;
+		const uint32_t count = position.count;
+
+		const bool hasNormal = normal.IsValid();
+		const bool floatTexCoord = texCoord.IsValid() && texCoord.componentType == COMPONENT_FLOAT;
+		const float zero[4] = {};
+
+		const uint8_t* positionData = position.data;
+		const uint8_t* normalData = hasNormal ? normal.data : reinterpret_cast<const uint8_t*>(zero);
+		const uint8_t* texCoordData = floatTexCoord ? texCoord.data : reinterpret_cast<const uint8_t*>(zero);
+		const uint32_t normalStride = hasNormal ? normal.stride : 0;
+		const uint32_t texCoordStride = floatTexCoord ? texCoord.stride : 0;
+
+		for (uint32_t i = 0; i + 1 < count; i++)
+		{
+			__m128 p = _mm_loadu_ps(reinterpret_cast<const float*>(positionData));
+			__m128 n = hasNormal ? _mm_loadu_ps(reinterpret_cast<const float*>(normalData)) : _mm_setzero_ps();
+			__m128 t = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(texCoordData)));
+
+			__m128 zx = _mm_shuffle_ps(p, n, _MM_SHUFFLE(0, 0, 2, 2));
+			__m128 first = _mm_shuffle_ps(p, zx, _MM_SHUFFLE(2, 0, 1, 0));
+			__m128 second = _mm_movelh_ps(_mm_shuffle_ps(n, n, _MM_SHUFFLE(3, 3, 2, 1)), t);
+
+			float* out = reinterpret_cast<float*>(&vertices[i]);
+			_mm_storeu_ps(out, first);
+			_mm_storeu_ps(out + 4, second);
+
+			positionData += position.stride;
+			normalData += normalStride;
+			texCoordData += texCoordStride;
+		}
+
+		Vertex& last = vertices[count - 1];
+		memcpy(&last.pos, positionData, sizeof(glm::vec3));
+		memcpy(&last.normal, normalData, sizeof(glm::vec3));
+		memcpy(&last.texCoord, texCoordData, sizeof(glm::vec2));
+
+		if (texCoord.IsValid() && !floatTexCoord)
+		{
+			const uint32_t componentSize = ComponentSize(texCoord.componentType);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const uint8_t* element = texCoord.data + (uint64_t)i * texCoord.stride;
+				vertices[i].texCoord.x = ReadNormalized(element, texCoord.componentType);
+				vertices[i].texCoord.y = ReadNormalized(element + componentSize, texCoord.componentType);
+			}
+		}
+	}
+
+	// Widens the indices to 32 bits and reverses the winding of every triangle.
+	bool ConvertIndices(const Primitive& primitive, uint32_t* indices)
+	{
+		const Accessor& source = primitive.indices;
+		const uint32_t count = primitive.numIndices;
+
+		if (!source.IsValid())
+		{
+			for (uint32_t i = 0; i < count; i++) indices[i] = i;
+		}
+		else if (source.componentType == COMPONENT_UNSIGNED_SHORT)
+		{
+			const uint8_t* data = source.data;
+			const __m128i zero = _mm_setzero_si128();
+			uint32_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * sizeof(uint16_t)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i), _mm_unpacklo_epi16(packed, zero));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i + 4), _mm_unpackhi_epi16(packed, zero));
+			}
+			for (; i < count; i++)
+			{
+				uint16_t value;
+				memcpy(&value, data + i * sizeof(uint16_t), sizeof(value));
+				indices[i] = value;
+			}
+		}
+		else if (source.componentType == COMPONENT_UNSIGNED_BYTE)
+		{
+			for (uint32_t i = 0; i < count; i++) indices[i] = source.data[i];
+		}
+		else
+		{
+			memcpy(indices, source.data, count * sizeof(uint32_t));
+		}
+
+		const uint32_t numVertices = primitive.position.count;
+		for (uint32_t i = 0; i < count; i += 3)
+		{
+			std::swap(indices[i + 1], indices[i + 2]);
+			if (indices[i] >= numVertices || indices[i + 1] >= numVertices || indices[i + 2] >= numVertices)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// glTF asks for flat normals when NORMAL is missing. Faces are averaged here
+	// instead so the vertices stay shared, the result matches for flat-shaded
+	// assets which are exported without shared corners anyway.
+	void GenerateNormals(Vertex* vertices, uint32_t numVertices, const uint32_t* indices, uint32_t numIndices)
+	{
+		for (uint32_t i = 0; i < numIndices; i += 3)
+		{
+			// the winding is already reversed, so the operands are swapped too
+			Vertex& a = vertices[indices[i]];
+			Vertex& b = vertices[indices[i + 1]];
+			Vertex& c = vertices[indices[i + 2]];
+			glm::vec3 faceNormal = glm::cross(c.pos - a.pos, b.pos - a.pos);
+			a.normal += faceNormal;
+			b.normal += faceNormal;
+			c.normal += faceNormal;
+		}
+
+		for (uint32_t i = 0; i < numVertices; i++)
+		{
+			float length = glm::length(vertices[i].normal);
+			vertices[i].normal = length > 0.0f ? vertices[i].normal / length : glm::vec3(0.0f);
+		}
+	}
+
+	glm::mat4 NodeTransform(const JsonValue& node)
+	{
+		glm::mat4 transform(1.0f);
+
+		const JsonValue& matrix = node["matrix"];
+		if (matrix.Size() == 16)
+		{
+			// glTF matrices are column-major like glm
+			for (uint32_t column = 0; column < 4; column++)
+			{
+				for (uint32_t row = 0; row < 4; row++)
+				{
+					transform[column][row] = (float)matrix[column * 4 + row].AsNumber();
+				}
+			}
+			return transform;
+		}
+
+		const JsonValue& translation = node["translation"];
+		const JsonValue& rotation = node["rotation"];
+		const JsonValue& scale = node["scale"];
+
+		float x = (float)rotation[0].AsNumber(0.0);
+		float y = (float)rotation[1].AsNumber(0.0);
+		float z = (float)rotation[2].AsNumber(0.0);
+		float w = (float)rotation[3].AsNumber(1.0);
+
+		glm::vec3 s((float)scale[0].AsNumber(1.0), (float)scale[1].AsNumber(1.0), (float)scale[2].AsNumber(1.0));
+
+		// T * R * S
+		transform[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w), 0.0f) * s.x;
+		transform[1] = glm::vec4(2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w), 0.0f) * s.y;
+		transform[2] = glm::vec4(2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y), 0.0f) * s.z;
+		transform[3] = glm::vec4(
+			(float)translation[0].AsNumber(0.0),
+			(float)translation[1].AsNumber(0.0),
+			(float)translation[2].AsNumber(0.0),
+			1.0f
+		);
+
+		return transform;
+	}
+
+	bool AppendNode(const JsonValue& json, uint32_t nodeIndex, const std::vector<std::vector<uint32_t>>& meshPrimitives,
+		std::vector<bool>& visited, ImportedScene& imported)
+	{
+		const JsonValue& node = json["nodes"][nodeIndex];
+		if (!node.IsObject() || visited[nodeIndex])
+		{
+			return false;
+		}
+		visited[nodeIndex] = true;
+
+		const JsonValue& children = node["children"];
+
+		ImportedNode importedNode;
+		importedNode.transform = NodeTransform(node);
+		importedNode.firstMesh = (uint32_t)imported.nodeMeshes.size();
+		importedNode.numChildren = (uint32_t)children.Size();
+
+		if (node.Has("mesh"))
+		{
+			uint32_t meshIndex = node["mesh"].AsIndex();
+			if (meshIndex >= meshPrimitives.size())
+			{
+				return false;
+			}
+			importedNode.numMeshes = (uint32_t)meshPrimitives[meshIndex].size();
+			imported.nodeMeshes.insert(imported.nodeMeshes.end(), meshPrimitives[meshIndex].begin(), meshPrimitives[meshIndex].end());
+		}
+
+		imported.nodes.push_back(importedNode);
+
+		for (size_t i = 0; i < children.Size(); i++)
+		{
+			uint32_t child = children[i].AsIndex();
+			if (child >= visited.size() || !AppendNode(json, child, meshPrimitives, visited, imported))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	std::string DecodeUri(const std::string& uri)
+	{
+		std::string decoded;
+		decoded.reserve(uri.size());
+		for (size_t i = 0; i < uri.size(); i++)
+		{
+			if (uri[i] == '%' && i + 2 < uri.size() && isxdigit((uint8_t)uri[i + 1]) && isxdigit((uint8_t)uri[i + 2]))
+			{
+				decoded.push_back((char)std::stoi(uri.substr(i + 1, 2), nullptr, 16));
+				i += 2;
+			}
+			else
+			{
+				decoded.push_back(uri[i]);
+			}
+		}
+		return decoded;
+	}
+
+	// Textures are loaded by path, so images embedded in the BIN chunk are written
+	// next to the model once and referenced from there.
+	bool ExtractImage(const std::filesystem::path& modelPath, uint32_t imageIndex, const uint8_t* data, uint64_t size,
+		const std::string& mimeType, std::string& relativePath)
+	{
+		const char* extension = mimeType == "image/jpeg" ? ".jpg" : ".png";
+		relativePath = modelPath.stem().string() + ".image" + std::to_string(imageIndex) + extension;
+		std::filesystem::path fullPath = modelPath.parent_path() / relativePath;
+
+		std::error_code error;
+		if (std::filesystem::file_size(fullPath, error) == size && !error)
+		{
+			return true;
+		}
+
+		std::ofstream file(fullPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(data), size);
+		if (!file.good())
+		{
+			Logger::Error("Failed to extract embedded image %s\n", fullPath.string().c_str());
+			return false;
+		}
+
+		return true;
+	}
+}
+
+bool GltfImporter::Import(const char* path, MappedFile& mapping, ImportedScene& imported)
+{
+	if (!mapping.Open(path))
+	{
+		return false;
+	}
+
+	const uint8_t* data = mapping.GetData();
+	const uint64_t size = mapping.GetSize();
+
+	GlbHeader header;
+	GlbChunkHeader jsonChunk;
+	if (size < sizeof(header) + sizeof(jsonChunk))
+	{
+		mapping.Close();
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	memcpy(&jsonChunk, data + sizeof(header), sizeof(jsonChunk));
+
+	const uint64_t jsonOffset = sizeof(header) + sizeof(jsonChunk);
+	if (header.magic != GlbMagic || header.version != GlbVersion || header.length > size ||
+		jsonChunk.type != ChunkJson || jsonOffset + jsonChunk.length > header.length)
+	{
+		Logger::Error("%s is not a glTF 2.0 binary\n", path);
+		mapping.Close();
+		return false;
+	}
+
+	const uint8_t* bin = nullptr;
+	uint64_t binSize = 0;
+	const uint64_t binHeaderOffset = jsonOffset + ((jsonChunk.length + 3) & ~3ull);
+	if (binHeaderOffset + sizeof(GlbChunkHeader) <= header.length)
+	{
+		GlbChunkHeader binChunk;
+		memcpy(&binChunk, data + binHeaderOffset, sizeof(binChunk));
+		if (binChunk.type == ChunkBin && binHeaderOffset + sizeof(binChunk) + binChunk.length <= header.length)
+		{
+			bin = data + binHeaderOffset + sizeof(binChunk);
+			binSize = binChunk.length;
+		}
+	}
+
+	JsonValue json;
+	if (!JsonValue::Parse(reinterpret_cast<const char*>(data + jsonOffset), jsonChunk.length, json))
+	{
+		Logger::Error("Malformed glTF JSON in %s\n", path);
+		mapping.Close();
+		return false;
+	}
+
+	if (json["extensionsRequired"].Size() > 0)
+	{
+		Logger::Info("%s requires glTF extensions, using the generic importer\n", path);
+		mapping.Close();
+		return false;
+	}
+
+	if (json["buffers"].Size() != 1 || json["buffers"][0].Has("uri") || !bin)
+	{
+		Logger::Info("%s references external buffers, using the generic importer\n", path);
+		mapping.Close();
+		return false;
+	}
+
+	// Every triangle primitive becomes one imported mesh.
+	const JsonValue& meshes = json["meshes"];
+	std::vector<Primitive> primitives;
+	std::vector<std::vector<uint32_t>> meshPrimitives(meshes.Size());
+
+	for (size_t m = 0; m < meshes.Size(); m++)
+	{
+		const JsonValue& meshPrimitiveList = meshes[m]["primitives"];
+		for (size_t p = 0; p < meshPrimitiveList.Size(); p++)
+		{
+			const JsonValue& source = meshPrimitiveList[p];
+			if (source["mode"].AsIndex(ModeTriangles) != ModeTriangles)
+			{
+				Logger::Info("Skipping non-triangle primitive in mesh %zu of %s\n", m, path);
+				continue;
+			}
+
+			const JsonValue& attributes = source["attributes"];
+			Primitive primitive;
+
+			bool valid = ResolveAccessor(json, bin, binSize, attributes["POSITION"].AsIndex(), primitive.position) &&
+				primitive.position.componentType == COMPONENT_FLOAT && primitive.position.components == 3;
+
+			if (valid && attributes.Has("NORMAL"))
+			{
+				valid = ResolveAccessor(json, bin, binSize, attributes["NORMAL"].AsIndex(), primitive.normal) &&
+					primitive.normal.componentType == COMPONENT_FLOAT && primitive.normal.components == 3 &&
+					primitive.normal.count == primitive.position.count;
+			}
+
+			if (valid && attributes.Has("TEXCOORD_0"))
+			{
+				valid = ResolveAccessor(json, bin, binSize, attributes["TEXCOORD_0"].AsIndex(), primitive.texCoord) &&
+					primitive.texCoord.components == 2 && primitive.texCoord.count == primitive.position.count &&
+					(primitive.texCoord.componentType == COMPONENT_FLOAT || primitive.texCoord.normalized);
+			}
+
+			if (valid && source.Has("indices"))
+			{
+				valid = ResolveAccessor(json, bin, binSize, source["indices"].AsIndex(), primitive.indices) &&
+					primitive.indices.components == 1 && primitive.indices.stride == ComponentSize(primitive.indices.componentType) &&
+					(primitive.indices.componentType == COMPONENT_UNSIGNED_BYTE ||
+						primitive.indices.componentType == COMPONENT_UNSIGNED_SHORT ||
+						primitive.indices.componentType == COMPONENT_UNSIGNED_INT);
+			}
+
+			if (!valid)
+			{
+				Logger::Error("Invalid accessors in mesh %zu of %s\n", m, path);
+				mapping.Close();
+				return false;
+			}
+
+			primitive.numIndices = primitive.indices.IsValid() ? primitive.indices.count : primitive.position.count;
+			primitive.numIndices -= primitive.numIndices % 3;
+			primitive.zeroCopy = MatchesVertexLayout(primitive);
+			// material 0 is the default, glTF materials follow
+			primitive.materialIndex = source.Has("material") ? source["material"].AsIndex() + 1 : 0;
+			if (primitive.materialIndex > json["materials"].Size())
+			{
+				primitive.materialIndex = 0;
+			}
+
+			meshPrimitives[m].push_back((uint32_t)primitives.size());
+			primitives.push_back(primitive);
+		}
+	}
+
+	// Storage for everything that can't be read in place.
+	std::vector<size_t> vertexOffsets(primitives.size());
+	std::vector<size_t> indexOffsets(primitives.size());
+	size_t totalVertices = 0;
+	size_t totalIndices = 0;
+	uint32_t zeroCopyCount = 0;
+	for (size_t i = 0; i < primitives.size(); i++)
+	{
+		vertexOffsets[i] = totalVertices;
+		indexOffsets[i] = totalIndices;
+		totalVertices += primitives[i].zeroCopy ? 0 : primitives[i].position.count;
+		totalIndices += primitives[i].numIndices;
+		zeroCopyCount += primitives[i].zeroCopy ? 1 : 0;
+	}
+
+	imported.vertexStorage.resize(totalVertices);
+	imported.indexStorage.resize(totalIndices);
+	imported.meshes.resize(primitives.size());
+
+	std::atomic<bool> failed = false;
+	JobSystem::Get()->ParallelFor((uint32_t)primitives.size(), 1, [&](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const Primitive& primitive = primitives[i];
+			uint32_t* indices = imported.indexStorage.data() + indexOffsets[i];
+			if (!ConvertIndices(primitive, indices))
+			{
+				failed = true;
+				continue;
+			}
+
+			const Vertex* vertices = reinterpret_cast<const Vertex*>(primitive.position.data);
+			if (!primitive.zeroCopy)
+			{
+				Vertex* converted = imported.vertexStorage.data() + vertexOffsets[i];
+				ConvertVertices(primitive, converted);
+				if (!primitive.normal.IsValid())
+				{
+					GenerateNormals(converted, primitive.position.count, indices, primitive.numIndices);
+				}
+				vertices = converted;
+			}
+
+			ImportedMesh& mesh = imported.meshes[i];
+			mesh.vertices = vertices;
+			mesh.numVertices = primitive.position.count;
+			mesh.indices = indices;
+			mesh.numIndices = primitive.numIndices;
+			mesh.materialIndex = primitive.materialIndex;
+			mesh.bounds = MeshOptimizer::ComputeBounds(vertices, mesh.numVertices);
+		}
+	});
+
+	if (failed)
+	{
+		Logger::Error("Index out of range in %s\n", path);
+		imported = ImportedScene();
+		mapping.Close();
+		return false;
+	}
+
+	// Materials only carry the base color texture.
+	const JsonValue& materials = json["materials"];
+	const JsonValue& images = json["images"];
+	std::vector<int32_t> imageString(images.Size(), -1);
+	std::vector<int32_t> materialString(materials.Size() + 1, -1);
+
+	for (size_t i = 0; i < materials.Size(); i++)
+	{
+		uint32_t textureIndex = materials[i]["pbrMetallicRoughness"]["baseColorTexture"]["index"].AsIndex();
+		uint32_t imageIndex = json["textures"][textureIndex]["source"].AsIndex();
+		const JsonValue& image = images[imageIndex];
+		if (!image.IsObject())
+		{
+			continue;
+		}
+
+		if (imageString[imageIndex] < 0)
+		{
+			std::string relativePath;
+			if (image.Has("bufferView"))
+			{
+				const JsonValue& view = json["bufferViews"][image["bufferView"].AsIndex()];
+				uint64_t viewOffset = (uint64_t)view["byteOffset"].AsNumber(0.0);
+				uint64_t viewLength = (uint64_t)view["byteLength"].AsNumber(0.0);
+				if (!view.IsObject() || viewOffset + viewLength > binSize ||
+					!ExtractImage(path, imageIndex, bin + viewOffset, viewLength, image["mimeType"].AsString(), relativePath))
+				{
+					continue;
+				}
+			}
+			else if (image["uri"].IsString() && image["uri"].AsString().compare(0, 5, "data:") != 0)
+			{
+				relativePath = DecodeUri(image["uri"].AsString());
+			}
+			else
+			{
+				Logger::Info("Skipping data URI image %zu in %s\n", (size_t)imageIndex, path);
+				continue;
+			}
+
+			imageString[imageIndex] = (int32_t)imported.stringStorage.size();
+			imported.stringStorage.push_back(relativePath);
+		}
+
+		materialString[i + 1] = imageString[imageIndex];
+	}
+
+	imported.materials.resize(materials.Size() + 1);
+	for (size_t i = 0; i < imported.materials.size(); i++)
+	{
+		if (materialString[i] >= 0)
+		{
+			imported.materials[i].diffuseTexture = imported.stringStorage[materialString[i]].c_str();
+		}
+	}
+
+	// The root converts to the engine's left-handed space, the scene's root nodes hang below it.
+	std::vector<uint32_t> roots;
+	const JsonValue& scene = json["scenes"][json["scene"].AsIndex(0)];
+	if (scene.IsObject())
+	{
+		for (size_t i = 0; i < scene["nodes"].Size(); i++)
+		{
+			roots.push_back(scene["nodes"][i].AsIndex());
+		}
+	}
+	else
+	{
+		std::vector<bool> isChild(json["nodes"].Size(), false);
+		for (size_t i = 0; i < json["nodes"].Size(); i++)
+		{
+			const JsonValue& children = json["nodes"][i]["children"];
+			for (size_t c = 0; c < children.Size(); c++)
+			{
+				uint32_t child = children[c].AsIndex();
+				if (child < isChild.size()) isChild[child] = true;
+			}
+		}
+		for (uint32_t i = 0; i < isChild.size(); i++)
+		{
+			if (!isChild[i]) roots.push_back(i);
+		}
+	}
+
+	ImportedNode root;
+	root.transform[2][2] = -1.0f;
+	root.numChildren = (uint32_t)roots.size();
+	imported.nodes.push_back(root);
+
+	std::vector<bool> visited(json["nodes"].Size(), false);
+	for (uint32_t rootIndex : roots)
+	{
+		if (rootIndex >= visited.size() || !AppendNode(json, rootIndex, meshPrimitives, visited, imported))
+		{
+			Logger::Error("Invalid node hierarchy in %s\n", path);
+			imported = ImportedScene();
+			mapping.Close();
+			return false;
+		}
+	}
+
+	Logger::Debug("Imported %s: %zu primitives, %u read in place\n", path, primitives.size(), zeroCopyCount);
+	return true;
+}
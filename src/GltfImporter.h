@@ -0,0 +1,26 @@
+#pragma once
+
+#include "MappedFile.h"
+
+struct ImportedScene;
+
+// glTF 2.0 binary (.glb) importer. The file stays memory-mapped: primitives whose
+// POSITION/NORMAL/TEXCOORD_0 accessors interleave exactly like Vertex are handed
+// to the upload straight from the BIN chunk, everything else is converted.
+//
+// glTF is right-handed with counter-clockwise front faces. Instead of rewriting
+// the vertices, the left-handed conversion is a z-mirror on the root node and
+// the index winding is reversed while the indices are widened to 32 bits.
+//
+// Scene runs MeshOptimizer on the result like on any other import. The widened
+// indices are reordered, split into ranges and get levels of detail and meshlets,
+// vertices read in place keep their order and only leave the mapping when a mesh
+// has to be split.
+class GltfImporter
+{
+public:
+	// mapping receives the .glb and must outlive the use of imported. Returns
+	// false for anything the loader doesn't handle (external buffers, required
+	// extensions, malformed files) so the caller can fall back to Assimp.
+	static bool Import(const char* path, MappedFile& mapping, ImportedScene& imported);
+};
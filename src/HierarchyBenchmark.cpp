@@ -0,0 +1,255 @@
+#include "HierarchyBenchmark.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "ImportedScene.h"
+#include "Logger.h"
+#include "SceneHierarchy.h"
+#include "Timer.h"
+
+namespace
+{
+	constexpr uint32_t Frames = 100;
+	constexpr uint32_t MeshesPerNode = 2;
+	constexpr uint32_t NumMeshes = 512;
+
+	const uint32_t s_NodeCounts[] = { 1000, 10000, 100000, 1000000 };
+	// of the nodes, moved every frame of the incremental update
+	constexpr uint32_t MovedNodesPerMille = 10;
+
+	// what the renderer gathered per mesh before and after the flat hierarchy, which
+	// keeps the world matrices around for the instances to point at
+	struct TreeInstance
+	{
+		uint32_t mesh;
+		glm::mat4 transform;
+	};
+
+	struct FlatInstance
+	{
+		uint32_t mesh;
+		const glm::mat4* transform;
+	};
+
+	// The hierarchy as Scene kept it before: children in a malloc'd array of node
+	// pointers, meshes in a new'd array, every node allocated on its own.
+	struct TreeNode
+	{
+		glm::mat4 transform;
+		uint32_t* meshes;
+		uint32_t numMeshes;
+		TreeNode** children;
+		uint32_t numChildren;
+	};
+
+	TreeNode* BuildTree(const ImportedScene& scene, uint32_t& cursor)
+	{
+		const ImportedNode& node = scene.nodes[cursor++];
+
+		uint32_t* meshes = new uint32_t[node.numMeshes];
+		for (uint32_t i = 0; i < node.numMeshes; i++)
+		{
+			meshes[i] = scene.nodeMeshes[node.firstMesh + i];
+		}
+
+		TreeNode* treeNode = new TreeNode{ node.transform, meshes, node.numMeshes, nullptr, 0 };
+		treeNode->children = (TreeNode**)malloc(sizeof(TreeNode*) * node.numChildren);
+		for (uint32_t i = 0; i < node.numChildren; i++)
+		{
+			treeNode->children[treeNode->numChildren++] = BuildTree(scene, cursor);
+		}
+		return treeNode;
+	}
+
+	void DestroyTree(TreeNode* node)
+	{
+		for (uint32_t i = 0; i < node->numChildren; i++)
+		{
+			DestroyTree(node->children[i]);
+		}
+		free(node->children);
+		delete[] node->meshes;
+		delete node;
+	}
+
+	void GatherTree(const TreeNode* node, glm::mat4 accumulatedTransform, std::vector<TreeInstance>& instances)
+	{
+		glm::mat4 transform = accumulatedTransform * node->transform;
+		for (uint32_t i = 0; i < node->numMeshes; i++)
+		{
+			instances.push_back({ node->meshes[i], transform });
+		}
+		for (uint32_t i = 0; i < node->numChildren; i++)
+		{
+			GatherTree(node->children[i], transform, instances);
+		}
+	}
+
+	// the root moves, so every world matrix is recomputed like the tree does
+	void GatherFlat(SceneHierarchy& hierarchy, const glm::mat4& rootTransform, std::vector<FlatInstance>& instances)
+	{
+		hierarchy.SetRootTransform(rootTransform);
+		hierarchy.UpdateWorldTransforms();
+
+		const uint32_t* nodeMeshes = hierarchy.GetNodeMeshes();
+		for (uint32_t node = 0; node < hierarchy.GetNodeCount(); node++)
+		{
+			const SceneHierarchy::MeshRange& range = hierarchy.GetMeshRange(node);
+			for (uint32_t i = range.firstMesh; i < range.firstMesh + range.numMeshes; i++)
+			{
+				instances.push_back({ nodeMeshes[i], &hierarchy.GetWorldTransform(node) });
+			}
+		}
+	}
+
+	// Random tree in pre-order: every node hangs below a random earlier one, which
+	// keeps the depth logarithmic and the fan-out uneven, like exported scenes.
+	void GenerateScene(uint32_t numNodes, ImportedScene& scene)
+	{
+		uint32_t seed = 0x2545F491u;
+		auto next = [&seed]()
+		{
+			seed = seed * 1664525u + 1013904223u;
+			return seed >> 8;
+		};
+
+		std::vector<uint32_t> parents(numNodes, SceneHierarchy::NoParent);
+		std::vector<uint32_t> childCounts(numNodes, 0);
+		for (uint32_t i = 1; i < numNodes; i++)
+		{
+			parents[i] = next() % i;
+			childCounts[parents[i]]++;
+		}
+
+		std::vector<uint32_t> childOffsets(numNodes + 1, 0);
+		for (uint32_t i = 0; i < numNodes; i++)
+		{
+			childOffsets[i + 1] = childOffsets[i] + childCounts[i];
+		}
+		std::vector<uint32_t> children(numNodes > 0 ? numNodes - 1 : 0);
+		std::vector<uint32_t> cursor(childOffsets.begin(), childOffsets.end() - 1);
+		for (uint32_t i = 1; i < numNodes; i++)
+		{
+			children[cursor[parents[i]]++] = i;
+		}
+
+		scene.nodes.clear();
+		scene.nodeMeshes.clear();
+		std::vector<uint32_t> stack = { 0 };
+		while (!stack.empty())
+		{
+			const uint32_t node = stack.back();
+			stack.pop_back();
+
+			ImportedNode imported;
+			const float offset = (float)(next() % 1000) * 0.01f;
+			imported.transform = glm::translate(glm::mat4(1.0f), glm::vec3(offset, 0.0f, -offset));
+			imported.transform = glm::rotate(imported.transform, offset, glm::vec3(0.0f, 1.0f, 0.0f));
+			imported.firstMesh = (uint32_t)scene.nodeMeshes.size();
+			imported.numMeshes = MeshesPerNode;
+			imported.numChildren = childCounts[node];
+			for (uint32_t i = 0; i < MeshesPerNode; i++)
+			{
+				scene.nodeMeshes.push_back(next() % NumMeshes);
+			}
+			scene.nodes.push_back(imported);
+
+			// reversed so the first child comes off the stack first
+			for (uint32_t i = childOffsets[node + 1]; i > childOffsets[node]; i--)
+			{
+				stack.push_back(children[i - 1]);
+			}
+		}
+	}
+
+	template<typename Instance, typename GatherFunction>
+	float Measure(GatherFunction gather, std::vector<Instance>& instances)
+	{
+		Timer timer;
+		float bestSeconds = 0.0f;
+		for (uint32_t frame = 0; frame < Frames; frame++)
+		{
+			instances.clear();
+
+			timer.Reset();
+			gather(instances);
+			timer.Tick();
+
+			const float seconds = timer.GetDeltaTime();
+			bestSeconds = frame == 0 ? seconds : std::min(bestSeconds, seconds);
+		}
+		return bestSeconds;
+	}
+}
+
+void HierarchyBenchmark::Run()
+{
+	Logger::Info("Hierarchy benchmark, best of %u frames, %u meshes per node\n", Frames, MeshesPerNode);
+
+	const glm::mat4 rootTransform = glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+	for (uint32_t numNodes : s_NodeCounts)
+	{
+		ImportedScene scene;
+		GenerateScene(numNodes, scene);
+
+		uint32_t cursor = 0;
+		TreeNode* tree = BuildTree(scene, cursor);
+		SceneHierarchy hierarchy;
+		hierarchy.Build(scene);
+
+		std::vector<TreeInstance> treeInstances;
+		std::vector<FlatInstance> flatInstances;
+		treeInstances.reserve(scene.nodeMeshes.size());
+		flatInstances.reserve(scene.nodeMeshes.size());
+
+		const float treeSeconds = Measure([&](std::vector<TreeInstance>& instances)
+		{
+			GatherTree(tree, rootTransform, instances);
+		}, treeInstances);
+		const float flatSeconds = Measure([&](std::vector<FlatInstance>& instances)
+		{
+			GatherFlat(hierarchy, rootTransform, instances);
+		}, flatInstances);
+
+		// The renderer keeps its instances while the scene's nodes stay the same, so
+		// a frame only updates the world matrices of what moved. The moved nodes are
+		// set to the transforms they already have, the results stay comparable.
+		std::vector<uint32_t> movedNodes(std::max(numNodes / 1000 * MovedNodesPerMille, 1u));
+		for (uint32_t i = 0; i < movedNodes.size(); i++)
+		{
+			movedNodes[i] = (uint32_t)((i + 1) * 2654435761u) % numNodes;
+		}
+		std::vector<FlatInstance> unused;
+		uint32_t changedNodes = 0;
+		const float incrementalSeconds = Measure([&](std::vector<FlatInstance>&)
+		{
+			for (uint32_t node : movedNodes)
+			{
+				hierarchy.SetLocalTransform(node, hierarchy.GetLocalTransform(node));
+			}
+			hierarchy.UpdateWorldTransforms();
+			changedNodes = (uint32_t)hierarchy.GetChangedNodes().size();
+		}, unused);
+		const float staticSeconds = Measure([&](std::vector<FlatInstance>&)
+		{
+			hierarchy.UpdateWorldTransforms();
+		}, unused);
+
+		// both walk the nodes in pre-order, so the instances have to match one for one,
+		// after the incremental updates as well
+		bool matches = treeInstances.size() == flatInstances.size();
+		for (size_t i = 0; matches && i < treeInstances.size(); i++)
+		{
+			matches = treeInstances[i].mesh == flatInstances[i].mesh && treeInstances[i].transform == *flatInstances[i].transform;
+		}
+
+		Logger::Info("%7u nodes  tree %8.3f ms  flat %8.3f ms  speedup %5.2fx  %u moved (%u updated) %8.3f ms  static %8.3f ms%s\n", numNodes,
+			treeSeconds * 1000.0f, flatSeconds * 1000.0f, flatSeconds > 0.0f ? treeSeconds / flatSeconds : 0.0f,
+			(uint32_t)movedNodes.size(), changedNodes, incrementalSeconds * 1000.0f, staticSeconds * 1000.0f,
+			matches ? "" : "  (instances differ)");
+
+		DestroyTree(tree);
+	}
+}
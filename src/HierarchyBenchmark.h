@@ -0,0 +1,13 @@
+#pragma once
+
+// Times one frame's worth of hierarchy traversal, world matrices plus the list of
+// mesh instances, for the old pointer tree of nodes against SceneHierarchy's flat
+// arrays on generated scenes of growing size, then the flat arrays' incremental
+// update with a percent of the nodes moving and with none, and logs the results.
+// Runs without a window or device, main() calls it when the executable is started
+// with --benchmark-hierarchy.
+class HierarchyBenchmark
+{
+public:
+	static void Run();
+};
@@ -0,0 +1,163 @@
+#include "ImageDecoder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "Logger.h"
+
+namespace
+{
+	// Destination armed by DecodeRGBA8 on this thread. Only an allocation of exactly
+	// the output size is redirected; freeing it re-arms it, so a conversion that
+	// allocates its result after dropping an intermediate of that size still lands
+	// in the destination.
+	struct DecodeTarget
+	{
+		void* memory = nullptr;
+		size_t size = 0;
+		bool handedOut = false;
+	};
+
+	thread_local DecodeTarget t_Target;
+
+	void* DecoderMalloc(size_t size)
+	{
+		if (t_Target.memory && !t_Target.handedOut && size == t_Target.size)
+		{
+			t_Target.handedOut = true;
+			return t_Target.memory;
+		}
+		return malloc(size);
+	}
+
+	void DecoderFree(void* memory)
+	{
+		if (memory && memory == t_Target.memory)
+		{
+			t_Target.handedOut = false;
+			return;
+		}
+		free(memory);
+	}
+
+	void* DecoderRealloc(void* memory, size_t oldSize, size_t newSize)
+	{
+		if (memory && memory == t_Target.memory)
+		{
+			// can't grow the destination in place, move it to the heap
+			void* moved = malloc(newSize);
+			if (moved)
+			{
+				memcpy(moved, memory, std::min(oldSize, newSize));
+				t_Target.handedOut = false;
+			}
+			return moved;
+		}
+		return realloc(memory, newSize);
+	}
+}
+
+#define STBI_MALLOC(size) DecoderMalloc(size)
+#define STBI_FREE(memory) DecoderFree(memory)
+#define STBI_REALLOC_SIZED(memory, oldSize, newSize) DecoderRealloc(memory, oldSize, newSize)
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+bool ImageDecoder::GetInfo(const char* path, uint32_t& width, uint32_t& height)
+{
+	int x = 0;
+	int y = 0;
+	int numChannels = 0;
+
+	if (!stbi_info(path, &x, &y, &numChannels) || x <= 0 || y <= 0)
+	{
+		return false;
+	}
+
+	width = (uint32_t)x;
+	height = (uint32_t)y;
+	return true;
+}
+
+bool ImageDecoder::DecodeRGBA8(const char* path, void* destination, uint32_t width, uint32_t height)
+{
+	const size_t size = (size_t)width * height * 4;
+
+	t_Target.memory = destination;
+	t_Target.size = size;
+	t_Target.handedOut = false;
+
+	int x = 0;
+	int y = 0;
+	int numChannels = 0;
+	stbi_uc* pixels = stbi_load(path, &x, &y, &numChannels, STBI_rgb_alpha);
+
+	t_Target = DecodeTarget();
+
+	if (!pixels)
+	{
+		return false;
+	}
+
+	if ((uint32_t)x != width || (uint32_t)y != height)
+	{
+		// the file changed between GetInfo and the decode
+		Logger::Error("Image %s changed size while loading\n", path);
+		if (pixels != destination)
+		{
+			stbi_image_free(pixels);
+		}
+		return false;
+	}
+
+	if (pixels != destination)
+	{
+		memcpy(destination, pixels, size);
+		stbi_image_free(pixels);
+	}
+
+	return true;
+}
+
+uint32_t ImageDecoder::GetUsedChannels(const uint8_t* rgba, uint64_t texelCount)
+{
+	bool gray = true;
+	bool opaque = true;
+	for (uint64_t i = 0; i < texelCount && gray; i++)
+	{
+		const uint8_t* texel = rgba + i * 4;
+		gray = texel[0] == texel[1] && texel[1] == texel[2];
+		opaque &= texel[3] == 255;
+	}
+
+	if (!gray)
+	{
+		return 4;
+	}
+	return opaque ? 1 : 2;
+}
+
+void ImageDecoder::PackChannels(const uint8_t* rgba, uint64_t texelCount, uint32_t channels, uint8_t* destination)
+{
+	switch (channels)
+	{
+	case 1:
+		for (uint64_t i = 0; i < texelCount; i++)
+		{
+			destination[i] = rgba[i * 4];
+		}
+		break;
+	case 2:
+		// gray and alpha, the view swizzles them back into place
+		for (uint64_t i = 0; i < texelCount; i++)
+		{
+			destination[i * 2] = rgba[i * 4];
+			destination[i * 2 + 1] = rgba[i * 4 + 3];
+		}
+		break;
+	default:
+		memmove(destination, rgba, texelCount * 4);
+		break;
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// stb_image front end that decodes into a buffer the caller owns, e.g. the staging
+// range the mip chain is then built in. stb_image has no such entry point, so its
+// allocator hooks hand out the destination for the one allocation the size of the
+// RGBA8 output, which saves copying the image out of stb's own buffer. Formats
+// whose converters end up returning a different buffer still work, at the cost of
+// that copy.
+class ImageDecoder
+{
+public:
+	// Reads the header only.
+	static bool GetInfo(const char* path, uint32_t& width, uint32_t& height);
+
+	// destination must hold width * height * 4 bytes as reported by GetInfo.
+	static bool DecodeRGBA8(const char* path, void* destination, uint32_t width, uint32_t height);
+
+	// Channels of decoded RGBA8 texels that carry information, whatever the file
+	// stored: 1 when every texel is opaque gray, 2 for gray with alpha, else 4.
+	static uint32_t GetUsedChannels(const uint8_t* rgba, uint64_t texelCount);
+	// Packs texels into the layout of GetUsedChannels: gray, gray and alpha, or RGBA
+	// as it is. destination may be rgba itself.
+	static void PackChannels(const uint8_t* rgba, uint64_t texelCount, uint32_t channels, uint8_t* destination);
+};
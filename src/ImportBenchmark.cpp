@@ -0,0 +1,122 @@
+#include "ImportBenchmark.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include "AssimpImporter.h"
+#include "ImportedScene.h"
+#include "JobSystem.h"
+#include "Logger.h"
+#include "ObjImporter.h"
+#include "Timer.h"
+
+#include "exception/RendererException.h"
+
+namespace
+{
+	constexpr uint32_t Iterations = 5;
+
+	const char* const s_Models[] =
+	{
+		"./Models/square.obj",
+		"./Models/suzanne.obj",
+		"./Models/Sponza/sponza.obj",
+	};
+
+	struct Result
+	{
+		float bestSeconds = 0.0f;
+		size_t numMeshes = 0;
+		size_t numVertices = 0;
+		size_t numIndices = 0;
+		bool succeeded = false;
+	};
+
+	template<typename ImportFunction>
+	Result Measure(const char* path, ImportFunction import)
+	{
+		Result result;
+		Timer timer;
+
+		for (uint32_t i = 0; i < Iterations; i++)
+		{
+			ImportedScene imported;
+
+			timer.Reset();
+			bool succeeded = import(path, imported);
+			timer.Tick();
+
+			if (!succeeded)
+			{
+				result.succeeded = false;
+				return result;
+			}
+
+			float seconds = timer.GetDeltaTime();
+			result.bestSeconds = i == 0 ? seconds : std::min(result.bestSeconds, seconds);
+			result.numMeshes = imported.meshes.size();
+			result.numVertices = imported.vertexStorage.size();
+			result.numIndices = imported.indexStorage.size();
+			result.succeeded = true;
+		}
+
+		return result;
+	}
+
+	void Report(const char* name, const Result& result)
+	{
+		if (!result.succeeded)
+		{
+			Logger::Error("  %-8s failed\n", name);
+			return;
+		}
+
+		Logger::Info("  %-8s %9.2f ms  %5zu meshes  %9zu vertices  %9zu indices\n",
+			name, result.bestSeconds * 1000.0f, result.numMeshes, result.numVertices, result.numIndices);
+	}
+}
+
+void ImportBenchmark::Run()
+{
+	// the importers split their work over the job system, the engine isn't created in this mode
+	JobSystem jobSystem;
+
+	Logger::Info("Import benchmark, best of %u runs on %u workers\n", Iterations, jobSystem.GetWorkerCount());
+
+	for (const char* path : s_Models)
+	{
+		if (!std::filesystem::exists(path))
+		{
+			Logger::Info("%s: not found, skipped\n", path);
+			continue;
+		}
+
+		Logger::Info("%s (%ju bytes)\n", path, (uintmax_t)std::filesystem::file_size(path));
+
+		Result native = Measure(path, [](const char* file, ImportedScene& imported)
+		{
+			return ObjImporter::Import(file, imported);
+		});
+
+		Result assimp = Measure(path, [](const char* file, ImportedScene& imported)
+		{
+			try
+			{
+				AssimpImporter::Import(file, imported);
+				return true;
+			}
+			catch (const RendererException&)
+			{
+				return false;
+			}
+		});
+
+		Report("native", native);
+		Report("assimp", assimp);
+
+		if (native.succeeded && assimp.succeeded && native.bestSeconds > 0.0f)
+		{
+			Logger::Info("  speedup  %9.2fx\n", assimp.bestSeconds / native.bestSeconds);
+		}
+	}
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// Times the native OBJ importer against Assimp on the bundled models and logs
+// the results. Runs without a window or device, main() calls it when the
+// executable is started with --benchmark-import.
+class ImportBenchmark
+{
+public:
+	static void Run();
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "VkStructs.h"
+
+// Importer-agnostic description of a model. Meshes and materials only point at
+// their data, which is either owned by the storage vectors below or by whatever
+// the importer keeps alive (e.g. a memory-mapped cache) until the Scene is built.
+struct ImportedMesh
+{
+	const Vertex* vertices = nullptr;
+	uint32_t numVertices = 0;
+	const uint32_t* indices = nullptr;
+	uint32_t numIndices = 0;
+	uint32_t materialIndex = 0;
+	// into ImportedScene::indexRanges, none when the indices aren't rebased and
+	// address the whole mesh. With levels of detail every level has the same number
+	// of ranges, the full level's first.
+	uint32_t firstIndexRange = 0;
+	uint32_t numIndexRanges = 0;
+	uint32_t numLods = 1;
+	// object space error of every level, see MeshSimplifier::Simplify
+	float lodErrors[MaxMeshLods] = {};
+	// into ImportedScene::meshlets, sorted by firstIndex, every range's triangles
+	// covered once even when levels share a range
+	uint32_t firstMeshlet = 0;
+	uint32_t numMeshlets = 0;
+	MeshBounds bounds;
+};
+
+struct ImportedMaterial
+{
+	// relative to the model's directory, nullptr when the material has no diffuse map
+	const char* diffuseTexture = nullptr;
+};
+
+// Nodes are stored in pre-order: every node is directly followed by its
+// children's subtrees, so the hierarchy can be rebuilt with a single cursor.
+struct ImportedNode
+{
+	glm::mat4 transform = glm::mat4(1.0f);
+	uint32_t firstMesh = 0;
+	uint32_t numMeshes = 0;
+	uint32_t numChildren = 0;
+};
+
+// Post-transform vertex cache statistics over all meshes, see MeshOptimizer.
+// Zero when the scene wasn't optimized.
+struct ImportedCacheStats
+{
+	float acmrBefore = 0.0f;
+	float acmrAfter = 0.0f;
+	float atvrBefore = 0.0f;
+	float atvrAfter = 0.0f;
+};
+
+struct ImportedScene
+{
+	std::vector<ImportedMesh> meshes;
+	std::vector<ImportedMaterial> materials;
+	std::vector<ImportedNode> nodes;
+	// indices into meshes, referenced by ImportedNode::firstMesh/numMeshes
+	std::vector<uint32_t> nodeMeshes;
+	std::vector<IndexRange> indexRanges;
+	std::vector<Meshlet> meshlets;
+	ImportedCacheStats cacheStats;
+
+	std::vector<Vertex> vertexStorage;
+	std::vector<uint32_t> indexStorage;
+	std::vector<std::string> stringStorage;
+};
@@ -0,0 +1,210 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "Logger.h"
+
+JobSystem::JobSystem(uint32_t numWorkers)
+{
+	assert(s_Instance == nullptr);
+
+	if (numWorkers == 0)
+	{
+		numWorkers = std::max(1u, std::thread::hardware_concurrency());
+	}
+	numWorkers = std::min(numWorkers, MaxWorkers);
+
+	m_Queues.reserve(numWorkers);
+	for (uint32_t i = 0; i < numWorkers; i++)
+	{
+		m_Queues.push_back(std::make_unique<WorkerQueue>());
+	}
+
+	t_WorkerIndex = 0;
+	s_Instance = this;
+
+	for (uint32_t i = 1; i < numWorkers; i++)
+	{
+		m_Threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_Running.store(false);
+	}
+	m_SleepCondition.notify_all();
+
+	for (std::thread& thread : m_Threads)
+	{
+		thread.join();
+	}
+
+	s_Instance = nullptr;
+}
+
+void JobSystem::Submit(Job job, JobCounter* counter)
+{
+	if (counter)
+	{
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	uint32_t workerIndex = GetCurrentWorkerIndex();
+	WorkerQueue& queue = *m_Queues[workerIndex];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back({ std::move(job), counter });
+	}
+
+	{
+		// taking the lock orders the increment against a worker about to go to sleep
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_QueuedJobs.fetch_add(1, std::memory_order_release);
+	}
+	m_SleepCondition.notify_one();
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t granularity, const RangeJob& job)
+{
+	if (count == 0) return;
+	granularity = std::max(1u, granularity);
+
+	JobCounter counter;
+	for (uint32_t begin = 0; begin < count; begin += granularity)
+	{
+		uint32_t end = std::min(count, begin + granularity);
+		Submit([&job, begin, end](uint32_t workerIndex) { job(begin, end, workerIndex); }, &counter);
+	}
+	WaitFor(counter);
+}
+
+void JobSystem::WaitFor(JobCounter& counter)
+{
+	uint32_t workerIndex = GetCurrentWorkerIndex();
+	while (!counter.IsDone())
+	{
+		if (!TryRunOne(workerIndex))
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// every job is done, nothing writes the exception anymore
+	if (counter.exception)
+	{
+		std::exception_ptr exception = counter.exception;
+		counter.exception = nullptr;
+		std::rethrow_exception(exception);
+	}
+}
+
+void JobSystem::WorkerLoop(uint32_t workerIndex)
+{
+	t_WorkerIndex = workerIndex;
+
+	while (m_Running.load(std::memory_order_acquire))
+	{
+		if (TryRunOne(workerIndex))
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		m_SleepCondition.wait(lock, [this]()
+		{
+			return m_QueuedJobs.load(std::memory_order_acquire) > 0 || !m_Running.load(std::memory_order_acquire);
+		});
+	}
+}
+
+bool JobSystem::TryRunOne(uint32_t workerIndex)
+{
+	JobEntry entry;
+	if (!PopLocal(workerIndex, entry) && !Steal(workerIndex, entry))
+	{
+		return false;
+	}
+
+	m_QueuedJobs.fetch_sub(1, std::memory_order_acq_rel);
+
+	std::exception_ptr exception;
+	try
+	{
+		entry.function(workerIndex);
+	}
+	catch (...)
+	{
+		exception = std::current_exception();
+	}
+
+	if (entry.counter)
+	{
+		if (exception)
+		{
+			std::lock_guard<std::mutex> lock(entry.counter->exceptionMutex);
+			if (!entry.counter->exception)
+			{
+				entry.counter->exception = exception;
+			}
+		}
+		// released after the exception is stored, WaitFor reads it once this reaches zero
+		entry.counter->pending.fetch_sub(1, std::memory_order_release);
+	}
+	else if (exception)
+	{
+		// Nobody waits for the job. Rethrowing would end a worker thread, or unwind
+		// an unrelated WaitFor that stole it while its own jobs still run.
+		try
+		{
+			std::rethrow_exception(exception);
+		}
+		catch (const std::exception& e)
+		{
+			Logger::Error("Job without a counter threw: %s\n", e.what());
+		}
+		catch (...)
+		{
+			Logger::Error("Job without a counter threw an unknown exception\n");
+		}
+	}
+
+	return true;
+}
+
+bool JobSystem::PopLocal(uint32_t workerIndex, JobEntry& entry)
+{
+	WorkerQueue& queue = *m_Queues[workerIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty())
+	{
+		return false;
+	}
+
+	entry = std::move(queue.jobs.back());
+	queue.jobs.pop_back();
+	return true;
+}
+
+bool JobSystem::Steal(uint32_t workerIndex, JobEntry& entry)
+{
+	const uint32_t workerCount = GetWorkerCount();
+	for (uint32_t i = 1; i < workerCount; i++)
+	{
+		WorkerQueue& victim = *m_Queues[(workerIndex + i) % workerCount];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.jobs.empty())
+		{
+			continue;
+		}
+
+		entry = std::move(victim.jobs.front());
+		victim.jobs.pop_front();
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tracks outstanding jobs. Every job submitted with a counter increments it and
+// decrements it once it finished running, so a job that submits children against
+// its own counter keeps the counter alive until the whole tree is done. A job that
+// throws still counts as finished, WaitFor rethrows the first exception. Jobs
+// submitted without a counter have nobody to hand it to, theirs are logged.
+struct JobCounter
+{
+	std::atomic<uint32_t> pending{ 0 };
+	std::exception_ptr exception;
+	std::mutex exceptionMutex;
+
+	bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Work-stealing job system. Each worker owns a deque: it pushes and pops at the
+// back, idle workers steal from the front of somebody else's. Worker 0 is the
+// thread that created the system (the main thread), it only runs jobs while it
+// is blocked inside WaitFor.
+class JobSystem
+{
+public:
+	using Job = std::function<void(uint32_t workerIndex)>;
+	using RangeJob = std::function<void(uint32_t begin, uint32_t end, uint32_t workerIndex)>;
+
+	// numWorkers includes the calling thread, 0 means one per hardware thread
+	explicit JobSystem(uint32_t numWorkers = 0);
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+	~JobSystem();
+
+	void Submit(Job job, JobCounter* counter = nullptr);
+	// Splits [0, count) into chunks of at most granularity items and blocks until all of them ran.
+	void ParallelFor(uint32_t count, uint32_t granularity, const RangeJob& job);
+	// Runs queued jobs on the calling thread until counter reaches zero, then rethrows
+	// the first exception one of its jobs threw.
+	void WaitFor(JobCounter& counter);
+
+	uint32_t GetWorkerCount() const { return static_cast<uint32_t>(m_Queues.size()); }
+	// Index of the calling worker, usable to pick per-thread resources. Threads that
+	// are not part of the system report 0, the same as the creating thread.
+	static uint32_t GetCurrentWorkerIndex() { return t_WorkerIndex; }
+	static JobSystem* Get() { return s_Instance; }
+
+	static constexpr uint32_t MaxWorkers = 64;
+
+private:
+	struct JobEntry
+	{
+		Job function;
+		JobCounter* counter = nullptr;
+	};
+
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<JobEntry> jobs;
+	};
+
+	void WorkerLoop(uint32_t workerIndex);
+	bool TryRunOne(uint32_t workerIndex);
+	bool PopLocal(uint32_t workerIndex, JobEntry& entry);
+	bool Steal(uint32_t workerIndex, JobEntry& entry);
+
+private:
+	std::vector<std::unique_ptr<WorkerQueue>>	m_Queues;
+	std::vector<std::thread>					m_Threads;
+	std::mutex									m_SleepMutex;
+	std::condition_variable						m_SleepCondition;
+	std::atomic<uint32_t>						m_QueuedJobs{ 0 };
+	std::atomic<bool>							m_Running{ true };
+
+	static inline JobSystem*					s_Instance = nullptr;
+	static inline thread_local uint32_t			t_WorkerIndex = 0;
+};
@@ -0,0 +1,288 @@
+#include "Json.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	constexpr uint32_t MaxDepth = 128;
+
+	const JsonValue s_Null;
+	const std::string s_EmptyString;
+
+	void AppendUtf8(std::string& out, uint32_t codePoint)
+	{
+		if (codePoint < 0x80)
+		{
+			out.push_back((char)codePoint);
+		}
+		else if (codePoint < 0x800)
+		{
+			out.push_back((char)(0xC0 | (codePoint >> 6)));
+			out.push_back((char)(0x80 | (codePoint & 0x3F)));
+		}
+		else if (codePoint < 0x10000)
+		{
+			out.push_back((char)(0xE0 | (codePoint >> 12)));
+			out.push_back((char)(0x80 | ((codePoint >> 6) & 0x3F)));
+			out.push_back((char)(0x80 | (codePoint & 0x3F)));
+		}
+		else
+		{
+			out.push_back((char)(0xF0 | (codePoint >> 18)));
+			out.push_back((char)(0x80 | ((codePoint >> 12) & 0x3F)));
+			out.push_back((char)(0x80 | ((codePoint >> 6) & 0x3F)));
+			out.push_back((char)(0x80 | (codePoint & 0x3F)));
+		}
+	}
+}
+
+class JsonParser
+{
+public:
+	JsonParser(const char* text, size_t length)
+		:
+		m_It(text),
+		m_End(text + length)
+	{}
+
+	bool ParseDocument(JsonValue& out)
+	{
+		if (!ParseValue(out, 0)) return false;
+		SkipWhitespace();
+		return m_It == m_End;
+	}
+
+private:
+	void SkipWhitespace()
+	{
+		while (m_It < m_End && (*m_It == ' ' || *m_It == '\t' || *m_It == '\n' || *m_It == '\r')) m_It++;
+	}
+
+	bool Consume(const char* literal)
+	{
+		size_t length = strlen(literal);
+		if ((size_t)(m_End - m_It) < length || memcmp(m_It, literal, length) != 0) return false;
+		m_It += length;
+		return true;
+	}
+
+	bool ParseHex(uint32_t& out)
+	{
+		if (m_End - m_It < 4) return false;
+		out = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			char c = *m_It++;
+			out <<= 4;
+			if (c >= '0' && c <= '9') out |= c - '0';
+			else if (c >= 'a' && c <= 'f') out |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') out |= c - 'A' + 10;
+			else return false;
+		}
+		return true;
+	}
+
+	bool ParseString(std::string& out)
+	{
+		if (m_It >= m_End || *m_It != '"') return false;
+		m_It++;
+
+		for (;;)
+		{
+			const char* runStart = m_It;
+			while (m_It < m_End && *m_It != '"' && *m_It != '\\' && (uint8_t)*m_It >= 0x20) m_It++;
+			out.append(runStart, m_It);
+
+			if (m_It >= m_End || (uint8_t)*m_It < 0x20) return false;
+			if (*m_It++ == '"') return true;
+
+			if (m_It >= m_End) return false;
+			char escape = *m_It++;
+			switch (escape)
+			{
+			case '"': out.push_back('"'); break;
+			case '\\': out.push_back('\\'); break;
+			case '/': out.push_back('/'); break;
+			case 'b': out.push_back('\b'); break;
+			case 'f': out.push_back('\f'); break;
+			case 'n': out.push_back('\n'); break;
+			case 'r': out.push_back('\r'); break;
+			case 't': out.push_back('\t'); break;
+			case 'u':
+			{
+				uint32_t codePoint;
+				if (!ParseHex(codePoint)) return false;
+				if (codePoint >= 0xD800 && codePoint < 0xDC00)
+				{
+					uint32_t low;
+					if (!Consume("\\u") || !ParseHex(low) || low < 0xDC00 || low >= 0xE000) return false;
+					codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				AppendUtf8(out, codePoint);
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+	}
+
+	bool ParseNumber(double& out)
+	{
+		// strtod needs a terminated buffer, numbers are short so copy them out
+		char buffer[64];
+		size_t length = 0;
+		while (m_It + length < m_End && length < sizeof(buffer) - 1 && strchr("+-0123456789.eE", m_It[length]))
+		{
+			buffer[length] = m_It[length];
+			length++;
+		}
+		buffer[length] = '\0';
+
+		char* parsedEnd = nullptr;
+		out = strtod(buffer, &parsedEnd);
+		if (parsedEnd == buffer || !std::isfinite(out)) return false;
+
+		m_It += parsedEnd - buffer;
+		return true;
+	}
+
+	bool ParseValue(JsonValue& out, uint32_t depth)
+	{
+		if (depth > MaxDepth) return false;
+
+		SkipWhitespace();
+		if (m_It >= m_End) return false;
+
+		switch (*m_It)
+		{
+		case '{':
+		{
+			m_It++;
+			out.m_Type = JsonValue::JSON_OBJECT;
+			SkipWhitespace();
+			if (m_It < m_End && *m_It == '}')
+			{
+				m_It++;
+				return true;
+			}
+			for (;;)
+			{
+				SkipWhitespace();
+				out.m_Members.emplace_back();
+				if (!ParseString(out.m_Members.back().first)) return false;
+				SkipWhitespace();
+				if (!Consume(":")) return false;
+				if (!ParseValue(out.m_Members.back().second, depth + 1)) return false;
+				SkipWhitespace();
+				if (Consume("}")) return true;
+				if (!Consume(",")) return false;
+			}
+		}
+		case '[':
+		{
+			m_It++;
+			out.m_Type = JsonValue::JSON_ARRAY;
+			SkipWhitespace();
+			if (m_It < m_End && *m_It == ']')
+			{
+				m_It++;
+				return true;
+			}
+			for (;;)
+			{
+				out.m_Elements.emplace_back();
+				if (!ParseValue(out.m_Elements.back(), depth + 1)) return false;
+				SkipWhitespace();
+				if (Consume("]")) return true;
+				if (!Consume(",")) return false;
+			}
+		}
+		case '"':
+			out.m_Type = JsonValue::JSON_STRING;
+			return ParseString(out.m_String);
+		case 't':
+			out.m_Type = JsonValue::JSON_BOOL;
+			out.m_Bool = true;
+			return Consume("true");
+		case 'f':
+			out.m_Type = JsonValue::JSON_BOOL;
+			out.m_Bool = false;
+			return Consume("false");
+		case 'n':
+			out.m_Type = JsonValue::JSON_NULL;
+			return Consume("null");
+		default:
+			out.m_Type = JsonValue::JSON_NUMBER;
+			return ParseNumber(out.m_Number);
+		}
+	}
+
+private:
+	const char* m_It;
+	const char* m_End;
+};
+
+bool JsonValue::Parse(const char* text, size_t length, JsonValue& out)
+{
+	out = JsonValue();
+
+	JsonParser parser(text, length);
+	if (!parser.ParseDocument(out))
+	{
+		out = JsonValue();
+		return false;
+	}
+
+	return true;
+}
+
+uint32_t JsonValue::AsIndex(uint32_t fallback) const
+{
+	if (m_Type != JSON_NUMBER || m_Number < 0.0 || m_Number >= (double)UINT32_MAX || m_Number != std::floor(m_Number))
+	{
+		return fallback;
+	}
+
+	return (uint32_t)m_Number;
+}
+
+const std::string& JsonValue::AsString() const
+{
+	return m_Type == JSON_STRING ? m_String : s_EmptyString;
+}
+
+size_t JsonValue::Size() const
+{
+	if (m_Type == JSON_ARRAY) return m_Elements.size();
+	if (m_Type == JSON_OBJECT) return m_Members.size();
+	return 0;
+}
+
+const JsonValue& JsonValue::At(size_t index) const
+{
+	if (m_Type != JSON_ARRAY || index >= m_Elements.size())
+	{
+		return s_Null;
+	}
+
+	return m_Elements[index];
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const
+{
+	if (m_Type == JSON_OBJECT)
+	{
+		for (const std::pair<std::string, JsonValue>& member : m_Members)
+		{
+			if (member.first == key)
+			{
+				return member.second;
+			}
+		}
+	}
+
+	return s_Null;
+}
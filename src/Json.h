@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Minimal read-only JSON DOM, enough for asset headers like glTF. Lookups never
+// fail: a missing key or out of range index yields a shared null value, so
+// chains like json["a"][0]["b"].AsNumber(0.0) don't need intermediate checks.
+class JsonValue
+{
+public:
+	enum Type : uint8_t
+	{
+		JSON_NULL,
+		JSON_BOOL,
+		JSON_NUMBER,
+		JSON_STRING,
+		JSON_ARRAY,
+		JSON_OBJECT,
+	};
+
+	// Parses a complete document, returns false (and leaves out as null) on a syntax error.
+	static bool Parse(const char* text, size_t length, JsonValue& out);
+
+	Type GetType() const { return m_Type; }
+	bool IsNull() const { return m_Type == JSON_NULL; }
+	bool IsNumber() const { return m_Type == JSON_NUMBER; }
+	bool IsString() const { return m_Type == JSON_STRING; }
+	bool IsArray() const { return m_Type == JSON_ARRAY; }
+	bool IsObject() const { return m_Type == JSON_OBJECT; }
+
+	bool AsBool(bool fallback = false) const { return m_Type == JSON_BOOL ? m_Bool : fallback; }
+	double AsNumber(double fallback = 0.0) const { return m_Type == JSON_NUMBER ? m_Number : fallback; }
+	// Non-negative integer value, fallback for anything else (including fractions).
+	uint32_t AsIndex(uint32_t fallback = UINT32_MAX) const;
+	const std::string& AsString() const;
+
+	// Element count of an array or member count of an object, 0 otherwise.
+	size_t Size() const;
+
+	const JsonValue& At(size_t index) const;
+	const JsonValue& operator[](const char* key) const;
+	// integral overload so a literal 0 doesn't read as a null key
+	template<typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+	const JsonValue& operator[](T index) const { return At(static_cast<size_t>(index)); }
+	bool Has(const char* key) const { return !(*this)[key].IsNull(); }
+
+	const std::vector<std::pair<std::string, JsonValue>>& GetMembers() const { return m_Members; }
+
+private:
+	friend class JsonParser;
+
+	Type m_Type = JSON_NULL;
+	bool m_Bool = false;
+	double m_Number = 0.0;
+	std::string m_String;
+	std::vector<JsonValue> m_Elements;
+	std::vector<std::pair<std::string, JsonValue>> m_Members;
+};
@@ -0,0 +1,109 @@
+#include "MappedFile.h"
+
+#include <utility>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#include <Windows.h>
+
+MappedFile::MappedFile(const char* path)
+{
+	Open(path);
+}
+
+MappedFile::MappedFile(MappedFile&& rhs) noexcept
+	:
+	m_File(std::exchange(rhs.m_File, nullptr)),
+	m_Mapping(std::exchange(rhs.m_Mapping, nullptr)),
+	m_Data(std::exchange(rhs.m_Data, nullptr)),
+	m_Size(std::exchange(rhs.m_Size, 0))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& rhs) noexcept
+{
+	if (this != &rhs)
+	{
+		Close();
+		m_File = std::exchange(rhs.m_File, nullptr);
+		m_Mapping = std::exchange(rhs.m_Mapping, nullptr);
+		m_Data = std::exchange(rhs.m_Data, nullptr);
+		m_Size = std::exchange(rhs.m_Size, 0);
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+
+	HANDLE file = CreateFileA(
+		path,
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+		nullptr
+	);
+
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	// CreateFileMapping refuses to map empty files, so there is nothing to view.
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	m_File = file;
+	m_Mapping = mapping;
+	m_Data = static_cast<const uint8_t*>(view);
+	m_Size = static_cast<uint64_t>(size.QuadPart);
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_Data)
+	{
+		UnmapViewOfFile(m_Data);
+		m_Data = nullptr;
+	}
+	if (m_Mapping)
+	{
+		CloseHandle(m_Mapping);
+		m_Mapping = nullptr;
+	}
+	if (m_File)
+	{
+		CloseHandle(m_File);
+		m_File = nullptr;
+	}
+	m_Size = 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Read-only view of a whole file mapped into the address space.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	explicit MappedFile(const char* path);
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+	MappedFile(MappedFile&& rhs) noexcept;
+	MappedFile& operator=(MappedFile&& rhs) noexcept;
+	~MappedFile();
+
+	bool Open(const char* path);
+	void Close();
+
+	bool IsOpen() const { return m_Data != nullptr; }
+	const uint8_t* GetData() const { return m_Data; }
+	uint64_t GetSize() const { return m_Size; }
+
+private:
+	void* m_File = nullptr;
+	void* m_Mapping = nullptr;
+	const uint8_t* m_Data = nullptr;
+	uint64_t m_Size = 0;
+};
@@ -0,0 +1,160 @@
+#include "MappedIOSystem.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+// Read-only cursor over a shared mapping. An empty file has no mapping and
+// behaves like a stream that is always at its end.
+class MappedIOStream : public Assimp::IOStream
+{
+public:
+	MappedIOStream(std::shared_ptr<const MappedFile> file, MappedIOSystem& system)
+		:
+		m_File(std::move(file)),
+		m_System(system)
+	{
+		if (m_File)
+		{
+			m_Data = m_File->GetData();
+			m_Size = static_cast<size_t>(m_File->GetSize());
+		}
+	}
+
+	size_t Read(void* buffer, size_t size, size_t count) override
+	{
+		if (size == 0 || count == 0)
+		{
+			return 0;
+		}
+
+		// like fread only whole elements count, a partial trailing element is still copied
+		size_t available = m_Size - m_Cursor;
+		size_t bytes = std::min(available, size * count);
+		memcpy(buffer, m_Data + m_Cursor, bytes);
+		m_Cursor += bytes;
+
+		m_System.m_BytesRead.fetch_add(bytes, std::memory_order_relaxed);
+
+		return bytes / size;
+	}
+
+	size_t Write(const void*, size_t, size_t) override
+	{
+		return 0;
+	}
+
+	aiReturn Seek(size_t offset, aiOrigin origin) override
+	{
+		size_t target;
+		switch (origin)
+		{
+		case aiOrigin_SET: target = offset; break;
+		case aiOrigin_CUR: target = m_Cursor + offset; break;
+		// the offset is negative (two's complement) for aiOrigin_END
+		case aiOrigin_END: target = m_Size + offset; break;
+		default: return aiReturn_FAILURE;
+		}
+
+		if (target > m_Size)
+		{
+			return aiReturn_FAILURE;
+		}
+
+		m_Cursor = target;
+		return aiReturn_SUCCESS;
+	}
+
+	size_t Tell() const override { return m_Cursor; }
+	size_t FileSize() const override { return m_Size; }
+	void Flush() override {}
+
+private:
+	std::shared_ptr<const MappedFile> m_File;
+	MappedIOSystem& m_System;
+	const uint8_t* m_Data = nullptr;
+	size_t m_Size = 0;
+	size_t m_Cursor = 0;
+};
+
+std::string MappedIOSystem::NormalizePath(const char* path)
+{
+	return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+bool MappedIOSystem::Exists(const char* path) const
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_Mappings.count(NormalizePath(path)))
+		{
+			return true;
+		}
+	}
+
+	std::error_code error;
+	return std::filesystem::is_regular_file(path, error);
+}
+
+char MappedIOSystem::getOsSeparator() const
+{
+#ifdef _WIN32
+	return '\\';
+#else
+	return '/';
+#endif
+}
+
+Assimp::IOStream* MappedIOSystem::Open(const char* path, const char* mode)
+{
+	// the mappings are read-only, Assimp only writes when exporting
+	if (strchr(mode, 'w') || strchr(mode, 'a') || strchr(mode, '+'))
+	{
+		return nullptr;
+	}
+
+	std::string key = NormalizePath(path);
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	auto found = m_Mappings.find(key);
+	if (found != m_Mappings.end())
+	{
+		m_Stats.opens++;
+		return new MappedIOStream(found->second, *this);
+	}
+
+	auto file = std::make_shared<MappedFile>();
+	if (!file->Open(path))
+	{
+		// mapping an empty file fails, but the file itself is valid
+		std::error_code error;
+		if (std::filesystem::is_regular_file(path, error) && std::filesystem::file_size(path, error) == 0 && !error)
+		{
+			m_Stats.opens++;
+			return new MappedIOStream(nullptr, *this);
+		}
+
+		m_Stats.failedOpens++;
+		return nullptr;
+	}
+
+	m_Stats.opens++;
+	m_Stats.mappings++;
+	m_Stats.bytesMapped += file->GetSize();
+	m_Mappings.emplace(key, file);
+
+	return new MappedIOStream(std::move(file), *this);
+}
+
+void MappedIOSystem::Close(Assimp::IOStream* stream)
+{
+	delete stream;
+}
+
+MappedIOSystem::Stats MappedIOSystem::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Stats stats = m_Stats;
+	stats.bytesRead = m_BytesRead.load(std::memory_order_relaxed);
+	return stats;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include "MappedFile.h"
+
+// Assimp IOSystem that serves every file from a read-only memory mapping instead
+// of buffered stdio. Reads are a single memcpy out of the mapping, and a file
+// that is opened again (Assimp probes most files before importing them) reuses
+// the mapping made by the first open. Mappings live as long as the IOSystem,
+// which the Importer owns and destroys with itself.
+class MappedIOSystem : public Assimp::IOSystem
+{
+public:
+	struct Stats
+	{
+		uint64_t bytesRead = 0;
+		uint64_t bytesMapped = 0;
+		uint32_t opens = 0;
+		uint32_t mappings = 0;
+		uint32_t failedOpens = 0;
+	};
+
+public:
+	MappedIOSystem() = default;
+	~MappedIOSystem() override = default;
+
+	bool Exists(const char* path) const override;
+	char getOsSeparator() const override;
+	Assimp::IOStream* Open(const char* path, const char* mode = "rb") override;
+	void Close(Assimp::IOStream* stream) override;
+
+	Stats GetStats() const;
+
+private:
+	friend class MappedIOStream;
+
+	static std::string NormalizePath(const char* path);
+
+private:
+	mutable std::mutex m_Mutex;
+	std::unordered_map<std::string, std::shared_ptr<const MappedFile>> m_Mappings;
+	Stats m_Stats;
+	// updated by every read, outside of the mutex
+	std::atomic<uint64_t> m_BytesRead{ 0 };
+};
@@ -1,40 +1,68 @@
 #include "Mesh.h"
 
+#include <algorithm>
+#include <cmath>
+
+#include <emmintrin.h>
+
 #include "VkStructs.h"
 #include "Renderer.h"
 
+#include "FrustumCuller.h"
 #include "Logger.h"
+#include "VertexQuantizer.h"
 #include "imgui/lib/imgui.h"
 
-#define STB_IMAGE_IMPLEMENTATION
 #include "exception/RendererException.h"
-#include "stb/stb_image.h"
 
-Mesh::Mesh(Vertex* vertices, uint32_t numVertices, uint32_t* indices, uint32_t numIndices, const char* texturePath, uint8_t threadId)
+Mesh::Mesh(const Vertex* vertices, uint32_t numVertices, const uint32_t* indices, uint32_t numIndices,
+	const IndexRange* indexRanges, uint32_t numIndexRanges, const float* lodErrors, uint32_t numLods,
+	const Meshlet* meshlets, uint32_t numMeshlets, const MeshBounds& bounds, const char* texturePath, uint8_t threadId)
 	:
 	m_NumIndices(numIndices),
+	m_Bounds(bounds),
 	m_ThreadId(threadId)
 {
 	const Renderer* renderer = Renderer::Get();
 
-	size_t vsize = sizeof(Vertex) * numVertices;
-	size_t isize = sizeof(uint32_t) * m_NumIndices;
+	if (numIndexRanges > 0)
+	{
+		m_IndexRanges.assign(indexRanges, indexRanges + numIndexRanges);
+		m_NumLods = std::clamp(numLods, 1u, MaxMeshLods);
+		m_RangesPerLod = numIndexRanges / m_NumLods;
+		std::copy(lodErrors, lodErrors + m_NumLods, m_LodErrors);
+	}
+	else
+	{
+		m_IndexRanges.push_back({ 0, numIndices, 0 });
+	}
+
+	// ranges are relative to their vertex offset, levels of detail needn't be split
+	const uint32_t maxIndex = numIndices > 0 ? *std::max_element(indices, indices + numIndices) : 0;
+	m_IndexType = maxIndex < IndexRange::MaxVertices ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
 
-	memcpy(vertices, vertices, vsize);
-	memcpy(indices, indices, isize);
+	if (numMeshlets > 0)
+	{
+		SetupMeshlets(meshlets, numMeshlets);
+	}
 
 	CreateDescriptorSets(renderer);
-	CreateUniformBuffers(renderer);
 	CreateMeshBuffers(numIndices, indices, numVertices, vertices);
-	CreateTextureImage(renderer, texturePath);
+	CreateUniformBuffers(renderer);
+	CalculateUVDensity(vertices, indices);
+	texturePath = texturePath ? texturePath : "./Models/no_texture.png";
+	AcquireTexture(renderer, texturePath);
 	UpdateDescriptorSets(renderer);
 }
 
 Mesh::~Mesh() {
 	const Renderer* renderer = Renderer::Get();
 	vkDeviceWaitIdle(renderer->GetLogicalDevice());
-	renderer->DestroyImageView(m_TextureImage);
-	renderer->DestroyImage(m_TextureImage);
+	TextureCache::Get()->Release(m_Texture);
+	if (m_VirtualTexture)
+	{
+		VirtualTexture::Get()->Release(m_VirtualTexture);
+	}
 	delete[] m_VertexDescSet;
 	delete[] m_FragmentDescSet;
 	renderer->DestroyBuffer(m_VertexUBO);
@@ -64,13 +92,153 @@ void Mesh::UpdateDescriptorSet(const glm::mat4& transform, uint32_t frameNum) co
 	}
 }
 
-void Mesh::Draw(VkCommandBuffer commandBuffer, const glm::mat4& transform, uint32_t frameNum) const {
+void Mesh::Cull(MeshInstance& instance, bool cullMeshlets, MeshCullStats& stats) const
+{
 	const Renderer* renderer = Renderer::Get();
 
+	const glm::mat4& transform = *instance.transform;
+	float scale = 0.0f;
+	float distance = 0.0f;
+	GetViewDistance(transform, scale, distance);
+	instance.lodLevel = SelectLod(scale, distance, instance.lodLevel);
+
+	const uint32_t firstRange = instance.lodLevel * m_RangesPerLod;
+	instance.draws.clear();
+	if (!cullMeshlets || m_MeshletBounds.empty())
+	{
+		instance.draws.assign(m_IndexRanges.begin() + firstRange, m_IndexRanges.begin() + firstRange + m_RangesPerLod);
+		return;
+	}
+
+	// the frustum planes in object space, the distances compare against the radii
+	glm::vec4 objectPlanes[6];
+	FrustumCuller::ExtractPlanes(renderer->m_Projection * renderer->m_View * transform, objectPlanes);
+	__m128 planes[6][4];
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		for (uint32_t component = 0; component < 4; component++)
+		{
+			planes[i][component] = _mm_set1_ps(objectPlanes[i][component]);
+		}
+	}
+
+	// The test runs in object space, where a mirror doesn't move the camera to the
+	// other side of a plane. It only turns the winding around, and with it the
+	// cones, which then point inward, like those of a .glb under its z-mirror.
+	const __m128 coneSign = _mm_set1_ps(glm::determinant(glm::mat3(transform)) < 0.0f ? -1.0f : 1.0f);
+	const glm::vec3 camera = glm::vec3(glm::inverse(renderer->m_View * transform)[3]);
+	const __m128 cameraX = _mm_set1_ps(camera.x);
+	const __m128 cameraY = _mm_set1_ps(camera.y);
+	const __m128 cameraZ = _mm_set1_ps(camera.z);
+
+	for (uint32_t r = firstRange; r < firstRange + m_RangesPerLod; r++)
+	{
+		const MeshletSpan& span = m_MeshletSpans[r];
+		if (span.numMeshlets == 0)
+		{
+			instance.draws.push_back(m_IndexRanges[r]);
+			continue;
+		}
+		stats.meshlets += span.numMeshlets;
+
+		const uint32_t end = span.firstMeshlet + span.numMeshlets;
+		for (uint32_t block = span.firstMeshlet / 4; block * 4 < end; block++)
+		{
+			const MeshletBounds4& bounds = m_MeshletBounds[block];
+			const __m128 centerX = _mm_loadu_ps(bounds.centerX);
+			const __m128 centerY = _mm_loadu_ps(bounds.centerY);
+			const __m128 centerZ = _mm_loadu_ps(bounds.centerZ);
+			const __m128 radius = _mm_loadu_ps(bounds.radius);
+			const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (uint32_t i = 0; i < 6; i++)
+			{
+				__m128 planeDistance = _mm_add_ps(_mm_mul_ps(planes[i][0], centerX), _mm_mul_ps(planes[i][1], centerY));
+				planeDistance = _mm_add_ps(planeDistance, _mm_add_ps(_mm_mul_ps(planes[i][2], centerZ), planes[i][3]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(planeDistance, negativeRadius));
+			}
+
+			// facing away when the camera is behind every plane of the cone widened by the radius
+			const __m128 toX = _mm_sub_ps(centerX, cameraX);
+			const __m128 toY = _mm_sub_ps(centerY, cameraY);
+			const __m128 toZ = _mm_sub_ps(centerZ, cameraZ);
+			__m128 along = _mm_add_ps(_mm_mul_ps(toX, _mm_loadu_ps(bounds.coneX)), _mm_mul_ps(toY, _mm_loadu_ps(bounds.coneY)));
+			along = _mm_mul_ps(_mm_add_ps(along, _mm_mul_ps(toZ, _mm_loadu_ps(bounds.coneZ))), coneSign);
+			__m128 length = _mm_add_ps(_mm_mul_ps(toX, toX), _mm_mul_ps(toY, toY));
+			length = _mm_sqrt_ps(_mm_add_ps(length, _mm_mul_ps(toZ, toZ)));
+			const __m128 limit = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(bounds.coneCutoff), length), radius);
+			const int backfacing = _mm_movemask_ps(_mm_cmpge_ps(along, limit));
+			const int insideMask = _mm_movemask_ps(inside);
+			const int visible = insideMask & ~backfacing;
+
+			for (uint32_t lane = 0; lane < 4; lane++)
+			{
+				const uint32_t meshlet = block * 4 + lane;
+				if (meshlet < span.firstMeshlet || meshlet >= end)
+				{
+					continue;
+				}
+
+				const int bit = 1 << lane;
+				if (!(visible & bit))
+				{
+					if (insideMask & bit)
+					{
+						stats.backfaceCulled++;
+					}
+					else
+					{
+						stats.frustumCulled++;
+					}
+					continue;
+				}
+
+				// meshlets follow each other in the index buffer, neighbours are one draw
+				const IndexRange& draw = m_MeshletDraws[meshlet];
+				if (!instance.draws.empty() &&
+					instance.draws.back().vertexOffset == draw.vertexOffset &&
+					instance.draws.back().firstIndex + instance.draws.back().numIndices == draw.firstIndex)
+				{
+					instance.draws.back().numIndices += draw.numIndices;
+				}
+				else
+				{
+					instance.draws.push_back(draw);
+				}
+			}
+		}
+	}
+}
+
+void Mesh::Draw(VkCommandBuffer commandBuffer, const MeshInstance& instance, uint32_t frameNum) const {
+	const Renderer* renderer = Renderer::Get();
+
+	const glm::mat4& transform = *instance.transform;
+	float scale = 0.0f;
+	float distance = 0.0f;
+	GetViewDistance(transform, scale, distance);
+
+	// culled meshes keep their texture streaming in, they are likely back soon
+	if (m_Texture && m_Texture->stream && !m_VirtualTexture)
+	{
+		TextureStreamer::Get()->Request(m_Texture->stream, scale > 0.0f ? m_UVDensity / scale : 0.0f, distance);
+	}
+
+	if (instance.draws.empty())
+	{
+		return;
+	}
+
 	UpdateDescriptorSet(transform, frameNum);
+
+	if (m_Texture && m_BoundTextureViews[frameNum] != m_Texture->image.view)
+	{
+		UpdateTextureDescriptor(renderer, frameNum);
+	}
 	
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_VertexBuffer.buffer, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer.buffer, 0, m_IndexType);
 	
 	VkDescriptorSet sets[] = { m_VertexDescSet[frameNum], m_FragmentDescSet[frameNum] };
 	vkCmdBindDescriptorSets(
@@ -81,49 +249,126 @@ void Mesh::Draw(VkCommandBuffer commandBuffer, const glm::mat4& transform, uint3
 		0, nullptr
 	);
 	
-	vkCmdDrawIndexed(commandBuffer, m_NumIndices, 1, 0, 0, 0);
+	for (const IndexRange& range : instance.draws)
+	{
+		vkCmdDrawIndexed(commandBuffer, range.numIndices, 1, range.firstIndex, range.vertexOffset, 0);
+	}
+}
+
+void Mesh::GetViewDistance(const glm::mat4& transform, float& scale, float& distance) const
+{
+	// the closest the bounding sphere gets to the camera, scaled like the mesh
+	const Renderer* renderer = Renderer::Get();
+	scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+	const glm::vec4 center = renderer->m_View * transform * glm::vec4(m_Bounds.center, 1.0f);
+	distance = std::max(glm::length(glm::vec3(center)) - m_Bounds.radius * scale, 0.0f);
+}
+
+uint32_t Mesh::SelectLod(float scale, float distance, uint32_t currentLevel) const
+{
+	if (m_NumLods == 1)
+	{
+		return 0;
+	}
+
+	const Renderer* renderer = Renderer::Get();
+	const Renderer::LodSettings& settings = renderer->m_LodSettings;
+	if (settings.forcedLevel >= 0)
+	{
+		return std::min((uint32_t)settings.forcedLevel, m_NumLods - 1);
+	}
+
+	// inside the bounds every error is too large
+	if (distance <= 0.0f)
+	{
+		return 0;
+	}
+
+	// pixels an object space unit covers at the closest point of the bounds
+	const float pixelsPerUnit = scale * std::abs(renderer->m_Projection[1][1]) * renderer->GetHeight() * 0.5f / distance;
+
+	// finer as soon as the level is off by too much, coarser only once the next one
+	// is clearly good enough, so meshes at the switch distance don't flicker
+	uint32_t level = std::min(currentLevel, m_NumLods - 1);
+	while (level > 0 && m_LodErrors[level] * pixelsPerUnit > settings.pixelError)
+	{
+		level--;
+	}
+	while (level + 1 < m_NumLods && m_LodErrors[level + 1] * pixelsPerUnit <= settings.pixelError * (1.0f - settings.hysteresis))
+	{
+		level++;
+	}
+	return level;
 }
 
-void Mesh::CreateMeshBuffers(uint32_t indexCount, uint32_t* indices, uint32_t vertexCount, Vertex* vertices)
+void Mesh::CreateMeshBuffers(uint32_t indexCount, const uint32_t* indices, uint32_t vertexCount, const Vertex* vertices)
 {
 	const Renderer* renderer = Renderer::Get();
+
+	const void* vertexData = vertices;
+	uint64_t vertexSize = vertexCount * sizeof(Vertex);
+	std::vector<CompactVertex> compactVertices;
+	if (renderer->GetGraphicsPipeline(GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE_COMPACT) != VK_NULL_HANDLE)
+	{
+		compactVertices.resize(vertexCount);
+		if (VertexQuantizer::Quantize(vertices, vertexCount, VertexQuantizer::Settings(), compactVertices.data(), m_PositionOffset, m_PositionScale))
+		{
+			m_VertexFormat = VERTEX_FORMAT_COMPACT;
+			vertexData = compactVertices.data();
+			vertexSize = vertexCount * sizeof(CompactVertex);
+		}
+	}
+
 	GPUBuffer vertexBuffer = renderer->CreateBuffer(
-		vertexCount * sizeof(Vertex), 
+		vertexSize, 
 		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
 	GPUBuffer stagingVertexBuffer = renderer->CreateBuffer(
-		indexCount * sizeof(Vertex),
+		vertexSize,
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
 		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
+	const uint64_t indexSize = indexCount * (m_IndexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t));
+
 	GPUBuffer indexBuffer = renderer->CreateBuffer(
-		m_NumIndices * sizeof(uint32_t),
+		indexSize,
 		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
 	GPUBuffer stagingIndexBuffer = renderer->CreateBuffer(
-		m_NumIndices * sizeof(uint32_t),
+		indexSize,
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 	
 	void* mappedVertexBuffer = renderer->MapBuffer(stagingVertexBuffer);
-	memcpy(mappedVertexBuffer, vertices, vertexCount * sizeof(Vertex));
+	memcpy(mappedVertexBuffer, vertexData, vertexSize);
 
 	void* mappedIndexBuffer = renderer->MapBuffer(stagingIndexBuffer);
-	memcpy(mappedIndexBuffer, indices, indexCount * sizeof(uint32_t));
+	if (m_IndexType == VK_INDEX_TYPE_UINT16)
+	{
+		uint16_t* shortIndices = static_cast<uint16_t*>(mappedIndexBuffer);
+		for (uint32_t i = 0; i < indexCount; i++)
+		{
+			shortIndices[i] = static_cast<uint16_t>(indices[i]);
+		}
+	}
+	else
+	{
+		memcpy(mappedIndexBuffer, indices, indexSize);
+	}
 
 	VkCommandBuffer commandBuffer = renderer->GetTransientTransferCommandBuffer(m_ThreadId, false);
 
 	VkBufferCopy vertexRegion;
 	vertexRegion.srcOffset = 0;
 	vertexRegion.dstOffset = 0;
-	vertexRegion.size = vertexCount * sizeof(Vertex);
+	vertexRegion.size = vertexSize;
 
 	VkBufferCopy indexRegion;
 	indexRegion.srcOffset = 0;
 	indexRegion.dstOffset = 0;
-	indexRegion.size = indexCount * sizeof(uint32_t);
+	indexRegion.size = indexSize;
 
 	vkCmdCopyBuffer(commandBuffer, stagingVertexBuffer.buffer, vertexBuffer.buffer, 1, &vertexRegion);
 	vkCmdCopyBuffer(commandBuffer, stagingIndexBuffer.buffer, indexBuffer.buffer, 1, &indexRegion);
@@ -143,6 +388,78 @@ void Mesh::CreateMeshBuffers(uint32_t indexCount, uint32_t* indices, uint32_t ve
 	m_IndexBuffer = indexBuffer;
 }
 
+void Mesh::SetupMeshlets(const Meshlet* meshlets, uint32_t numMeshlets)
+{
+	m_MeshletDraws.assign(numMeshlets, { 0, 0, 0 });
+	m_MeshletSpans.assign(m_IndexRanges.size(), { 0, 0 });
+
+	// meshlets are sorted by their first index, a range is covered by a run of them
+	for (size_t r = 0; r < m_IndexRanges.size(); r++)
+	{
+		const IndexRange& range = m_IndexRanges[r];
+		const Meshlet* first = std::lower_bound(meshlets, meshlets + numMeshlets, range.firstIndex, [](const Meshlet& meshlet, uint32_t firstIndex)
+		{
+			return meshlet.firstIndex < firstIndex;
+		});
+
+		uint32_t meshlet = (uint32_t)(first - meshlets);
+		uint32_t covered = range.firstIndex;
+		const uint32_t end = range.firstIndex + range.numIndices;
+		while (meshlet < numMeshlets && meshlets[meshlet].firstIndex == covered && covered < end)
+		{
+			covered += meshlets[meshlet].numIndices;
+			m_MeshletDraws[meshlet] = { meshlets[meshlet].firstIndex, meshlets[meshlet].numIndices, range.vertexOffset };
+			meshlet++;
+		}
+		if (covered == end && range.numIndices > 0)
+		{
+			m_MeshletSpans[r] = { (uint32_t)(first - meshlets), meshlet - (uint32_t)(first - meshlets) };
+		}
+	}
+
+	// the lanes past the last meshlet are never looked at
+	m_MeshletBounds.assign((numMeshlets + 3) / 4, MeshletBounds4{});
+	for (uint32_t i = 0; i < numMeshlets; i++)
+	{
+		MeshletBounds4& bounds = m_MeshletBounds[i / 4];
+		const uint32_t lane = i % 4;
+		bounds.centerX[lane] = meshlets[i].center.x;
+		bounds.centerY[lane] = meshlets[i].center.y;
+		bounds.centerZ[lane] = meshlets[i].center.z;
+		bounds.radius[lane] = meshlets[i].radius;
+		bounds.coneX[lane] = meshlets[i].coneAxis.x;
+		bounds.coneY[lane] = meshlets[i].coneAxis.y;
+		bounds.coneZ[lane] = meshlets[i].coneAxis.z;
+		bounds.coneCutoff[lane] = meshlets[i].coneCutoff;
+	}
+}
+
+void Mesh::CalculateUVDensity(const Vertex* vertices, const uint32_t* indices)
+{
+	// twice the areas, the factor cancels out
+	float worldArea = 0.0f;
+	float uvArea = 0.0f;
+	for (uint32_t r = 0; r < m_RangesPerLod; r++)
+	{
+		const IndexRange& range = m_IndexRanges[r];
+		const Vertex* rangeVertices = vertices + range.vertexOffset;
+		const uint32_t* rangeIndices = indices + range.firstIndex;
+		for (uint32_t i = 0; i + 2 < range.numIndices; i += 3)
+		{
+			const Vertex& a = rangeVertices[rangeIndices[i]];
+			const Vertex& b = rangeVertices[rangeIndices[i + 1]];
+			const Vertex& c = rangeVertices[rangeIndices[i + 2]];
+
+			worldArea += glm::length(glm::cross(b.pos - a.pos, c.pos - a.pos));
+			const glm::vec2 uvB = b.texCoord - a.texCoord;
+			const glm::vec2 uvC = c.texCoord - a.texCoord;
+			uvArea += std::abs(uvB.x * uvC.y - uvB.y * uvC.x);
+		}
+	}
+
+	m_UVDensity = worldArea > 0.0f ? std::sqrt(uvArea / worldArea) : 0.0f;
+}
+
 void Mesh::CreateDescriptorSets(const Renderer* renderer)
 {
 	uint32_t frameNum = renderer->GetFrameCount();
@@ -179,6 +496,15 @@ void Mesh::CreateUniformBuffers(const Renderer* renderer)
 
 	m_FragmentUBO.mappedBuffer = renderer->MapBuffer(m_FragmentUBO);
 
+	// fixed for the mesh's lifetime, UpdateDescriptorSet only writes the matrices
+	MVP* mvpgpu = (MVP*)m_VertexUBO.mappedBuffer;
+	for (uint32_t i = 0; i < renderer->GetFrameCount(); i++)
+	{
+		mvpgpu[i] = MVP();
+		mvpgpu[i].positionOffset = m_PositionOffset;
+		mvpgpu[i].positionScale = m_PositionScale;
+	}
+
 	FragmentBuffer fbcpu{};
 	fbcpu.lightPos = { 0.0f, 0.0f, -4.0f };
 
@@ -189,6 +515,46 @@ void Mesh::CreateUniformBuffers(const Renderer* renderer)
 	}
 }
 
+void Mesh::AcquireTexture(const Renderer* renderer, const char* texturePath)
+{
+	const TextureAtlas::Entry* atlasEntry = TextureAtlas::Get() ? TextureAtlas::Get()->Find(texturePath) : nullptr;
+	if (!atlasEntry)
+	{
+		m_Texture = TextureCache::Get()->Acquire(texturePath, m_ThreadId);
+		AcquireVirtualTexture(renderer, texturePath);
+		return;
+	}
+
+	// shares the page's image with every other texture packed into it
+	m_Texture = TextureCache::Get()->Acquire(atlasEntry->pagePath.c_str(), m_ThreadId);
+	// the streamer sizes the page, the texture covers only its rect of it
+	m_UVDensity *= std::sqrt(atlasEntry->rect.z * atlasEntry->rect.w);
+
+	FragmentBuffer* fbgpu = (FragmentBuffer*)m_FragmentUBO.mappedBuffer;
+	for (uint32_t i = 0; i < renderer->GetFrameCount(); i++)
+	{
+		fbgpu[i].atlasRect = atlasEntry->rect;
+	}
+}
+
+void Mesh::AcquireVirtualTexture(const Renderer* renderer, const char* texturePath)
+{
+	VirtualTexture* virtualTexture = VirtualTexture::Get();
+	if (!virtualTexture)
+	{
+		return;
+	}
+
+	m_VirtualTexture = virtualTexture->Acquire(texturePath);
+
+	// the same for every frame, UpdateDescriptorSet leaves them alone
+	FragmentBuffer* fbgpu = (FragmentBuffer*)m_FragmentUBO.mappedBuffer;
+	for (uint32_t i = 0; i < renderer->GetFrameCount(); i++)
+	{
+		virtualTexture->GetShaderParameters(m_VirtualTexture, fbgpu[i].virtualRect, fbgpu[i].virtualInfo);
+	}
+}
+
 void Mesh::UpdateDescriptorSets(const Renderer* renderer)
 {
 	VkWriteDescriptorSet* writeSets = (VkWriteDescriptorSet*)alloca(
@@ -201,8 +567,9 @@ void Mesh::UpdateDescriptorSets(const Renderer* renderer)
 
 	VkDescriptorImageInfo imageInfo;
 	imageInfo.sampler = renderer->GetSampler();
-	imageInfo.imageView = m_TextureImage.view;
-	imageInfo.imageLayout = m_TextureImage.layout;
+	imageInfo.imageView = m_Texture->image.view;
+	imageInfo.imageLayout = m_Texture->image.layout;
+	m_BoundTextureViews.assign(renderer->GetFrameCount(), imageInfo.imageView);
 	
 	for (uint32_t i = 0; i < renderer->GetFrameCount(); i++)
 	{
@@ -260,80 +627,26 @@ void Mesh::UpdateDescriptorSets(const Renderer* renderer)
 	);
 }
 
-void Mesh::CreateTextureImage(const Renderer* renderer, const char* texturePath)
+void Mesh::UpdateTextureDescriptor(const Renderer* renderer, uint32_t frameNum) const
 {
-	int x = 0;
-	int y = 0;
-	int numChannels = 0;
-
-	if (!texturePath)
-	{
-		texturePath = "./Models/no_texture.png";
-	}
-	
-	stbi_uc* image = stbi_load(texturePath, &x, &y, &numChannels, STBI_rgb_alpha);
-
-	if (!image)
-	{
-		Logger::Error("Failed to load image %s\n", texturePath);
-		throw RendererException("Failed to load image");
-	}
-
-	uint16_t mipLevels = Renderer::CalculateMipMaps<uint16_t>(x, y);
-	
-	GPUImage gpuImage = renderer->CreateImage(
-		VK_FORMAT_R8G8B8A8_SRGB,
-		VK_IMAGE_ASPECT_COLOR_BIT,
-		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-		(uint16_t)x, (int16_t)y,
-		mipLevels, VK_SAMPLE_COUNT_1_BIT,
-		VK_IMAGE_TILING_OPTIMAL
-	);
-
-	renderer->CreateImageView(gpuImage);
-
-	VkCommandBuffer commandBuffer = renderer->GetTransientTransferCommandBuffer(m_ThreadId, true);
-	
-	renderer->ImageBarrier(
-		commandBuffer,
-		gpuImage,
-		VK_ACCESS_NONE,
-		VK_ACCESS_MEMORY_WRITE_BIT,
-		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-	);
-	
-	uint64_t imageSizeInBytes = (uint64_t)x * (uint64_t)y * (uint64_t)4;
-
-	VkFence fence = renderer->CreateFence();
-	
-	GPUUniformBuffer stagingBuffer = renderer->CreateBuffer(
-		imageSizeInBytes,
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-
-	stagingBuffer.mappedBuffer = renderer->MapBuffer(stagingBuffer);
-	
-	memcpy(stagingBuffer.mappedBuffer, image, imageSizeInBytes);
-	
-	renderer->CopyBufferToImage(commandBuffer, stagingBuffer, gpuImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-	renderer->GenerateMipMaps(commandBuffer, gpuImage);
-	
-	renderer->ImageBarrier(
-		commandBuffer,
-		gpuImage,
-		VK_ACCESS_MEMORY_WRITE_BIT,
-		VK_ACCESS_MEMORY_READ_BIT,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-	);
-	
-	renderer->EndTransientTransferCommandBuffer(commandBuffer, fence, m_ThreadId, true);
-
-	vkWaitForFences(renderer->GetLogicalDevice(), 1, &fence, VK_TRUE, UINT64_MAX);
-
-	renderer->DestroyFence(fence);
-	renderer->DestroyBuffer(stagingBuffer);
-
-	m_TextureImage = gpuImage;
+	VkDescriptorImageInfo imageInfo;
+	imageInfo.sampler = renderer->GetSampler();
+	imageInfo.imageView = m_Texture->image.view;
+	imageInfo.imageLayout = m_Texture->image.layout;
+
+	VkWriteDescriptorSet writeSet;
+	writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeSet.pNext = nullptr;
+	writeSet.dstSet = m_FragmentDescSet[frameNum];
+	writeSet.dstBinding = 1;
+	writeSet.dstArrayElement = 0;
+	writeSet.descriptorCount = 1;
+	writeSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeSet.pImageInfo = &imageInfo;
+	writeSet.pBufferInfo = nullptr;
+	writeSet.pTexelBufferView = nullptr;
+
+	vkUpdateDescriptorSets(renderer->GetLogicalDevice(), 1, &writeSet, 0, VK_NULL_HANDLE);
+
+	m_BoundTextureViews[frameNum] = imageInfo.imageView;
 }
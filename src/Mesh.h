@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Engine.h"
+#include "TextureAtlas.h"
+#include "TextureCache.h"
+#include "VirtualTexture.h"
 #include "VkStructs.h"
 
 struct Vertex;
@@ -9,21 +12,60 @@ struct Light;
 
 class Mesh {
 public:
-	Mesh(Vertex* vertices, uint32_t numVertices, uint32_t* indices, uint32_t numIndices, const char* texturePath, uint8_t threadId = 0);
+	// Without index ranges the indices address the whole mesh. With levels of detail
+	// every level has numIndexRanges / numLods ranges, the full level's first. Ranges
+	// without meshlets covering them exactly are drawn whole. The bounds come from import.
+	Mesh(const Vertex* vertices, uint32_t numVertices, const uint32_t* indices, uint32_t numIndices,
+		const IndexRange* indexRanges, uint32_t numIndexRanges, const float* lodErrors, uint32_t numLods,
+		const Meshlet* meshlets, uint32_t numMeshlets, const MeshBounds& bounds, const char* texturePath, uint8_t threadId = 0);
 	Mesh(const Mesh& rhs) = delete;
 	Mesh& operator=(const Mesh& rhs) = delete;
 	~Mesh();
 	void UpdateDescriptorSet(const glm::mat4& transform, uint32_t frameNum) const;
 
-	void Draw(VkCommandBuffer commandBuffer, const glm::mat4& transform, uint32_t frameNum) const;
+	// Picks the instance's level of detail and fills instance.draws with the meshlets
+	// of it that are inside the frustum and not facing away. Only touches instance,
+	// so instances cull in parallel. Instances FrustumCuller rejects don't get here.
+	void Cull(MeshInstance& instance, bool cullMeshlets, MeshCullStats& stats) const;
+	void Draw(VkCommandBuffer commandBuffer, const MeshInstance& instance, uint32_t frameNum) const;
 
-	bool HasTexture() const { return m_TextureImage.image != VK_NULL_HANDLE; }
+	bool HasTexture() const { return m_Texture && m_Texture->image.image != VK_NULL_HANDLE; }
+	// the renderer draws every format with its own pipeline
+	VertexFormat GetVertexFormat() const { return m_VertexFormat; }
+	VkIndexType GetIndexType() const { return m_IndexType; }
+	uint32_t GetNumLods() const { return m_NumLods; }
+	const MeshBounds& GetBounds() const { return m_Bounds; }
 private:
-	void CreateMeshBuffers(uint32_t indexCount, uint32_t* indices, uint32_t vertexCount, Vertex* vertices);
+	// bounds of four consecutive meshlets, a struct of arrays for SIMD
+	struct MeshletBounds4
+	{
+		float centerX[4];
+		float centerY[4];
+		float centerZ[4];
+		float radius[4];
+		float coneX[4];
+		float coneY[4];
+		float coneZ[4];
+		float coneCutoff[4];
+	};
+
+	struct MeshletSpan
+	{
+		uint32_t firstMeshlet;
+		uint32_t numMeshlets;
+	};
+
+	void GetViewDistance(const glm::mat4& transform, float& scale, float& distance) const;
+	uint32_t SelectLod(float scale, float distance, uint32_t currentLevel) const;
+	void CreateMeshBuffers(uint32_t indexCount, const uint32_t* indices, uint32_t vertexCount, const Vertex* vertices);
+	void CalculateUVDensity(const Vertex* vertices, const uint32_t* indices);
+	void SetupMeshlets(const Meshlet* meshlets, uint32_t numMeshlets);
 	void CreateDescriptorSets(const Renderer* renderer);
 	void CreateUniformBuffers(const Renderer* renderer);
 	void UpdateDescriptorSets(const Renderer* renderer);
-	void CreateTextureImage(const Renderer* renderer, const char* texturePath);
+	void UpdateTextureDescriptor(const Renderer* renderer, uint32_t frameNum) const;
+	void AcquireTexture(const Renderer* renderer, const char* texturePath);
+	void AcquireVirtualTexture(const Renderer* renderer, const char* texturePath);
 	
 protected:
 	static constexpr uint64_t offsets[1] = {};
@@ -32,13 +74,39 @@ protected:
 	
 	GPUBuffer m_VertexBuffer;
 	GPUBuffer m_IndexBuffer;
+	// 16-bit whenever every range's vertices fit, one draw per range of the level drawn
+	VkIndexType m_IndexType = VK_INDEX_TYPE_UINT32;
+	std::vector<IndexRange> m_IndexRanges;
+	uint32_t m_NumLods = 1;
+	uint32_t m_RangesPerLod = 1;
+	// object space error of every level, see MeshSimplifier::Simplify
+	float m_LodErrors[MaxMeshLods] = {};
+	// per index range, the draw of every meshlet and their bounds four at a time
+	std::vector<MeshletSpan> m_MeshletSpans;
+	std::vector<IndexRange> m_MeshletDraws;
+	std::vector<MeshletBounds4> m_MeshletBounds;
+	// CompactVertex when the mesh quantizes within VertexQuantizer's bounds and the
+	// renderer has the compact pipeline, the offset and scale go to the MVP buffer
+	VertexFormat m_VertexFormat = VERTEX_FORMAT_FLOAT;
+	glm::vec4 m_PositionOffset = glm::vec4(0.0f);
+	glm::vec4 m_PositionScale = glm::vec4(1.0f);
 
 	VkDescriptorSet* m_VertexDescSet;
 	VkDescriptorSet* m_FragmentDescSet;
 	
 	GPUUniformBuffer m_VertexUBO;
 	GPUUniformBuffer m_FragmentUBO;
-	GPUImage m_TextureImage;
+	TextureCache::Handle m_Texture = nullptr;
+	// view each frame's descriptor set points at, a streamed texture's view changes as levels come and go
+	mutable std::vector<VkImageView> m_BoundTextureViews;
+	// set when the texture is sampled from the virtual texture, m_Texture is the fallback
+	// until its pages are in and isn't streamed
+	VirtualTexture::Texture* m_VirtualTexture = nullptr;
+
+	// the sphere for level of detail and texture streaming, the box for culling
+	MeshBounds m_Bounds;
+	// texture coordinate units per world unit, for texture streaming
+	float m_UVDensity = 0.0f;
 
 	uint8_t m_ThreadId = 0;
 };
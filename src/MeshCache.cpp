@@ -0,0 +1,381 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "ImportedScene.h"
+#include "Logger.h"
+
+namespace
+{
+	constexpr uint64_t BlobAlignment = 16;
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	bool RangeInFile(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+	{
+		if (offset > fileSize) return false;
+		if (elementSize != 0 && count > (fileSize - offset) / elementSize) return false;
+		return true;
+	}
+
+	void WritePadding(std::ofstream& file, uint64_t targetOffset)
+	{
+		static const char zeros[BlobAlignment] = {};
+		uint64_t current = static_cast<uint64_t>(file.tellp());
+		if (targetOffset > current)
+		{
+			file.write(zeros, static_cast<std::streamsize>(targetOffset - current));
+		}
+	}
+}
+
+std::string MeshCache::GetCachePath(const char* sourcePath)
+{
+	return std::string(sourcePath) + ".meshcache";
+}
+
+uint64_t MeshCache::Hash(const void* data, uint64_t size, uint64_t seed)
+{
+	// FNV-1a over 8 byte words, the tail is folded in byte by byte.
+	constexpr uint64_t prime = 1099511628211ull;
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+
+	uint64_t wordCount = size / sizeof(uint64_t);
+	for (uint64_t i = 0; i < wordCount; i++)
+	{
+		uint64_t word;
+		memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(word));
+		hash = (hash ^ word) * prime;
+	}
+	for (uint64_t i = wordCount * sizeof(uint64_t); i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * prime;
+	}
+
+	return (hash ^ size) * prime;
+}
+
+bool MeshCache::HashFile(const char* path, uint64_t& hash)
+{
+	MappedFile file(path);
+	if (!file.IsOpen())
+	{
+		return false;
+	}
+
+	hash = Hash(file.GetData(), file.GetSize());
+	return true;
+}
+
+bool MeshCache::Load(const char* cachePath, uint64_t sourceHash, uint32_t importFlags, MappedFile& mapping, ImportedScene& scene)
+{
+	if (!mapping.Open(cachePath))
+	{
+		return false;
+	}
+
+	const uint8_t* data = mapping.GetData();
+	const uint64_t size = mapping.GetSize();
+
+	if (size < sizeof(Header))
+	{
+		mapping.Close();
+		return false;
+	}
+
+	const Header& header = *reinterpret_cast<const Header*>(data);
+
+	if (header.magic != Magic || header.version != Version)
+	{
+		Logger::Info("Mesh cache %s has an incompatible version, re-importing.\n", cachePath);
+		mapping.Close();
+		return false;
+	}
+
+	if (header.sourceHash != sourceHash || header.importFlags != importFlags)
+	{
+		Logger::Info("Mesh cache %s is out of date, re-importing.\n", cachePath);
+		mapping.Close();
+		return false;
+	}
+
+	bool valid =
+		RangeInFile(header.meshOffset, header.numMeshes, sizeof(MeshEntry), size) &&
+		RangeInFile(header.materialOffset, header.numMaterials, sizeof(MaterialEntry), size) &&
+		RangeInFile(header.nodeOffset, header.numNodes, sizeof(NodeEntry), size) &&
+		RangeInFile(header.nodeMeshOffset, header.numNodeMeshes, sizeof(uint32_t), size) &&
+		RangeInFile(header.vertexOffset, header.numVertices, sizeof(Vertex), size) &&
+		RangeInFile(header.indexOffset, header.numIndices, sizeof(uint32_t), size) &&
+		RangeInFile(header.stringOffset, header.stringBytes, 1, size) &&
+		RangeInFile(header.indexRangeOffset, header.numIndexRanges, sizeof(IndexRange), size) &&
+		RangeInFile(header.meshletOffset, header.numMeshlets, sizeof(Meshlet), size) &&
+		header.numNodes > 0 &&
+		(header.stringBytes == 0 || data[header.stringOffset + header.stringBytes - 1] == '\0');
+
+	if (!valid)
+	{
+		Logger::Error("Mesh cache %s is corrupted, re-importing.\n", cachePath);
+		mapping.Close();
+		return false;
+	}
+
+	const MeshEntry* meshes = reinterpret_cast<const MeshEntry*>(data + header.meshOffset);
+	const MaterialEntry* materials = reinterpret_cast<const MaterialEntry*>(data + header.materialOffset);
+	const NodeEntry* nodes = reinterpret_cast<const NodeEntry*>(data + header.nodeOffset);
+	const uint32_t* nodeMeshes = reinterpret_cast<const uint32_t*>(data + header.nodeMeshOffset);
+	const Vertex* vertices = reinterpret_cast<const Vertex*>(data + header.vertexOffset);
+	const uint32_t* indices = reinterpret_cast<const uint32_t*>(data + header.indexOffset);
+	const char* strings = reinterpret_cast<const char*>(data + header.stringOffset);
+	const IndexRange* indexRanges = reinterpret_cast<const IndexRange*>(data + header.indexRangeOffset);
+	const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(data + header.meshletOffset);
+
+	scene.meshes.resize(header.numMeshes);
+	for (uint32_t i = 0; i < header.numMeshes; i++)
+	{
+		const MeshEntry& entry = meshes[i];
+		if (entry.firstVertex + entry.numVertices > header.numVertices ||
+			entry.firstIndex + entry.numIndices > header.numIndices ||
+			entry.materialIndex >= header.numMaterials ||
+			(uint64_t)entry.firstIndexRange + entry.numIndexRanges > header.numIndexRanges ||
+			entry.numLods == 0 || entry.numLods > MaxMeshLods ||
+			(entry.numLods > 1 && (entry.numIndexRanges == 0 || entry.numIndexRanges % entry.numLods != 0)) ||
+			(uint64_t)entry.firstMeshlet + entry.numMeshlets > header.numMeshlets)
+		{
+			Logger::Error("Mesh cache %s has an invalid mesh entry, re-importing.\n", cachePath);
+			scene = ImportedScene();
+			mapping.Close();
+			return false;
+		}
+
+		ImportedMesh& mesh = scene.meshes[i];
+		mesh.vertices = vertices + entry.firstVertex;
+		mesh.numVertices = entry.numVertices;
+		mesh.indices = indices + entry.firstIndex;
+		mesh.numIndices = entry.numIndices;
+		mesh.materialIndex = entry.materialIndex;
+		mesh.firstIndexRange = entry.firstIndexRange;
+		mesh.numIndexRanges = entry.numIndexRanges;
+		mesh.numLods = entry.numLods;
+		std::copy(entry.lodErrors, entry.lodErrors + MaxMeshLods, mesh.lodErrors);
+
+		for (uint32_t j = 0; j < entry.numIndexRanges; j++)
+		{
+			const IndexRange& range = indexRanges[entry.firstIndexRange + j];
+			if ((uint64_t)range.firstIndex + range.numIndices > entry.numIndices ||
+				range.vertexOffset < 0 || (uint32_t)range.vertexOffset >= entry.numVertices)
+			{
+				Logger::Error("Mesh cache %s has an invalid index range, re-importing.\n", cachePath);
+				scene = ImportedScene();
+				mapping.Close();
+				return false;
+			}
+		}
+
+		mesh.firstMeshlet = entry.firstMeshlet;
+		mesh.numMeshlets = entry.numMeshlets;
+		mesh.bounds = entry.bounds;
+		for (uint32_t j = 0; j < entry.numMeshlets; j++)
+		{
+			const Meshlet& meshlet = meshlets[entry.firstMeshlet + j];
+			if ((uint64_t)meshlet.firstIndex + meshlet.numIndices > entry.numIndices)
+			{
+				Logger::Error("Mesh cache %s has an invalid meshlet, re-importing.\n", cachePath);
+				scene = ImportedScene();
+				mapping.Close();
+				return false;
+			}
+		}
+	}
+	scene.indexRanges.assign(indexRanges, indexRanges + header.numIndexRanges);
+	scene.meshlets.assign(meshlets, meshlets + header.numMeshlets);
+
+	scene.materials.resize(header.numMaterials);
+	for (uint32_t i = 0; i < header.numMaterials; i++)
+	{
+		uint32_t offset = materials[i].diffuseTexture;
+		if (offset != NoString && offset < header.stringBytes)
+		{
+			scene.materials[i].diffuseTexture = strings + offset;
+		}
+	}
+
+	scene.nodes.resize(header.numNodes);
+	for (uint32_t i = 0; i < header.numNodes; i++)
+	{
+		if ((uint64_t)nodes[i].firstMesh + nodes[i].numMeshes > header.numNodeMeshes)
+		{
+			Logger::Error("Mesh cache %s has an invalid node entry, re-importing.\n", cachePath);
+			scene = ImportedScene();
+			mapping.Close();
+			return false;
+		}
+
+		scene.nodes[i].transform = nodes[i].transform;
+		scene.nodes[i].firstMesh = nodes[i].firstMesh;
+		scene.nodes[i].numMeshes = nodes[i].numMeshes;
+		scene.nodes[i].numChildren = nodes[i].numChildren;
+	}
+
+	scene.nodeMeshes.assign(nodeMeshes, nodeMeshes + header.numNodeMeshes);
+	scene.cacheStats.acmrBefore = header.acmrBefore;
+	scene.cacheStats.acmrAfter = header.acmrAfter;
+	scene.cacheStats.atvrBefore = header.atvrBefore;
+	scene.cacheStats.atvrAfter = header.atvrAfter;
+	for (uint32_t meshIndex : scene.nodeMeshes)
+	{
+		if (meshIndex >= header.numMeshes)
+		{
+			Logger::Error("Mesh cache %s references a missing mesh, re-importing.\n", cachePath);
+			scene = ImportedScene();
+			mapping.Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool MeshCache::Write(const char* cachePath, uint64_t sourceHash, uint32_t importFlags, const ImportedScene& scene)
+{
+	std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		Logger::Error("Failed to create mesh cache %s\n", cachePath);
+		return false;
+	}
+
+	Header header{};
+	header.version = Version;
+	header.sourceHash = sourceHash;
+	header.importFlags = importFlags;
+	header.numMeshes = static_cast<uint32_t>(scene.meshes.size());
+	header.numMaterials = static_cast<uint32_t>(scene.materials.size());
+	header.numNodes = static_cast<uint32_t>(scene.nodes.size());
+	header.numNodeMeshes = static_cast<uint32_t>(scene.nodeMeshes.size());
+	header.numIndexRanges = static_cast<uint32_t>(scene.indexRanges.size());
+	header.numMeshlets = static_cast<uint32_t>(scene.meshlets.size());
+	header.acmrBefore = scene.cacheStats.acmrBefore;
+	header.acmrAfter = scene.cacheStats.acmrAfter;
+	header.atvrBefore = scene.cacheStats.atvrBefore;
+	header.atvrAfter = scene.cacheStats.atvrAfter;
+
+	std::vector<MeshEntry> meshEntries(scene.meshes.size());
+	for (size_t i = 0; i < scene.meshes.size(); i++)
+	{
+		const ImportedMesh& mesh = scene.meshes[i];
+		meshEntries[i].firstVertex = header.numVertices;
+		meshEntries[i].firstIndex = header.numIndices;
+		meshEntries[i].numVertices = mesh.numVertices;
+		meshEntries[i].numIndices = mesh.numIndices;
+		meshEntries[i].materialIndex = mesh.materialIndex;
+		meshEntries[i].firstIndexRange = mesh.firstIndexRange;
+		meshEntries[i].numIndexRanges = mesh.numIndexRanges;
+		meshEntries[i].numLods = mesh.numLods;
+		std::copy(mesh.lodErrors, mesh.lodErrors + MaxMeshLods, meshEntries[i].lodErrors);
+		meshEntries[i].firstMeshlet = mesh.firstMeshlet;
+		meshEntries[i].numMeshlets = mesh.numMeshlets;
+		meshEntries[i].bounds = mesh.bounds;
+		header.numVertices += mesh.numVertices;
+		header.numIndices += mesh.numIndices;
+	}
+
+	std::string strings;
+	std::vector<MaterialEntry> materialEntries(scene.materials.size());
+	for (size_t i = 0; i < scene.materials.size(); i++)
+	{
+		const char* texture = scene.materials[i].diffuseTexture;
+		if (texture)
+		{
+			materialEntries[i].diffuseTexture = static_cast<uint32_t>(strings.size());
+			strings.append(texture);
+			strings.push_back('\0');
+		}
+		else
+		{
+			materialEntries[i].diffuseTexture = NoString;
+		}
+	}
+	header.stringBytes = strings.size();
+
+	std::vector<NodeEntry> nodeEntries(scene.nodes.size());
+	for (size_t i = 0; i < scene.nodes.size(); i++)
+	{
+		nodeEntries[i].transform = scene.nodes[i].transform;
+		nodeEntries[i].firstMesh = scene.nodes[i].firstMesh;
+		nodeEntries[i].numMeshes = scene.nodes[i].numMeshes;
+		nodeEntries[i].numChildren = scene.nodes[i].numChildren;
+		nodeEntries[i].reserved = 0;
+	}
+
+	uint64_t offset = AlignUp(sizeof(Header), BlobAlignment);
+	header.meshOffset = offset;
+	offset = AlignUp(offset + meshEntries.size() * sizeof(MeshEntry), BlobAlignment);
+	header.materialOffset = offset;
+	offset = AlignUp(offset + materialEntries.size() * sizeof(MaterialEntry), BlobAlignment);
+	header.nodeOffset = offset;
+	offset = AlignUp(offset + nodeEntries.size() * sizeof(NodeEntry), BlobAlignment);
+	header.nodeMeshOffset = offset;
+	offset = AlignUp(offset + scene.nodeMeshes.size() * sizeof(uint32_t), BlobAlignment);
+	header.vertexOffset = offset;
+	offset = AlignUp(offset + header.numVertices * sizeof(Vertex), BlobAlignment);
+	header.indexOffset = offset;
+	offset = AlignUp(offset + header.numIndices * sizeof(uint32_t), BlobAlignment);
+	header.indexRangeOffset = offset;
+	offset = AlignUp(offset + scene.indexRanges.size() * sizeof(IndexRange), BlobAlignment);
+	header.meshletOffset = offset;
+	offset = AlignUp(offset + scene.meshlets.size() * sizeof(Meshlet), BlobAlignment);
+	header.stringOffset = offset;
+
+	// The magic is written last so an interrupted write never produces a cache that validates.
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	WritePadding(file, header.meshOffset);
+	file.write(reinterpret_cast<const char*>(meshEntries.data()), meshEntries.size() * sizeof(MeshEntry));
+	WritePadding(file, header.materialOffset);
+	file.write(reinterpret_cast<const char*>(materialEntries.data()), materialEntries.size() * sizeof(MaterialEntry));
+	WritePadding(file, header.nodeOffset);
+	file.write(reinterpret_cast<const char*>(nodeEntries.data()), nodeEntries.size() * sizeof(NodeEntry));
+	WritePadding(file, header.nodeMeshOffset);
+	file.write(reinterpret_cast<const char*>(scene.nodeMeshes.data()), scene.nodeMeshes.size() * sizeof(uint32_t));
+
+	WritePadding(file, header.vertexOffset);
+	for (const ImportedMesh& mesh : scene.meshes)
+	{
+		file.write(reinterpret_cast<const char*>(mesh.vertices), mesh.numVertices * sizeof(Vertex));
+	}
+
+	WritePadding(file, header.indexOffset);
+	for (const ImportedMesh& mesh : scene.meshes)
+	{
+		file.write(reinterpret_cast<const char*>(mesh.indices), mesh.numIndices * sizeof(uint32_t));
+	}
+
+	WritePadding(file, header.indexRangeOffset);
+	file.write(reinterpret_cast<const char*>(scene.indexRanges.data()), scene.indexRanges.size() * sizeof(IndexRange));
+	WritePadding(file, header.meshletOffset);
+	file.write(reinterpret_cast<const char*>(scene.meshlets.data()), scene.meshlets.size() * sizeof(Meshlet));
+
+	WritePadding(file, header.stringOffset);
+	file.write(strings.data(), strings.size());
+
+	header.magic = Magic;
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header.magic), sizeof(header.magic));
+
+	if (!file.good())
+	{
+		Logger::Error("Failed to write mesh cache %s\n", cachePath);
+		file.close();
+		std::remove(cachePath);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "MappedFile.h"
+#include "VkStructs.h"
+
+struct ImportedScene;
+
+// Versioned binary snapshot of an imported model. The file is laid out so that
+// vertex and index blobs can be handed to the GPU upload straight from the mapping.
+class MeshCache
+{
+public:
+	static constexpr uint32_t Magic = 0x48534D53; // "SMSH"
+	static constexpr uint32_t Version = 7;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		// of the source file, an OBJ's material libraries are folded in
+		uint64_t sourceHash;
+		uint32_t importFlags;
+		uint32_t numMeshes;
+		uint32_t numMaterials;
+		uint32_t numNodes;
+		uint32_t numNodeMeshes;
+		uint32_t numIndexRanges;
+		// ImportedCacheStats of the optimized meshes
+		float acmrBefore;
+		float acmrAfter;
+		float atvrBefore;
+		float atvrAfter;
+		uint32_t numMeshlets;
+		uint32_t reserved;
+		uint64_t numVertices;
+		uint64_t numIndices;
+		uint64_t stringBytes;
+		uint64_t meshOffset;
+		uint64_t materialOffset;
+		uint64_t nodeOffset;
+		uint64_t nodeMeshOffset;
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		uint64_t stringOffset;
+		uint64_t indexRangeOffset;
+		uint64_t meshletOffset;
+	};
+
+	struct MeshEntry
+	{
+		uint64_t firstVertex;
+		uint64_t firstIndex;
+		uint32_t numVertices;
+		uint32_t numIndices;
+		uint32_t materialIndex;
+		uint32_t firstIndexRange;
+		uint32_t numIndexRanges;
+		uint32_t numLods;
+		float lodErrors[MaxMeshLods];
+		uint32_t firstMeshlet;
+		uint32_t numMeshlets;
+		MeshBounds bounds;
+	};
+
+	struct MaterialEntry
+	{
+		// offset into the string blob, NoString when there is no diffuse map
+		uint32_t diffuseTexture;
+	};
+
+	struct NodeEntry
+	{
+		glm::mat4 transform;
+		uint32_t firstMesh;
+		uint32_t numMeshes;
+		uint32_t numChildren;
+		uint32_t reserved;
+	};
+
+	static constexpr uint32_t NoString = UINT32_MAX;
+
+public:
+	static std::string GetCachePath(const char* sourcePath);
+	static bool HashFile(const char* path, uint64_t& hash);
+	static uint64_t Hash(const void* data, uint64_t size, uint64_t seed = 14695981039346656037ull);
+
+	// Maps the cache and fills scene with views into it. The mapping must outlive the scene's use.
+	static bool Load(const char* cachePath, uint64_t sourceHash, uint32_t importFlags, MappedFile& mapping, ImportedScene& scene);
+	static bool Write(const char* cachePath, uint64_t sourceHash, uint32_t importFlags, const ImportedScene& scene);
+};
@@ -0,0 +1,807 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "ImportedScene.h"
+#include "JobSystem.h"
+
+namespace
+{
+	constexpr uint32_t NoVertex = UINT32_MAX;
+
+	// FIFO cache with timestamps instead of a queue: every miss advances the clock
+	// and a vertex is still cached while fewer than cacheSize misses came after it.
+	class CacheSimulator
+	{
+	public:
+		CacheSimulator(uint32_t numVertices, uint32_t cacheSize)
+			: m_LoadedAt(numVertices, 0), m_Clock(cacheSize + 1), m_CacheSize(cacheSize)
+		{
+		}
+
+		// 1 on a miss, 0 on a hit
+		uint32_t Access(uint32_t vertex)
+		{
+			if (m_Clock - m_LoadedAt[vertex] <= m_CacheSize)
+			{
+				return 0;
+			}
+			m_LoadedAt[vertex] = m_Clock++;
+			return 1;
+		}
+
+		uint32_t AccessTriangle(const uint32_t* triangle)
+		{
+			return Access(triangle[0]) + Access(triangle[1]) + Access(triangle[2]);
+		}
+
+		void Flush()
+		{
+			m_Clock += m_CacheSize;
+		}
+
+	private:
+		std::vector<uint32_t> m_LoadedAt;
+		uint32_t m_Clock;
+		uint32_t m_CacheSize;
+	};
+
+	uint32_t FindNextFan(const std::vector<uint32_t>& candidates, std::vector<uint32_t>& deadEnd, const std::vector<uint32_t>& live,
+		const std::vector<uint32_t>& cacheTime, uint32_t time, uint32_t cacheSize, uint32_t& scan)
+	{
+		// the candidate that stays longest in the cache while its remaining triangles
+		// are emitted, vertices that would drop out on the way rank lowest
+		uint32_t best = NoVertex;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (live[vertex] == 0)
+			{
+				continue;
+			}
+
+			int64_t priority = 0;
+			uint32_t age = time - cacheTime[vertex];
+			if (age + 2 * live[vertex] <= cacheSize)
+			{
+				priority = age;
+			}
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = vertex;
+			}
+		}
+		if (best != NoVertex)
+		{
+			return best;
+		}
+
+		// dead end: back to the most recently used vertex that still has triangles
+		while (!deadEnd.empty())
+		{
+			uint32_t vertex = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[vertex] > 0)
+			{
+				return vertex;
+			}
+		}
+
+		while (scan < live.size() && live[scan] == 0)
+		{
+			scan++;
+		}
+		return scan < live.size() ? scan : NoVertex;
+	}
+
+	bool IsOwnedBy(const void* begin, const void* end, const void* data, size_t bytes)
+	{
+		uintptr_t address = reinterpret_cast<uintptr_t>(data);
+		return address >= reinterpret_cast<uintptr_t>(begin) && address + bytes <= reinterpret_cast<uintptr_t>(end);
+	}
+}
+
+MeshBounds MeshOptimizer::ComputeBounds(const Vertex* vertices, uint32_t numVertices)
+{
+	MeshBounds bounds;
+	if (numVertices == 0)
+	{
+		return bounds;
+	}
+
+	bounds.minimum = vertices[0].pos;
+	bounds.maximum = vertices[0].pos;
+	for (uint32_t i = 1; i < numVertices; i++)
+	{
+		bounds.minimum = glm::min(bounds.minimum, vertices[i].pos);
+		bounds.maximum = glm::max(bounds.maximum, vertices[i].pos);
+	}
+
+	bounds.center = (bounds.minimum + bounds.maximum) * 0.5f;
+	float radiusSquared = 0.0f;
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		const glm::vec3 offset = vertices[i].pos - bounds.center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	bounds.radius = std::sqrt(radiusSquared);
+	return bounds;
+}
+
+void MeshOptimizer::CountCacheMisses(const uint32_t* indices, uint32_t numIndices, uint32_t numVertices, uint32_t cacheSize, uint32_t& misses, uint32_t& usedVertices)
+{
+	CacheSimulator cache(numVertices, cacheSize);
+	std::vector<bool> used(numVertices, false);
+
+	misses = 0;
+	usedVertices = 0;
+	for (uint32_t i = 0; i < numIndices; i++)
+	{
+		misses += cache.Access(indices[i]);
+		if (!used[indices[i]])
+		{
+			used[indices[i]] = true;
+			usedVertices++;
+		}
+	}
+}
+
+void MeshOptimizer::OptimizeVertexCache(uint32_t* indices, uint32_t numIndices, uint32_t numVertices, uint32_t cacheSize)
+{
+	// Tipsify (Sander, Nehab, Barczak: Fast Triangle Reordering for Vertex Locality
+	// and Reduced Overdraw). Emits all remaining triangles around a fan vertex, then
+	// moves on to a vertex of those triangles that is still in the cache.
+	const uint32_t numTriangles = numIndices / 3;
+	if (numTriangles == 0 || numVertices == 0)
+	{
+		return;
+	}
+
+	const std::vector<uint32_t> source(indices, indices + numTriangles * 3);
+
+	// triangles around every vertex
+	std::vector<uint32_t> live(numVertices, 0);
+	for (uint32_t index : source)
+	{
+		live[index]++;
+	}
+	std::vector<uint32_t> offsets(numVertices + 1, 0);
+	for (uint32_t vertex = 0; vertex < numVertices; vertex++)
+	{
+		offsets[vertex + 1] = offsets[vertex] + live[vertex];
+	}
+	std::vector<uint32_t> adjacency(source.size());
+	{
+		std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i = 0; i < source.size(); i++)
+		{
+			adjacency[cursor[source[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<uint32_t> cacheTime(numVertices, 0);
+	std::vector<bool> emitted(numTriangles, false);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	deadEnd.reserve(source.size());
+
+	uint32_t time = cacheSize + 1;
+	uint32_t scan = 0;
+	uint32_t written = 0;
+	uint32_t fan = FindNextFan(candidates, deadEnd, live, cacheTime, time, cacheSize, scan);
+
+	while (fan != NoVertex)
+	{
+		candidates.clear();
+		for (uint32_t i = offsets[fan]; i < offsets[fan + 1]; i++)
+		{
+			uint32_t triangle = adjacency[i];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+			emitted[triangle] = true;
+
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				uint32_t vertex = source[triangle * 3 + corner];
+				indices[written++] = vertex;
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				live[vertex]--;
+				if (time - cacheTime[vertex] > cacheSize)
+				{
+					cacheTime[vertex] = time++;
+				}
+			}
+		}
+
+		fan = FindNextFan(candidates, deadEnd, live, cacheTime, time, cacheSize, scan);
+	}
+}
+
+void MeshOptimizer::OptimizeOverdraw(uint32_t* indices, uint32_t numIndices, const Vertex* vertices, uint32_t numVertices, uint32_t cacheSize, float threshold)
+{
+	const uint32_t numTriangles = numIndices / 3;
+	if (numTriangles < 2 || numVertices == 0)
+	{
+		return;
+	}
+
+	CacheSimulator cache(numVertices, cacheSize);
+
+	// hard boundaries: where the cache order starts over, all corners of a triangle miss
+	std::vector<uint32_t> hardClusters;
+	for (uint32_t triangle = 0; triangle < numTriangles; triangle++)
+	{
+		uint32_t misses = cache.AccessTriangle(indices + triangle * 3);
+		if (misses == 3 || triangle == 0)
+		{
+			hardClusters.push_back(triangle);
+		}
+	}
+	hardClusters.push_back(numTriangles);
+
+	// soft boundaries: a hard cluster is cut wherever the part before the cut, drawn
+	// on its own from a cold cache, is within threshold of the whole cluster's ACMR
+	std::vector<uint32_t> clusters;
+	for (size_t i = 0; i + 1 < hardClusters.size(); i++)
+	{
+		const uint32_t begin = hardClusters[i];
+		const uint32_t end = hardClusters[i + 1];
+
+		cache.Flush();
+		uint32_t clusterMisses = 0;
+		for (uint32_t triangle = begin; triangle < end; triangle++)
+		{
+			clusterMisses += cache.AccessTriangle(indices + triangle * 3);
+		}
+		const float limit = threshold * clusterMisses / float(end - begin);
+
+		cache.Flush();
+		uint32_t start = begin;
+		uint32_t misses = 0;
+		clusters.push_back(begin);
+		for (uint32_t triangle = begin; triangle + 1 < end; triangle++)
+		{
+			misses += cache.AccessTriangle(indices + triangle * 3);
+			if (misses <= limit * (triangle - start + 1))
+			{
+				start = triangle + 1;
+				misses = 0;
+				clusters.push_back(start);
+				cache.Flush();
+			}
+		}
+	}
+	clusters.push_back(numTriangles);
+
+	const uint32_t numClusters = (uint32_t)clusters.size() - 1;
+
+	// Clusters facing away from the mesh's center are likely in front of the rest
+	// and go first. Vertex normals keep this independent of the winding.
+	glm::vec3 meshCenter(0.0f);
+	for (uint32_t vertex = 0; vertex < numVertices; vertex++)
+	{
+		meshCenter += vertices[vertex].pos;
+	}
+	meshCenter /= float(numVertices);
+
+	std::vector<float> sortKeys(numClusters);
+	for (uint32_t cluster = 0; cluster < numClusters; cluster++)
+	{
+		glm::vec3 center(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+		for (uint32_t triangle = clusters[cluster]; triangle < clusters[cluster + 1]; triangle++)
+		{
+			const Vertex& a = vertices[indices[triangle * 3 + 0]];
+			const Vertex& b = vertices[indices[triangle * 3 + 1]];
+			const Vertex& c = vertices[indices[triangle * 3 + 2]];
+
+			float triangleArea = glm::length(glm::cross(b.pos - a.pos, c.pos - a.pos)) * 0.5f;
+			center += (a.pos + b.pos + c.pos) * (triangleArea / 3.0f);
+			normal += (a.normal + b.normal + c.normal) * triangleArea;
+			area += triangleArea;
+		}
+
+		float normalLength = glm::length(normal);
+		if (area <= 0.0f || normalLength <= 0.0f)
+		{
+			sortKeys[cluster] = 0.0f;
+			continue;
+		}
+		sortKeys[cluster] = glm::dot(center / area - meshCenter, normal / normalLength);
+	}
+
+	std::vector<uint32_t> order(numClusters);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b)
+	{
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	const std::vector<uint32_t> source(indices, indices + numTriangles * 3);
+	uint32_t written = 0;
+	for (uint32_t cluster : order)
+	{
+		uint32_t first = clusters[cluster] * 3;
+		uint32_t last = clusters[cluster + 1] * 3;
+		std::copy(source.begin() + first, source.begin() + last, indices + written);
+		written += last - first;
+	}
+}
+
+uint32_t MeshOptimizer::OptimizeVertexFetch(Vertex* vertices, uint32_t* indices, uint32_t numIndices, uint32_t numVertices)
+{
+	std::vector<uint32_t> remap(numVertices, NoVertex);
+	uint32_t used = 0;
+	for (uint32_t i = 0; i < numIndices; i++)
+	{
+		uint32_t& target = remap[indices[i]];
+		if (target == NoVertex)
+		{
+			target = used++;
+		}
+		indices[i] = target;
+	}
+
+	const std::vector<Vertex> source(vertices, vertices + numVertices);
+	for (uint32_t vertex = 0; vertex < numVertices; vertex++)
+	{
+		if (remap[vertex] != NoVertex)
+		{
+			vertices[remap[vertex]] = source[vertex];
+		}
+	}
+
+	return used;
+}
+
+void MeshOptimizer::SplitIndexRanges(const Vertex* vertices, uint32_t numVertices, uint32_t* indices, uint32_t numIndices,
+	std::vector<Vertex>& splitVertices, std::vector<IndexRange>& ranges)
+{
+	splitVertices.clear();
+	ranges.clear();
+
+	// the range a vertex was last copied into and its index there
+	std::vector<uint32_t> owner(numVertices, NoVertex);
+	std::vector<uint32_t> local(numVertices, 0);
+
+	IndexRange range = { 0, 0, 0 };
+	uint32_t rangeId = 0;
+	uint32_t used = 0;
+	for (uint32_t i = 0; i + 2 < numIndices; i += 3)
+	{
+		uint32_t missing = 0;
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			missing += owner[indices[i + corner]] != rangeId ? 1 : 0;
+		}
+		if (used + missing > IndexRange::MaxVertices)
+		{
+			range.numIndices = i - range.firstIndex;
+			ranges.push_back(range);
+			range = { i, 0, (int32_t)splitVertices.size() };
+			rangeId++;
+			used = 0;
+		}
+
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			uint32_t vertex = indices[i + corner];
+			if (owner[vertex] != rangeId)
+			{
+				owner[vertex] = rangeId;
+				local[vertex] = used++;
+				splitVertices.push_back(vertices[vertex]);
+			}
+			indices[i + corner] = local[vertex];
+		}
+	}
+	range.numIndices = numIndices - range.firstIndex;
+	ranges.push_back(range);
+}
+
+void MeshOptimizer::BuildMeshlets(const Vertex* vertices, const uint32_t* indices, uint32_t firstIndex, uint32_t numIndices,
+	std::vector<Meshlet>& meshlets)
+{
+	const uint32_t* span = indices + firstIndex;
+	numIndices -= numIndices % 3;
+	if (numIndices == 0)
+	{
+		return;
+	}
+
+	// the meshlet that last used every vertex
+	const uint32_t maxIndex = *std::max_element(span, span + numIndices);
+	std::vector<uint32_t> usedBy(maxIndex + 1, UINT32_MAX);
+
+	auto finish = [&](Meshlet& meshlet)
+	{
+		const uint32_t* meshletIndices = indices + meshlet.firstIndex;
+
+		glm::vec3 minimum = vertices[meshletIndices[0]].pos;
+		glm::vec3 maximum = minimum;
+		for (uint32_t i = 1; i < meshlet.numIndices; i++)
+		{
+			minimum = glm::min(minimum, vertices[meshletIndices[i]].pos);
+			maximum = glm::max(maximum, vertices[meshletIndices[i]].pos);
+		}
+		meshlet.center = (minimum + maximum) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (uint32_t i = 0; i < meshlet.numIndices; i++)
+		{
+			meshlet.radius = std::max(meshlet.radius, glm::length(vertices[meshletIndices[i]].pos - meshlet.center));
+		}
+
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet.numIndices / 3);
+		glm::vec3 axis(0.0f);
+		for (uint32_t i = 0; i < meshlet.numIndices; i += 3)
+		{
+			const glm::vec3& a = vertices[meshletIndices[i]].pos;
+			glm::vec3 normal = glm::cross(vertices[meshletIndices[i + 1]].pos - a, vertices[meshletIndices[i + 2]].pos - a);
+			const float length = glm::length(normal);
+			if (length > 0.0f)
+			{
+				normals.push_back(normal / length);
+				axis += normals.back();
+			}
+		}
+
+		// the spread is from the average normal, near a hemisphere the cone never culls anything
+		meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCutoff = 1.0f;
+		const float axisLength = glm::length(axis);
+		if (axisLength > 0.0f)
+		{
+			meshlet.coneAxis = axis / axisLength;
+			float minDot = 1.0f;
+			for (const glm::vec3& normal : normals)
+			{
+				minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+			}
+			if (minDot > 0.1f)
+			{
+				meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+			}
+		}
+		meshlets.push_back(meshlet);
+	};
+
+	Meshlet meshlet{};
+	meshlet.firstIndex = firstIndex;
+	uint32_t meshletId = (uint32_t)meshlets.size();
+	uint32_t numVertices = 0;
+	for (uint32_t i = 0; i < numIndices; i += 3)
+	{
+		const uint32_t a = span[i], b = span[i + 1], c = span[i + 2];
+		uint32_t newVertices = (usedBy[a] != meshletId) + (usedBy[b] != meshletId && b != a) + (usedBy[c] != meshletId && c != a && c != b);
+		if (numVertices + newVertices > Meshlet::MaxVertices || meshlet.numIndices == Meshlet::MaxTriangles * 3)
+		{
+			finish(meshlet);
+			meshlet.firstIndex = firstIndex + i;
+			meshlet.numIndices = 0;
+			meshletId++;
+			numVertices = 0;
+			newVertices = 1 + (b != a) + (c != a && c != b);
+		}
+
+		usedBy[a] = usedBy[b] = usedBy[c] = meshletId;
+		numVertices += newVertices;
+		meshlet.numIndices += 3;
+	}
+	finish(meshlet);
+}
+
+uint32_t MeshOptimizer::GenerateLods(const Vertex* vertices, uint32_t numVertices, std::vector<uint32_t>& indices,
+	std::vector<IndexRange>& ranges, const Settings& settings, float* lodErrors)
+{
+	const uint32_t rangesPerLevel = (uint32_t)ranges.size();
+	const uint32_t maxLevels = std::min(settings.lodLevels, MaxMeshLods);
+	lodErrors[0] = 0.0f;
+
+	// the ranges' vertices follow each other
+	std::vector<uint32_t> rangeVertices(rangesPerLevel);
+	for (uint32_t r = 0; r < rangesPerLevel; r++)
+	{
+		const uint32_t next = r + 1 < rangesPerLevel ? (uint32_t)ranges[r + 1].vertexOffset : numVertices;
+		rangeVertices[r] = next - (uint32_t)ranges[r].vertexOffset;
+	}
+
+	uint32_t numLods = 1;
+	std::vector<uint32_t> simplified;
+	for (uint32_t level = 1; level < maxLevels; level++)
+	{
+		const size_t previousFirst = (size_t)(level - 1) * rangesPerLevel;
+		uint64_t previousTriangles = 0;
+		for (uint32_t r = 0; r < rangesPerLevel; r++)
+		{
+			previousTriangles += ranges[previousFirst + r].numIndices / 3;
+		}
+		if (previousTriangles < settings.lodMinTriangles)
+		{
+			break;
+		}
+
+		const size_t indicesBefore = indices.size();
+		uint64_t triangles = 0;
+		float error = lodErrors[level - 1];
+		for (uint32_t r = 0; r < rangesPerLevel; r++)
+		{
+			const IndexRange previous = ranges[previousFirst + r];
+			const uint32_t target = (uint32_t)(previous.numIndices / 3 * settings.lodReduction) * 3;
+			const float rangeError = MeshSimplifier::Simplify(vertices + previous.vertexOffset, rangeVertices[r],
+				indices.data() + previous.firstIndex, previous.numIndices, target, settings.simplifier, simplified);
+
+			// a range that didn't get any simpler is drawn as it was
+			if (simplified.size() < previous.numIndices)
+			{
+				OptimizeVertexCache(simplified.data(), (uint32_t)simplified.size(), rangeVertices[r], settings.cacheSize);
+				ranges.push_back({ (uint32_t)indices.size(), (uint32_t)simplified.size(), previous.vertexOffset });
+				indices.insert(indices.end(), simplified.begin(), simplified.end());
+				error = std::max(error, rangeError);
+			}
+			else
+			{
+				ranges.push_back(previous);
+			}
+			triangles += ranges.back().numIndices / 3;
+		}
+
+		if (triangles > previousTriangles * settings.lodMaxRatio)
+		{
+			indices.resize(indicesBefore);
+			ranges.resize(previousFirst + rangesPerLevel);
+			break;
+		}
+		lodErrors[level] = error;
+		numLods++;
+	}
+
+	for (uint32_t level = numLods; level < MaxMeshLods; level++)
+	{
+		lodErrors[level] = lodErrors[numLods - 1];
+	}
+	return numLods;
+}
+
+void MeshOptimizer::Optimize(ImportedScene& scene, const Settings& settings)
+{
+	struct MeshResult
+	{
+		uint32_t missesBefore = 0;
+		uint32_t missesAfter = 0;
+		uint32_t vertices = 0;
+		uint32_t triangles = 0;
+		bool ownsIndices = false;
+		bool ownsVertices = false;
+		// the mesh's vertices once it's cut into index ranges, seams duplicated
+		std::vector<Vertex> splitVertices;
+		std::vector<IndexRange> ranges;
+		// the mesh's indices once levels of detail are appended
+		std::vector<uint32_t> lodIndices;
+		std::vector<Meshlet> meshlets;
+	};
+
+	const uint32_t numMeshes = (uint32_t)scene.meshes.size();
+	std::vector<MeshResult> results(numMeshes);
+
+	Vertex* vertexStorage = scene.vertexStorage.data();
+	uint32_t* indexStorage = scene.indexStorage.data();
+	const Vertex* vertexEnd = vertexStorage + scene.vertexStorage.size();
+	const uint32_t* indexEnd = indexStorage + scene.indexStorage.size();
+
+	JobSystem::Get()->ParallelFor(numMeshes, 1, [&](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			ImportedMesh& mesh = scene.meshes[i];
+			MeshResult& result = results[i];
+			result.ownsVertices = IsOwnedBy(vertexStorage, vertexEnd, mesh.vertices, mesh.numVertices * sizeof(Vertex));
+			result.ownsIndices = IsOwnedBy(indexStorage, indexEnd, mesh.indices, mesh.numIndices * sizeof(uint32_t));
+			if (mesh.numIndices < 3 || !result.ownsIndices)
+			{
+				mesh.bounds = ComputeBounds(mesh.vertices, mesh.numVertices);
+				continue;
+			}
+
+			uint32_t* indices = indexStorage + (mesh.indices - indexStorage);
+			mesh.numLods = 1;
+			std::fill(std::begin(mesh.lodErrors), std::end(mesh.lodErrors), 0.0f);
+			result.triangles = mesh.numIndices / 3;
+			CountCacheMisses(indices, mesh.numIndices, mesh.numVertices, settings.cacheSize, result.missesBefore, result.vertices);
+
+			OptimizeVertexCache(indices, mesh.numIndices, mesh.numVertices, settings.cacheSize);
+			OptimizeOverdraw(indices, mesh.numIndices, mesh.vertices, mesh.numVertices, settings.cacheSize, settings.overdrawThreshold);
+			// vertices read in place from a mapping keep their order, only the triangles move
+			if (result.ownsVertices)
+			{
+				Vertex* ownedVertices = vertexStorage + (mesh.vertices - vertexStorage);
+				// only the referenced vertices are left
+				mesh.numVertices = OptimizeVertexFetch(ownedVertices, indices, mesh.numIndices, mesh.numVertices);
+			}
+			const Vertex* vertices = mesh.vertices;
+			mesh.bounds = ComputeBounds(vertices, mesh.numVertices);
+
+			uint32_t usedVertices = 0;
+			CountCacheMisses(indices, mesh.numIndices, mesh.numVertices, settings.cacheSize, result.missesAfter, usedVertices);
+
+			if (settings.splitIndexRanges && mesh.numVertices > IndexRange::MaxVertices)
+			{
+				SplitIndexRanges(vertices, mesh.numVertices, indices, mesh.numIndices, result.splitVertices, result.ranges);
+			}
+
+			if (settings.lodLevels > 1)
+			{
+				const bool split = !result.ranges.empty();
+				std::vector<IndexRange> ranges = split ? result.ranges : std::vector<IndexRange>{ { 0, mesh.numIndices, 0 } };
+				std::vector<uint32_t> lodIndices(indices, indices + mesh.numIndices);
+				const uint32_t numLods = GenerateLods(split ? result.splitVertices.data() : vertices,
+					split ? (uint32_t)result.splitVertices.size() : mesh.numVertices, lodIndices, ranges, settings, mesh.lodErrors);
+				if (numLods > 1)
+				{
+					mesh.numLods = numLods;
+					result.ranges = std::move(ranges);
+					result.lodIndices = std::move(lodIndices);
+				}
+			}
+
+			if (settings.buildMeshlets)
+			{
+				// levels that didn't reduce a range share it, its meshlets are built once
+				std::vector<IndexRange> spans = result.ranges.empty() ? std::vector<IndexRange>{ { 0, mesh.numIndices, 0 } } : result.ranges;
+				std::sort(spans.begin(), spans.end(), [](const IndexRange& a, const IndexRange& b)
+				{
+					return a.firstIndex < b.firstIndex;
+				});
+				spans.erase(std::unique(spans.begin(), spans.end(), [](const IndexRange& a, const IndexRange& b)
+				{
+					return a.firstIndex == b.firstIndex;
+				}), spans.end());
+
+				const Vertex* meshVertices = result.splitVertices.empty() ? vertices : result.splitVertices.data();
+				const uint32_t* meshIndices = result.lodIndices.empty() ? indices : result.lodIndices.data();
+				for (const IndexRange& span : spans)
+				{
+					BuildMeshlets(meshVertices + span.vertexOffset, meshIndices, span.firstIndex, span.numIndices, result.meshlets);
+				}
+			}
+		}
+	});
+
+	scene.indexRanges.clear();
+	scene.meshlets.clear();
+	bool anySplit = false;
+	bool anyLods = false;
+	for (uint32_t i = 0; i < numMeshes; i++)
+	{
+		ImportedMesh& mesh = scene.meshes[i];
+		const std::vector<IndexRange>& ranges = results[i].ranges;
+		mesh.firstIndexRange = (uint32_t)scene.indexRanges.size();
+		mesh.numIndexRanges = (uint32_t)ranges.size();
+		scene.indexRanges.insert(scene.indexRanges.end(), ranges.begin(), ranges.end());
+		mesh.firstMeshlet = (uint32_t)scene.meshlets.size();
+		mesh.numMeshlets = (uint32_t)results[i].meshlets.size();
+		scene.meshlets.insert(scene.meshlets.end(), results[i].meshlets.begin(), results[i].meshlets.end());
+		anySplit |= !results[i].splitVertices.empty();
+		anyLods |= !results[i].lodIndices.empty();
+	}
+
+	// split meshes grew, the storage is rebuilt with every owned mesh's vertices in
+	// turn. Mapped meshes move into it only when they were split.
+	if (anySplit)
+	{
+		std::vector<uint8_t> stored(numMeshes, 0);
+		std::vector<size_t> offsets(numMeshes, 0);
+		size_t totalVertices = 0;
+		for (uint32_t i = 0; i < numMeshes; i++)
+		{
+			stored[i] = results[i].ownsVertices || !results[i].splitVertices.empty();
+			offsets[i] = totalVertices;
+			if (stored[i])
+			{
+				totalVertices += results[i].splitVertices.empty() ? scene.meshes[i].numVertices : results[i].splitVertices.size();
+			}
+		}
+
+		std::vector<Vertex> storage(totalVertices);
+		for (uint32_t i = 0; i < numMeshes; i++)
+		{
+			if (!stored[i])
+			{
+				continue;
+			}
+
+			ImportedMesh& mesh = scene.meshes[i];
+			if (!results[i].splitVertices.empty())
+			{
+				mesh.numVertices = (uint32_t)results[i].splitVertices.size();
+				std::copy(results[i].splitVertices.begin(), results[i].splitVertices.end(), storage.begin() + offsets[i]);
+			}
+			else
+			{
+				std::copy(mesh.vertices, mesh.vertices + mesh.numVertices, storage.begin() + offsets[i]);
+			}
+		}
+
+		scene.vertexStorage.swap(storage);
+		for (uint32_t i = 0; i < numMeshes; i++)
+		{
+			if (stored[i])
+			{
+				scene.meshes[i].vertices = scene.vertexStorage.data() + offsets[i];
+			}
+		}
+	}
+
+	// and the same for the indices of meshes with levels of detail
+	if (anyLods)
+	{
+		std::vector<size_t> offsets(numMeshes, 0);
+		size_t totalIndices = 0;
+		for (uint32_t i = 0; i < numMeshes; i++)
+		{
+			offsets[i] = totalIndices;
+			if (results[i].ownsIndices)
+			{
+				totalIndices += results[i].lodIndices.empty() ? scene.meshes[i].numIndices : results[i].lodIndices.size();
+			}
+		}
+
+		std::vector<uint32_t> storage(totalIndices);
+		for (uint32_t i = 0; i < numMeshes; i++)
+		{
+			if (!results[i].ownsIndices)
+			{
+				continue;
+			}
+
+			ImportedMesh& mesh = scene.meshes[i];
+			if (!results[i].lodIndices.empty())
+			{
+				mesh.numIndices = (uint32_t)results[i].lodIndices.size();
+				std::copy(results[i].lodIndices.begin(), results[i].lodIndices.end(), storage.begin() + offsets[i]);
+			}
+			else
+			{
+				std::copy(mesh.indices, mesh.indices + mesh.numIndices, storage.begin() + offsets[i]);
+			}
+		}
+
+		scene.indexStorage.swap(storage);
+		for (uint32_t i = 0; i < numMeshes; i++)
+		{
+			if (results[i].ownsIndices)
+			{
+				scene.meshes[i].indices = scene.indexStorage.data() + offsets[i];
+			}
+		}
+	}
+
+	uint64_t missesBefore = 0;
+	uint64_t missesAfter = 0;
+	uint64_t vertices = 0;
+	uint64_t triangles = 0;
+	for (const MeshResult& result : results)
+	{
+		missesBefore += result.missesBefore;
+		missesAfter += result.missesAfter;
+		vertices += result.vertices;
+		triangles += result.triangles;
+	}
+
+	scene.cacheStats = ImportedCacheStats();
+	if (triangles > 0)
+	{
+		scene.cacheStats.acmrBefore = float(double(missesBefore) / triangles);
+		scene.cacheStats.acmrAfter = float(double(missesAfter) / triangles);
+		scene.cacheStats.atvrBefore = float(double(missesBefore) / vertices);
+		scene.cacheStats.atvrAfter = float(double(missesAfter) / vertices);
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "MeshSimplifier.h"
+#include "VkStructs.h"
+
+struct ImportedScene;
+
+// Import-time reordering of the meshes for the GPU, run on freshly imported
+// scenes before they are written to the mesh cache:
+//  - triangles are reordered for the post-transform vertex cache (Tipsify),
+//  - the cache friendly order is split into clusters which are sorted so that
+//    the outward facing ones are drawn first, to cut overdraw,
+//  - vertices are renumbered in the order the triangles first use them, so
+//    vertex fetch walks the buffer front to back,
+//  - meshes with more vertices than 16-bit indices address are cut into index
+//    ranges along that order, each drawn with its own vertex offset,
+//  - coarser levels of detail are simplified from every range and appended to
+//    the index buffer as ranges of their own, on the same vertices,
+//  - every range is cut into meshlets with bounds for culling, in place,
+//  - every mesh gets its bounds, including the ones it can't reorder.
+//
+// The cache is simulated as a FIFO of Settings::cacheSize entries. ACMR is the
+// number of vertex shader invocations per triangle (0.5 is the best a regular
+// grid can do, 3 means no reuse at all), ATVR the invocations per vertex (1 is
+// optimal).
+class MeshOptimizer
+{
+public:
+	struct Settings
+	{
+		uint32_t cacheSize = 16;
+		// how much worse than the cache order's ACMR the overdraw clusters may get,
+		// 1 keeps the clusters at the hard boundaries of the cache order only
+		float overdrawThreshold = 1.05f;
+		// false keeps large meshes on 32-bit indices
+		bool splitIndexRanges = true;
+
+		// levels of detail including the full mesh, at most MaxMeshLods
+		uint32_t lodLevels = MaxMeshLods;
+		// triangles a level aims for relative to the previous one
+		float lodReduction = 0.5f;
+		// a level that keeps more of the previous one's triangles isn't worth it
+		float lodMaxRatio = 0.8f;
+		// meshes that get this small stop getting levels
+		uint32_t lodMinTriangles = 128;
+		MeshSimplifier::Settings simplifier;
+
+		bool buildMeshlets = true;
+	};
+
+public:
+	// Optimizes every mesh whose indices live in the scene's storage in place and fills
+	// scene.cacheStats, scene.indexRanges and scene.meshlets. Vertices outside the
+	// storage, read in place from a mapping, keep their order and are only copied into
+	// it when the mesh is split. Runs one job per mesh.
+	static void Optimize(ImportedScene& scene, const Settings& settings);
+
+	static void OptimizeVertexCache(uint32_t* indices, uint32_t numIndices, uint32_t numVertices, uint32_t cacheSize);
+	// Expects indices that went through OptimizeVertexCache.
+	static void OptimizeOverdraw(uint32_t* indices, uint32_t numIndices, const Vertex* vertices, uint32_t numVertices, uint32_t cacheSize, float threshold);
+	// Returns the number of vertices still referenced, they are moved to the front.
+	static uint32_t OptimizeVertexFetch(Vertex* vertices, uint32_t* indices, uint32_t numIndices, uint32_t numVertices);
+
+	// Cuts the triangles, in order, into ranges that use at most IndexRange::MaxVertices
+	// vertices. Every range's vertices are copied to splitVertices in the order the
+	// range first uses them, so those on the seams between ranges are duplicated,
+	// and the indices are rewritten relative to the range.
+	static void SplitIndexRanges(const Vertex* vertices, uint32_t numVertices, uint32_t* indices, uint32_t numIndices,
+		std::vector<Vertex>& splitVertices, std::vector<IndexRange>& ranges);
+
+	// Simplifies every range of the full level, which ranges holds on entry, and
+	// appends the coarser levels' indices and ranges, each level with as many ranges
+	// as the full one. Fills lodErrors with the error bound of every level in object
+	// space units and returns the number of levels.
+	static uint32_t GenerateLods(const Vertex* vertices, uint32_t numVertices, std::vector<uint32_t>& indices,
+		std::vector<IndexRange>& ranges, const Settings& settings, float* lodErrors);
+
+	// Cuts indices[firstIndex, firstIndex + numIndices) into meshlets, in order so the
+	// vertex cache order is kept. A meshlet ends when the next triangle would take it
+	// past Meshlet::MaxVertices or MaxTriangles.
+	static void BuildMeshlets(const Vertex* vertices, const uint32_t* indices, uint32_t firstIndex, uint32_t numIndices,
+		std::vector<Meshlet>& meshlets);
+
+	static MeshBounds ComputeBounds(const Vertex* vertices, uint32_t numVertices);
+
+	// Simulated cache misses of the index buffer and how many vertices it references.
+	static void CountCacheMisses(const uint32_t* indices, uint32_t numIndices, uint32_t numVertices, uint32_t cacheSize, uint32_t& misses, uint32_t& usedVertices);
+};
@@ -0,0 +1,292 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// symmetric 4x4 matrix of the plane equations, weighted by the triangles' areas
+	struct Quadric
+	{
+		double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+		double b2 = 0.0, bc = 0.0, bd = 0.0;
+		double c2 = 0.0, cd = 0.0;
+		double d2 = 0.0;
+		double weight = 0.0;
+
+		void AddPlane(const glm::vec3& normal, float distance, float area)
+		{
+			const double a = normal.x, b = normal.y, c = normal.z, d = distance, w = area;
+			a2 += w * a * a; ab += w * a * b; ac += w * a * c; ad += w * a * d;
+			b2 += w * b * b; bc += w * b * c; bd += w * b * d;
+			c2 += w * c * c; cd += w * c * d;
+			d2 += w * d * d;
+			weight += w;
+		}
+
+		void Add(const Quadric& other)
+		{
+			a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+			b2 += other.b2; bc += other.bc; bd += other.bd;
+			c2 += other.c2; cd += other.cd;
+			d2 += other.d2;
+			weight += other.weight;
+		}
+
+		// mean squared distance of point to the planes
+		double Evaluate(const glm::vec3& point) const
+		{
+			const double x = point.x, y = point.y, z = point.z;
+			double error =
+				a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x +
+				b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y +
+				c2 * z * z + 2.0 * cd * z +
+				d2;
+			return weight > 0.0 ? std::max(error / weight, 0.0) : 0.0;
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		float cost;
+	};
+
+	uint64_t EdgeKey(uint32_t a, uint32_t b)
+	{
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+}
+
+float MeshSimplifier::Simplify(const Vertex* vertices, uint32_t numVertices, const uint32_t* indices, uint32_t numIndices,
+	uint32_t targetIndices, const Settings& settings, std::vector<uint32_t>& output)
+{
+	output.assign(indices, indices + numIndices - numIndices % 3);
+	if (numVertices == 0 || output.size() <= targetIndices)
+	{
+		return 0.0f;
+	}
+
+	// positions in a unit box, so the weights don't depend on the model's scale
+	glm::vec3 minimum = vertices[0].pos;
+	glm::vec3 maximum = vertices[0].pos;
+	for (uint32_t i = 1; i < numVertices; i++)
+	{
+		minimum = glm::min(minimum, vertices[i].pos);
+		maximum = glm::max(maximum, vertices[i].pos);
+	}
+	const glm::vec3 extent = maximum - minimum;
+	const float size = std::max({ extent.x, extent.y, extent.z });
+	if (!(size > 0.0f))
+	{
+		return 0.0f;
+	}
+
+	std::vector<glm::vec3> positions(numVertices);
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		positions[i] = (vertices[i].pos - minimum) / size;
+	}
+
+	std::vector<Quadric> quadrics(numVertices);
+	for (size_t i = 0; i < output.size(); i += 3)
+	{
+		const glm::vec3& p0 = positions[output[i]];
+		glm::vec3 normal = glm::cross(positions[output[i + 1]] - p0, positions[output[i + 2]] - p0);
+		float length = glm::length(normal);
+		if (length <= 0.0f)
+		{
+			continue;
+		}
+		normal /= length;
+		const float distance = -glm::dot(normal, p0);
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			quadrics[output[i + corner]].AddPlane(normal, distance, length * 0.5f);
+		}
+	}
+
+	// open and non-manifold edges keep both their vertices
+	std::vector<bool> locked(numVertices, false);
+	{
+		std::vector<uint64_t> edges;
+		edges.reserve(output.size());
+		for (size_t i = 0; i < output.size(); i += 3)
+		{
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				edges.push_back(EdgeKey(output[i + corner], output[i + (corner + 1) % 3]));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t end = i + 1;
+			while (end < edges.size() && edges[end] == edges[i])
+			{
+				end++;
+			}
+			if (end - i != 2)
+			{
+				locked[(uint32_t)(edges[i] >> 32)] = true;
+				locked[(uint32_t)edges[i]] = true;
+			}
+			i = end;
+		}
+	}
+
+	auto attributeCost = [&](uint32_t from, uint32_t to)
+	{
+		const glm::vec3 normal = vertices[from].normal - vertices[to].normal;
+		const glm::vec2 texCoord = vertices[from].texCoord - vertices[to].texCoord;
+		return settings.attributeWeight * (glm::dot(normal, normal) + glm::dot(texCoord, texCoord));
+	};
+
+	std::vector<uint32_t> offsets(numVertices + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> remap(numVertices);
+	std::vector<bool> touched(numVertices);
+	double maxCost = 0.0;
+
+	for (uint32_t pass = 0; pass < settings.maxPasses && output.size() > targetIndices; pass++)
+	{
+		const uint32_t numTriangles = (uint32_t)output.size() / 3;
+
+		// triangles around every vertex
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (uint32_t index : output)
+		{
+			offsets[index + 1]++;
+		}
+		for (uint32_t i = 0; i < numVertices; i++)
+		{
+			offsets[i + 1] += offsets[i];
+		}
+		adjacency.resize(output.size());
+		{
+			std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+			for (uint32_t i = 0; i < output.size(); i++)
+			{
+				adjacency[cursor[output[i]]++] = i / 3;
+			}
+		}
+
+		collapses.clear();
+		for (uint32_t i = 0; i < output.size(); i += 3)
+		{
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				const uint32_t a = output[i + corner];
+				const uint32_t b = output[i + (corner + 1) % 3];
+				for (uint32_t direction = 0; direction < 2; direction++)
+				{
+					const uint32_t from = direction == 0 ? a : b;
+					const uint32_t to = direction == 0 ? b : a;
+					if (locked[from])
+					{
+						continue;
+					}
+
+					Quadric quadric = quadrics[from];
+					quadric.Add(quadrics[to]);
+					const double cost = quadric.Evaluate(positions[to]) + attributeCost(from, to);
+					collapses.push_back({ from, to, (float)cost });
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b)
+		{
+			return a.cost < b.cost;
+		});
+
+		for (uint32_t i = 0; i < numVertices; i++)
+		{
+			remap[i] = i;
+		}
+		std::fill(touched.begin(), touched.end(), false);
+
+		// each collapse needs its triangles to itself, the rest waits for the next pass
+		uint32_t trianglesLeft = numTriangles;
+		const uint32_t targetTriangles = targetIndices / 3;
+		uint32_t accepted = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (trianglesLeft <= targetTriangles)
+			{
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to])
+			{
+				continue;
+			}
+
+			// the triangles that stay must not flip or degenerate when from moves onto to
+			bool valid = true;
+			uint32_t removed = 0;
+			for (uint32_t k = offsets[collapse.from]; k < offsets[collapse.from + 1] && valid; k++)
+			{
+				const uint32_t* triangle = &output[adjacency[k] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					removed++;
+					continue;
+				}
+
+				glm::vec3 before[3];
+				glm::vec3 after[3];
+				for (uint32_t corner = 0; corner < 3; corner++)
+				{
+					before[corner] = positions[triangle[corner]];
+					after[corner] = triangle[corner] == collapse.from ? positions[collapse.to] : before[corner];
+				}
+				const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+				const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+				// turning by more than about 75 degrees counts as a flip too, or folds build up over the levels
+				valid = glm::dot(normalBefore, normalAfter) > 0.25f * glm::length(normalBefore) * glm::length(normalAfter);
+			}
+			if (!valid || removed == 0)
+			{
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].Add(quadrics[collapse.from]);
+			for (uint32_t k = offsets[collapse.from]; k < offsets[collapse.from + 1]; k++)
+			{
+				const uint32_t* triangle = &output[adjacency[k] * 3];
+				touched[triangle[0]] = true;
+				touched[triangle[1]] = true;
+				touched[triangle[2]] = true;
+			}
+
+			maxCost = std::max(maxCost, (double)collapse.cost);
+			trianglesLeft -= std::min(removed, trianglesLeft);
+			accepted++;
+		}
+
+		if (accepted == 0)
+		{
+			break;
+		}
+
+		// drop the triangles that collapsed
+		size_t written = 0;
+		for (size_t i = 0; i < output.size(); i += 3)
+		{
+			const uint32_t a = remap[output[i]];
+			const uint32_t b = remap[output[i + 1]];
+			const uint32_t c = remap[output[i + 2]];
+			if (a != b && b != c && a != c)
+			{
+				output[written++] = a;
+				output[written++] = b;
+				output[written++] = c;
+			}
+		}
+		output.resize(written);
+	}
+
+	return (float)std::sqrt(maxCost) * size;
+}
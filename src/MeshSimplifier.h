@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "VkStructs.h"
+
+// Quadric error metric simplification (Garland, Heckbert: Surface Simplification
+// Using Quadric Error Metrics) by half-edge collapses, so the simplified index
+// buffer keeps using the original vertices and LODs share the vertex buffer.
+//
+// Every vertex carries the planes of the triangles around it, weighted by their
+// area. A collapse moves a vertex onto a neighbour, its cost is the mean squared
+// distance of the neighbour to both vertices' planes plus the weighted squared
+// difference of their normals and texture coordinates, which keeps collapses off
+// creases and UV seams. Open edges, including the seams between vertices that
+// share a position, are locked so the silhouette of open meshes and the seams
+// between index ranges don't crack.
+class MeshSimplifier
+{
+public:
+	struct Settings
+	{
+		// attribute differences against squared positions in units of the mesh's extent
+		float attributeWeight = 0.01f;
+		uint32_t maxPasses = 32;
+	};
+
+public:
+	// Collapses edges, cheapest first, until at most targetIndices are left or
+	// nothing can collapse anymore. Returns the largest error of the collapses in
+	// object space units, an estimate of how far the surface moved.
+	static float Simplify(const Vertex* vertices, uint32_t numVertices, const uint32_t* indices, uint32_t numIndices,
+		uint32_t targetIndices, const Settings& settings, std::vector<uint32_t>& output);
+};
@@ -0,0 +1,238 @@
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <xmmintrin.h>
+
+namespace
+{
+	constexpr uint32_t MaxTaps = 8;
+	constexpr uint32_t LinearToSrgbSize = 4096;
+
+	// Separable 2:1 reduction, target texel x reads source texels 2x + first .. 2x + first + taps - 1.
+	struct Kernel
+	{
+		uint32_t taps;
+		int32_t first;
+		float weights[MaxTaps];
+	};
+
+	float ZeroOrderBessel(float x)
+	{
+		float sum = 1.0f;
+		float term = 1.0f;
+		for (uint32_t k = 1; k < 16; k++)
+		{
+			term *= (x * 0.5f / k) * (x * 0.5f / k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	struct Tables
+	{
+		float toLinear[256];
+		uint8_t toSrgb[LinearToSrgbSize];
+		Kernel box;
+		Kernel kaiser;
+
+		Tables()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				const float value = i / 255.0f;
+				toLinear[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+			}
+
+			for (uint32_t i = 0; i < LinearToSrgbSize; i++)
+			{
+				const float value = i / (float)(LinearToSrgbSize - 1);
+				const float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+				toSrgb[i] = (uint8_t)std::clamp((int)(srgb * 255.0f + 0.5f), 0, 255);
+			}
+
+			box = { 2, 0, { 0.5f, 0.5f } };
+
+			// sinc at half the source rate, windowed over two target texels either side
+			constexpr float beta = 4.0f;
+			constexpr float radius = 2.0f;
+			constexpr float pi = 3.14159265358979f;
+
+			kaiser.taps = MaxTaps;
+			kaiser.first = -3;
+			float sum = 0.0f;
+			for (uint32_t k = 0; k < MaxTaps; k++)
+			{
+				// distance from the target texel's center in target texels
+				const float t = ((float)k - 3.5f) * 0.5f;
+				const float sinc = std::sin(pi * t) / (pi * t);
+				const float ratio = t / radius;
+				const float window = ZeroOrderBessel(beta * std::sqrt(std::max(0.0f, 1.0f - ratio * ratio))) / ZeroOrderBessel(beta);
+				kaiser.weights[k] = sinc * window;
+				sum += kaiser.weights[k];
+			}
+			for (uint32_t k = 0; k < MaxTaps; k++)
+			{
+				kaiser.weights[k] /= sum;
+			}
+		}
+	};
+
+	const Tables& GetTables()
+	{
+		static const Tables tables;
+		return tables;
+	}
+
+	void LoadRow(const uint8_t* rgba, uint32_t width, bool srgb, __m128* row)
+	{
+		const Tables& tables = GetTables();
+		const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const uint8_t* texel = rgba + x * 4;
+			if (srgb)
+			{
+				row[x] = _mm_setr_ps(tables.toLinear[texel[0]], tables.toLinear[texel[1]], tables.toLinear[texel[2]], texel[3] / 255.0f);
+			}
+			else
+			{
+				row[x] = _mm_mul_ps(_mm_setr_ps(texel[0], texel[1], texel[2], texel[3]), scale);
+			}
+		}
+	}
+
+	void StoreRow(const __m128* row, uint32_t width, bool srgb, uint8_t* rgba)
+	{
+		const Tables& tables = GetTables();
+		const float colorScale = srgb ? (float)(LinearToSrgbSize - 1) : 255.0f;
+		const __m128 scale = _mm_setr_ps(colorScale, colorScale, colorScale, 255.0f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+
+		for (uint32_t x = 0; x < width; x++)
+		{
+			// the sinc lobes can overshoot, clamp before quantizing
+			const __m128 value = _mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(row[x], zero), one), scale), half);
+
+			alignas(16) float lanes[4];
+			_mm_store_ps(lanes, value);
+
+			uint8_t* texel = rgba + x * 4;
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				texel[c] = srgb ? tables.toSrgb[(uint32_t)lanes[c]] : (uint8_t)lanes[c];
+			}
+			texel[3] = (uint8_t)lanes[3];
+		}
+	}
+
+	void FilterRow(const __m128* source, uint32_t sourceWidth, const Kernel& kernel, __m128* target, uint32_t targetWidth)
+	{
+		for (uint32_t x = 0; x < targetWidth; x++)
+		{
+			__m128 sum = _mm_setzero_ps();
+			for (uint32_t k = 0; k < kernel.taps; k++)
+			{
+				const int32_t sourceX = std::clamp((int32_t)(x * 2) + kernel.first + (int32_t)k, 0, (int32_t)sourceWidth - 1);
+				sum = _mm_add_ps(sum, _mm_mul_ps(source[sourceX], _mm_set1_ps(kernel.weights[k])));
+			}
+			target[x] = sum;
+		}
+	}
+
+	// Writes levels 1 to mipLevels - 1 of rgba to output, tightly packed.
+	void FilterLevels(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t mipLevels, MipGenerator::Filter filter, bool srgb, uint8_t* output)
+	{
+		const Kernel& kernel = filter == MipGenerator::Filter::Kaiser ? GetTables().kaiser : GetTables().box;
+
+		// linear texels of the level being read; level 0 is converted a row at a time instead
+		std::vector<__m128> level;
+		std::vector<__m128> nextLevel;
+		std::vector<__m128> baseRow(width);
+		std::vector<__m128> targetRow;
+
+		// horizontally filtered source rows, the rows one target row needs never share a slot
+		std::vector<__m128> filteredRows[MaxTaps];
+		int32_t filteredRowIndex[MaxTaps];
+
+		uint32_t sourceWidth = width;
+		uint32_t sourceHeight = height;
+
+		for (uint32_t i = 1; i < mipLevels; i++)
+		{
+			const uint32_t targetWidth = std::max(1u, sourceWidth / 2);
+			const uint32_t targetHeight = std::max(1u, sourceHeight / 2);
+			const bool keepLevel = i + 1 < mipLevels;
+
+			nextLevel.resize(keepLevel ? (size_t)targetWidth * targetHeight : 0);
+			targetRow.resize(targetWidth);
+			for (uint32_t k = 0; k < kernel.taps; k++)
+			{
+				filteredRows[k].resize(targetWidth);
+				filteredRowIndex[k] = -1;
+			}
+
+			for (uint32_t y = 0; y < targetHeight; y++)
+			{
+				__m128* target = keepLevel ? &nextLevel[(size_t)y * targetWidth] : targetRow.data();
+				std::fill(target, target + targetWidth, _mm_setzero_ps());
+
+				for (uint32_t k = 0; k < kernel.taps; k++)
+				{
+					const int32_t sourceY = std::clamp((int32_t)(y * 2) + kernel.first + (int32_t)k, 0, (int32_t)sourceHeight - 1);
+					const uint32_t slot = (uint32_t)sourceY % kernel.taps;
+
+					if (filteredRowIndex[slot] != sourceY)
+					{
+						const __m128* source;
+						if (i == 1)
+						{
+							LoadRow(rgba + (size_t)sourceY * width * 4, width, srgb, baseRow.data());
+							source = baseRow.data();
+						}
+						else
+						{
+							source = &level[(size_t)sourceY * sourceWidth];
+						}
+
+						FilterRow(source, sourceWidth, kernel, filteredRows[slot].data(), targetWidth);
+						filteredRowIndex[slot] = sourceY;
+					}
+
+					const __m128 weight = _mm_set1_ps(kernel.weights[k]);
+					const __m128* filtered = filteredRows[slot].data();
+					for (uint32_t x = 0; x < targetWidth; x++)
+					{
+						target[x] = _mm_add_ps(target[x], _mm_mul_ps(filtered[x], weight));
+					}
+				}
+
+				StoreRow(target, targetWidth, srgb, output + (size_t)y * targetWidth * 4);
+			}
+
+			output += (size_t)targetWidth * targetHeight * 4;
+			level.swap(nextLevel);
+			sourceWidth = targetWidth;
+			sourceHeight = targetHeight;
+		}
+	}
+}
+
+void MipGenerator::Generate(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t mipLevels, Filter filter, bool srgb, uint8_t* destination)
+{
+	if (destination != rgba)
+	{
+		memcpy(destination, rgba, (size_t)width * height * 4);
+	}
+	FilterLevels(rgba, width, height, mipLevels, filter, srgb, destination + (size_t)width * height * 4);
+}
+
+void MipGenerator::Downsample(const uint8_t* rgba, uint32_t width, uint32_t height, Filter filter, bool srgb, uint8_t* destination)
+{
+	FilterLevels(rgba, width, height, 2, filter, srgb, destination);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+// Builds RGBA8 mip chains on the CPU so textures can be uploaded whole with a
+// copy instead of being blitted down on the graphics queue. Filtering runs on
+// linear values, sRGB color is converted through lookup tables on the way in
+// and out, and every texel is processed as one SSE vector.
+class MipGenerator
+{
+public:
+	enum class Filter
+	{
+		// 2x2 average, cheap enough for load time
+		Box,
+		// 8 tap Kaiser windowed sinc, sharper, used when cooking
+		Kaiser,
+	};
+
+	// Writes mipLevels levels of rgba, level 0 included, tightly packed and largest
+	// first to destination. srgb false treats the color channels as linear data,
+	// e.g. normal maps; alpha is always linear. rgba may be destination itself, level
+	// 0 then stays where it is.
+	static void Generate(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t mipLevels, Filter filter, bool srgb, uint8_t* destination);
+	// Writes only the level below rgba, for callers that take the chain one level at
+	// a time. The chain is filtered from 8 bit levels then, Generate keeps them linear.
+	static void Downsample(const uint8_t* rgba, uint32_t width, uint32_t height, Filter filter, bool srgb, uint8_t* destination);
+};
@@ -0,0 +1,904 @@
+#include "ObjImporter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+#include "ImportedScene.h"
+#include "JobSystem.h"
+#include "Logger.h"
+#include "MappedFile.h"
+
+namespace
+{
+	constexpr uint64_t MinChunkSize = 256 * 1024;
+	constexpr int32_t MissingIndex = -1;
+
+	enum FixupComponent : uint8_t
+	{
+		FIXUP_POSITION = 1 << 0,
+		FIXUP_TEXCOORD = 1 << 1,
+		FIXUP_NORMAL = 1 << 2,
+	};
+
+	struct Corner
+	{
+		int32_t position;
+		int32_t texCoord;
+		int32_t normal;
+	};
+
+	// Negative OBJ indices are relative to the element count at that line, which a
+	// chunk only knows locally. They are stored chunk-local and rebased afterwards.
+	struct Fixup
+	{
+		uint32_t corner;
+		uint8_t components;
+	};
+
+	// Faces from firstFace until the next segment use this object and material.
+	// -1 means "whatever was active at the end of the previous chunk".
+	struct Segment
+	{
+		int32_t object;
+		int32_t material;
+		uint32_t firstFace;
+	};
+
+	struct Chunk
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> texCoords;
+		std::vector<Corner> corners;
+		// first corner of every face, the last face ends at corners.size()
+		std::vector<uint32_t> faceStarts;
+		std::vector<Fixup> fixups;
+		std::vector<Segment> segments;
+		std::vector<std::string> names;
+		std::vector<std::string> materialLibraries;
+
+		uint32_t positionBase = 0;
+		uint32_t texCoordBase = 0;
+		uint32_t normalBase = 0;
+		bool failed = false;
+	};
+
+	struct FaceRange
+	{
+		uint32_t chunk;
+		uint32_t firstFace;
+		uint32_t endFace;
+	};
+
+	struct PendingMesh
+	{
+		uint32_t object;
+		uint32_t material;
+		std::vector<FaceRange> ranges;
+
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+	};
+
+	inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline const char* SkipSpaces(const char* it, const char* end)
+	{
+		while (it < end && IsSpace(*it)) it++;
+		return it;
+	}
+
+	inline const char* SkipLine(const char* it, const char* end)
+	{
+		while (it < end && *it != '\n') it++;
+		return it < end ? it + 1 : end;
+	}
+
+	const char* ParseFloat(const char* it, const char* end, float& out)
+	{
+		static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16 };
+
+		it = SkipSpaces(it, end);
+
+		bool negative = false;
+		if (it < end && (*it == '-' || *it == '+'))
+		{
+			negative = *it == '-';
+			it++;
+		}
+
+		double value = 0.0;
+		while (it < end && *it >= '0' && *it <= '9')
+		{
+			value = value * 10.0 + (*it - '0');
+			it++;
+		}
+
+		if (it < end && *it == '.')
+		{
+			it++;
+			double fraction = 0.0;
+			int digits = 0;
+			while (it < end && *it >= '0' && *it <= '9')
+			{
+				if (digits < 16)
+				{
+					fraction = fraction * 10.0 + (*it - '0');
+					digits++;
+				}
+				it++;
+			}
+			value += fraction / powers[digits];
+		}
+
+		if (it < end && (*it == 'e' || *it == 'E'))
+		{
+			it++;
+			bool negativeExponent = false;
+			if (it < end && (*it == '-' || *it == '+'))
+			{
+				negativeExponent = *it == '-';
+				it++;
+			}
+			int exponent = 0;
+			while (it < end && *it >= '0' && *it <= '9')
+			{
+				exponent = std::min(exponent * 10 + (*it - '0'), 400);
+				it++;
+			}
+			value = negativeExponent ? value / std::pow(10.0, exponent) : value * std::pow(10.0, exponent);
+		}
+
+		out = static_cast<float>(negative ? -value : value);
+		return it;
+	}
+
+	const char* ParseInt(const char* it, const char* end, int32_t& out, bool& valid)
+	{
+		bool negative = false;
+		if (it < end && *it == '-')
+		{
+			negative = true;
+			it++;
+		}
+
+		valid = it < end && *it >= '0' && *it <= '9';
+		int64_t value = 0;
+		while (it < end && *it >= '0' && *it <= '9')
+		{
+			value = std::min<int64_t>(value * 10 + (*it - '0'), INT32_MAX);
+			it++;
+		}
+
+		out = static_cast<int32_t>(negative ? -value : value);
+		return it;
+	}
+
+	std::string ParseRestOfLine(const char* it, const char* end)
+	{
+		it = SkipSpaces(it, end);
+		const char* lineEnd = it;
+		while (lineEnd < end && *lineEnd != '\n') lineEnd++;
+		while (lineEnd > it && IsSpace(lineEnd[-1])) lineEnd--;
+		return std::string(it, lineEnd);
+	}
+
+	inline const char* SkipToken(const char* it, const char* end)
+	{
+		while (it < end && !IsSpace(*it) && *it != '\n') it++;
+		return it;
+	}
+
+	// mtllib may name several libraries, separated by spaces.
+	void ParseMaterialLibraries(const char* it, const char* end, std::vector<std::string>& libraries)
+	{
+		while (true)
+		{
+			it = SkipSpaces(it, end);
+			const char* nameEnd = SkipToken(it, end);
+			if (nameEnd == it) break;
+			libraries.emplace_back(it, nameEnd);
+			it = nameEnd;
+		}
+	}
+
+	struct TextureOption
+	{
+		const char* name;
+		uint32_t minArguments;
+		uint32_t maxArguments;
+	};
+
+	// the options a texture map statement may put before its file name; -o, -s and -t
+	// take one to three numbers
+	const TextureOption s_TextureOptions[] =
+	{
+		{ "-blendu", 1, 1 }, { "-blendv", 1, 1 }, { "-bm", 1, 1 }, { "-boost", 1, 1 }, { "-cc", 1, 1 },
+		{ "-clamp", 1, 1 }, { "-imfchan", 1, 1 }, { "-mm", 2, 2 }, { "-o", 1, 3 }, { "-s", 1, 3 },
+		{ "-t", 1, 3 }, { "-texres", 1, 1 }, { "-type", 1, 1 },
+	};
+
+	bool IsNumber(const char* it, const char* end)
+	{
+		float value;
+		return it < end && (*it == '-' || *it == '+' || *it == '.' || (*it >= '0' && *it <= '9')) && ParseFloat(it, end, value) == end;
+	}
+
+	// Skips the known options, the file name is the rest of the line and may contain spaces.
+	std::string ParseTextureName(const char* it, const char* end)
+	{
+		while (true)
+		{
+			it = SkipSpaces(it, end);
+			const char* optionEnd = SkipToken(it, end);
+			const TextureOption* option = nullptr;
+			for (const TextureOption& candidate : s_TextureOptions)
+			{
+				if (strlen(candidate.name) == (size_t)(optionEnd - it) && strncmp(candidate.name, it, optionEnd - it) == 0)
+				{
+					option = &candidate;
+					break;
+				}
+			}
+			if (!option) break;
+
+			it = optionEnd;
+			for (uint32_t i = 0; i < option->maxArguments; i++)
+			{
+				const char* argument = SkipSpaces(it, end);
+				const char* argumentEnd = SkipToken(argument, end);
+				if (argument == argumentEnd || (i >= option->minArguments && !IsNumber(argument, argumentEnd))) break;
+				it = argumentEnd;
+			}
+		}
+		return ParseRestOfLine(it, end);
+	}
+
+	// Converts a 1-based (or negative, relative) OBJ index. Returns false on 0.
+	bool ResolveIndex(int32_t raw, uint32_t localCount, int32_t& out, bool& relative)
+	{
+		if (raw > 0)
+		{
+			out = raw - 1;
+			relative = false;
+			return true;
+		}
+		if (raw < 0)
+		{
+			out = static_cast<int32_t>(localCount) + raw;
+			relative = true;
+			return true;
+		}
+		return false;
+	}
+
+	int32_t AddName(Chunk& chunk, std::string name)
+	{
+		chunk.names.push_back(std::move(name));
+		return static_cast<int32_t>(chunk.names.size() - 1);
+	}
+
+	void ParseFace(Chunk& chunk, const char* it, const char* end)
+	{
+		uint32_t firstCorner = static_cast<uint32_t>(chunk.corners.size());
+
+		for (;;)
+		{
+			it = SkipSpaces(it, end);
+			if (it >= end || *it == '\n' || *it == '#') break;
+
+			Corner corner = { MissingIndex, MissingIndex, MissingIndex };
+			uint8_t relativeComponents = 0;
+			int32_t raw = 0;
+			bool valid = false;
+			bool relative = false;
+
+			it = ParseInt(it, end, raw, valid);
+			if (!valid || !ResolveIndex(raw, (uint32_t)chunk.positions.size(), corner.position, relative))
+			{
+				chunk.failed = true;
+				return;
+			}
+			if (relative) relativeComponents |= FIXUP_POSITION;
+
+			if (it < end && *it == '/')
+			{
+				it++;
+				if (it < end && *it != '/')
+				{
+					it = ParseInt(it, end, raw, valid);
+					if (!valid || !ResolveIndex(raw, (uint32_t)chunk.texCoords.size(), corner.texCoord, relative))
+					{
+						chunk.failed = true;
+						return;
+					}
+					if (relative) relativeComponents |= FIXUP_TEXCOORD;
+				}
+				if (it < end && *it == '/')
+				{
+					it++;
+					it = ParseInt(it, end, raw, valid);
+					if (!valid || !ResolveIndex(raw, (uint32_t)chunk.normals.size(), corner.normal, relative))
+					{
+						chunk.failed = true;
+						return;
+					}
+					if (relative) relativeComponents |= FIXUP_NORMAL;
+				}
+			}
+
+			if (relativeComponents)
+			{
+				chunk.fixups.push_back({ (uint32_t)chunk.corners.size(), relativeComponents });
+			}
+			chunk.corners.push_back(corner);
+
+			// skip anything we did not understand up to the next corner
+			while (it < end && !IsSpace(*it) && *it != '\n') it++;
+		}
+
+		uint32_t cornerCount = static_cast<uint32_t>(chunk.corners.size()) - firstCorner;
+		if (cornerCount < 3)
+		{
+			// points and degenerate faces don't produce triangles
+			chunk.corners.resize(firstCorner);
+			while (!chunk.fixups.empty() && chunk.fixups.back().corner >= firstCorner)
+			{
+				chunk.fixups.pop_back();
+			}
+			return;
+		}
+
+		chunk.faceStarts.push_back(firstCorner);
+	}
+
+	void ParseChunk(Chunk& chunk)
+	{
+		// every chunk starts by inheriting the state the previous one ended with
+		chunk.segments.push_back({ -1, -1, 0 });
+
+		const char* end = chunk.end;
+		const char* it = chunk.begin;
+
+		while (it < end && !chunk.failed)
+		{
+			it = SkipSpaces(it, end);
+			if (it >= end) break;
+
+			const char* line = it;
+			switch (line[0])
+			{
+			case 'v':
+				if (line + 1 < end && IsSpace(line[1]))
+				{
+					glm::vec3 position;
+					it = ParseFloat(line + 1, end, position.x);
+					it = ParseFloat(it, end, position.y);
+					it = ParseFloat(it, end, position.z);
+					chunk.positions.push_back(position);
+				}
+				else if (line + 1 < end && line[1] == 't')
+				{
+					glm::vec2 texCoord;
+					it = ParseFloat(line + 2, end, texCoord.x);
+					it = ParseFloat(it, end, texCoord.y);
+					chunk.texCoords.push_back(texCoord);
+				}
+				else if (line + 1 < end && line[1] == 'n')
+				{
+					glm::vec3 normal;
+					it = ParseFloat(line + 2, end, normal.x);
+					it = ParseFloat(it, end, normal.y);
+					it = ParseFloat(it, end, normal.z);
+					chunk.normals.push_back(normal);
+				}
+				break;
+			case 'f':
+				if (line + 1 < end && IsSpace(line[1]))
+				{
+					ParseFace(chunk, line + 1, end);
+				}
+				break;
+			case 'o':
+			case 'g':
+				if (line + 1 < end && IsSpace(line[1]))
+				{
+					int32_t material = chunk.segments.back().material;
+					int32_t object = AddName(chunk, ParseRestOfLine(line + 1, end));
+					chunk.segments.push_back({ object, material, (uint32_t)chunk.faceStarts.size() });
+				}
+				break;
+			case 'u':
+				if (end - line > 7 && strncmp(line, "usemtl", 6) == 0 && IsSpace(line[6]))
+				{
+					int32_t object = chunk.segments.back().object;
+					int32_t material = AddName(chunk, ParseRestOfLine(line + 6, end));
+					chunk.segments.push_back({ object, material, (uint32_t)chunk.faceStarts.size() });
+				}
+				break;
+			case 'm':
+				if (end - line > 7 && strncmp(line, "mtllib", 6) == 0 && IsSpace(line[6]))
+				{
+					ParseMaterialLibraries(line + 6, end, chunk.materialLibraries);
+				}
+				break;
+			default:
+				break;
+			}
+
+			it = SkipLine(it, end);
+		}
+	}
+
+	// Only newmtl and map_Kd matter to the renderer.
+	void ParseMaterialLibrary(const std::string& path, std::vector<std::string>& names, std::vector<std::string>& diffuseTextures)
+	{
+		MappedFile file(path.c_str());
+		if (!file.IsOpen())
+		{
+			Logger::Error("Failed to open material library %s\n", path.c_str());
+			return;
+		}
+
+		const char* it = reinterpret_cast<const char*>(file.GetData());
+		const char* end = it + file.GetSize();
+
+		while (it < end)
+		{
+			it = SkipSpaces(it, end);
+			if (it >= end) break;
+
+			if (end - it > 7 && strncmp(it, "newmtl", 6) == 0 && IsSpace(it[6]))
+			{
+				names.push_back(ParseRestOfLine(it + 6, end));
+				diffuseTextures.emplace_back();
+			}
+			else if (end - it > 7 && strncmp(it, "map_Kd", 6) == 0 && IsSpace(it[6]) && !names.empty())
+			{
+				diffuseTextures.back() = ParseTextureName(it + 6, end);
+			}
+
+			it = SkipLine(it, end);
+		}
+	}
+
+	uint64_t CornerKey(const Corner& corner)
+	{
+		return ((uint64_t)(uint32_t)corner.position * 0x9E3779B97F4A7C15ull) ^
+			((uint64_t)(uint32_t)corner.texCoord * 0xC2B2AE3D27D4EB4Full) ^
+			((uint64_t)(uint32_t)corner.normal * 0x165667B19E3779F9ull);
+	}
+
+	bool SameCorner(const Corner& a, const Corner& b)
+	{
+		return a.position == b.position && a.texCoord == b.texCoord && a.normal == b.normal;
+	}
+
+	// Open addressing table from corner to welded vertex index.
+	class WeldTable
+	{
+	public:
+		explicit WeldTable(uint32_t expectedCorners)
+		{
+			uint32_t capacity = 16;
+			while (capacity < expectedCorners * 2) capacity <<= 1;
+			m_Mask = capacity - 1;
+			m_Keys.resize(capacity);
+			m_Values.assign(capacity, UINT32_MAX);
+		}
+
+		// Returns the existing vertex or stores newIndex and returns it.
+		uint32_t FindOrInsert(const Corner& corner, uint32_t newIndex)
+		{
+			uint64_t slot = CornerKey(corner) & m_Mask;
+			for (;;)
+			{
+				if (m_Values[slot] == UINT32_MAX)
+				{
+					m_Keys[slot] = corner;
+					m_Values[slot] = newIndex;
+					return newIndex;
+				}
+				if (SameCorner(m_Keys[slot], corner))
+				{
+					return m_Values[slot];
+				}
+				slot = (slot + 1) & m_Mask;
+			}
+		}
+
+	private:
+		uint64_t m_Mask;
+		std::vector<Corner> m_Keys;
+		std::vector<uint32_t> m_Values;
+	};
+
+	struct GlobalData
+	{
+		const std::vector<Chunk>* chunks;
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> texCoords;
+	};
+
+	bool WeldMesh(const GlobalData& global, PendingMesh& mesh)
+	{
+		const std::vector<Chunk>& chunks = *global.chunks;
+
+		uint32_t cornerCount = 0;
+		uint32_t triangleCount = 0;
+		for (const FaceRange& range : mesh.ranges)
+		{
+			const Chunk& chunk = chunks[range.chunk];
+			for (uint32_t face = range.firstFace; face < range.endFace; face++)
+			{
+				uint32_t faceEnd = face + 1 < chunk.faceStarts.size() ? chunk.faceStarts[face + 1] : (uint32_t)chunk.corners.size();
+				cornerCount += faceEnd - chunk.faceStarts[face];
+				triangleCount += faceEnd - chunk.faceStarts[face] - 2;
+			}
+		}
+
+		WeldTable table(cornerCount);
+		mesh.vertices.reserve(cornerCount);
+		mesh.indices.reserve(triangleCount * 3);
+
+		// faces without normals get a flat one; every such face gets a unique normal
+		// key so its corners only weld with each other, like Assimp's GenNormals
+		int32_t generatedNormalKey = -2;
+		uint32_t polygon[3];
+
+		for (const FaceRange& range : mesh.ranges)
+		{
+			const Chunk& chunk = chunks[range.chunk];
+			for (uint32_t face = range.firstFace; face < range.endFace; face++)
+			{
+				uint32_t faceBegin = chunk.faceStarts[face];
+				uint32_t faceEnd = face + 1 < chunk.faceStarts.size() ? chunk.faceStarts[face + 1] : (uint32_t)chunk.corners.size();
+
+				bool needsNormal = false;
+				for (uint32_t c = faceBegin; c < faceEnd; c++)
+				{
+					const Corner& corner = chunk.corners[c];
+					if (corner.position < 0 || (uint32_t)corner.position >= global.positions.size()) return false;
+					if (corner.texCoord >= 0 && (uint32_t)corner.texCoord >= global.texCoords.size()) return false;
+					if (corner.normal >= 0 && (uint32_t)corner.normal >= global.normals.size()) return false;
+					needsNormal |= corner.normal < 0;
+				}
+
+				glm::vec3 faceNormal(0.0f);
+				int32_t faceNormalKey = MissingIndex;
+				if (needsNormal)
+				{
+					const glm::vec3& p0 = global.positions[chunk.corners[faceBegin].position];
+					const glm::vec3& p1 = global.positions[chunk.corners[faceBegin + 1].position];
+					const glm::vec3& p2 = global.positions[chunk.corners[faceBegin + 2].position];
+					glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+					float length = glm::length(normal);
+					faceNormal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+					faceNormalKey = generatedNormalKey--;
+				}
+
+				// fan triangulation, emitted with reversed winding for the left-handed conversion
+				for (uint32_t c = faceBegin + 1; c + 1 < faceEnd; c++)
+				{
+					uint32_t triangle[3] = { c + 1, c, faceBegin };
+					for (uint32_t k = 0; k < 3; k++)
+					{
+						Corner corner = chunk.corners[triangle[k]];
+						if (corner.normal < 0) corner.normal = faceNormalKey;
+
+						uint32_t index = table.FindOrInsert(corner, (uint32_t)mesh.vertices.size());
+						if (index == mesh.vertices.size())
+						{
+							Vertex vertex;
+							vertex.pos = global.positions[corner.position];
+							vertex.normal = corner.normal >= 0 ? global.normals[corner.normal] : faceNormal;
+							vertex.texCoord = corner.texCoord >= 0 ? global.texCoords[corner.texCoord] : glm::vec2(0.0f);
+
+							vertex.pos.z = -vertex.pos.z;
+							vertex.normal.z = -vertex.normal.z;
+							if (corner.texCoord >= 0) vertex.texCoord.y = 1.0f - vertex.texCoord.y;
+
+							mesh.vertices.push_back(vertex);
+						}
+						polygon[k] = index;
+					}
+
+					mesh.indices.insert(mesh.indices.end(), polygon, polygon + 3);
+				}
+			}
+		}
+
+		return true;
+	}
+}
+
+bool ObjImporter::Import(const char* path, ImportedScene& imported)
+{
+	MappedFile file(path);
+	if (!file.IsOpen())
+	{
+		return false;
+	}
+
+	JobSystem* jobSystem = JobSystem::Get();
+	const char* data = reinterpret_cast<const char*>(file.GetData());
+	const uint64_t size = file.GetSize();
+
+	// line-aligned chunks, a few per worker so stealing can even out dense regions
+	uint64_t chunkCount = std::max<uint64_t>(1, std::min<uint64_t>(jobSystem->GetWorkerCount() * 4ull, size / MinChunkSize));
+	std::vector<Chunk> chunks;
+	chunks.reserve(chunkCount);
+
+	const char* chunkBegin = data;
+	const char* fileEnd = data + size;
+	for (uint64_t i = 0; i < chunkCount && chunkBegin < fileEnd; i++)
+	{
+		const char* chunkEnd = i + 1 == chunkCount ? fileEnd : std::max(chunkBegin + 1, data + size * (i + 1) / chunkCount);
+		chunkEnd = SkipLine(chunkEnd - 1, fileEnd);
+
+		Chunk chunk;
+		chunk.begin = chunkBegin;
+		chunk.end = chunkEnd;
+		chunks.push_back(std::move(chunk));
+
+		chunkBegin = chunkEnd;
+	}
+
+	jobSystem->ParallelFor((uint32_t)chunks.size(), 1, [&chunks](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			ParseChunk(chunks[i]);
+		}
+	});
+
+	GlobalData global;
+	global.chunks = &chunks;
+
+	uint32_t positionCount = 0;
+	uint32_t texCoordCount = 0;
+	uint32_t normalCount = 0;
+	for (Chunk& chunk : chunks)
+	{
+		if (chunk.failed)
+		{
+			Logger::Error("Malformed face in %s\n", path);
+			return false;
+		}
+
+		chunk.positionBase = positionCount;
+		chunk.texCoordBase = texCoordCount;
+		chunk.normalBase = normalCount;
+		positionCount += (uint32_t)chunk.positions.size();
+		texCoordCount += (uint32_t)chunk.texCoords.size();
+		normalCount += (uint32_t)chunk.normals.size();
+	}
+
+	global.positions.resize(positionCount);
+	global.texCoords.resize(texCoordCount);
+	global.normals.resize(normalCount);
+
+	jobSystem->ParallelFor((uint32_t)chunks.size(), 1, [&chunks, &global](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			Chunk& chunk = chunks[i];
+			std::copy(chunk.positions.begin(), chunk.positions.end(), global.positions.begin() + chunk.positionBase);
+			std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), global.texCoords.begin() + chunk.texCoordBase);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), global.normals.begin() + chunk.normalBase);
+
+			for (const Fixup& fixup : chunk.fixups)
+			{
+				Corner& corner = chunk.corners[fixup.corner];
+				if (fixup.components & FIXUP_POSITION) corner.position += chunk.positionBase;
+				if (fixup.components & FIXUP_TEXCOORD) corner.texCoord += chunk.texCoordBase;
+				if (fixup.components & FIXUP_NORMAL) corner.normal += chunk.normalBase;
+			}
+		}
+	});
+
+	// Walk the segments in file order to give every face run its object and material.
+	std::vector<std::string> objectNames;
+	std::vector<std::string> materialNames;
+	std::unordered_map<std::string, uint32_t> objectLookup;
+	std::unordered_map<std::string, uint32_t> materialLookup;
+	std::unordered_map<uint64_t, uint32_t> meshLookup;
+	std::vector<PendingMesh> meshes;
+
+	auto intern = [](const std::string& name, std::vector<std::string>& names, std::unordered_map<std::string, uint32_t>& lookup)
+	{
+		auto found = lookup.find(name);
+		if (found != lookup.end()) return found->second;
+		uint32_t index = (uint32_t)names.size();
+		names.push_back(name);
+		lookup.emplace(name, index);
+		return index;
+	};
+
+	uint32_t currentObject = intern("default", objectNames, objectLookup);
+	uint32_t currentMaterial = UINT32_MAX;
+	std::vector<std::string> materialLibraries;
+
+	for (uint32_t c = 0; c < chunks.size(); c++)
+	{
+		const Chunk& chunk = chunks[c];
+		materialLibraries.insert(materialLibraries.end(), chunk.materialLibraries.begin(), chunk.materialLibraries.end());
+
+		for (size_t s = 0; s < chunk.segments.size(); s++)
+		{
+			const Segment& segment = chunk.segments[s];
+			if (segment.object >= 0) currentObject = intern(chunk.names[segment.object], objectNames, objectLookup);
+			if (segment.material >= 0) currentMaterial = intern(chunk.names[segment.material], materialNames, materialLookup);
+
+			uint32_t endFace = s + 1 < chunk.segments.size() ? chunk.segments[s + 1].firstFace : (uint32_t)chunk.faceStarts.size();
+			if (endFace == segment.firstFace) continue;
+
+			uint64_t key = ((uint64_t)currentObject << 32) | currentMaterial;
+			auto found = meshLookup.find(key);
+			uint32_t meshIndex;
+			if (found == meshLookup.end())
+			{
+				meshIndex = (uint32_t)meshes.size();
+				meshLookup.emplace(key, meshIndex);
+				meshes.emplace_back();
+				meshes.back().object = currentObject;
+				meshes.back().material = currentMaterial;
+			}
+			else
+			{
+				meshIndex = found->second;
+			}
+
+			meshes[meshIndex].ranges.push_back({ c, segment.firstFace, endFace });
+		}
+	}
+
+	std::atomic<bool> failed = false;
+	jobSystem->ParallelFor((uint32_t)meshes.size(), 1, [&meshes, &global, &failed](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			if (!WeldMesh(global, meshes[i]))
+			{
+				failed = true;
+			}
+		}
+	});
+
+	if (failed)
+	{
+		Logger::Error("Face index out of range in %s\n", path);
+		return false;
+	}
+
+	// Materials: slot 0 is the default material, then every material the file uses.
+	std::vector<std::string> libraryNames;
+	std::vector<std::string> libraryTextures;
+	std::filesystem::path basePath = std::filesystem::path(path).parent_path();
+	for (const std::string& library : materialLibraries)
+	{
+		ParseMaterialLibrary((basePath / library).string(), libraryNames, libraryTextures);
+	}
+
+	imported.stringStorage.clear();
+	std::vector<int32_t> materialTexture(materialNames.size() + 1, -1);
+	for (size_t i = 0; i < materialNames.size(); i++)
+	{
+		auto found = std::find(libraryNames.begin(), libraryNames.end(), materialNames[i]);
+		if (found != libraryNames.end())
+		{
+			const std::string& texture = libraryTextures[found - libraryNames.begin()];
+			if (!texture.empty())
+			{
+				materialTexture[i + 1] = (int32_t)imported.stringStorage.size();
+				imported.stringStorage.push_back(texture);
+			}
+		}
+	}
+
+	imported.materials.resize(materialNames.size() + 1);
+	for (size_t i = 0; i < imported.materials.size(); i++)
+	{
+		imported.materials[i].diffuseTexture = materialTexture[i] >= 0 ? imported.stringStorage[materialTexture[i]].c_str() : nullptr;
+	}
+
+	size_t totalVertices = 0;
+	size_t totalIndices = 0;
+	std::vector<size_t> vertexOffsets(meshes.size());
+	std::vector<size_t> indexOffsets(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		vertexOffsets[i] = totalVertices;
+		indexOffsets[i] = totalIndices;
+		totalVertices += meshes[i].vertices.size();
+		totalIndices += meshes[i].indices.size();
+	}
+
+	imported.vertexStorage.resize(totalVertices);
+	imported.indexStorage.resize(totalIndices);
+	imported.meshes.resize(meshes.size());
+
+	jobSystem->ParallelFor((uint32_t)meshes.size(), 1, [&](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			PendingMesh& mesh = meshes[i];
+			Vertex* vertices = imported.vertexStorage.data() + vertexOffsets[i];
+			uint32_t* indices = imported.indexStorage.data() + indexOffsets[i];
+			std::copy(mesh.vertices.begin(), mesh.vertices.end(), vertices);
+			std::copy(mesh.indices.begin(), mesh.indices.end(), indices);
+
+			ImportedMesh& importedMesh = imported.meshes[i];
+			importedMesh.vertices = vertices;
+			importedMesh.numVertices = (uint32_t)mesh.vertices.size();
+			importedMesh.indices = indices;
+			importedMesh.numIndices = (uint32_t)mesh.indices.size();
+			importedMesh.materialIndex = mesh.material == UINT32_MAX ? 0 : mesh.material + 1;
+
+			mesh.vertices = std::vector<Vertex>();
+			mesh.indices = std::vector<uint32_t>();
+		}
+	});
+
+	// Root node with one child per object, each holding that object's meshes.
+	std::vector<std::vector<uint32_t>> objectMeshes(objectNames.size());
+	for (uint32_t i = 0; i < meshes.size(); i++)
+	{
+		objectMeshes[meshes[i].object].push_back(i);
+	}
+
+	ImportedNode root;
+	imported.nodes.push_back(root);
+	for (const std::vector<uint32_t>& objectMeshList : objectMeshes)
+	{
+		if (objectMeshList.empty()) continue;
+
+		ImportedNode node;
+		node.firstMesh = (uint32_t)imported.nodeMeshes.size();
+		node.numMeshes = (uint32_t)objectMeshList.size();
+		imported.nodeMeshes.insert(imported.nodeMeshes.end(), objectMeshList.begin(), objectMeshList.end());
+		imported.nodes.push_back(node);
+		imported.nodes[0].numChildren++;
+	}
+
+	return true;
+}
+
+bool ObjImporter::GetMaterialLibraries(const char* path, std::vector<std::string>& libraries)
+{
+	MappedFile file(path);
+	if (!file.IsOpen())
+	{
+		return false;
+	}
+
+	const char* it = reinterpret_cast<const char*>(file.GetData());
+	const char* end = it + file.GetSize();
+	std::vector<std::string> names;
+	while (it < end)
+	{
+		it = SkipSpaces(it, end);
+		if (end - it > 7 && strncmp(it, "mtllib", 6) == 0 && IsSpace(it[6]))
+		{
+			ParseMaterialLibraries(it + 6, end, names);
+		}
+		it = SkipLine(it, end);
+	}
+
+	// relative to the OBJ, like Import opens them
+	std::filesystem::path basePath = std::filesystem::path(path).parent_path();
+	for (const std::string& name : names)
+	{
+		libraries.push_back((basePath / name).string());
+	}
+	return true;
+}
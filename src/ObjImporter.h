@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct ImportedScene;
+
+// Wavefront OBJ/MTL importer that skips Assimp. The file is memory-mapped, split
+// into line-aligned chunks that are parsed on the job system, and every
+// object/material pair is welded into its own mesh in parallel.
+//
+// The output matches AssimpImporter::ImportFlags: polygons are fan-triangulated,
+// data is converted to left-handed (z flipped, v flipped, winding reversed),
+// faces without normals get flat normals and identical corners are joined.
+class ObjImporter
+{
+public:
+	// Returns false when the file can't be mapped or is malformed; the caller is
+	// expected to fall back to the generic importer in that case.
+	static bool Import(const char* path, ImportedScene& imported);
+	// The paths of the material libraries the file's mtllib lines name, without
+	// importing it. False when the file can't be mapped.
+	static bool GetMaterialLibraries(const char* path, std::vector<std::string>& libraries);
+};
@@ -0,0 +1,180 @@
+#include "OcclusionBenchmark.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <filesystem>
+#include <vector>
+
+#include "FrustumCuller.h"
+#include "ImportedScene.h"
+#include "JobSystem.h"
+#include "Logger.h"
+#include "ObjImporter.h"
+#include "OcclusionCuller.h"
+#include "SceneHierarchy.h"
+#include "Timer.h"
+
+namespace
+{
+	// every view is culled this often, the times are the mean
+	constexpr uint32_t Repeats = 20;
+
+	const char* const s_SponzaPath = "./Models/Sponza/sponza.obj";
+
+	struct View
+	{
+		glm::vec3 position;
+		glm::vec3 direction;
+	};
+
+	// Three points along the longer horizontal axis, at a fifth of the height, each
+	// looking both ways along it and both ways across.
+	std::vector<View> GetViews(const glm::vec3& minimum, const glm::vec3& maximum)
+	{
+		const glm::vec3 size = maximum - minimum;
+		const uint32_t along = size.x >= size.z ? 0 : 2;
+		const uint32_t across = 2 - along;
+
+		std::vector<View> views;
+		for (float t : { 0.15f, 0.5f, 0.85f })
+		{
+			glm::vec3 position = (minimum + maximum) * 0.5f;
+			position[along] = minimum[along] + size[along] * t;
+			position.y = minimum.y + size.y * 0.2f;
+			for (uint32_t axis : { along, across })
+			{
+				for (float sign : { 1.0f, -1.0f })
+				{
+					glm::vec3 direction(0.0f);
+					direction[axis] = sign;
+					views.push_back({ position, direction });
+				}
+			}
+		}
+		return views;
+	}
+}
+
+void OcclusionBenchmark::Run()
+{
+	// the OBJ importer and the culler split their work over the job system, the engine isn't created in this mode
+	JobSystem jobSystem;
+
+	if (!std::filesystem::exists(s_SponzaPath))
+	{
+		Logger::Info("%s: not found, skipped\n", s_SponzaPath);
+		return;
+	}
+
+	ImportedScene imported;
+	if (!ObjImporter::Import(s_SponzaPath, imported))
+	{
+		Logger::Error("%s: import failed, skipped\n", s_SponzaPath);
+		return;
+	}
+
+	std::vector<Occluder> occluders(imported.meshes.size());
+	uint32_t numOccluderMeshes = 0;
+	for (uint32_t i = 0; i < imported.meshes.size(); i++)
+	{
+		const ImportedMesh& mesh = imported.meshes[i];
+		OcclusionCuller::BuildOccluder(mesh.vertices, mesh.indices, mesh.numIndices,
+			imported.indexRanges.data() + mesh.firstIndexRange, mesh.numIndexRanges / std::max(mesh.numLods, 1u), occluders[i]);
+		numOccluderMeshes += occluders[i].corners.empty() ? 0 : 1;
+	}
+
+	// the instances in node order, like Scene gathers them
+	SceneHierarchy hierarchy;
+	hierarchy.Build(imported);
+	hierarchy.UpdateWorldTransforms();
+	std::vector<OcclusionCuller::OccluderInstance> instances;
+	for (uint32_t node = 0; node < hierarchy.GetNodeCount(); node++)
+	{
+		const SceneHierarchy::MeshRange& range = hierarchy.GetMeshRange(node);
+		for (uint32_t i = range.firstMesh; i < range.firstMesh + range.numMeshes; i++)
+		{
+			const uint32_t mesh = hierarchy.GetNodeMeshes()[i];
+			instances.push_back({ &occluders[mesh], &hierarchy.GetWorldTransform(node), glm::vec3(0.0f), glm::vec3(0.0f) });
+		}
+	}
+
+	const uint32_t numInstances = (uint32_t)instances.size();
+	FrustumCuller frustumCuller;
+	frustumCuller.Resize(numInstances);
+	glm::vec3 sceneMinimum(FLT_MAX);
+	glm::vec3 sceneMaximum(-FLT_MAX);
+	for (uint32_t i = 0; i < numInstances; i++)
+	{
+		const uint32_t mesh = (uint32_t)(instances[i].occluder - occluders.data());
+		frustumCuller.SetBounds(i, imported.meshes[mesh].bounds, *instances[i].transform);
+		instances[i].center = frustumCuller.GetCenter(i);
+		instances[i].extent = frustumCuller.GetExtent(i);
+		sceneMinimum = glm::min(sceneMinimum, instances[i].center - instances[i].extent);
+		sceneMaximum = glm::max(sceneMaximum, instances[i].center + instances[i].extent);
+	}
+
+	OcclusionCuller occlusionCuller;
+	Logger::Info("Occlusion benchmark, %u instances, %u meshes of %zu occlude, %ux%u buffer, %u workers\n", numInstances,
+		numOccluderMeshes, imported.meshes.size(), occlusionCuller.GetWidth(), occlusionCuller.GetHeight(), jobSystem.GetWorkerCount());
+
+	// the renderer's projection, at 16:9
+	const glm::mat4 projection = glm::perspectiveFovLH(45.f, 16.0f, 9.0f, 0.1f, 10000.f);
+	std::vector<uint8_t> visibility(numInstances);
+	std::vector<OcclusionCuller::OccluderInstance> candidates;
+	uint32_t totalVisible = 0;
+	uint32_t totalOccluded = 0;
+	float totalRenderTime = 0.0f;
+	float totalTestTime = 0.0f;
+	const std::vector<View> views = GetViews(sceneMinimum, sceneMaximum);
+	for (const View& view : views)
+	{
+		const glm::mat4 viewProjection = projection * glm::lookAtLH(view.position, view.position + view.direction, glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::vec4 planes[6];
+		FrustumCuller::ExtractPlanes(viewProjection, planes);
+		const uint32_t numVisible = frustumCuller.Cull(planes, 0, numInstances, visibility.data());
+
+		candidates.clear();
+		for (uint32_t i = 0; i < numInstances; i++)
+		{
+			if (visibility[i])
+				candidates.push_back(instances[i]);
+		}
+
+		Timer timer;
+		timer.Reset();
+		for (uint32_t repeat = 0; repeat < Repeats; repeat++)
+		{
+			occlusionCuller.Render(viewProjection, candidates.data(), (uint32_t)candidates.size());
+		}
+		timer.Tick();
+		const float renderTime = timer.GetDeltaTime() * 1000.0f / Repeats;
+
+		uint32_t numOccluded = 0;
+		timer.Reset();
+		for (uint32_t repeat = 0; repeat < Repeats; repeat++)
+		{
+			numOccluded = 0;
+			for (const OcclusionCuller::OccluderInstance& candidate : candidates)
+			{
+				numOccluded += occlusionCuller.IsOccluded(candidate.center, candidate.extent) ? 1 : 0;
+			}
+		}
+		timer.Tick();
+		const float testTime = timer.GetDeltaTime() * 1000.0f / Repeats;
+
+		Logger::Info("  at (%.0f, %.0f, %.0f) towards (%.0f, %.0f, %.0f): %u in the frustum, %u occluded (%.1f%%) by %u occluders of %u triangles, render %.3f ms, test %.3f ms\n",
+			view.position.x, view.position.y, view.position.z, view.direction.x, view.direction.y, view.direction.z,
+			numVisible, numOccluded, numVisible > 0 ? 100.0f * numOccluded / numVisible : 0.0f,
+			occlusionCuller.GetOccluderCount(), occlusionCuller.GetTriangleCount(), renderTime, testTime);
+
+		totalVisible += numVisible;
+		totalOccluded += numOccluded;
+		totalRenderTime += renderTime;
+		totalTestTime += testTime;
+	}
+
+	Logger::Info("Mean over %zu views: %.1f in the frustum, %.1f occluded (%.1f%%), render %.3f ms, test %.3f ms\n", views.size(),
+		(float)totalVisible / views.size(), (float)totalOccluded / views.size(),
+		totalVisible > 0 ? 100.0f * totalOccluded / totalVisible : 0.0f,
+		totalRenderTime / views.size(), totalTestTime / views.size());
+}
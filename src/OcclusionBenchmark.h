@@ -0,0 +1,12 @@
+#pragma once
+
+// Culls Sponza's mesh instances from views along its nave, first against the frustum
+// and then against the occlusion buffer, and reports per view how many each removes,
+// how many occluders and triangles were rasterized and the time spent rendering and
+// testing. Runs without a window or device, main() calls it when the executable is
+// started with --benchmark-occlusion.
+class OcclusionBenchmark
+{
+public:
+	static void Run();
+};
@@ -0,0 +1,466 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+#include "JobSystem.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+#if defined(__AVX__)
+	constexpr uint32_t Width = 8;
+
+	typedef __m256 Floats;
+	inline Floats Load(const float* values) { return _mm256_loadu_ps(values); }
+	inline void Store(float* values, Floats a) { _mm256_storeu_ps(values, a); }
+	inline Floats Set(float value) { return _mm256_set1_ps(value); }
+	inline Floats Add(Floats a, Floats b) { return _mm256_add_ps(a, b); }
+	inline Floats Mul(Floats a, Floats b) { return _mm256_mul_ps(a, b); }
+	inline Floats Max(Floats a, Floats b) { return _mm256_max_ps(a, b); }
+	inline Floats And(Floats a, Floats b) { return _mm256_and_ps(a, b); }
+	inline Floats GreaterEqual(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	inline int Mask(Floats a) { return _mm256_movemask_ps(a); }
+	// the pixel centers of a block
+	inline Floats LaneCenters() { return _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f); }
+#else
+	constexpr uint32_t Width = 4;
+
+	typedef __m128 Floats;
+	inline Floats Load(const float* values) { return _mm_loadu_ps(values); }
+	inline void Store(float* values, Floats a) { _mm_storeu_ps(values, a); }
+	inline Floats Set(float value) { return _mm_set1_ps(value); }
+	inline Floats Add(Floats a, Floats b) { return _mm_add_ps(a, b); }
+	inline Floats Mul(Floats a, Floats b) { return _mm_mul_ps(a, b); }
+	inline Floats Max(Floats a, Floats b) { return _mm_max_ps(a, b); }
+	inline Floats And(Floats a, Floats b) { return _mm_and_ps(a, b); }
+	inline Floats GreaterEqual(Floats a, Floats b) { return _mm_cmpge_ps(a, b); }
+	inline int Mask(Floats a) { return _mm_movemask_ps(a); }
+	inline Floats LaneCenters() { return _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f); }
+#endif
+
+	// occluders are clipped and boxes counted visible at this w, close enough to the camera
+	// that nothing the near plane keeps is lost
+	constexpr float NearW = 1e-3f;
+	// a box's own surface doesn't hide it when rounding puts it a little behind itself
+	constexpr float DepthBias = 1.001f;
+
+	constexpr uint32_t ClipPlanes = 5;
+
+	// at or above zero inside: w - x, w + x, w - y, w + y and the near plane
+	float GetClipDistance(const glm::vec4& corner, uint32_t plane)
+	{
+		switch (plane)
+		{
+		case 0: return corner.w - corner.x;
+		case 1: return corner.w + corner.x;
+		case 2: return corner.w - corner.y;
+		case 3: return corner.w + corner.y;
+		default: return corner.w - NearW;
+		}
+	}
+
+	uint32_t GetOutsidePlanes(const glm::vec4& corner)
+	{
+		uint32_t planes = 0;
+		for (uint32_t plane = 0; plane < ClipPlanes; plane++)
+		{
+			if (GetClipDistance(corner, plane) < 0.0f)
+				planes |= 1u << plane;
+		}
+		return planes;
+	}
+
+	int32_t ToPixel(float value, uint32_t size)
+	{
+		return static_cast<int32_t>(std::min(std::max(value, 0.0f), static_cast<float>(size)));
+	}
+}
+
+OcclusionCuller::OcclusionCuller()
+	: OcclusionCuller(Settings())
+{
+}
+
+OcclusionCuller::OcclusionCuller(const Settings& settings)
+	: m_Settings(settings)
+{
+	m_Width = (settings.width + TileSize - 1) / TileSize * TileSize;
+	m_Height = (settings.height + TileSize - 1) / TileSize * TileSize;
+	m_Depth.resize(m_Width * m_Height);
+	m_TileDepth.resize((m_Width / TileSize) * (m_Height / TileSize));
+}
+
+void OcclusionCuller::BuildOccluder(const Vertex* vertices, const uint32_t* indices, uint32_t numIndices,
+	const IndexRange* ranges, uint32_t numRanges, Occluder& occluder)
+{
+	const IndexRange wholeMesh = { 0, numIndices, 0 };
+	if (numRanges == 0)
+	{
+		ranges = &wholeMesh;
+		numRanges = 1;
+	}
+
+	uint32_t numTriangles = 0;
+	for (uint32_t r = 0; r < numRanges; r++)
+	{
+		numTriangles += ranges[r].numIndices / 3;
+	}
+
+	occluder.corners.clear();
+	if (numTriangles > MaxOccluderTriangles)
+	{
+		return;
+	}
+
+	occluder.corners.reserve(numTriangles * 3);
+	for (uint32_t r = 0; r < numRanges; r++)
+	{
+		const IndexRange& range = ranges[r];
+		for (uint32_t i = range.firstIndex; i + 2 < range.firstIndex + range.numIndices; i += 3)
+		{
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				occluder.corners.push_back(vertices[range.vertexOffset + indices[i + corner]].pos);
+			}
+		}
+	}
+}
+
+void OcclusionCuller::Render(const glm::mat4& viewProjection, const OccluderInstance* candidates, uint32_t numCandidates)
+{
+	m_ViewProjection = viewProjection;
+
+	// The candidates' boxes that cover most of the screen are the occluders most
+	// likely to hide something, they take the triangle budget first. A box the
+	// camera is in covers everything.
+	const float screenArea = static_cast<float>(m_Width * m_Height);
+	std::vector<std::pair<float, uint32_t>> areas;
+	for (uint32_t i = 0; i < numCandidates; i++)
+	{
+		if (candidates[i].occluder->corners.empty())
+			continue;
+
+		ScreenRect rect;
+		float area = 1.0f;
+		if (ProjectBox(candidates[i].center, candidates[i].extent, rect))
+		{
+			const float width = static_cast<float>(ToPixel(rect.maxX, m_Width) - ToPixel(rect.minX, m_Width));
+			const float height = static_cast<float>(ToPixel(rect.maxY, m_Height) - ToPixel(rect.minY, m_Height));
+			area = width * height / screenArea;
+		}
+		if (area >= m_Settings.minOccluderArea)
+			areas.emplace_back(area, i);
+	}
+	std::sort(areas.begin(), areas.end(), [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b)
+	{
+		return a.first > b.first;
+	});
+
+	m_Occluders.clear();
+	m_NumTriangles = 0;
+	for (const std::pair<float, uint32_t>& area : areas)
+	{
+		const OccluderInstance& candidate = candidates[area.second];
+		const uint32_t numTriangles = static_cast<uint32_t>(candidate.occluder->corners.size() / 3);
+		if (m_NumTriangles + numTriangles > m_Settings.maxTriangles)
+			continue;
+
+		m_Occluders.push_back(candidate);
+		m_NumTriangles += numTriangles;
+	}
+	m_NumOccluders = static_cast<uint32_t>(m_Occluders.size());
+
+	// every worker sets up triangles of its own, then every one rasterizes all of them into its rows
+	JobSystem* jobSystem = JobSystem::Get();
+	m_WorkerTriangles.resize(jobSystem->GetWorkerCount());
+	for (std::vector<ScreenTriangle>& triangles : m_WorkerTriangles)
+	{
+		triangles.clear();
+	}
+
+	jobSystem->ParallelFor(m_NumOccluders, 1, [this](uint32_t begin, uint32_t end, uint32_t workerIndex)
+	{
+		std::vector<ScreenTriangle>& triangles = m_WorkerTriangles[workerIndex];
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const glm::mat4 matrix = m_ViewProjection * *m_Occluders[i].transform;
+			const std::vector<glm::vec3>& corners = m_Occluders[i].occluder->corners;
+			for (size_t triangle = 0; triangle < corners.size(); triangle += 3)
+			{
+				const glm::vec4 clipCorners[3] = {
+					matrix * glm::vec4(corners[triangle], 1.0f),
+					matrix * glm::vec4(corners[triangle + 1], 1.0f),
+					matrix * glm::vec4(corners[triangle + 2], 1.0f)
+				};
+				AddTriangle(clipCorners, triangles);
+			}
+		}
+	});
+
+	jobSystem->ParallelFor(m_Height / TileSize, 1, [this](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t tileRow = begin; tileRow < end; tileRow++)
+		{
+			RasterizeTileRow(tileRow);
+		}
+	});
+}
+
+bool OcclusionCuller::IsOccluded(const glm::vec3& center, const glm::vec3& extent) const
+{
+	ScreenRect rect;
+	if (!ProjectBox(center, extent, rect))
+	{
+		return false;
+	}
+
+	// every pixel the rectangle touches, not just the ones whose centers it holds
+	const int32_t minX = ToPixel(rect.minX, m_Width);
+	const int32_t minY = ToPixel(rect.minY, m_Height);
+	const int32_t maxX = std::min(ToPixel(rect.maxX, m_Width), static_cast<int32_t>(m_Width) - 1);
+	const int32_t maxY = std::min(ToPixel(rect.maxY, m_Height), static_cast<int32_t>(m_Height) - 1);
+	if (minX > maxX || minY > maxY)
+	{
+		return false;
+	}
+
+	const float nearest = rect.nearest * DepthBias;
+	const uint32_t tilesX = m_Width / TileSize;
+	for (int32_t tileY = minY / TileSize; tileY <= maxY / static_cast<int32_t>(TileSize); tileY++)
+	{
+		for (int32_t tileX = minX / TileSize; tileX <= maxX / static_cast<int32_t>(TileSize); tileX++)
+		{
+			if (m_TileDepth[tileY * tilesX + tileX] > nearest)
+				continue;
+
+			// somewhere in the tile the buffer is behind the box, maybe outside the rectangle
+			const int32_t firstY = std::max(minY, tileY * static_cast<int32_t>(TileSize));
+			const int32_t lastY = std::min(maxY, (tileY + 1) * static_cast<int32_t>(TileSize) - 1);
+			const int32_t firstX = std::max(minX, tileX * static_cast<int32_t>(TileSize));
+			const int32_t lastX = std::min(maxX, (tileX + 1) * static_cast<int32_t>(TileSize) - 1);
+			for (int32_t y = firstY; y <= lastY; y++)
+			{
+				const float* row = &m_Depth[y * m_Width];
+				for (int32_t x = firstX; x <= lastX; x++)
+				{
+					if (row[x] <= nearest)
+						return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+bool OcclusionCuller::ProjectBox(const glm::vec3& center, const glm::vec3& extent, ScreenRect& rect) const
+{
+	// the corners are the center plus or minus the matrix's columns scaled by the extent
+	const glm::vec4 clipCenter = m_ViewProjection * glm::vec4(center, 1.0f);
+	glm::vec4 axes[3];
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		axes[axis] = m_ViewProjection[axis] * extent[axis];
+	}
+
+	rect = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0.0f };
+	for (uint32_t corner = 0; corner < 8; corner++)
+	{
+		glm::vec4 clip = clipCenter;
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			clip = clip + axes[axis] * ((corner >> axis) & 1 ? 1.0f : -1.0f);
+		}
+		if (clip.w < NearW)
+		{
+			return false;
+		}
+
+		const float inverseW = 1.0f / clip.w;
+		const float x = (clip.x * inverseW * 0.5f + 0.5f) * m_Width;
+		const float y = (clip.y * inverseW * 0.5f + 0.5f) * m_Height;
+		rect.minX = std::min(rect.minX, x);
+		rect.minY = std::min(rect.minY, y);
+		rect.maxX = std::max(rect.maxX, x);
+		rect.maxY = std::max(rect.maxY, y);
+		rect.nearest = std::max(rect.nearest, inverseW);
+	}
+	return true;
+}
+
+void OcclusionCuller::AddTriangle(const glm::vec4 corners[3], std::vector<ScreenTriangle>& triangles) const
+{
+	const uint32_t outside[3] = { GetOutsidePlanes(corners[0]), GetOutsidePlanes(corners[1]), GetOutsidePlanes(corners[2]) };
+	if (outside[0] & outside[1] & outside[2])
+	{
+		// all behind the same plane
+		return;
+	}
+	if ((outside[0] | outside[1] | outside[2]) == 0)
+	{
+		AddClippedTriangle(corners[0], corners[1], corners[2], triangles);
+		return;
+	}
+
+	// Sutherland, Hodgman: every plane cuts the polygon down and adds at most one corner
+	glm::vec4 polygons[2][3 + ClipPlanes];
+	uint32_t numCorners = 3;
+	std::copy(corners, corners + 3, polygons[0]);
+	uint32_t current = 0;
+	for (uint32_t plane = 0; plane < ClipPlanes; plane++)
+	{
+		if (((outside[0] | outside[1] | outside[2]) & (1u << plane)) == 0)
+			continue;
+
+		const glm::vec4* polygon = polygons[current];
+		glm::vec4* clipped = polygons[current ^ 1];
+		uint32_t numClipped = 0;
+		for (uint32_t i = 0; i < numCorners; i++)
+		{
+			const glm::vec4& a = polygon[i];
+			const glm::vec4& b = polygon[(i + 1) % numCorners];
+			const float distanceA = GetClipDistance(a, plane);
+			const float distanceB = GetClipDistance(b, plane);
+			if (distanceA >= 0.0f)
+				clipped[numClipped++] = a;
+			if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+				clipped[numClipped++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+		}
+
+		numCorners = numClipped;
+		current ^= 1;
+		if (numCorners < 3)
+			return;
+	}
+
+	for (uint32_t i = 1; i + 1 < numCorners; i++)
+	{
+		AddClippedTriangle(polygons[current][0], polygons[current][i], polygons[current][i + 1], triangles);
+	}
+}
+
+void OcclusionCuller::AddClippedTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, std::vector<ScreenTriangle>& triangles) const
+{
+	const glm::vec4* corners[3] = { &a, &b, &c };
+	ScreenTriangle triangle;
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		const float inverseW = 1.0f / corners[i]->w;
+		triangle.x[i] = (corners[i]->x * inverseW * 0.5f + 0.5f) * m_Width;
+		triangle.y[i] = (corners[i]->y * inverseW * 0.5f + 0.5f) * m_Height;
+		triangle.z[i] = inverseW;
+	}
+
+	// slivers cover no pixel centers worth having, and would divide by about zero
+	const float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+		(triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+	if (std::abs(area) < 1e-6f)
+	{
+		return;
+	}
+	if (area < 0.0f)
+	{
+		std::swap(triangle.x[1], triangle.x[2]);
+		std::swap(triangle.y[1], triangle.y[2]);
+		std::swap(triangle.z[1], triangle.z[2]);
+	}
+
+	const float minX = std::min(std::min(triangle.x[0], triangle.x[1]), triangle.x[2]);
+	const float minY = std::min(std::min(triangle.y[0], triangle.y[1]), triangle.y[2]);
+	const float maxX = std::max(std::max(triangle.x[0], triangle.x[1]), triangle.x[2]);
+	const float maxY = std::max(std::max(triangle.y[0], triangle.y[1]), triangle.y[2]);
+	triangle.minX = std::max(static_cast<int32_t>(std::ceil(minX - 0.5f)), 0);
+	triangle.minY = std::max(static_cast<int32_t>(std::ceil(minY - 0.5f)), 0);
+	triangle.maxX = std::min(static_cast<int32_t>(std::floor(maxX - 0.5f)), static_cast<int32_t>(m_Width) - 1);
+	triangle.maxY = std::min(static_cast<int32_t>(std::floor(maxY - 0.5f)), static_cast<int32_t>(m_Height) - 1);
+	if (triangle.minX <= triangle.maxX && triangle.minY <= triangle.maxY)
+	{
+		triangles.push_back(triangle);
+	}
+}
+
+void OcclusionCuller::RasterizeTileRow(uint32_t tileRow)
+{
+	const int32_t firstY = static_cast<int32_t>(tileRow * TileSize);
+	const int32_t lastY = firstY + static_cast<int32_t>(TileSize) - 1;
+	std::fill(m_Depth.begin() + firstY * m_Width, m_Depth.begin() + (lastY + 1) * m_Width, 0.0f);
+
+	const Floats zero = Set(0.0f);
+	const Floats laneCenters = LaneCenters();
+	for (const std::vector<ScreenTriangle>& triangles : m_WorkerTriangles)
+	{
+		for (const ScreenTriangle& triangle : triangles)
+		{
+			if (triangle.maxY < firstY || triangle.minY > lastY)
+				continue;
+
+			// Edge i runs from corner i to the next, the triangle is where all three
+			// a x + b y + c are at or above zero. Each is twice the area of the triangle
+			// it spans with the pixel, which weighs the opposite corner's depth.
+			float edgeA[3];
+			float edgeB[3];
+			float edgeC[3];
+			for (uint32_t i = 0; i < 3; i++)
+			{
+				const uint32_t next = (i + 1) % 3;
+				edgeA[i] = triangle.y[i] - triangle.y[next];
+				edgeB[i] = triangle.x[next] - triangle.x[i];
+				edgeC[i] = -(edgeA[i] * triangle.x[i] + edgeB[i] * triangle.y[i]);
+			}
+			const float inverseArea = 1.0f / (edgeA[0] * triangle.x[2] + edgeB[0] * triangle.y[2] + edgeC[0]);
+			const float depthA = (triangle.z[0] * edgeA[1] + triangle.z[1] * edgeA[2] + triangle.z[2] * edgeA[0]) * inverseArea;
+			const float depthB = (triangle.z[0] * edgeB[1] + triangle.z[1] * edgeB[2] + triangle.z[2] * edgeB[0]) * inverseArea;
+			const float depthC = (triangle.z[0] * edgeC[1] + triangle.z[1] * edgeC[2] + triangle.z[2] * edgeC[0]) * inverseArea;
+
+			const int32_t startX = triangle.minX / Width * Width;
+			const Floats edgeSteps[3] = { Set(edgeA[0] * Width), Set(edgeA[1] * Width), Set(edgeA[2] * Width) };
+			const Floats depthStep = Set(depthA * Width);
+			for (int32_t y = std::max(triangle.minY, firstY); y <= std::min(triangle.maxY, lastY); y++)
+			{
+				const float centerY = y + 0.5f;
+				Floats edges[3];
+				for (uint32_t i = 0; i < 3; i++)
+				{
+					edges[i] = Add(Set(edgeA[i] * startX + edgeB[i] * centerY + edgeC[i]), Mul(Set(edgeA[i]), laneCenters));
+				}
+				Floats depth = Add(Set(depthA * startX + depthB * centerY + depthC), Mul(Set(depthA), laneCenters));
+
+				float* row = &m_Depth[y * m_Width];
+				for (int32_t x = startX; x <= triangle.maxX; x += Width)
+				{
+					const Floats inside = And(And(GreaterEqual(edges[0], zero), GreaterEqual(edges[1], zero)), GreaterEqual(edges[2], zero));
+					if (Mask(inside))
+					{
+						Store(row + x, Max(Load(row + x), And(inside, depth)));
+					}
+
+					for (uint32_t i = 0; i < 3; i++)
+					{
+						edges[i] = Add(edges[i], edgeSteps[i]);
+					}
+					depth = Add(depth, depthStep);
+				}
+			}
+		}
+	}
+
+	// the farthest depth of every tile in the row
+	const uint32_t tilesX = m_Width / TileSize;
+	for (uint32_t tileX = 0; tileX < tilesX; tileX++)
+	{
+		float farthest = FLT_MAX;
+		for (int32_t y = firstY; y <= lastY; y++)
+		{
+			const float* row = &m_Depth[y * m_Width + tileX * TileSize];
+			farthest = std::min(farthest, *std::min_element(row, row + TileSize));
+		}
+		m_TileDepth[tileRow * tilesX + tileX] = farthest;
+	}
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "VkStructs.h"
+
+// A mesh's triangles as the occlusion buffer sees them, see OcclusionCuller::BuildOccluder.
+struct Occluder
+{
+	// three object space corners per triangle, empty when the mesh doesn't occlude
+	std::vector<glm::vec3> corners;
+};
+
+// Software occlusion culling against a low resolution depth buffer on the CPU,
+// with no readback from the GPU. The largest occluders on screen are rasterized
+// into it, eight pixels of a row at a time with AVX when the build enables it
+// and four with SSE otherwise. Each job of the job system takes one row of tiles.
+// Every tile also keeps its farthest depth, so most boxes are tested per tile.
+// Only the pixels of tiles that are not covered throughout are read.
+//
+// Depth is stored as 1 / w, which interpolates linearly across the screen and
+// grows towards the camera whatever depth range the projection maps to. Like the
+// GPU, occluders cover the pixels whose centers they cover. A box is occluded when
+// its nearest corner lies behind the buffer at every pixel its screen rectangle
+// touches.
+class OcclusionCuller
+{
+public:
+	struct Settings
+	{
+		// of the depth buffer, rounded up to whole tiles
+		uint32_t width = 320;
+		uint32_t height = 180;
+		// rasterized per frame, from the occluders covering most of the screen down
+		uint32_t maxTriangles = 16384;
+		// smallest fraction of the screen an occluder's box covers
+		float minOccluderArea = 0.01f;
+	};
+
+	struct OccluderInstance
+	{
+		const Occluder* occluder;
+		const glm::mat4* transform;
+		// the world space box, center and half extent
+		glm::vec3 center;
+		glm::vec3 extent;
+	};
+
+	static constexpr uint32_t TileSize = 8;
+	// meshes with more triangles are left out, they'd cost more than they hide
+	static constexpr uint32_t MaxOccluderTriangles = 4096;
+
+public:
+	OcclusionCuller();
+	explicit OcclusionCuller(const Settings& settings);
+
+	// Copies the full level's triangles of small enough meshes, without index ranges
+	// the indices address the whole mesh, see Mesh.
+	static void BuildOccluder(const Vertex* vertices, const uint32_t* indices, uint32_t numIndices,
+		const IndexRange* ranges, uint32_t numRanges, Occluder& occluder);
+
+	// Clears the buffer and rasterizes the candidates the settings pick, in parallel
+	// on the job system.
+	void Render(const glm::mat4& viewProjection, const OccluderInstance* candidates, uint32_t numCandidates);
+	// True when the world space box is hidden behind what Render() drew. Only reads
+	// the buffer, boxes test in parallel.
+	bool IsOccluded(const glm::vec3& center, const glm::vec3& extent) const;
+
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+	// of the last Render()
+	uint32_t GetOccluderCount() const { return m_NumOccluders; }
+	uint32_t GetTriangleCount() const { return m_NumTriangles; }
+
+private:
+	struct ScreenRect
+	{
+		float minX;
+		float minY;
+		float maxX;
+		float maxY;
+		// the largest 1 / w of the box
+		float nearest;
+	};
+
+	// corners in pixels and 1 / w, counter-clockwise
+	struct ScreenTriangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+		// the pixels whose centers the triangle's bounds hold
+		int32_t minX;
+		int32_t minY;
+		int32_t maxX;
+		int32_t maxY;
+	};
+
+	// false when the box reaches in front of the near plane, where it can't be projected
+	bool ProjectBox(const glm::vec3& center, const glm::vec3& extent, ScreenRect& rect) const;
+	// Clips the triangle in clip space to the screen and the near plane and adds what's left.
+	void AddTriangle(const glm::vec4 corners[3], std::vector<ScreenTriangle>& triangles) const;
+	void AddClippedTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, std::vector<ScreenTriangle>& triangles) const;
+	void RasterizeTileRow(uint32_t tileRow);
+
+private:
+	Settings m_Settings;
+	uint32_t m_Width;
+	uint32_t m_Height;
+	glm::mat4 m_ViewProjection = glm::mat4(1.0f);
+	// 1 / w per pixel, zero where nothing was drawn
+	std::vector<float> m_Depth;
+	// per tile the smallest of its pixels' depths
+	std::vector<float> m_TileDepth;
+	// set up by every worker, rasterized by all of them
+	std::vector<std::vector<ScreenTriangle>> m_WorkerTriangles;
+	std::vector<OccluderInstance> m_Occluders;
+	uint32_t m_NumOccluders = 0;
+	uint32_t m_NumTriangles = 0;
+};
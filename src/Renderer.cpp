@@ -8,11 +8,14 @@
 #include <WinBase.h>
 #include <vulkan/vulkan.h>
 
+#include "JobSystem.h"
 #include "Logger.h"
 #include "Window.h"
 #include "imgui/lib/imgui_impl_vulkan.h"
 #include "exception/RendererException.h"
 #include "Scene.h"
+#include "Timer.h"
+#include "VirtualTexture.h"
 #include "event/EventManager.h"
 
 //#define SHOW_EXTRA_INFO
@@ -36,6 +39,9 @@ Renderer::Renderer(uint16_t width, uint16_t height, Window* window, ImGuiManager
 	m_PhysicalDevice = PickPhysicalDevice(m_Instance, features);
 	m_PhysicalDeviceInfo = GetPhysicalDeviceInfo(m_PhysicalDevice);
 
+	// optional, cooked textures fall back to RGBA8 on devices without it
+	features.textureCompressionBC = m_PhysicalDeviceInfo.features.textureCompressionBC;
+
 	m_Surface = (VkSurfaceKHR)m_Window->CreateVulkanSurface(m_Instance, m_Allocator);
 
 	std::vector<OptionalVulkanRequest> desiredExtensions;
@@ -72,32 +78,58 @@ Renderer::Renderer(uint16_t width, uint16_t height, Window* window, ImGuiManager
 		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 	};
-	m_DescriptorPool[0] = CreateDescriptorPool(types, _countof(types), 1000, 10000, true);
-	m_DescriptorPool[1] = CreateDescriptorPool(types, _countof(types), 1000, 10000, true);
+	// one pool per job worker, so workers can allocate without synchronizing with each other
+	const uint32_t workerCount = JobSystem::Get()->GetWorkerCount();
+	m_DescriptorPool.resize(workerCount);
+	for (uint32_t i = 0; i < workerCount; i++)
+		m_DescriptorPool[i] = CreateDescriptorPool(types, _countof(types), 1000, 10000, true);
 	VkDescriptorType uboTypes[] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER };
 	VkDescriptorType cisTypes[] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
 	m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_VERTEX_UNIFORM] = CreateDescriptorSetLayout(uboTypes, _countof(uboTypes), 1, VK_SHADER_STAGE_VERTEX_BIT);
 	m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_FRAGMENT_UNIFORM] = CreateDescriptorSetLayout(uboTypes, _countof(uboTypes), 1, VK_SHADER_STAGE_FRAGMENT_BIT);
 	m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_FRAGMENT_UNIFORM_BUFFER_COMBINED_IMAGE_SAMPLER] =
 		CreateDescriptorSetLayout(cisTypes, _countof(cisTypes), 1, VK_SHADER_STAGE_FRAGMENT_BIT);
-	m_GraphicsCommandPool[0] = CreateCommandPool(true, false, m_GraphicsQueueIndex);
-	m_GraphicsCommandPool[1] = CreateCommandPool(true, false, m_GraphicsQueueIndex);
-	m_TransferCommandPool[0] = CreateCommandPool(true, true, m_TransferQueueIndex);
-	m_TransferCommandPool[1] = CreateCommandPool(true, true, m_TransferQueueIndex);
+	// page cache and indirection texture of the virtual texture
+	VkDescriptorType virtualTextureTypes[] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
+	m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_VIRTUAL_TEXTURE] =
+		CreateDescriptorSetLayout(virtualTextureTypes, _countof(virtualTextureTypes), 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+	// two extra slots past the workers, for the texture uploader and texture streamer threads
+	m_GraphicsCommandPool.resize(workerCount + 2);
+	m_TransferCommandPool.resize(workerCount + 2);
+	for (uint32_t i = 0; i < workerCount + 2; i++)
+	{
+		m_GraphicsCommandPool[i] = CreateCommandPool(true, false, m_GraphicsQueueIndex);
+		m_TransferCommandPool[i] = CreateCommandPool(true, true, m_TransferQueueIndex);
+	}
 	CreateGraphicsCommandBuffers(m_CommandBuffers);
 
 	Shader shaders[2];
 	shaders[0] = CreateShader("./Shaders/vertexshader.spv", VK_SHADER_STAGE_VERTEX_BIT);
 	shaders[1] = CreateShader("./Shaders/fragmentshader.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 
-	VkDescriptorSetLayout layoutMvpLightTexture[] = { m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_VERTEX_UNIFORM], m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_FRAGMENT_UNIFORM_BUFFER_COMBINED_IMAGE_SAMPLER] };
+	VkDescriptorSetLayout layoutMvpLightTexture[] = { m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_VERTEX_UNIFORM], m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_FRAGMENT_UNIFORM_BUFFER_COMBINED_IMAGE_SAMPLER],
+		m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_VIRTUAL_TEXTURE] };
 	VkDescriptorSetLayout layoutMvpLight[] = { m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_VERTEX_UNIFORM], m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_FRAGMENT_UNIFORM] };
 	m_PipelineLayouts[GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE] = CreatePipelineLayout(_countof(layoutMvpLightTexture), layoutMvpLightTexture);
 	m_PipelineLayouts[GRAPHICS_PIPELINE_TYPE_MVP_LIGHT] = CreatePipelineLayout(_countof(layoutMvpLight), layoutMvpLight);
+	m_PipelineLayouts[GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE_COMPACT] = CreatePipelineLayout(_countof(layoutMvpLightTexture), layoutMvpLightTexture);
 	m_GraphicsPipelines[GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE] = CreateGraphicsPipeline(shaders, _countof(shaders), m_PipelineLayouts[GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE], m_RenderPass);
 	//m_GraphicsPipelines[GRAPHICS_PIPELINE_TYPE_MVP_LIGHT] = CreateGraphicsPipeline(shaders, _countof(shaders), m_PipelineLayouts[GRAPHICS_PIPELINE_TYPE_MVP_LIGHT], m_RenderPass);
 
 	vkDestroyShaderModule(m_LogicalDevice, shaders[0].shader, m_Allocator);
+
+	// without the compact shader every mesh keeps the float format
+	shaders[0] = CreateShader("./Shaders/compactvertexshader.spv", VK_SHADER_STAGE_VERTEX_BIT);
+	if (shaders[0].shader != VK_NULL_HANDLE)
+	{
+		m_GraphicsPipelines[GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE_COMPACT] = CreateGraphicsPipeline(shaders, _countof(shaders),
+			m_PipelineLayouts[GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE_COMPACT], m_RenderPass, VERTEX_FORMAT_COMPACT);
+		vkDestroyShaderModule(m_LogicalDevice, shaders[0].shader, m_Allocator);
+	}
+	else
+	{
+		Logger::Info("Compact vertex shader is missing, run Shaders/build.bat. Meshes keep the float vertex format\n");
+	}
 	vkDestroyShaderModule(m_LogicalDevice, shaders[1].shader, m_Allocator);
 
 	CreateVertexBuffer();
@@ -191,6 +223,10 @@ bool Renderer::BeginFrame(float deltaTime) {
 	vkResetCommandBuffer(m_CurrCmdBuf, 0);
 	vkBeginCommandBuffer(m_CurrCmdBuf, &cmdBeginInfo);
 
+	// page uploads go before the render pass, the fence above means this slot's feedback is readable
+	if (VirtualTexture* virtualTexture = VirtualTexture::Get())
+		virtualTexture->Update(m_CurrCmdBuf, m_CurrentFrame);
+
 	// color -> depth
 	VkClearValue clearValues[2]{};
 	clearValues[0].color.float32[0] = 0.7f;
@@ -238,15 +274,36 @@ bool Renderer::BeginFrame(float deltaTime) {
 		}
 		ImGui::End();	
 	}
+
+	if (ImGui::Begin("Level of detail"))
+	{
+		ImGui::SliderFloat("Pixel error", &m_LodSettings.pixelError, 0.25f, 16.0f);
+		ImGui::SliderFloat("Hysteresis", &m_LodSettings.hysteresis, 0.0f, 0.9f);
+		ImGui::SliderInt("Force level", &m_LodSettings.forcedLevel, -1, (int)MaxMeshLods - 1);
+	}
+	ImGui::End();
 	
 	return true;
 }
 
 void Renderer::RenderFrame(float deltaTime) {
-	vkCmdBindPipeline(m_CurrCmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipelines[GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE]);
+	const PipelineType pipelineTypes[VERTEX_FORMAT_MAX] = { GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE, GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE_COMPACT };
+
+	// once for the main and the feedback pass
+	CullMeshes();
 
 	// draw commands
-	DrawAllMeshes(m_CurrCmdBuf, m_FrameIndex);
+	for (uint32_t format = 0; format < VERTEX_FORMAT_MAX; format++)
+	{
+		VkPipeline pipeline = m_GraphicsPipelines[pipelineTypes[format]];
+		if (pipeline == VK_NULL_HANDLE)
+			continue;
+
+		vkCmdBindPipeline(m_CurrCmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		if (const VirtualTexture* virtualTexture = VirtualTexture::Get())
+			virtualTexture->Bind(m_CurrCmdBuf);
+		DrawAllMeshes(m_CurrCmdBuf, m_FrameIndex, (VertexFormat)format);
+	}
 	m_ImGuiManager.Draw(this, deltaTime);
 	// end draw
 }
@@ -256,6 +313,19 @@ void Renderer::EndFrame()
 	m_ImGuiManager.EndFrame(m_CurrCmdBuf);
 	
 	vkCmdEndRenderPass(m_CurrCmdBuf);
+
+	// the scene again at low resolution, writing the virtual texture pages it samples
+	VirtualTexture* virtualTexture = VirtualTexture::Get();
+	if (virtualTexture && virtualTexture->BeginFeedbackPass(m_CurrCmdBuf))
+	{
+		for (uint32_t format = 0; format < VERTEX_FORMAT_MAX; format++)
+		{
+			if (virtualTexture->BindFeedbackPipeline(m_CurrCmdBuf, (VertexFormat)format))
+				DrawAllMeshes(m_CurrCmdBuf, m_FrameIndex, (VertexFormat)format);
+		}
+		virtualTexture->EndFeedbackPass(m_CurrCmdBuf, m_CurrentFrame);
+	}
+
 	vkEndCommandBuffer(m_CurrCmdBuf);
 
 	VkPipelineStageFlags stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
@@ -271,6 +341,7 @@ void Renderer::EndFrame()
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = &m_CurrQueueSubmt;
 
+	std::unique_lock<std::mutex> queueLock(m_QueueSubmitMutex);
 	VkResult result = vkQueueSubmit(m_GraphicsQueue[0], 1, &submitInfo, m_CurrFence);
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
@@ -289,6 +360,7 @@ void Renderer::EndFrame()
 	presentInfo.pResults = VK_NULL_HANDLE;
 
 	result = vkQueuePresentKHR(m_GraphicsQueue[0], &presentInfo);
+	queueLock.unlock();
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		RecreateSwapchain();
@@ -298,8 +370,9 @@ void Renderer::EndFrame()
 	m_CurrentFrame = (m_CurrentFrame + 1) % m_Framecount;
 }
 
-void Renderer::AddScene(const class Scene* scene) {
+void Renderer::AddScene(class Scene* scene) {
 	m_Meshes.push_back(scene);
+	m_GatherInstances = true;
 }
 
 VkFence Renderer::CreateFence() const
@@ -366,10 +439,10 @@ ImGui_ImplVulkan_InitInfo Renderer::GetVulkanImGuiInitInfo() const
 	return initInfo;
 }
 
-void Renderer::CopyBufferToImage(VkCommandBuffer commandBuffer, const GPUBuffer& buffer, const GPUImage& image, VkImageLayout imageLayout) const
+void Renderer::CopyBufferToImage(VkCommandBuffer commandBuffer, const GPUBuffer& buffer, const GPUImage& image, VkImageLayout imageLayout, uint64_t bufferOffset) const
 {
 	VkBufferImageCopy copyRegion;
-	copyRegion.bufferOffset = 0;
+	copyRegion.bufferOffset = bufferOffset;
 	copyRegion.bufferRowLength = 0;
 	copyRegion.bufferImageHeight = 0;
 	copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -384,6 +457,77 @@ void Renderer::CopyBufferToImage(VkCommandBuffer commandBuffer, const GPUBuffer&
 	vkCmdCopyBufferToImage(commandBuffer, buffer.buffer, image.image, imageLayout, 1, &copyRegion);
 }
 
+void Renderer::CopyBufferToImageLevels(VkCommandBuffer commandBuffer, const GPUBuffer& buffer, const GPUImage& image, VkImageLayout imageLayout, const std::vector<uint64_t>& levelOffsets) const
+{
+	std::vector<VkBufferImageCopy> copyRegions(levelOffsets.size());
+
+	for (uint32_t i = 0; i < (uint32_t)levelOffsets.size(); i++)
+	{
+		VkBufferImageCopy& copyRegion = copyRegions[i];
+		copyRegion.bufferOffset = levelOffsets[i];
+		copyRegion.bufferRowLength = 0;
+		copyRegion.bufferImageHeight = 0;
+		copyRegion.imageSubresource.aspectMask = image.aspect;
+		copyRegion.imageSubresource.layerCount = 1;
+		copyRegion.imageSubresource.mipLevel = i;
+		copyRegion.imageSubresource.baseArrayLayer = 0;
+		copyRegion.imageOffset = {};
+		copyRegion.imageExtent.depth = 1;
+		copyRegion.imageExtent.width = std::max(1u, (uint32_t)image.width >> i);
+		copyRegion.imageExtent.height = std::max(1u, (uint32_t)image.height >> i);
+	}
+
+	vkCmdCopyBufferToImage(commandBuffer, buffer.buffer, image.image, imageLayout, (uint32_t)copyRegions.size(), copyRegions.data());
+}
+
+bool Renderer::IsSampledFormatSupported(VkFormat format) const
+{
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(m_PhysicalDevice, format, &properties);
+	// every texture is sampled with a linear filter
+	const VkFormatFeatureFlags features = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return (properties.optimalTilingFeatures & features) == features;
+}
+
+VkMemoryPropertyFlags Renderer::GetHostCachedMemoryProperties() const
+{
+	const VkMemoryPropertyFlags candidates[] =
+	{
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+	};
+
+	const VkPhysicalDeviceMemoryProperties& memoryProperties = m_PhysicalDeviceInfo.memoryProperties;
+	for (VkMemoryPropertyFlags candidate : candidates)
+	{
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		{
+			if ((memoryProperties.memoryTypes[i].propertyFlags & candidate) == candidate)
+			{
+				return candidate;
+			}
+		}
+	}
+
+	return VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+void Renderer::FlushBuffer(const GPUBuffer& buffer, uint64_t offset, uint64_t size) const
+{
+	const uint64_t atomSize = m_PhysicalDeviceInfo.properties.limits.nonCoherentAtomSize;
+	const uint64_t end = (offset + size + atomSize - 1) / atomSize * atomSize;
+
+	VkMappedMemoryRange range;
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.pNext = nullptr;
+	range.memory = buffer.memory;
+	range.offset = offset - offset % atomSize;
+	// the allocation may not end on an atom, VK_WHOLE_SIZE covers its tail
+	range.size = end > buffer.size ? VK_WHOLE_SIZE : end - range.offset;
+
+	VkRes(vkFlushMappedMemoryRanges(m_LogicalDevice, 1, &range), "Failed to flush mapped memory");
+}
+
 void Renderer::GenerateMipMaps(VkCommandBuffer commandBuffer, GPUImage& image) const
 {
 	VkOffset3D srcExtent = { image.width, image.height, 1 };
@@ -1011,6 +1155,14 @@ void Renderer::CreateImageView(GPUImage& image) const {
 	createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
 	createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
 	createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	// the gray textures, with alpha in the second channel, read as RGBA like every other texture
+	if (image.format.format == VK_FORMAT_R8_SRGB || image.format.format == VK_FORMAT_R8G8_SRGB)
+	{
+		createInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+		createInfo.components.g = VK_COMPONENT_SWIZZLE_R;
+		createInfo.components.b = VK_COMPONENT_SWIZZLE_R;
+		createInfo.components.a = image.format.format == VK_FORMAT_R8G8_SRGB ? VK_COMPONENT_SWIZZLE_G : VK_COMPONENT_SWIZZLE_ONE;
+	}
 	createInfo.subresourceRange.aspectMask = image.aspect;
 	createInfo.subresourceRange.baseMipLevel = 0;
 	createInfo.subresourceRange.levelCount = image.mipLevels;
@@ -1196,7 +1348,7 @@ uint32_t Renderer::FindMemoryIndex(uint32_t typeFilter, VkMemoryHeapFlags flags)
 	const VkMemoryType* types = m_PhysicalDeviceInfo.memoryProperties.memoryTypes;
 	
 	for (uint32_t i = 0; i < memoryTypeCount; i++) {
-		bool supportedType = typeFilter & (i << 1);
+		bool supportedType = typeFilter & (1u << i);
 		bool supportedFlag = (types[i].propertyFlags & flags) == flags;
 
 		if (supportedType && supportedFlag) {
@@ -1453,7 +1605,8 @@ VkPipelineLayout Renderer::CreatePipelineLayout(uint32_t setCount, VkDescriptorS
 	return layout;
 }
 
-VkPipeline Renderer::CreateGraphicsPipeline(Shader* shaders, uint32_t shaderCount, VkPipelineLayout pipelineLayout, VkRenderPass renderPass) const {
+VkPipeline Renderer::CreateGraphicsPipeline(Shader* shaders, uint32_t shaderCount, VkPipelineLayout pipelineLayout, VkRenderPass renderPass,
+										   VertexFormat vertexFormat) const {
 	VkPipeline pipeline;
 
 	VkPipelineShaderStageCreateInfo* stageCreateInfos = (VkPipelineShaderStageCreateInfo*)alloca(sizeof(VkPipelineShaderStageCreateInfo) * shaderCount);
@@ -1489,6 +1642,18 @@ VkPipeline Renderer::CreateGraphicsPipeline(Shader* shaders, uint32_t shaderCoun
 	vertexAttributes[2].format = VK_FORMAT_R32G32_SFLOAT;
 	vertexAttributes[2].offset = sizeof(glm::vec3) * 2;
 
+	if (vertexFormat == VERTEX_FORMAT_COMPACT)
+	{
+		// the shader dequantizes, see VertexQuantizer
+		vertexBindings[0].stride = sizeof(CompactVertex);
+		vertexAttributes[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+		vertexAttributes[0].offset = offsetof(CompactVertex, pos);
+		vertexAttributes[1].format = VK_FORMAT_R16G16_SNORM;
+		vertexAttributes[1].offset = offsetof(CompactVertex, normal);
+		vertexAttributes[2].format = VK_FORMAT_R16G16_SFLOAT;
+		vertexAttributes[2].offset = offsetof(CompactVertex, texCoord);
+	}
+
 	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo;
 	vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	vertexInputCreateInfo.pNext = nullptr;
@@ -1749,18 +1914,22 @@ void Renderer::EndTransientTransferCommandBuffer(VkCommandBuffer commandBuffer,
 	VkQueue queue;
 	VkCommandPool pool;
 
+	// there are more workers than hardware queues, so workers share them round-robin
 	if (isGraphics)
 	{
-		queue = m_GraphicsQueue[threadId];
+		queue = m_GraphicsQueue[threadId % _countof(m_GraphicsQueue)];
 		pool = m_GraphicsCommandPool[threadId];
 	}
 	else
 	{
-		queue = m_TransferQueue[threadId];
+		queue = m_TransferQueue[threadId % _countof(m_TransferQueue)];
 		pool = m_TransferCommandPool[threadId];
 	}
 
-	vkQueueSubmit(queue, 1, &submit, fenceToSignal);
+	{
+		std::lock_guard<std::mutex> queueLock(m_QueueSubmitMutex);
+		vkQueueSubmit(queue, 1, &submit, fenceToSignal);
+	}
 	
 	if (fenceToSignal) {
 		vkWaitForFences(m_LogicalDevice, 1, &fenceToSignal, VK_TRUE, UINT64_MAX);
@@ -1991,7 +2160,8 @@ VkSampler Renderer::CreateSampler() const
 	createInfo.compareEnable = VK_FALSE;
 	createInfo.compareOp = VK_COMPARE_OP_NEVER;
 	createInfo.minLod = 0.0f;
-	createInfo.maxLod = 1.0f;
+	// image views only cover resident levels, so the whole view may be sampled
+	createInfo.maxLod = VK_LOD_CLAMP_NONE;
 	createInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_WHITE;
 	createInfo.unnormalizedCoordinates = VK_FALSE;
 
@@ -2078,9 +2248,117 @@ void Renderer::RecreateSwapchain() {
 	}
 }
 
-void Renderer::DrawAllMeshes(VkCommandBuffer commandBuffer, uint32_t frameNum) {
-	for (const Scene* scene : m_Meshes) {
-		scene->Draw(commandBuffer, frameNum);
+void Renderer::CullMeshes()
+{
+	for (Scene* scene : m_Meshes) {
+		scene->UpdateTransforms();
+	}
+
+	// the instances point at the scenes' world transforms, only a new scene changes them
+	if (m_GatherInstances) {
+		uint32_t numInstances = 0;
+		for (const Scene* scene : m_Meshes) {
+			scene->GatherInstances(m_MeshInstances, numInstances);
+		}
+		m_NumMeshInstances = numInstances;
+		m_GatherInstances = false;
+
+		m_FrustumCuller.Resize(m_NumMeshInstances);
+		m_MeshVisibility.resize(m_NumMeshInstances);
+		for (uint32_t i = 0; i < m_NumMeshInstances; i++) {
+			m_FrustumCuller.SetBounds(i, m_MeshInstances[i].mesh->GetBounds(), *m_MeshInstances[i].transform);
+		}
+	}
+	else {
+		// the world bounds follow the nodes that moved, none for a static scene
+		uint32_t sceneInstances = 0;
+		for (const Scene* scene : m_Meshes) {
+			for (uint32_t node : scene->GetHierarchy().GetChangedNodes()) {
+				const uint32_t first = sceneInstances + scene->GetNodeFirstInstance(node);
+				for (uint32_t i = first; i < first + scene->GetNodeInstanceCount(node); i++) {
+					m_FrustumCuller.SetBounds(i, m_MeshInstances[i].mesh->GetBounds(), *m_MeshInstances[i].transform);
+				}
+			}
+			sceneInstances += scene->GetInstanceCount();
+		}
+	}
+
+	glm::vec4 planes[6];
+	FrustumCuller::ExtractPlanes(m_Projection * m_View, planes);
+
+	// a worker runs one job at a time, so it can add up its stats without synchronizing;
+	// the chunks are whole SIMD blocks of the culler
+	JobSystem* jobSystem = JobSystem::Get();
+	std::vector<MeshCullStats> workerStats(jobSystem->GetWorkerCount());
+	jobSystem->ParallelFor(m_NumMeshInstances, 16 * FrustumCuller::Width, [this, &planes, &workerStats](uint32_t begin, uint32_t end, uint32_t workerIndex)
+	{
+		MeshCullStats& stats = workerStats[workerIndex];
+		const uint32_t numVisible = m_FrustumCuller.Cull(planes, begin, end, &m_MeshVisibility[begin]);
+		stats.meshes += end - begin;
+		stats.meshesCulled += end - begin - numVisible;
+	});
+
+	// the frustum's survivors hide each other, the ones behind the largest on screen are dropped too
+	m_OcclusionTime = 0.0f;
+	if (m_OcclusionCulling)
+	{
+		Timer timer;
+		timer.Reset();
+
+		m_OccluderCandidates.clear();
+		for (uint32_t i = 0; i < m_NumMeshInstances; i++)
+		{
+			const MeshInstance& instance = m_MeshInstances[i];
+			if (m_MeshVisibility[i] && instance.occluder)
+				m_OccluderCandidates.push_back({ instance.occluder, instance.transform, m_FrustumCuller.GetCenter(i), m_FrustumCuller.GetExtent(i) });
+		}
+		m_OcclusionCuller.Render(m_Projection * m_View, m_OccluderCandidates.data(), (uint32_t)m_OccluderCandidates.size());
+
+		jobSystem->ParallelFor(m_NumMeshInstances, 64, [this, &workerStats](uint32_t begin, uint32_t end, uint32_t workerIndex)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				if (m_MeshVisibility[i] && m_OcclusionCuller.IsOccluded(m_FrustumCuller.GetCenter(i), m_FrustumCuller.GetExtent(i)))
+				{
+					m_MeshVisibility[i] = 0;
+					workerStats[workerIndex].meshesOccluded++;
+				}
+			}
+		});
+
+		timer.Tick();
+		m_OcclusionTime = timer.GetDeltaTime() * 1000.0f;
+	}
+
+	jobSystem->ParallelFor(m_NumMeshInstances, 64, [this, &workerStats](uint32_t begin, uint32_t end, uint32_t workerIndex)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			// Draw() still gets culled instances, for their texture streaming
+			if (m_MeshVisibility[i])
+				m_MeshInstances[i].mesh->Cull(m_MeshInstances[i], m_MeshletCulling, workerStats[workerIndex]);
+			else
+				m_MeshInstances[i].draws.clear();
+		}
+	});
+
+	m_CullStats = MeshCullStats();
+	for (const MeshCullStats& stats : workerStats)
+	{
+		m_CullStats.Add(stats);
+	}
+	if (m_OcclusionCulling)
+	{
+		m_CullStats.occluders = m_OcclusionCuller.GetOccluderCount();
+		m_CullStats.occluderTriangles = m_OcclusionCuller.GetTriangleCount();
+	}
+}
+
+void Renderer::DrawAllMeshes(VkCommandBuffer commandBuffer, uint32_t frameNum, VertexFormat vertexFormat) {
+	for (uint32_t i = 0; i < m_NumMeshInstances; i++) {
+		const MeshInstance& instance = m_MeshInstances[i];
+		if (instance.mesh->GetVertexFormat() == vertexFormat)
+			instance.mesh->Draw(commandBuffer, instance, frameNum);
 	}
 }
 
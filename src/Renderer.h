@@ -1,6 +1,10 @@
 #pragma once
 
+#include <mutex>
+
+#include "FrustumCuller.h"
 #include "Light.h"
+#include "OcclusionCuller.h"
 #include "VkStructs.h"
 #include "Window.h"
 #include "imgui/ImGuiManager.h"
@@ -30,6 +34,7 @@ enum DescriptorSetType
 	DESCRIPTOR_SET_TYPE_VERTEX_UNIFORM,
 	DESCRIPTOR_SET_TYPE_FRAGMENT_UNIFORM,
 	DESCRIPTOR_SET_TYPE_FRAGMENT_UNIFORM_BUFFER_COMBINED_IMAGE_SAMPLER,
+	DESCRIPTOR_SET_TYPE_VIRTUAL_TEXTURE,
 
 	DESCRIPTOR_SET_TYPE_MAX
 };
@@ -38,6 +43,8 @@ enum PipelineType
 {
 	GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE,
 	GRAPHICS_PIPELINE_TYPE_MVP_LIGHT,
+	// MVP_LIGHT_TEXTURE for meshes in VERTEX_FORMAT_COMPACT, null when its shader is missing
+	GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE_COMPACT,
 	
 	GRAPHICS_PIPELINE_TYPE_MAX
 };
@@ -57,6 +64,7 @@ public:
 public:
 	// Public API
 	VkDevice					GetLogicalDevice() const { return m_LogicalDevice; }
+	uint16_t					GetHeight() const { return m_Height; }
 	void*						MapBuffer(const GPUBuffer& buffer) const;
 	void						UnmapBuffer(const GPUBuffer& buffer) const;
 	void						DestroyBuffer(GPUBuffer& buffer) const;
@@ -68,6 +76,8 @@ public:
 	void						DestroyGraphicsCommandBuffers(std::vector<VkCommandBuffer>& commandBuffers) const;
 	GPUBuffer					CreateBuffer(uint64_t size, VkBufferUsageFlags usage, VkMemoryHeapFlags memoryProperties) const;
 	Shader						CreateShader(const char* shaderPath, VkShaderStageFlagBits shaderStage) const;
+	VkPipeline					CreateGraphicsPipeline(Shader* shaders, uint32_t shaderCount, VkPipelineLayout pipelineLayout, VkRenderPass renderPass,
+											   VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT) const;
 	GPUImage					CreateImage(VkFormat format, VkImageAspectFlags aspect, VkImageUsageFlags usage, 
 											uint16_t width, uint16_t height, uint16_t mipLevels, VkSampleCountFlagBits sampleCount,
 											VkImageTiling tiling) const;
@@ -75,12 +85,16 @@ public:
 	void						DestroyImage(GPUImage& image) const;
 	void						GetViewportAndScissor(VkViewport& viewport, VkRect2D& scissor) const;
 	VkPipelineLayout			GetGraphicsPipelineLayout(PipelineType type) const { return m_PipelineLayouts[type]; }
+	VkPipeline					GetGraphicsPipeline(PipelineType type) const { return m_GraphicsPipelines[type]; }
 	VkDescriptorSetLayout		GetDescriptorSetLayout(DescriptorSetType type) const { return m_DescriptorSetLayouts[type]; }
 	VkDescriptorSet				CreateDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout setLayout, uint32_t setCount) const;
 	VkCommandBuffer				GetTransientTransferCommandBuffer(uint8_t threadId, bool isGraphics = false) const;
 	void						EndTransientTransferCommandBuffer(VkCommandBuffer commandBuffer, VkFence fenceToSignal, uint8_t threadId, bool isGraphics) const;
 	VkDescriptorPool			GetDescriptorPool(uint8_t threadId) const { return m_DescriptorPool[threadId]; }
-	void						AddScene(const class Scene* scene);
+	// command pool slots for the texture uploader and the texture streamer, threads outside the job system
+	uint8_t						GetUploaderThreadId() const { return (uint8_t)(m_GraphicsCommandPool.size() - 1); }
+	uint8_t						GetStreamerThreadId() const { return (uint8_t)(m_GraphicsCommandPool.size() - 2); }
+	void						AddScene(class Scene* scene);
 	VkFence						CreateFence() const;
 	void						DestroyFence(VkFence fence) const;
 	static const Renderer*		Get();
@@ -90,7 +104,16 @@ public:
 	void						ImageBarrier(VkCommandBuffer commandBuffer, GPUImage& image, VkAccessFlags srcMask,
 											 VkAccessFlags dstMask, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevel) const;
 	VkSampler					GetSampler() const { return m_Sampler; }
-	void						CopyBufferToImage(VkCommandBuffer commandBuffer, const GPUBuffer& buffer, const GPUImage& image, VkImageLayout imageLayout) const;
+	void						CopyBufferToImage(VkCommandBuffer commandBuffer, const GPUBuffer& buffer, const GPUImage& image, VkImageLayout imageLayout, uint64_t bufferOffset = 0) const;
+	// one region per mip level, levelOffsets[i] is where level i starts in buffer
+	void						CopyBufferToImageLevels(VkCommandBuffer commandBuffer, const GPUBuffer& buffer, const GPUImage& image, VkImageLayout imageLayout, const std::vector<uint64_t>& levelOffsets) const;
+	bool						IsSampledFormatSupported(VkFormat format) const;
+	// Host visible memory the CPU can also read back quickly: cached, and coherent as
+	// well if the device has such a type. Falls back to coherent uncached memory.
+	VkMemoryPropertyFlags		GetHostCachedMemoryProperties() const;
+	// Makes host writes to memory that isn't HOST_COHERENT visible to the device. The
+	// range is widened to whole nonCoherentAtomSize blocks.
+	void						FlushBuffer(const GPUBuffer& buffer, uint64_t offset, uint64_t size) const;
 	template<typename T>
 	static T					CalculateMipMaps(T width, T height)
 	{
@@ -128,7 +151,6 @@ private:
 	VkDescriptorSetLayout		CreateDescriptorSetLayout(VkDescriptorType* descriptorTypes, uint32_t typesCount, uint32_t descriptorCount, VkShaderStageFlagBits shaderStage) const;
 	VkCommandPool				CreateCommandPool(bool canReset, bool isTransient, uint32_t queueIndex) const;
 	VkPipelineLayout			CreatePipelineLayout(uint32_t setCount, VkDescriptorSetLayout* setLayout) const;
-	VkPipeline					CreateGraphicsPipeline(Shader* shaders, uint32_t shaderCount, VkPipelineLayout pipelineLayout, VkRenderPass renderPass) const;
 	void						CreateVertexBuffer();
 	void						CreateIndexBuffer();
 	GPUUniformBuffer			CreateMVPBuffer() const;
@@ -144,7 +166,10 @@ private:
 								 const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
 								 void* pUserData);
 	void						RecreateSwapchain();
-	void						DrawAllMeshes(VkCommandBuffer commandBuffer, uint32_t frameNum);
+	// gathers this frame's mesh instances and culls them across the job system
+	void						CullMeshes();
+	// only the meshes stored in vertexFormat, every format is drawn with its own pipeline
+	void						DrawAllMeshes(VkCommandBuffer commandBuffer, uint32_t frameNum, VertexFormat vertexFormat);
 	void						CalculateAndShowFps(float deltaTime) const;
 	void						MouseMoved(int64_t x, int64_t y);
 	void						RegisterForEvents();
@@ -174,10 +199,11 @@ private:
 	std::vector<VkFramebuffer>		m_Framebuffer;
 	VkRenderPass					m_RenderPass;
 	GPUImage						m_DepthBuffer;
-	VkDescriptorPool				m_DescriptorPool[2];
+	std::vector<VkDescriptorPool>	m_DescriptorPool;
 	VkDescriptorSetLayout			m_DescriptorSetLayouts[DESCRIPTOR_SET_TYPE_MAX];
-	VkCommandPool					m_GraphicsCommandPool[2];
-	VkCommandPool					m_TransferCommandPool[2];
+	std::vector<VkCommandPool>		m_GraphicsCommandPool;
+	std::vector<VkCommandPool>		m_TransferCommandPool;
+	mutable std::mutex				m_QueueSubmitMutex;
 	std::vector<VkCommandBuffer>	m_CommandBuffers;
 	GPUBuffer						m_VertexBuffer;
 	GPUBuffer						m_IndexBuffer;
@@ -196,13 +222,40 @@ private:
 	ImGuiManager&					m_ImGuiManager;
 	uint32_t						m_FrameIndex;
 private:
-	std::vector<const Scene*>		m_Meshes;
+	std::vector<Scene*>				m_Meshes;
+	// entries past m_NumMeshInstances are kept for their allocations
+	std::vector<MeshInstance>		m_MeshInstances;
+	uint32_t						m_NumMeshInstances = 0;
+	bool							m_GatherInstances = false;
+	// world bounds of the instances and whether they were inside the frustum this frame
+	FrustumCuller					m_FrustumCuller;
+	std::vector<uint8_t>			m_MeshVisibility;
+	// the visible instances' occluders, the culler rasterizes the largest on screen
+	OcclusionCuller					m_OcclusionCuller;
+	std::vector<OcclusionCuller::OccluderInstance> m_OccluderCandidates;
 public:
 	float							m_CameraPitch;
 	float							m_CameraYaw;
 	glm::mat4						m_View;
 	glm::mat4						m_Projection;
 	bool							m_MouseShowing = false;
+public:
+	struct LodSettings
+	{
+		// how far a level's surface may be off on screen, in pixels
+		float pixelError = 1.0f;
+		// a coarser level has to be this much below pixelError before it's picked
+		float hysteresis = 0.25f;
+		// debug override, draws every mesh at this level or its coarsest when not negative
+		int32_t forcedLevel = -1;
+	};
+	LodSettings						m_LodSettings;
+	bool							m_MeshletCulling = true;
+	bool							m_OcclusionCulling = true;
+	// of the last frame's CullMeshes
+	MeshCullStats					m_CullStats;
+	// rasterizing the occluders and testing against them, in milliseconds
+	float							m_OcclusionTime = 0.0f;
 public:
 	// per frame state
 	VkCommandBuffer					m_CurrCmdBuf;
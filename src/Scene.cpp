@@ -1,42 +1,137 @@
 #include "Scene.h"
 
+#include <algorithm>
 #include <filesystem>
-#include <thread>
+#include <numeric>
 
+#include "AssimpImporter.h"
 #include "Engine.h"
+#include "FrustumCuller.h"
+#include "GltfImporter.h"
+#include "ImportedScene.h"
+#include "JobSystem.h"
 #include "Logger.h"
-
-#include <assimp/Importer.hpp>
-#include <assimp/postprocess.h>
-#include <assimp/scene.h>
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "ObjImporter.h"
+#include "TextureAtlas.h"
 
 #include "exception/RendererException.h"
 #include "stb/stb_image.h"
 
-void TestThread(const aiScene* scene, Mesh* memory, const char* path, uint32_t indexStart, uint32_t indexEnd, uint8_t threadId);
+static std::string GetTexturePath(const ImportedScene& imported, const std::string& basePath, uint32_t meshIndex);
+static void CreateMesh(const ImportedScene& imported, Mesh* memory, const std::string& texturePath, uint32_t meshIndex, uint8_t threadId);
 
-Scene::Scene(const char* path)
+Scene::Scene(const char* path, bool buildTriangleBvhs)
 {
-    Assimp::Importer imp;
-    const aiScene* scene = imp.ReadFile(path, aiProcess_Triangulate | aiProcess_ConvertToLeftHanded |
-        aiProcess_GenNormals | aiProcess_JoinIdenticalVertices);
+    ImportedScene imported;
+    // keeps the cache (or the .glb) mapped while the meshes upload straight from it
+    MappedFile mapping;
+    const std::filesystem::path extension = std::filesystem::path(path).extension();
 
-    if (!scene)
+    // a .glb is already laid out for mapping, so it doesn't go through the mesh cache
+    // and is optimized on every load
+    if (extension == ".glb" && GltfImporter::Import(path, mapping, imported))
+    {
+        MeshOptimizer::Optimize(imported, MeshOptimizer::Settings());
+        Logger::Debug("Loaded %s with the glTF importer, ACMR %.3f -> %.3f\n", path,
+            imported.cacheStats.acmrBefore, imported.cacheStats.acmrAfter);
+    }
+    else
     {
-        Logger::Error("Failed to import model: %s: %s\n", path, imp.GetErrorString());
-        throw RendererException("Failed to load a model. Check console for extra info.");
+        LoadCachedOrImport(path, mapping, imported);
     }
 
-    m_Meshes = (Mesh*)malloc(sizeof(Mesh) * scene->mNumMeshes);
-    m_NumMeshes = scene->mNumMeshes;
+    m_Meshes = (Mesh*)malloc(sizeof(Mesh) * imported.meshes.size());
+    m_NumMeshes = (uint32_t)imported.meshes.size();
+    m_Occluders.resize(m_NumMeshes);
+    if (buildTriangleBvhs)
+    {
+        m_TriangleBvhs.resize(m_NumMeshes);
+    }
+
+    ParseMesh(imported, m_Meshes, path);
+
+    m_Hierarchy.Build(imported);
+    m_Hierarchy.UpdateWorldTransforms();
 
-    ParseMesh(scene, m_Meshes, path);
-    m_RootNode = ParseNode(scene->mRootNode);
+    const uint32_t numNodes = m_Hierarchy.GetNodeCount();
+    const uint32_t* nodeMeshes = m_Hierarchy.GetNodeMeshes();
+    m_FirstInstances.resize(numNodes + 1);
+    m_FirstInstances[0] = 0;
+    for (uint32_t node = 0; node < numNodes; node++)
+    {
+        const SceneHierarchy::MeshRange& range = m_Hierarchy.GetMeshRange(node);
+        m_FirstInstances[node + 1] = m_FirstInstances[node] + range.numMeshes;
+        for (uint32_t i = range.firstMesh; i < range.firstMesh + range.numMeshes; i++)
+        {
+            m_InstanceNodes.push_back(node);
+            m_InstanceMeshes.push_back(nodeMeshes[i]);
+        }
+    }
+
+    std::vector<Bvh::Bounds> bounds(GetInstanceCount());
+    for (uint32_t i = 0; i < GetInstanceCount(); i++)
+    {
+        const MeshBounds& meshBounds = m_Meshes[m_InstanceMeshes[i]].GetBounds();
+        bounds[i] = Bvh::Transform({ meshBounds.minimum, meshBounds.maximum }, m_Hierarchy.GetWorldTransform(m_InstanceNodes[i]));
+    }
+    m_Bvh.Build(bounds.data(), GetInstanceCount());
+    m_BuiltBvhCost = m_Bvh.GetCost();
+    Logger::Debug("Built the BVH of %s, %u instances, SAH cost %.1f\n", path, GetInstanceCount(), m_Bvh.GetCost());
+}
+
+void Scene::LoadCachedOrImport(const char* path, MappedFile& cacheMapping, ImportedScene& imported)
+{
+    std::string cachePath = MeshCache::GetCachePath(path);
+    uint64_t sourceHash = 0;
+    bool hasSourceHash = MeshCache::HashFile(path, sourceHash);
+    bool isObj = std::filesystem::path(path).extension() == ".obj";
+
+    // the materials live in the libraries, so editing one invalidates the cache as well
+    std::vector<std::string> materialLibraries;
+    if (hasSourceHash && isObj && ObjImporter::GetMaterialLibraries(path, materialLibraries))
+    {
+        for (const std::string& library : materialLibraries)
+        {
+            // a missing library still changes the key, and again once it shows up
+            uint64_t libraryHash = 0;
+            MeshCache::HashFile(library.c_str(), libraryHash);
+            sourceHash = MeshCache::Hash(&libraryHash, sizeof(libraryHash), sourceHash);
+        }
+    }
+
+    if (hasSourceHash && MeshCache::Load(cachePath.c_str(), sourceHash, AssimpImporter::ImportFlags, cacheMapping, imported))
+    {
+        Logger::Debug("Loaded %s from mesh cache, ACMR %.3f, ATVR %.3f\n", path,
+            imported.cacheStats.acmrAfter, imported.cacheStats.atvrAfter);
+        return;
+    }
+
+    if (!isObj || !ObjImporter::Import(path, imported))
+    {
+        if (isObj)
+        {
+            Logger::Info("Native OBJ import of %s failed, falling back to Assimp\n", path);
+            imported = ImportedScene();
+        }
+        AssimpImporter::Import(path, imported);
+    }
+
+    // optimized once here, the cache stores the reordered buffers
+    MeshOptimizer::Optimize(imported, MeshOptimizer::Settings());
+    Logger::Info("Optimized %s for the vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", path,
+        imported.cacheStats.acmrBefore, imported.cacheStats.acmrAfter,
+        imported.cacheStats.atvrBefore, imported.cacheStats.atvrAfter);
+
+    if (hasSourceHash && MeshCache::Write(cachePath.c_str(), sourceHash, AssimpImporter::ImportFlags, imported))
+    {
+        Logger::Debug("Wrote mesh cache %s\n", cachePath.c_str());
+    }
 }
 
 Scene::~Scene()
 {
-    delete m_RootNode;
     for (uint32_t i = 0; i < m_NumMeshes; i++)
     {
         m_Meshes[i].~Mesh();
@@ -44,149 +139,276 @@ Scene::~Scene()
     free(m_Meshes);
 }
 
-void Scene::Draw(VkCommandBuffer commandBuffer, uint32_t frameNum) const
+void Scene::SetTransform(const glm::mat4& transform)
+{
+    m_Hierarchy.SetRootTransform(transform);
+}
+
+void Scene::SetNodeTransform(uint32_t node, const glm::mat4& transform)
 {
-    m_RootNode->Draw(commandBuffer, m_Transform, frameNum);
+    m_Hierarchy.SetLocalTransform(node, transform);
 }
 
-Node* Scene::ParseNode(const aiNode* node)
+void Scene::UpdateTransforms()
 {
-    Transform nodeTransform;
-    nodeTransform.model = *(glm::mat4*)&node->mTransformation;
+    m_Hierarchy.UpdateWorldTransforms();
 
-    Mesh** meshes = new Mesh*[node->mNumMeshes];
+    const std::vector<uint32_t>& changedNodes = m_Hierarchy.GetChangedNodes();
+    if (changedNodes.empty())
+    {
+        return;
+    }
 
-    for (uint32_t i = 0; i < node->mNumMeshes; i++)
+    std::vector<uint32_t> instances;
+    std::vector<Bvh::Bounds> bounds;
+    for (uint32_t node : changedNodes)
     {
-        uint32_t meshId = node->mMeshes[i];
-        meshes[i] = &m_Meshes[meshId];
+        for (uint32_t i = m_FirstInstances[node]; i < m_FirstInstances[node + 1]; i++)
+        {
+            const MeshBounds& meshBounds = m_Meshes[m_InstanceMeshes[i]].GetBounds();
+            instances.push_back(i);
+            bounds.push_back(Bvh::Transform({ meshBounds.minimum, meshBounds.maximum }, m_Hierarchy.GetWorldTransform(node)));
+        }
     }
+    m_Bvh.Refit(instances.data(), bounds.data(), (uint32_t)instances.size());
 
-    Node* newNode = new Node(meshes, node->mNumMeshes, node->mNumChildren, nodeTransform);
-    for (uint32_t i = 0; i < node->mNumChildren; i++)
+    // refits only loosen the tree as things drift apart, build it anew once queries got twice as slow
+    if (m_Bvh.GetCost() > m_BuiltBvhCost * 2.0f)
     {
-        newNode->AddChildren(ParseNode(node->mChildren[i]));
+        bounds.resize(GetInstanceCount());
+        for (uint32_t i = 0; i < GetInstanceCount(); i++)
+        {
+            bounds[i] = m_Bvh.GetItemBounds(i);
+        }
+        m_Bvh.Build(bounds.data(), GetInstanceCount());
+        m_BuiltBvhCost = m_Bvh.GetCost();
     }
+}
+
+bool Scene::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const
+{
+    hit.instance = Bvh::InvalidIndex;
+    hit.triangle = Bvh::InvalidIndex;
+    hit.distance = maxDistance;
+    return m_Bvh.Raycast(origin, direction, hit.distance, [&](uint32_t instance, float distance)
+    {
+        uint32_t triangle = Bvh::InvalidIndex;
+        const float hitDistance = IntersectInstance(instance, origin, direction, distance, triangle);
+        if (hitDistance < distance)
+        {
+            hit.instance = instance;
+            hit.triangle = triangle;
+        }
+        return hitDistance;
+    });
+}
 
-    return newNode;
+bool Scene::HasLineOfSight(const glm::vec3& from, const glm::vec3& to) const
+{
+    // any hit will do, the first one ends the query
+    float distance = 1.0f;
+    return !m_Bvh.Raycast(from, to - from, distance, [&](uint32_t instance, float maxDistance)
+    {
+        uint32_t triangle;
+        return IntersectInstance(instance, from, to - from, maxDistance, triangle) < maxDistance ? 0.0f : maxDistance;
+    });
 }
 
-void Scene::ParseMesh(const aiScene* scene, void* memory, const char* path)
+float Scene::IntersectInstance(uint32_t instance, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& triangle) const
 {
-    uint32_t halfIndex = scene->mNumMeshes / 2;
+    float distance = maxDistance;
+    if (!Bvh::IntersectRay(m_Bvh.GetItemBounds(instance), origin, direction, maxDistance, distance))
+    {
+        return maxDistance;
+    }
+    if (m_TriangleBvhs.empty())
+    {
+        return distance;
+    }
 
-    std::vector<std::thread> threads;
+    // the ray in object space keeps its distances, the direction is scaled along with the mesh
+    const glm::mat4 inverse = glm::inverse(m_Hierarchy.GetWorldTransform(m_InstanceNodes[instance]));
+    const glm::vec3 objectOrigin = glm::vec3(inverse * glm::vec4(origin, 1.0f));
+    const glm::vec3 objectDirection = glm::vec3(inverse * glm::vec4(direction, 0.0f));
+    distance = maxDistance;
+    m_TriangleBvhs[m_InstanceMeshes[instance]].Raycast(objectOrigin, objectDirection, distance, triangle);
+    return distance;
+}
 
-    threads.push_back(std::thread(TestThread, scene, (Mesh*)memory, path, 0, halfIndex, 0));
-    threads.push_back(std::thread(TestThread, scene, (Mesh*)memory, path, halfIndex, scene->mNumMeshes, 1));
+void Scene::QueryBox(const Bvh::Bounds& box, std::vector<uint32_t>& instances) const
+{
+    m_Bvh.QueryBox(box, instances);
+}
 
-    threads[0].join();
-    threads[1].join();
+void Scene::QueryFrustum(const glm::mat4& viewProjection, std::vector<uint32_t>& instances) const
+{
+    glm::vec4 planes[6];
+    FrustumCuller::ExtractPlanes(viewProjection, planes);
+    m_Bvh.QueryFrustum(planes, instances);
 }
 
-void TestThread(const aiScene* scene, Mesh* memory, const char* path, uint32_t indexStart, uint32_t indexEnd, uint8_t threadId)
+void Scene::GatherInstances(std::vector<MeshInstance>& instances, uint32_t& numInstances) const
 {
-    for (uint32_t i = indexStart; i < indexEnd; i++)
-    {
-        const aiMesh* mesh = scene->mMeshes[i];
-        const uint32_t vertCount = mesh->mNumVertices;
-        const uint32_t faceCount = mesh->mNumFaces * 3;
-        
-        Vertex* vertices = new Vertex[vertCount];
-        uint32_t* indices = new uint32_t[faceCount];
-        
-        for (uint32_t j = 0; j < vertCount; j++)
+    const uint32_t* nodeMeshes = m_Hierarchy.GetNodeMeshes();
+    const uint32_t numNodes = m_Hierarchy.GetNodeCount();
+    for (uint32_t node = 0; node < numNodes; node++)
+    {
+        const SceneHierarchy::MeshRange& range = m_Hierarchy.GetMeshRange(node);
+        for (uint32_t i = range.firstMesh; i < range.firstMesh + range.numMeshes; i++)
         {
-            vertices[j].pos = *reinterpret_cast<glm::vec3*>(&mesh->mVertices[j]);
-            if (mesh->mNormals)
+            if (numInstances == instances.size())
+                instances.emplace_back();
+
+            const Mesh* mesh = &m_Meshes[nodeMeshes[i]];
+            MeshInstance& instance = instances[numInstances++];
+            if (instance.mesh != mesh)
             {
-                vertices[j].normal = *reinterpret_cast<glm::vec3*>(&mesh->mNormals[j]);
+                instance.mesh = mesh;
+                instance.lodLevel = 0;
             }
-
-            memcpy(&vertices[j].texCoord, &mesh->mTextureCoords[0][j], 2 * sizeof(float));
+            instance.transform = &m_Hierarchy.GetWorldTransform(node);
+            instance.occluder = &m_Occluders[nodeMeshes[i]];
         }
+    }
+}
 
-        uint32_t currentIndex = 0;
-        for (uint32_t k = 0; k < mesh->mNumFaces; k++)
-        {
-            assert(mesh->mFaces[k].mNumIndices == 3 && "Expected 3 indices per face.");
-            indices[currentIndex++] = mesh->mFaces[k].mIndices[0];
-            indices[currentIndex++] = mesh->mFaces[k].mIndices[1];
-            indices[currentIndex++] = mesh->mFaces[k].mIndices[2];
-        }
+void Scene::ParseMesh(const ImportedScene& imported, void* memory, const char* path)
+{
+    const uint32_t numMeshes = (uint32_t)imported.meshes.size();
+    const std::string basePath = std::filesystem::path(path).parent_path().string();
 
-        //Logger::Debug("Creating mesh number: %d\n", i);
+    // one job per mesh; the biggest meshes are submitted last so the owning worker
+    // pops them first and the small ones fill the gaps on the other workers
+    std::vector<uint32_t> order(numMeshes);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&imported](uint32_t a, uint32_t b)
+    {
+        return imported.meshes[a].numIndices < imported.meshes[b].numIndices;
+    });
 
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        aiString texPath;
-        std::filesystem::path basePath = std::filesystem::path(path).parent_path();
-        
-        if (material->GetTexture(aiTextureType_DIFFUSE, 0, &texPath) == aiReturn_SUCCESS)
+    std::vector<std::string> texturePaths(numMeshes);
+    std::vector<std::string> uniquePaths;
+    for (uint32_t i = 0; i < numMeshes; i++)
+    {
+        texturePaths[i] = GetTexturePath(imported, basePath, i);
+        if (!texturePaths[i].empty())
         {
-            std::string fullPath;
-            fullPath.append(basePath.string() + "/");
-            fullPath.append(texPath.C_Str());
-
-            new (&memory[i]) Mesh(
-                vertices,
-                vertCount,
-                indices,
-                faceCount,
-                fullPath.c_str(),
-                threadId
-            );
+            // packed textures are loaded as the atlas page the meshes will ask for
+            const TextureAtlas::Entry* atlasEntry = TextureAtlas::Get() ? TextureAtlas::Get()->Find(texturePaths[i].c_str()) : nullptr;
+            uniquePaths.push_back(atlasEntry ? atlasEntry->pagePath : texturePaths[i]);
         }
-        else
+    }
+    std::sort(uniquePaths.begin(), uniquePaths.end());
+    uniquePaths.erase(std::unique(uniquePaths.begin(), uniquePaths.end()), uniquePaths.end());
+
+    // decode and upload the whole texture set up front as one pipelined batch, the
+    // mesh jobs below then only pick up finished textures; the preload references
+    // are dropped once the meshes hold their own
+    std::vector<TextureCache::Handle> preloaded;
+    TextureCache::Get()->Preload(uniquePaths, preloaded);
+
+    JobSystem* jobSystem = JobSystem::Get();
+    JobCounter counter;
+
+    for (uint32_t meshIndex : order)
+    {
+        jobSystem->Submit([this, &imported, memory, &texturePaths, meshIndex](uint32_t workerIndex)
         {
-            new (&memory[i]) Mesh(
-                vertices,
-                vertCount,
-                indices,
-                faceCount,
-                nullptr,
-                threadId
-            );
-        }
+            CreateMesh(imported, (Mesh*)memory, texturePaths[meshIndex], meshIndex, (uint8_t)workerIndex);
 
-        delete[] vertices;
-        delete[] indices;
+            // from the full level of detail, whose ranges come first
+            const ImportedMesh& mesh = imported.meshes[meshIndex];
+            const IndexRange* ranges = imported.indexRanges.data() + mesh.firstIndexRange;
+            const uint32_t numRanges = mesh.numIndexRanges / std::max(mesh.numLods, 1u);
+            OcclusionCuller::BuildOccluder(mesh.vertices, mesh.indices, mesh.numIndices, ranges, numRanges, m_Occluders[meshIndex]);
+            if (!m_TriangleBvhs.empty())
+            {
+                m_TriangleBvhs[meshIndex].Build(mesh.vertices, mesh.indices, mesh.numIndices, ranges, numRanges);
+            }
+        }, &counter);
     }
-}
 
-Node::Node(Mesh** meshes, size_t numMeshes, uint32_t numChildren, const Transform& transform)
-    :
-    m_Transform(transform),
-    m_Meshes(meshes),
-    m_NumMeshes(numMeshes)
-{
-    m_Children = (Node**)malloc(sizeof(Node*) * numChildren);
-}
+    jobSystem->WaitFor(counter);
 
-Node::~Node()
-{
-    delete[] m_Meshes;
-    m_NumMeshes = 0;
-    for (uint32_t i = 0; i < m_NumChildren; i++)
+    uint32_t compactMeshes = 0;
+    uint32_t shortIndexMeshes = 0;
+    uint32_t lodMeshes = 0;
+    for (uint32_t i = 0; i < numMeshes; i++)
+    {
+        compactMeshes += ((Mesh*)memory)[i].GetVertexFormat() == VERTEX_FORMAT_COMPACT ? 1 : 0;
+        shortIndexMeshes += ((Mesh*)memory)[i].GetIndexType() == VK_INDEX_TYPE_UINT16 ? 1 : 0;
+        lodMeshes += ((Mesh*)memory)[i].GetNumLods() > 1 ? 1 : 0;
+    }
+    Logger::Debug("%u of %u meshes of %s use the compact vertex format, %u use 16-bit indices, %u have levels of detail\n",
+        compactMeshes, numMeshes, path, shortIndexMeshes, lodMeshes);
+
+    for (TextureCache::Handle texture : preloaded)
     {
-        m_Children[i]->~Node();
+        TextureCache::Get()->Release(texture);
     }
-    free(m_Children);
-    m_Children = nullptr;
-    m_NumChildren = 0;
 }
 
-void Node::Draw(VkCommandBuffer commandBuffer, glm::mat4 accumulatedTransform, uint32_t frameNum)
+static std::string GetTexturePath(const ImportedScene& imported, const std::string& basePath, uint32_t meshIndex)
 {
-    glm::mat4 mat = m_Transform.model * accumulatedTransform;
-    
-    for (size_t i = 0; i < m_NumMeshes; i++)
-		m_Meshes[i]->Draw(commandBuffer, mat, frameNum);
-    for (size_t i = 0; i < m_NumChildren; i++)
-    	m_Children[i]->Draw(commandBuffer, mat, frameNum);
+    const ImportedMesh& mesh = imported.meshes[meshIndex];
+
+    const char* texture = nullptr;
+    if (mesh.materialIndex < imported.materials.size())
+    {
+        texture = imported.materials[mesh.materialIndex].diffuseTexture;
+    }
+
+    if (!texture)
+    {
+        return std::string();
+    }
+
+    std::string fullPath;
+    fullPath.append(basePath + "/");
+    fullPath.append(texture);
+    return fullPath;
 }
 
-void Node::AddChildren(Node* children)
+static void CreateMesh(const ImportedScene& imported, Mesh* memory, const std::string& texturePath, uint32_t meshIndex, uint8_t threadId)
 {
-    m_Children[m_NumChildren] = children;
-    m_NumChildren++;
+    const ImportedMesh& mesh = imported.meshes[meshIndex];
+
+    //Logger::Debug("Creating mesh number: %d\n", meshIndex);
+
+    if (!texturePath.empty())
+    {
+        new (&memory[meshIndex]) Mesh(
+            mesh.vertices,
+            mesh.numVertices,
+            mesh.indices,
+            mesh.numIndices,
+            imported.indexRanges.data() + mesh.firstIndexRange,
+            mesh.numIndexRanges,
+            mesh.lodErrors,
+            mesh.numLods,
+            imported.meshlets.data() + mesh.firstMeshlet,
+            mesh.numMeshlets,
+            mesh.bounds,
+            texturePath.c_str(),
+            threadId
+        );
+    }
+    else
+    {
+        new (&memory[meshIndex]) Mesh(
+            mesh.vertices,
+            mesh.numVertices,
+            mesh.indices,
+            mesh.numIndices,
+            imported.indexRanges.data() + mesh.firstIndexRange,
+            mesh.numIndexRanges,
+            mesh.lodErrors,
+            mesh.numLods,
+            imported.meshlets.data() + mesh.firstMeshlet,
+            mesh.numMeshlets,
+            mesh.bounds,
+            nullptr,
+            threadId
+        );
+    }
 }
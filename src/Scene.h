@@ -2,38 +2,77 @@
 
 #include <string>
 
+#include "Bvh.h"
 #include "Mesh.h"
+#include "OcclusionCuller.h"
+#include "SceneHierarchy.h"
+#include "TriangleBvh.h"
 
-class Node;
+class MappedFile;
+struct ImportedScene;
 
 class Scene
 {
 public:
-    Scene(const char* path);
+    struct RayHit
+    {
+        uint32_t instance;
+        // in the mesh's full level of detail, InvalidIndex without triangle BVHs
+        uint32_t triangle;
+        float distance;
+    };
+
+public:
+    // Triangle BVHs keep a copy of every mesh's positions, for exact ray hits.
+    Scene(const char* path, bool buildTriangleBvhs = false);
     ~Scene();
-    void Draw(VkCommandBuffer commandBuffer, uint32_t frameNum) const;
+    // Both only mark what changed, UpdateTransforms() applies it.
+    void SetTransform(const glm::mat4& transform);
+    void SetNodeTransform(uint32_t node, const glm::mat4& transform);
+    // Recomputes the world transforms of the nodes that moved, nothing for a static
+    // scene. The hierarchy lists the nodes it updated until the next call.
+    void UpdateTransforms();
+    const SceneHierarchy& GetHierarchy() const { return m_Hierarchy; }
+
+    // Appends an instance per mesh of every node at instances[numInstances], reusing the
+    // entries there so the level of detail carries over. The instances point at the
+    // world transforms, they stay valid as long as the scene does.
+    void GatherInstances(std::vector<MeshInstance>& instances, uint32_t& numInstances) const;
+    // the node's instances, relative to where GatherInstances started
+    uint32_t GetNodeFirstInstance(uint32_t node) const { return m_FirstInstances[node]; }
+    uint32_t GetNodeInstanceCount(uint32_t node) const { return m_FirstInstances[node + 1] - m_FirstInstances[node]; }
+    uint32_t GetInstanceCount() const { return m_FirstInstances.back(); }
+    uint32_t GetInstanceNode(uint32_t instance) const { return m_InstanceNodes[instance]; }
+    uint32_t GetInstanceMesh(uint32_t instance) const { return m_InstanceMeshes[instance]; }
+
+    // World space queries against the instances' boxes as of the last UpdateTransforms(),
+    // with a distance in units of direction's length. Rays hit the triangles when the
+    // scene has triangle BVHs.
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+    // true when nothing is in the way between the points
+    bool HasLineOfSight(const glm::vec3& from, const glm::vec3& to) const;
+    void QueryBox(const Bvh::Bounds& box, std::vector<uint32_t>& instances) const;
+    void QueryFrustum(const glm::mat4& viewProjection, std::vector<uint32_t>& instances) const;
 private:
-    Node* ParseNode(const struct aiNode* node);
-    void ParseMesh(const struct aiScene* scene, void* memory, const char* path);
+    void LoadCachedOrImport(const char* path, MappedFile& cacheMapping, ImportedScene& imported);
+    void ParseMesh(const ImportedScene& imported, void* memory, const char* path);
+    // where the instance is hit between 0 and maxDistance, maxDistance when it isn't
+    float IntersectInstance(uint32_t instance, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& triangle) const;
 private:
     Mesh* m_Meshes;
     uint32_t m_NumMeshes;
-    Node* m_RootNode = nullptr;
+    SceneHierarchy m_Hierarchy;
+    // per node and one past the last, the instances come in node order
+    std::vector<uint32_t> m_FirstInstances;
+    std::vector<uint32_t> m_InstanceNodes;
+    std::vector<uint32_t> m_InstanceMeshes;
+    // over the instances' world space boxes, refitted as nodes move
+    Bvh m_Bvh;
+    // SAH cost as of the last build
+    float m_BuiltBvhCost = 0.0f;
+    // per mesh when asked for, empty otherwise
+    std::vector<TriangleBvh> m_TriangleBvhs;
+    // per mesh, the ones with too many triangles to occlude are empty
+    std::vector<Occluder> m_Occluders;
     std::vector<std::string> m_TexturePath;
-    glm::mat4 m_Transform = glm::mat4(1.0f);
 };
-
-class Node
-{
-public:
-    Node(Mesh** meshes, size_t numMeshes, uint32_t numChildren, const Transform& transform);
-    ~Node();
-    void Draw(VkCommandBuffer commandBuffer, glm::mat4 accumulatedTransform, uint32_t frameNum);
-    void AddChildren(Node* children);
-private:
-    Transform m_Transform{};
-    Mesh** m_Meshes = nullptr;
-    Node** m_Children = nullptr;
-    size_t m_NumMeshes = 0;
-    size_t m_NumChildren = 0;
-};
\ No newline at end of file
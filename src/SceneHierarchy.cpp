@@ -0,0 +1,124 @@
+#include "SceneHierarchy.h"
+
+#include <algorithm>
+
+#include "ImportedScene.h"
+
+void SceneHierarchy::Build(const ImportedScene& imported)
+{
+	const uint32_t numNodes = static_cast<uint32_t>(imported.nodes.size());
+	m_Parents.resize(numNodes);
+	m_LocalTransforms.resize(numNodes);
+	m_MeshRanges.resize(numNodes);
+
+	// nodes whose children are still coming, with how many are left
+	struct OpenNode
+	{
+		uint32_t node;
+		uint32_t childrenLeft;
+	};
+	std::vector<OpenNode> open;
+
+	for (uint32_t i = 0; i < numNodes; i++)
+	{
+		while (!open.empty() && open.back().childrenLeft == 0)
+		{
+			open.pop_back();
+		}
+
+		// nodes past the root's subtree become roots of their own
+		if (open.empty())
+		{
+			m_Parents[i] = NoParent;
+		}
+		else
+		{
+			m_Parents[i] = open.back().node;
+			open.back().childrenLeft--;
+		}
+
+		const ImportedNode& node = imported.nodes[i];
+		m_LocalTransforms[i] = node.transform;
+		m_MeshRanges[i] = { node.firstMesh, node.numMeshes };
+		if (node.numChildren > 0)
+		{
+			open.push_back({ i, node.numChildren });
+		}
+	}
+
+	// children come after their parents, so walking backwards every subtree is complete
+	m_SubtreeEnds.resize(numNodes);
+	for (uint32_t i = 0; i < numNodes; i++)
+	{
+		m_SubtreeEnds[i] = i + 1;
+	}
+	for (uint32_t i = numNodes; i-- > 0;)
+	{
+		if (m_Parents[i] != NoParent)
+		{
+			m_SubtreeEnds[m_Parents[i]] = std::max(m_SubtreeEnds[m_Parents[i]], m_SubtreeEnds[i]);
+		}
+	}
+
+	m_NodeMeshes.assign(imported.nodeMeshes.begin(), imported.nodeMeshes.end());
+	m_WorldTransforms.resize(numNodes);
+
+	m_DirtyNodes.clear();
+	m_Dirty.assign(numNodes, false);
+	m_ChangedNodes.clear();
+	SetRootTransform(m_RootTransform);
+}
+
+void SceneHierarchy::SetLocalTransform(uint32_t node, const glm::mat4& transform)
+{
+	m_LocalTransforms[node] = transform;
+	MarkDirty(node);
+}
+
+void SceneHierarchy::SetRootTransform(const glm::mat4& transform)
+{
+	m_RootTransform = transform;
+	for (uint32_t node = 0; node < GetNodeCount(); node = m_SubtreeEnds[node])
+	{
+		MarkDirty(node);
+	}
+}
+
+void SceneHierarchy::MarkDirty(uint32_t node)
+{
+	if (!m_Dirty[node])
+	{
+		m_Dirty[node] = true;
+		m_DirtyNodes.push_back(node);
+	}
+}
+
+void SceneHierarchy::UpdateWorldTransforms()
+{
+	m_ChangedNodes.clear();
+	if (m_DirtyNodes.empty())
+	{
+		return;
+	}
+
+	// in order, a dirty node inside a subtree that was just swept is already up to date
+	std::sort(m_DirtyNodes.begin(), m_DirtyNodes.end());
+	uint32_t sweptEnd = 0;
+	for (uint32_t dirty : m_DirtyNodes)
+	{
+		m_Dirty[dirty] = false;
+		if (dirty < sweptEnd)
+		{
+			continue;
+		}
+
+		sweptEnd = m_SubtreeEnds[dirty];
+		for (uint32_t i = dirty; i < sweptEnd; i++)
+		{
+			const uint32_t parent = m_Parents[i];
+			m_WorldTransforms[i] = (parent == NoParent ? m_RootTransform : m_WorldTransforms[parent]) * m_LocalTransforms[i];
+			m_ChangedNodes.push_back(i);
+		}
+	}
+	m_DirtyNodes.clear();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "VkStructs.h"
+
+struct ImportedScene;
+
+// Node hierarchy of a scene as flat arrays, in the pre-order the importers emit:
+// every parent comes before its children, so world matrices are computed in a
+// single sweep front to back, and a node's subtree is the run of nodes after it.
+//
+// Changing a local transform only marks the node dirty. The next update recomputes
+// the dirty subtrees and nothing else, so a static scene costs next to nothing per
+// frame, and lists the nodes it touched for whoever caches world space data.
+class SceneHierarchy
+{
+public:
+	static constexpr uint32_t NoParent = UINT32_MAX;
+
+	struct MeshRange
+	{
+		uint32_t firstMesh;
+		uint32_t numMeshes;
+	};
+
+public:
+	// Every node starts out dirty.
+	void Build(const ImportedScene& imported);
+
+	void SetLocalTransform(uint32_t node, const glm::mat4& transform);
+	// parent of the nodes without one, dirties all of them
+	void SetRootTransform(const glm::mat4& transform);
+	// Recomputes the world matrices of the dirty subtrees and fills GetChangedNodes().
+	void UpdateWorldTransforms();
+
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_Parents.size()); }
+	uint32_t GetParent(uint32_t node) const { return m_Parents[node]; }
+	// one past the last node of the node's subtree
+	uint32_t GetSubtreeEnd(uint32_t node) const { return m_SubtreeEnds[node]; }
+	const glm::mat4& GetLocalTransform(uint32_t node) const { return m_LocalTransforms[node]; }
+	const glm::mat4& GetWorldTransform(uint32_t node) const { return m_WorldTransforms[node]; }
+	// into GetNodeMeshes(), which holds indices into the scene's meshes
+	const MeshRange& GetMeshRange(uint32_t node) const { return m_MeshRanges[node]; }
+	const uint32_t* GetNodeMeshes() const { return m_NodeMeshes.data(); }
+	// nodes whose world matrix the last update recomputed, ascending
+	const std::vector<uint32_t>& GetChangedNodes() const { return m_ChangedNodes; }
+
+private:
+	void MarkDirty(uint32_t node);
+
+private:
+	std::vector<uint32_t> m_Parents;
+	std::vector<uint32_t> m_SubtreeEnds;
+	std::vector<glm::mat4> m_LocalTransforms;
+	std::vector<glm::mat4> m_WorldTransforms;
+	std::vector<MeshRange> m_MeshRanges;
+	std::vector<uint32_t> m_NodeMeshes;
+	glm::mat4 m_RootTransform = glm::mat4(1.0f);
+
+	// nodes whose subtree needs an update, each listed once
+	std::vector<uint32_t> m_DirtyNodes;
+	std::vector<bool> m_Dirty;
+	std::vector<uint32_t> m_ChangedNodes;
+};
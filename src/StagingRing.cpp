@@ -0,0 +1,168 @@
+#include "StagingRing.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "Logger.h"
+#include "Renderer.h"
+
+StagingRing::~StagingRing()
+{
+	Destroy();
+}
+
+void StagingRing::Create(uint64_t capacity)
+{
+	assert(!IsCreated());
+
+	const Renderer* renderer = Renderer::Get();
+
+	// write-combined memory crawls when read, and decoders read back what they staged
+	m_MemoryProperties = renderer->GetHostCachedMemoryProperties();
+	m_Buffer = renderer->CreateBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, m_MemoryProperties);
+
+	// stays mapped for the lifetime of the ring
+	m_Buffer.mappedBuffer = renderer->MapBuffer(m_Buffer);
+	m_Head = 0;
+	m_Used = 0;
+	m_PeakUsage = 0;
+}
+
+void StagingRing::Destroy()
+{
+	if (!IsCreated())
+	{
+		return;
+	}
+
+	if (!m_Blocks.empty())
+	{
+		Logger::Error("Staging ring destroyed with %zu live allocations\n", m_Blocks.size());
+		m_Blocks.clear();
+	}
+
+	const Renderer* renderer = Renderer::Get();
+	renderer->UnmapBuffer(m_Buffer);
+	renderer->DestroyBuffer(m_Buffer);
+	m_Buffer = GPUUniformBuffer();
+}
+
+bool StagingRing::Allocate(uint64_t size, Allocation& allocation)
+{
+	size = (std::max<uint64_t>(size, 1) + Alignment - 1) & ~(Alignment - 1);
+	if (size > m_Buffer.size)
+	{
+		return false;
+	}
+
+	uint64_t offset = 0;
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_FreedCondition.wait(lock, [this, size, &offset]() { return TryAllocate(size, offset); });
+
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.mapped = (uint8_t*)m_Buffer.mappedBuffer + offset;
+	return true;
+}
+
+bool StagingRing::TryAllocate(uint64_t size, uint64_t& offset)
+{
+	const uint64_t capacity = m_Buffer.size;
+
+	if (m_Blocks.empty())
+	{
+		m_Head = 0;
+		offset = 0;
+	}
+	else
+	{
+		const uint64_t tail = m_Blocks.front().offset;
+		if (m_Head > tail)
+		{
+			// used space is [tail, head), free space is the end plus the start
+			if (m_Head + size <= capacity)
+			{
+				offset = m_Head;
+			}
+			else if (size <= tail)
+			{
+				// the unused end becomes padding, released together with the block before it
+				m_Blocks.push_back({ m_Head, capacity - m_Head, true });
+				m_Used += capacity - m_Head;
+				offset = 0;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		else if (m_Head + size <= tail && m_Head < tail)
+		{
+			// wrapped: the only free space is [head, tail)
+			offset = m_Head;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	m_Blocks.push_back({ offset, size, false });
+	m_Head = offset + size;
+	m_Used += size;
+	m_PeakUsage = std::max(m_PeakUsage, m_Used);
+	return true;
+}
+
+void StagingRing::Free(const Allocation& allocation)
+{
+	if (allocation.size == 0)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		auto it = std::find_if(m_Blocks.begin(), m_Blocks.end(), [&allocation](const Block& block)
+		{
+			return block.offset == allocation.offset && !block.freed;
+		});
+		assert(it != m_Blocks.end());
+		it->freed = true;
+
+		while (!m_Blocks.empty() && m_Blocks.front().freed)
+		{
+			m_Used -= m_Blocks.front().size;
+			m_Blocks.pop_front();
+		}
+
+		if (m_Blocks.empty())
+		{
+			m_Head = 0;
+		}
+	}
+
+	m_FreedCondition.notify_all();
+}
+
+void StagingRing::Flush(const Allocation& allocation, uint64_t size) const
+{
+	if (!(m_MemoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+	{
+		Renderer::Get()->FlushBuffer(m_Buffer, allocation.offset, std::min(size, allocation.size));
+	}
+}
+
+uint64_t StagingRing::GetPeakUsage() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_PeakUsage;
+}
+
+void StagingRing::ResetPeakUsage()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_PeakUsage = m_Used;
+}
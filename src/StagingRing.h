@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "VkStructs.h"
+
+// Persistently mapped host-visible buffer handed out as a ring. Allocations are
+// contiguous sub-ranges that stay valid until freed; frees may come in any order,
+// the space is reclaimed once every older allocation is freed as well. Allocate
+// blocks while the ring is full, so the capacity doubles as a staging budget.
+// The memory is host cached where the device has it, so users can read back what
+// they staged, and Flush has to run before the device reads an allocation.
+class StagingRing
+{
+public:
+	struct Allocation
+	{
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		void* mapped = nullptr;
+	};
+
+	static constexpr uint64_t Alignment = 16;
+
+public:
+	StagingRing() = default;
+	StagingRing(const StagingRing&) = delete;
+	StagingRing& operator=(const StagingRing&) = delete;
+	~StagingRing();
+
+	void Create(uint64_t capacity);
+	void Destroy();
+	bool IsCreated() const { return m_Buffer.buffer != VK_NULL_HANDLE; }
+
+	// False (without blocking) when size can never fit.
+	bool Allocate(uint64_t size, Allocation& allocation);
+	void Free(const Allocation& allocation);
+	// Makes the first size bytes of allocation visible to the device, a no-op on
+	// coherent memory.
+	void Flush(const Allocation& allocation, uint64_t size) const;
+
+	const GPUBuffer& GetBuffer() const { return m_Buffer; }
+	uint64_t GetCapacity() const { return m_Buffer.size; }
+	// what the ring was allocated from, for buffers that stand in for it
+	VkMemoryPropertyFlags GetMemoryProperties() const { return m_MemoryProperties; }
+	// highest number of bytes allocated at once, including wrap padding
+	uint64_t GetPeakUsage() const;
+	void ResetPeakUsage();
+
+private:
+	struct Block
+	{
+		uint64_t offset;
+		uint64_t size;
+		bool freed;
+	};
+
+	bool TryAllocate(uint64_t size, uint64_t& offset);
+
+private:
+	GPUUniformBuffer			m_Buffer;
+	VkMemoryPropertyFlags		m_MemoryProperties = 0;
+	mutable std::mutex			m_Mutex;
+	std::condition_variable		m_FreedCondition;
+	// live blocks oldest first; the first one marks the tail of the ring
+	std::deque<Block>			m_Blocks;
+	uint64_t					m_Head = 0;
+	uint64_t					m_Used = 0;
+	uint64_t					m_PeakUsage = 0;
+};
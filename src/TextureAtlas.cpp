@@ -0,0 +1,578 @@
+#include "TextureAtlas.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+#include "ImageDecoder.h"
+#include "JobSystem.h"
+#include "Logger.h"
+#include "MipGenerator.h"
+#include "Renderer.h"
+#include "TextureCache.h"
+#include "TextureFile.h"
+
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imgui/lib/imstb_rectpack.h"
+
+namespace
+{
+	struct IndexHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		// of the candidates and the settings the index was built from, equal means up to date
+		uint64_t sourcesHash;
+		uint32_t pageCount;
+		uint32_t entryCount;
+		// entryCount IndexEntry, pageCount IndexPage, then the names
+		uint64_t namesOffset;
+	};
+
+	struct IndexPage
+	{
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	struct IndexEntry
+	{
+		// file name of the source, relative to the index's directory
+		uint32_t nameOffset;
+		uint32_t nameLength;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint32_t page;
+		// the texture itself in the page, without the padding
+		uint16_t x;
+		uint16_t y;
+		uint16_t width;
+		uint16_t height;
+	};
+
+	struct Candidate
+	{
+		std::string path;
+		std::string name;
+		TextureFile::SourceStamp stamp;
+		uint32_t width = 0;
+		uint32_t height = 0;
+	};
+
+	struct Item
+	{
+		const Candidate* candidate = nullptr;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		// padded size, multiples of Alignment
+		uint32_t paddedWidth = 0;
+		uint32_t paddedHeight = 0;
+		// MipLevels RGBA8 levels of the padded texture
+		std::vector<uint8_t> levels;
+		uint32_t page = 0;
+		uint32_t x = 0;
+		uint32_t y = 0;
+	};
+
+	// RGBA8 bytes of the levels an atlas keeps
+	uint64_t GetLevelsSize(uint32_t width, uint32_t height)
+	{
+		uint64_t size = 0;
+		for (uint32_t level = 0; level < TextureAtlas::MipLevels; level++)
+		{
+			size += (uint64_t)(width >> level) * (height >> level) * 4;
+		}
+		return size;
+	}
+
+	uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+	{
+		// FNV-1a
+		const uint8_t* bytes = (const uint8_t*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+		}
+		return hash;
+	}
+
+	uint64_t HashCandidates(const std::vector<Candidate>& candidates, const TextureCooker::Settings& settings)
+	{
+		uint64_t hash = 0xCBF29CE484222325ull;
+		const uint32_t options[] = { settings.highQuality, settings.compress, settings.atlasMaxSize, settings.atlasPageSize };
+		hash = HashBytes(hash, options, sizeof(options));
+		for (const Candidate& candidate : candidates)
+		{
+			hash = HashBytes(hash, candidate.name.data(), candidate.name.size() + 1);
+			hash = HashBytes(hash, &candidate.stamp.size, sizeof(candidate.stamp.size));
+			hash = HashBytes(hash, &candidate.stamp.time, sizeof(candidate.stamp.time));
+		}
+		return hash;
+	}
+
+	bool ReadFile(const std::string& path, std::vector<uint8_t>& contents)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		contents.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(contents.data()), contents.size());
+		return file.good();
+	}
+
+	// Validates the index in contents, header is null if it isn't one.
+	const IndexHeader* ParseIndex(const std::vector<uint8_t>& contents, const IndexPage*& pages, const IndexEntry*& entries)
+	{
+		if (contents.size() < sizeof(IndexHeader))
+		{
+			return nullptr;
+		}
+
+		const IndexHeader* header = reinterpret_cast<const IndexHeader*>(contents.data());
+		const uint64_t tablesSize = sizeof(IndexHeader) + (uint64_t)header->pageCount * sizeof(IndexPage) + (uint64_t)header->entryCount * sizeof(IndexEntry);
+		if (header->magic != TextureAtlas::Magic || header->version != TextureAtlas::Version ||
+			tablesSize > contents.size() || header->namesOffset < tablesSize || header->namesOffset > contents.size())
+		{
+			return nullptr;
+		}
+
+		entries = reinterpret_cast<const IndexEntry*>(contents.data() + sizeof(IndexHeader));
+		pages = reinterpret_cast<const IndexPage*>(entries + header->entryCount);
+		for (uint32_t i = 0; i < header->entryCount; i++)
+		{
+			const IndexEntry& entry = entries[i];
+			if (entry.page >= header->pageCount ||
+				header->namesOffset + entry.nameOffset + (uint64_t)entry.nameLength > contents.size() ||
+				entry.x + entry.width > pages[entry.page].width || entry.y + entry.height > pages[entry.page].height)
+			{
+				return nullptr;
+			}
+		}
+		return header;
+	}
+
+	// The source wrapped around into a paddedWidth x paddedHeight image, texel
+	// (Padding, Padding) being its first one.
+	void PadTexture(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t paddedWidth, uint32_t paddedHeight, uint8_t* destination)
+	{
+		for (uint32_t y = 0; y < paddedHeight; y++)
+		{
+			const uint32_t sourceY = (y + height - TextureAtlas::Padding % height) % height;
+			for (uint32_t x = 0; x < paddedWidth; x++)
+			{
+				const uint32_t sourceX = (x + width - TextureAtlas::Padding % width) % width;
+				memcpy(destination + ((uint64_t)y * paddedWidth + x) * 4, rgba + ((uint64_t)sourceY * width + sourceX) * 4, 4);
+			}
+		}
+	}
+
+	// Places the items of one format on pages of at most pageSize, in Alignment
+	// units so every position and size stays on the grid. Returns the page count.
+	uint32_t PackItems(std::vector<Item*>& items, uint32_t pageSize, uint32_t firstPage)
+	{
+		const int gridSize = (int)(pageSize / TextureAtlas::Alignment);
+		std::vector<stbrp_node> nodes(gridSize);
+
+		std::vector<stbrp_rect> rects(items.size());
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			rects[i].id = (int)i;
+			rects[i].w = (stbrp_coord)(items[i]->paddedWidth / TextureAtlas::Alignment);
+			rects[i].h = (stbrp_coord)(items[i]->paddedHeight / TextureAtlas::Alignment);
+			rects[i].was_packed = 0;
+		}
+
+		uint32_t pageCount = 0;
+		while (!rects.empty())
+		{
+			stbrp_context context;
+			stbrp_init_target(&context, gridSize, gridSize, nodes.data(), gridSize);
+			stbrp_pack_rects(&context, rects.data(), (int)rects.size());
+
+			// the ones that didn't fit go on the next page
+			size_t remaining = 0;
+			for (const stbrp_rect& rect : rects)
+			{
+				if (rect.was_packed)
+				{
+					Item& item = *items[rect.id];
+					item.page = firstPage + pageCount;
+					item.x = (uint32_t)rect.x * TextureAtlas::Alignment;
+					item.y = (uint32_t)rect.y * TextureAtlas::Alignment;
+				}
+				else
+				{
+					rects[remaining++] = rect;
+				}
+			}
+
+			// every item is at most atlasMaxSize plus padding, so a page always takes at least one
+			assert(remaining < rects.size());
+			rects.resize(remaining);
+			pageCount++;
+		}
+		return pageCount;
+	}
+
+	bool WritePage(const std::string& path, VkFormat format, const std::vector<Item*>& items, uint32_t page, IndexPage& indexPage)
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		for (const Item* item : items)
+		{
+			if (item->page == page)
+			{
+				width = std::max(width, item->x + item->paddedWidth);
+				height = std::max(height, item->y + item->paddedHeight);
+			}
+		}
+
+		std::vector<uint8_t> levels(GetLevelsSize(width, height));
+		uint64_t levelOffset = 0;
+		for (uint32_t level = 0; level < TextureAtlas::MipLevels; level++)
+		{
+			const uint32_t levelWidth = width >> level;
+			uint8_t* pageLevel = levels.data() + levelOffset;
+
+			for (const Item* item : items)
+			{
+				if (item->page != page)
+				{
+					continue;
+				}
+
+				// the item's levels are packed the same way, largest first
+				const uint32_t itemWidth = item->paddedWidth >> level;
+				const uint32_t itemHeight = item->paddedHeight >> level;
+				uint64_t itemOffset = 0;
+				for (uint32_t i = 0; i < level; i++)
+				{
+					itemOffset += (uint64_t)(item->paddedWidth >> i) * (item->paddedHeight >> i) * 4;
+				}
+
+				for (uint32_t row = 0; row < itemHeight; row++)
+				{
+					memcpy(pageLevel + ((uint64_t)((item->y >> level) + row) * levelWidth + (item->x >> level)) * 4,
+						item->levels.data() + itemOffset + (uint64_t)row * itemWidth * 4, (size_t)itemWidth * 4);
+				}
+			}
+
+			levelOffset += (uint64_t)levelWidth * (height >> level) * 4;
+		}
+
+		std::vector<uint8_t> encoded;
+		TextureCooker::EncodeLevels(format, levels.data(), width, height, TextureAtlas::MipLevels, encoded);
+
+		indexPage.format = (uint32_t)format;
+		indexPage.width = width;
+		indexPage.height = height;
+
+		// there is no source to be out of date against, the index tracks the sources instead
+		return TextureFile::Write(TextureFile::GetPath(path.c_str()).c_str(), TextureFile::SourceStamp{}, format, width, height, TextureAtlas::MipLevels, encoded.data());
+	}
+
+	bool WriteIndex(const std::string& path, uint64_t sourcesHash, const std::vector<IndexPage>& pages, const std::vector<Item*>& items)
+	{
+		IndexHeader header{};
+		header.version = TextureAtlas::Version;
+		header.sourcesHash = sourcesHash;
+		header.pageCount = (uint32_t)pages.size();
+		header.entryCount = (uint32_t)items.size();
+		header.namesOffset = sizeof(IndexHeader) + pages.size() * sizeof(IndexPage) + items.size() * sizeof(IndexEntry);
+
+		std::vector<IndexEntry> entries(items.size());
+		std::string names;
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			const Item& item = *items[i];
+			IndexEntry& entry = entries[i];
+			entry.nameOffset = (uint32_t)names.size();
+			entry.nameLength = (uint32_t)item.candidate->name.size();
+			entry.sourceSize = item.candidate->stamp.size;
+			entry.sourceTime = item.candidate->stamp.time;
+			entry.page = item.page;
+			entry.x = (uint16_t)(item.x + TextureAtlas::Padding);
+			entry.y = (uint16_t)(item.y + TextureAtlas::Padding);
+			entry.width = (uint16_t)item.candidate->width;
+			entry.height = (uint16_t)item.candidate->height;
+			names += item.candidate->name;
+		}
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			Logger::Error("Failed to create atlas index %s\n", path.c_str());
+			return false;
+		}
+
+		// the magic is written last, like in texture files
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(IndexEntry));
+		file.write(reinterpret_cast<const char*>(pages.data()), pages.size() * sizeof(IndexPage));
+		file.write(names.data(), names.size());
+
+		header.magic = TextureAtlas::Magic;
+		file.seekp(0);
+		file.write(reinterpret_cast<const char*>(&header.magic), sizeof(header.magic));
+
+		if (!file.good())
+		{
+			Logger::Error("Failed to write atlas index %s\n", path.c_str());
+			file.close();
+			std::remove(path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void RemoveStalePages(const std::string& directory, uint32_t firstPage)
+	{
+		std::error_code error;
+		for (uint32_t page = firstPage; std::filesystem::remove(TextureFile::GetPath(TextureAtlas::GetPagePath(directory, page).c_str()), error); page++)
+		{
+		}
+	}
+}
+
+TextureAtlas::TextureAtlas()
+{
+	assert(s_Instance == nullptr);
+	s_Instance = this;
+}
+
+TextureAtlas::~TextureAtlas()
+{
+	s_Instance = nullptr;
+}
+
+std::string TextureAtlas::GetIndexPath(const std::string& directory)
+{
+	return directory + "/textures.atlas";
+}
+
+std::string TextureAtlas::GetPagePath(const std::string& directory, uint32_t page)
+{
+	return directory + "/textures_atlas" + std::to_string(page);
+}
+
+const TextureAtlas::Entry* TextureAtlas::Find(const char* path)
+{
+	const std::string key = TextureCache::NormalizePath(path);
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	const std::string directory = std::filesystem::path(key).parent_path().generic_string();
+	if (m_Directories.insert(directory).second)
+	{
+		LoadIndex(directory);
+	}
+
+	m_Stats.lookups++;
+	auto it = m_Entries.find(key);
+	if (it == m_Entries.end())
+	{
+		return nullptr;
+	}
+
+	m_Stats.hits++;
+	return &it->second;
+}
+
+TextureAtlas::Stats TextureAtlas::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+void TextureAtlas::LoadIndex(const std::string& directory)
+{
+	const std::string path = GetIndexPath(directory);
+	std::vector<uint8_t> contents;
+	if (!ReadFile(path, contents))
+	{
+		return;
+	}
+
+	const IndexPage* pages = nullptr;
+	const IndexEntry* entries = nullptr;
+	const IndexHeader* header = ParseIndex(contents, pages, entries);
+	if (!header)
+	{
+		Logger::Error("Atlas index %s is corrupted or out of date, cook the textures again\n", path.c_str());
+		return;
+	}
+
+	const Renderer* renderer = Renderer::Get();
+	std::vector<bool> usable(header->pageCount);
+	for (uint32_t i = 0; i < header->pageCount; i++)
+	{
+		usable[i] = renderer->IsSampledFormatSupported((VkFormat)pages[i].format);
+		m_Stats.pages += usable[i] ? 1 : 0;
+	}
+
+	const char* names = reinterpret_cast<const char*>(contents.data() + header->namesOffset);
+	uint32_t stale = 0;
+	for (uint32_t i = 0; i < header->entryCount; i++)
+	{
+		const IndexEntry& indexEntry = entries[i];
+		if (!usable[indexEntry.page])
+		{
+			continue;
+		}
+
+		const std::string sourcePath = directory + "/" + std::string(names + indexEntry.nameOffset, indexEntry.nameLength);
+
+		// like texture files, a missing source is fine, a changed one isn't
+		TextureFile::SourceStamp stamp;
+		if (TextureFile::GetSourceStamp(sourcePath.c_str(), stamp) && (stamp.size != indexEntry.sourceSize || stamp.time != indexEntry.sourceTime))
+		{
+			stale++;
+			continue;
+		}
+
+		const IndexPage& page = pages[indexEntry.page];
+		Entry& entry = m_Entries[TextureCache::NormalizePath(sourcePath.c_str())];
+		entry.pagePath = GetPagePath(directory, indexEntry.page);
+		entry.rect = glm::vec4(
+			(float)indexEntry.x / page.width, (float)indexEntry.y / page.height,
+			(float)indexEntry.width / page.width, (float)indexEntry.height / page.height);
+		m_Stats.entries++;
+	}
+
+	if (stale > 0)
+	{
+		Logger::Info("%u textures in %s changed since they were packed, cook the textures again\n", stale, path.c_str());
+	}
+}
+
+bool TextureAtlas::Build(const std::string& directory, const std::vector<std::string>& sources, const TextureCooker::Settings& settings)
+{
+	if (settings.atlasPageSize > UINT16_MAX || settings.atlasPageSize < settings.atlasMaxSize + 2 * Padding + Alignment)
+	{
+		Logger::Error("Atlas pages of %u texels can't hold textures of %u texels\n", settings.atlasPageSize, settings.atlasMaxSize);
+		return false;
+	}
+
+	std::vector<Candidate> candidates;
+	for (const std::string& source : sources)
+	{
+		Candidate candidate;
+		if (!TextureFile::GetSourceStamp(source.c_str(), candidate.stamp) ||
+			!ImageDecoder::GetInfo(source.c_str(), candidate.width, candidate.height) ||
+			std::max(candidate.width, candidate.height) > settings.atlasMaxSize)
+		{
+			continue;
+		}
+
+		candidate.path = source;
+		candidate.name = std::filesystem::path(source).filename().string();
+		candidates.push_back(std::move(candidate));
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.name < b.name; });
+	const uint64_t sourcesHash = HashCandidates(candidates, settings);
+	const std::string indexPath = GetIndexPath(directory);
+
+	std::vector<uint8_t> contents;
+	const IndexPage* indexPages = nullptr;
+	const IndexEntry* indexEntries = nullptr;
+	if (ReadFile(indexPath, contents))
+	{
+		const IndexHeader* header = ParseIndex(contents, indexPages, indexEntries);
+		if (header && header->sourcesHash == sourcesHash)
+		{
+			Logger::Debug("Atlas of %s is up to date\n", directory.c_str());
+			return true;
+		}
+	}
+
+	std::vector<Item> items(candidates.size());
+	std::atomic<uint32_t> failed{ 0 };
+	JobSystem::Get()->ParallelFor((uint32_t)candidates.size(), 1, [&](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const Candidate& candidate = candidates[i];
+			Item& item = items[i];
+			item.candidate = &candidate;
+
+			std::vector<uint8_t> pixels((size_t)candidate.width * candidate.height * 4);
+			if (!ImageDecoder::DecodeRGBA8(candidate.path.c_str(), pixels.data(), candidate.width, candidate.height))
+			{
+				Logger::Error("Failed to decode image %s\n", candidate.path.c_str());
+				failed++;
+				continue;
+			}
+
+			item.format = TextureCooker::ChooseFormat(TextureCooker::Classify(candidate.path.c_str(), pixels.data(), candidate.width, candidate.height), settings);
+			item.paddedWidth = (candidate.width + 2 * Padding + Alignment - 1) / Alignment * Alignment;
+			item.paddedHeight = (candidate.height + 2 * Padding + Alignment - 1) / Alignment * Alignment;
+
+			std::vector<uint8_t> padded((size_t)item.paddedWidth * item.paddedHeight * 4);
+			PadTexture(pixels.data(), candidate.width, candidate.height, item.paddedWidth, item.paddedHeight, padded.data());
+
+			// normal maps hold vectors, not colors
+			const bool srgb = item.format != VK_FORMAT_BC5_UNORM_BLOCK && item.format != VK_FORMAT_R8G8B8A8_UNORM;
+			item.levels.resize(GetLevelsSize(item.paddedWidth, item.paddedHeight));
+			MipGenerator::Generate(padded.data(), item.paddedWidth, item.paddedHeight, MipLevels, MipGenerator::Filter::Kaiser, srgb, item.levels.data());
+		}
+	});
+
+	// a page per format, a format with a single texture gains nothing from one
+	std::map<VkFormat, std::vector<Item*>> groups;
+	for (Item& item : items)
+	{
+		if (item.format != VK_FORMAT_UNDEFINED)
+		{
+			groups[item.format].push_back(&item);
+		}
+	}
+
+	std::vector<IndexPage> pages;
+	std::vector<Item*> packed;
+	for (auto& [format, group] : groups)
+	{
+		if (group.size() < 2)
+		{
+			continue;
+		}
+
+		const uint32_t firstPage = (uint32_t)pages.size();
+		const uint32_t pageCount = PackItems(group, settings.atlasPageSize, firstPage);
+		pages.resize(firstPage + pageCount);
+		for (uint32_t page = firstPage; page < firstPage + pageCount; page++)
+		{
+			if (!WritePage(GetPagePath(directory, page), format, group, page, pages[page]))
+			{
+				return false;
+			}
+		}
+		packed.insert(packed.end(), group.begin(), group.end());
+	}
+
+	RemoveStalePages(directory, (uint32_t)pages.size());
+	if (packed.empty())
+	{
+		std::error_code error;
+		std::filesystem::remove(indexPath, error);
+		return failed == 0;
+	}
+
+	// an index of a run with failures isn't up to date, the next one tries them again
+	if (!WriteIndex(indexPath, failed == 0 ? sourcesHash : 0, pages, packed))
+	{
+		return false;
+	}
+
+	Logger::Debug("Packed %zu of %zu small textures of %s into %zu atlas pages\n", packed.size(), candidates.size(), directory.c_str(), pages.size());
+	return failed == 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "TextureCooker.h"
+#include "VkStructs.h"
+
+// Packs the small textures of a directory into shared atlas pages when cooking,
+// so a scene full of little decals and trims needs a few images instead of one
+// per texture. Every texture is surrounded by Padding texels of itself, wrapped
+// around, and placed on an Alignment grid, which keeps the first MipLevels levels
+// of every texture, and their 4x4 blocks, apart from its neighbours. The pages
+// are texture files named "textures_atlas<n>" next to the sources, the index
+// "textures.atlas" says where each source ended up.
+//
+// At run time Find looks a texture path up in the index of its directory, loaded
+// on the first lookup there. Meshes then load the page through the texture cache
+// like any other texture and map their coordinates into the texture's rect in
+// the shader, fract keeps repeating coordinates inside it.
+class TextureAtlas
+{
+public:
+	static constexpr uint32_t Magic = 0x4C544153; // "SATL"
+	static constexpr uint32_t Version = 1;
+	// texels of the texture repeated around it
+	static constexpr uint32_t Padding = 8;
+	// texels the padded textures are placed and sized on
+	static constexpr uint32_t Alignment = 16;
+	// levels of the pages, the padding is down to two texels in the last one
+	static constexpr uint32_t MipLevels = 3;
+
+	struct Entry
+	{
+		// pass to TextureCache::Acquire instead of the texture's own path
+		std::string pagePath;
+		// xy offset and zw size of the texture in the page's coordinates
+		glm::vec4 rect;
+	};
+
+	struct Stats
+	{
+		uint32_t pages = 0;
+		uint32_t entries = 0;
+		uint32_t lookups = 0;
+		uint32_t hits = 0;
+	};
+
+public:
+	TextureAtlas();
+	TextureAtlas(const TextureAtlas&) = delete;
+	TextureAtlas& operator=(const TextureAtlas&) = delete;
+	~TextureAtlas();
+
+	// Null when the texture isn't packed, its source changed since or the device
+	// can't sample the page's format. Safe to call from any job.
+	const Entry* Find(const char* path);
+
+	Stats GetStats() const;
+
+	static std::string GetIndexPath(const std::string& directory);
+	static std::string GetPagePath(const std::string& directory, uint32_t page);
+
+	// Packs the sources of directory that are at most settings.atlasMaxSize on a
+	// side, one set of pages per cooked format. Does nothing when the index is
+	// up to date. Runs its decoding on the job system.
+	static bool Build(const std::string& directory, const std::vector<std::string>& sources, const TextureCooker::Settings& settings);
+
+	static TextureAtlas* Get() { return s_Instance; }
+
+private:
+	void LoadIndex(const std::string& directory);
+
+private:
+	mutable std::mutex								m_Mutex;
+	std::unordered_set<std::string>					m_Directories;
+	// by normalized source path
+	std::unordered_map<std::string, Entry>			m_Entries;
+	Stats											m_Stats;
+
+	static inline TextureAtlas*						s_Instance = nullptr;
+};
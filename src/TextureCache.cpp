@@ -0,0 +1,271 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <filesystem>
+
+#include "Logger.h"
+#include "Renderer.h"
+#include "Timer.h"
+
+#include "exception/RendererException.h"
+
+TextureCache::TextureCache(const TextureLoader::Settings& loaderSettings)
+	:
+	m_Loader(loaderSettings)
+{
+	assert(s_Instance == nullptr);
+	s_Instance = this;
+}
+
+TextureCache::~TextureCache()
+{
+	if (!m_Entries.empty())
+	{
+		Logger::Error("%zu textures are still referenced when the texture cache shuts down\n", m_Entries.size());
+		for (auto& [key, entry] : m_Entries)
+		{
+			Destroy(*entry);
+		}
+	}
+
+	s_Instance = nullptr;
+}
+
+std::string TextureCache::NormalizePath(const char* path)
+{
+	std::string normalized = std::filesystem::path(path).lexically_normal().generic_string();
+#ifdef _WIN32
+	// paths are case-insensitive here, and MTL files are not consistent about it
+	for (char& c : normalized)
+	{
+		c = (char)tolower((unsigned char)c);
+	}
+#endif
+	return normalized;
+}
+
+TextureCache::Entry* TextureCache::AddReference(const char* path)
+{
+	std::string key = NormalizePath(path);
+	std::unique_ptr<Entry>& slot = m_Entries[key];
+	if (!slot)
+	{
+		slot = std::make_unique<Entry>();
+		slot->key = std::move(key);
+	}
+	slot->refCount++;
+	return slot.get();
+}
+
+TextureCache::Handle TextureCache::Acquire(const char* path, uint8_t threadId)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	Entry* entry = AddReference(path);
+	m_Stats.requested++;
+
+	// somebody else is loading it, wait for them instead of loading it twice
+	m_LoadedCondition.wait(lock, [entry]() { return entry->state != Entry::STATE_LOADING; });
+
+	if (entry->state == Entry::STATE_EMPTY)
+	{
+		entry->state = Entry::STATE_LOADING;
+		lock.unlock();
+
+		TextureLoader::Request request;
+		try
+		{
+			Load(path, threadId, request);
+		}
+		catch (...)
+		{
+			// back to empty, so the next waiter retries the load
+			lock.lock();
+			entry->state = Entry::STATE_EMPTY;
+			ReleaseLocked(entry);
+			m_LoadedCondition.notify_all();
+			throw;
+		}
+
+		lock.lock();
+		SetLoaded(*entry, request);
+		m_LoadedCondition.notify_all();
+	}
+
+	if (entry->users++ > 0)
+	{
+		m_Stats.bytesSaved += entry->sizeInBytes;
+	}
+
+	return entry;
+}
+
+void TextureCache::Preload(const std::vector<std::string>& paths, std::vector<Handle>& handles)
+{
+	std::vector<TextureLoader::Request> requests;
+	std::vector<Entry*> requestEntries;
+	std::vector<Entry*> entries(paths.size());
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			entries[i] = AddReference(paths[i].c_str());
+			if (entries[i]->state == Entry::STATE_EMPTY)
+			{
+				// duplicates in paths now see STATE_LOADING and aren't requested twice
+				entries[i]->state = Entry::STATE_LOADING;
+				requests.emplace_back().path = paths[i];
+				requestEntries.push_back(entries[i]);
+			}
+		}
+	}
+
+	TextureLoader::Stats loaderStats;
+	Timer timer;
+	timer.Reset();
+	try
+	{
+		loaderStats = m_Loader.LoadBatch(requests);
+	}
+	catch (...)
+	{
+		const Renderer* renderer = Renderer::Get();
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (size_t i = 0; i < requests.size(); i++)
+		{
+			renderer->DestroyImageView(requests[i].image);
+			renderer->DestroyImage(requests[i].image);
+			requestEntries[i]->state = Entry::STATE_EMPTY;
+		}
+		for (Entry* entry : entries)
+		{
+			ReleaseLocked(entry);
+		}
+		m_LoadedCondition.notify_all();
+		throw;
+	}
+	timer.Tick();
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		Entry* entry = requestEntries[i];
+		if (requests[i].loaded)
+		{
+			SetLoaded(*entry, requests[i]);
+		}
+		else
+		{
+			// left for Acquire to retry, which reports the failure the usual way
+			entry->state = Entry::STATE_EMPTY;
+		}
+	}
+	m_LoadedCondition.notify_all();
+
+	handles.resize(paths.size());
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		if (entries[i]->state == Entry::STATE_READY)
+		{
+			handles[i] = entries[i];
+		}
+		else
+		{
+			handles[i] = nullptr;
+			ReleaseLocked(entries[i]);
+		}
+	}
+
+	float seconds = timer.GetDeltaTime();
+	Logger::Info("Preloaded %u textures (%u failed, %u from texture files) in %u batches: %.2f MB in %.2fs, peak staging %.2f MB\n",
+		loaderStats.loaded, loaderStats.failed, loaderStats.fromFiles, loaderStats.batches,
+		loaderStats.bytesUploaded / (1024.0 * 1024.0), seconds,
+		loaderStats.peakStagingBytes / (1024.0 * 1024.0));
+	if (loaderStats.compressed > 0)
+	{
+		Logger::Info("%u of them block compressed, %.2f MB against %.2f MB as RGBA8\n",
+			loaderStats.compressed, loaderStats.bytesUploaded / (1024.0 * 1024.0), loaderStats.rgbaBytes / (1024.0 * 1024.0));
+	}
+	if (loaderStats.reduced > 0)
+	{
+		Logger::Info("%u decoded textures are gray and stored with one or two channels\n", loaderStats.reduced);
+	}
+}
+
+void TextureCache::Release(Handle texture)
+{
+	if (!texture)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	ReleaseLocked(const_cast<Entry*>(static_cast<const Entry*>(texture)));
+}
+
+void TextureCache::ReleaseLocked(Entry* entry)
+{
+	assert(entry->refCount > 0);
+	if (--entry->refCount > 0)
+	{
+		return;
+	}
+
+	if (entry->image.image != VK_NULL_HANDLE)
+	{
+		m_Stats.resident--;
+	}
+	Destroy(*entry);
+	// the key lives in the entry that erase destroys
+	std::string key = std::move(entry->key);
+	m_Entries.erase(key);
+}
+
+TextureCache::Stats TextureCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+void TextureCache::SetLoaded(Entry& entry, const TextureLoader::Request& request)
+{
+	entry.image = request.image;
+	entry.sizeInBytes = request.sizeInBytes;
+	entry.state = Entry::STATE_READY;
+
+	// a decoded source has nowhere to load more levels from
+	if (request.fromFile && TextureStreamer::Get())
+	{
+		entry.stream = TextureStreamer::Get()->Add(request.path.c_str(), entry.image, request.firstLevel);
+	}
+
+	m_Stats.unique++;
+	m_Stats.resident++;
+	m_Stats.uniqueBytes += entry.sizeInBytes;
+}
+
+void TextureCache::Destroy(Entry& entry)
+{
+	if (entry.stream)
+	{
+		TextureStreamer::Get()->Remove(entry.stream);
+		entry.stream = nullptr;
+	}
+
+	const Renderer* renderer = Renderer::Get();
+	renderer->DestroyImageView(entry.image);
+	renderer->DestroyImage(entry.image);
+}
+
+void TextureCache::Load(const char* path, uint8_t threadId, TextureLoader::Request& request)
+{
+	request.path = path;
+
+	if (!m_Loader.Load(request, threadId))
+	{
+		Logger::Error("Failed to load image %s\n", path);
+		throw RendererException("Failed to load image");
+	}
+}
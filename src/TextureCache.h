@@ -0,0 +1,98 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+#include "VkStructs.h"
+
+// Reference counted GPU textures shared between meshes. Every unique image (by
+// normalized path) is decoded, uploaded and mip-mapped once, later requests for
+// the same path get the same GPUImage. Meshes hold a Handle and release it when
+// they are destroyed, the image goes away with the last reference. A scene can
+// Preload its whole texture set through the TextureLoader pipeline first, so the
+// meshes only find finished textures. Textures loaded from a texture file are
+// handed to the TextureStreamer when there is one, which replaces their image as
+// levels come and go.
+class TextureCache
+{
+public:
+	struct Texture
+	{
+		GPUImage image;
+		// the mip levels loaded up front
+		uint64_t sizeInBytes = 0;
+		// null unless the texture streams its levels
+		TextureStreamer::Stream* stream = nullptr;
+	};
+
+	using Handle = const Texture*;
+
+	struct Stats
+	{
+		uint32_t requested = 0;
+		uint32_t unique = 0;
+		uint32_t resident = 0;
+		uint64_t uniqueBytes = 0;
+		uint64_t bytesSaved = 0;
+	};
+
+public:
+	explicit TextureCache(const TextureLoader::Settings& loaderSettings = {});
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+	~TextureCache();
+
+	// Safe to call from any job. Concurrent requests for a texture that is still
+	// loading wait for the first one instead of loading it again.
+	Handle Acquire(const char* path, uint8_t threadId);
+	void Release(Handle texture);
+	// Loads every path that isn't cached yet as one pipelined batch. handles gets a
+	// reference per path (null where loading failed) that the caller releases once
+	// its own Acquires are done. Must not run concurrently with another Preload.
+	void Preload(const std::vector<std::string>& paths, std::vector<Handle>& handles);
+
+	Stats GetStats() const;
+
+	static std::string NormalizePath(const char* path);
+	static TextureCache* Get() { return s_Instance; }
+
+private:
+	struct Entry : Texture
+	{
+		enum State : uint8_t
+		{
+			STATE_EMPTY,
+			STATE_LOADING,
+			STATE_READY,
+		};
+
+		std::string key;
+		uint32_t refCount = 0;
+		// acquisitions after the first one are counted as saved uploads
+		uint32_t users = 0;
+		State state = STATE_EMPTY;
+	};
+
+	void Load(const char* path, uint8_t threadId, TextureLoader::Request& request);
+	void SetLoaded(Entry& entry, const TextureLoader::Request& request);
+	Entry* AddReference(const char* path);
+	void ReleaseLocked(Entry* entry);
+	void Destroy(Entry& entry);
+
+private:
+	mutable std::mutex										m_Mutex;
+	// signalled whenever an entry leaves STATE_LOADING
+	std::condition_variable									m_LoadedCondition;
+	std::unordered_map<std::string, std::unique_ptr<Entry>>	m_Entries;
+	Stats													m_Stats;
+	TextureLoader											m_Loader;
+
+	static inline TextureCache*								s_Instance = nullptr;
+};
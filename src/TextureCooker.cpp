@@ -0,0 +1,322 @@
+#include "TextureCooker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "BlockCompressor.h"
+#include "ImageDecoder.h"
+#include "JobSystem.h"
+#include "Logger.h"
+#include "MipGenerator.h"
+#include "Renderer.h"
+#include "TextureAtlas.h"
+#include "TextureFile.h"
+#include "TextureLoader.h"
+#include "Timer.h"
+
+namespace
+{
+	// share of sampled texels that have to decode to a unit vector to call an image a normal map
+	constexpr float NormalMapThreshold = 0.98f;
+
+	const char* const s_NormalMapHints[] = { "_ddn", "_nrm", "_norm" };
+	const char* const s_SourceExtensions[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+
+	bool ToBlockFormat(VkFormat format, BlockCompressor::Format& blockFormat)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK: blockFormat = BlockCompressor::Format::BC1; return true;
+		case VK_FORMAT_BC3_SRGB_BLOCK: blockFormat = BlockCompressor::Format::BC3; return true;
+		case VK_FORMAT_BC5_UNORM_BLOCK: blockFormat = BlockCompressor::Format::BC5; return true;
+		case VK_FORMAT_BC7_SRGB_BLOCK: blockFormat = BlockCompressor::Format::BC7; return true;
+		default: return false;
+		}
+	}
+
+	const char* GetFormatName(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK: return "BC1";
+		case VK_FORMAT_BC3_SRGB_BLOCK: return "BC3";
+		case VK_FORMAT_BC5_UNORM_BLOCK: return "BC5";
+		case VK_FORMAT_BC7_SRGB_BLOCK: return "BC7";
+		case VK_FORMAT_R8G8B8A8_SRGB: return "RGBA8";
+		case VK_FORMAT_R8G8B8A8_UNORM: return "RGBA8 linear";
+		case VK_FORMAT_R8_SRGB: return "R8";
+		case VK_FORMAT_R8G8_SRGB: return "RG8";
+		default: return "unknown";
+		}
+	}
+
+	std::string ToLower(std::string text)
+	{
+		std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		return text;
+	}
+
+	bool IsSourceImage(const std::filesystem::path& path)
+	{
+		const std::string extension = ToLower(path.extension().string());
+		return std::find(std::begin(s_SourceExtensions), std::end(s_SourceExtensions), extension) != std::end(s_SourceExtensions);
+	}
+}
+
+TextureCooker::Content TextureCooker::Classify(const char* path, const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+	const std::string name = ToLower(std::filesystem::path(path).stem().string());
+	for (const char* hint : s_NormalMapHints)
+	{
+		if (name.find(hint) != std::string::npos)
+		{
+			return Content::NormalMap;
+		}
+	}
+
+	const uint64_t texelCount = (uint64_t)width * height;
+	// every texel for alpha since a single cut out texel matters, a sparse sample is enough for the normal test
+	const uint64_t sampleStride = std::max<uint64_t>(1, texelCount / 65536);
+
+	bool hasAlpha = false;
+	bool gray = true;
+	uint64_t samples = 0;
+	uint64_t unitVectors = 0;
+
+	for (uint64_t i = 0; i < texelCount; i++)
+	{
+		const uint8_t* texel = rgba + i * 4;
+		hasAlpha |= texel[3] != 255;
+		gray &= texel[0] == texel[1] && texel[1] == texel[2];
+
+		if (i % sampleStride == 0)
+		{
+			const float x = texel[0] / 127.5f - 1.0f;
+			const float y = texel[1] / 127.5f - 1.0f;
+			const float z = texel[2] / 127.5f - 1.0f;
+			const float lengthSquared = x * x + y * y + z * z;
+			samples++;
+			unitVectors += (z > 0.0f && lengthSquared > 0.81f && lengthSquared < 1.21f) ? 1 : 0;
+		}
+	}
+
+	if (hasAlpha)
+	{
+		return gray ? Content::GrayscaleAlpha : Content::Alpha;
+	}
+	if (gray)
+	{
+		return Content::Grayscale;
+	}
+	if (samples > 0 && unitVectors >= samples * NormalMapThreshold)
+	{
+		return Content::NormalMap;
+	}
+	return Content::Opaque;
+}
+
+VkFormat TextureCooker::ChooseFormat(Content content, const Settings& settings)
+{
+	if (!settings.compress)
+	{
+		switch (content)
+		{
+		case Content::NormalMap: return VK_FORMAT_R8G8B8A8_UNORM;
+		case Content::Grayscale: return VK_FORMAT_R8_SRGB;
+		case Content::GrayscaleAlpha: return VK_FORMAT_R8G8_SRGB;
+		default: return VK_FORMAT_R8G8B8A8_SRGB;
+		}
+	}
+
+	// the gray formats of the BC family are linear only, so gray keeps the color
+	// formats, which cost the same per texel
+	switch (content)
+	{
+	case Content::NormalMap:
+		// X and Y only, Z is reconstructed when sampling
+		return VK_FORMAT_BC5_UNORM_BLOCK;
+	case Content::Alpha:
+	case Content::GrayscaleAlpha:
+		return VK_FORMAT_BC3_SRGB_BLOCK;
+	default:
+		return settings.highQuality ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+	}
+}
+
+bool TextureCooker::Cook(const char* sourcePath, const Settings& settings)
+{
+	TextureFile::SourceStamp stamp;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	if (!TextureFile::GetSourceStamp(sourcePath, stamp) || !ImageDecoder::GetInfo(sourcePath, width, height))
+	{
+		Logger::Error("Failed to read image %s\n", sourcePath);
+		return false;
+	}
+
+	if (width > UINT16_MAX || height > UINT16_MAX)
+	{
+		Logger::Error("Image %s is too large to cook (%ux%u)\n", sourcePath, width, height);
+		return false;
+	}
+
+	std::vector<uint8_t> pixels((size_t)width * height * 4);
+	if (!ImageDecoder::DecodeRGBA8(sourcePath, pixels.data(), width, height))
+	{
+		Logger::Error("Failed to decode image %s\n", sourcePath);
+		return false;
+	}
+
+	const VkFormat format = ChooseFormat(Classify(sourcePath, pixels.data(), width, height), settings);
+	const uint32_t mipLevels = Renderer::CalculateMipMaps<uint32_t>(width, height);
+
+	// normal maps hold vectors, not colors
+	const bool srgb = format != VK_FORMAT_BC5_UNORM_BLOCK && format != VK_FORMAT_R8G8B8A8_UNORM;
+	std::vector<uint8_t> levels(TextureLoader::GetSizeWithMips(width, height));
+	MipGenerator::Generate(pixels.data(), width, height, mipLevels, MipGenerator::Filter::Kaiser, srgb, levels.data());
+	pixels = std::vector<uint8_t>();
+
+	std::vector<uint8_t> encoded;
+	EncodeLevels(format, levels.data(), width, height, mipLevels, encoded);
+	const uint64_t dataSize = encoded.size();
+
+	if (!TextureFile::Write(TextureFile::GetPath(sourcePath).c_str(), stamp, format, width, height, mipLevels, encoded.data()))
+	{
+		return false;
+	}
+
+	Logger::Debug("Cooked %s: %s %ux%u, %u levels, %.2f MB\n", sourcePath, GetFormatName(format),
+		width, height, mipLevels, dataSize / (1024.0 * 1024.0));
+	return true;
+}
+
+void TextureCooker::EncodeLevels(VkFormat format, const uint8_t* levels, uint32_t width, uint32_t height, uint32_t mipLevels, std::vector<uint8_t>& output)
+{
+	uint64_t outputSize = 0;
+	for (uint32_t i = 0; i < mipLevels; i++)
+	{
+		outputSize += TextureFile::GetLevelSize(format, width, height, i);
+	}
+	output.resize(outputSize);
+
+	BlockCompressor::Format blockFormat;
+	const bool compressed = ToBlockFormat(format, blockFormat);
+	uint32_t blockSize = 0;
+	uint32_t blockBytes = 0;
+	TextureFile::GetBlockLayout(format, blockSize, blockBytes);
+
+	uint64_t levelOffset = 0;
+	uint64_t outputOffset = 0;
+	for (uint32_t i = 0; i < mipLevels; i++)
+	{
+		const uint32_t levelWidth = std::max(1u, width >> i);
+		const uint32_t levelHeight = std::max(1u, height >> i);
+
+		if (compressed)
+		{
+			BlockCompressor::Compress(blockFormat, levels + levelOffset, levelWidth, levelHeight, output.data() + outputOffset);
+		}
+		else
+		{
+			// one byte per channel, the gray formats keep gray and alpha
+			ImageDecoder::PackChannels(levels + levelOffset, (uint64_t)levelWidth * levelHeight, blockBytes, output.data() + outputOffset);
+		}
+
+		levelOffset += (uint64_t)levelWidth * levelHeight * 4;
+		outputOffset += TextureFile::GetLevelSize(format, width, height, i);
+	}
+}
+
+void TextureCooker::CookDirectory(const char* directory, const Settings& settings)
+{
+	JobSystem jobSystem;
+
+	std::vector<std::string> sources;
+	std::error_code error;
+	for (std::filesystem::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+	{
+		if (it->is_regular_file() && IsSourceImage(it->path()))
+		{
+			sources.push_back(it->path().string());
+		}
+	}
+
+	if (error)
+	{
+		Logger::Error("Failed to list %s: %s\n", directory, error.message().c_str());
+	}
+
+	Logger::Info("Cooking %zu images below %s on %u workers\n", sources.size(), directory, jobSystem.GetWorkerCount());
+
+	std::atomic<uint32_t> cooked{ 0 };
+	std::atomic<uint32_t> upToDate{ 0 };
+	std::atomic<uint32_t> failed{ 0 };
+	std::atomic<uint64_t> rgbaBytes{ 0 };
+	std::atomic<uint64_t> cookedBytes{ 0 };
+
+	Timer timer;
+	timer.Reset();
+
+	// one image per job, the block rows of each level are split again inside Compress
+	jobSystem.ParallelFor((uint32_t)sources.size(), 1, [&](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const char* path = sources[i].c_str();
+
+			MappedFile mapping;
+			TextureFile::Texture texture;
+			if (!TextureFile::Load(path, mapping, texture))
+			{
+				mapping.Close();
+				if (!Cook(path, settings) || !TextureFile::Load(path, mapping, texture))
+				{
+					failed++;
+					continue;
+				}
+				cooked++;
+			}
+			else
+			{
+				upToDate++;
+			}
+
+			rgbaBytes += TextureLoader::GetSizeWithMips(texture.width, texture.height);
+			cookedBytes += texture.GetDataSize();
+		}
+	});
+
+	timer.Tick();
+
+	Logger::Info("Cooked %u images (%u up to date, %u failed) in %.2fs: %.2f MB as RGBA8, %.2f MB cooked (%.1fx)\n",
+		cooked.load(), upToDate.load(), failed.load(), timer.GetDeltaTime(),
+		rgbaBytes / (1024.0 * 1024.0), cookedBytes / (1024.0 * 1024.0),
+		cookedBytes > 0 ? (double)rgbaBytes / cookedBytes : 0.0);
+
+	if (!settings.buildAtlases)
+	{
+		return;
+	}
+
+	// meshes look their textures up in the atlas of the texture's own directory
+	std::map<std::string, std::vector<std::string>> directories;
+	for (const std::string& source : sources)
+	{
+		directories[std::filesystem::path(source).parent_path().generic_string()].push_back(source);
+	}
+
+	timer.Reset();
+	uint32_t atlasFailures = 0;
+	for (const auto& [atlasDirectory, atlasSources] : directories)
+	{
+		atlasFailures += TextureAtlas::Build(atlasDirectory, atlasSources, settings) ? 0 : 1;
+	}
+	timer.Tick();
+
+	Logger::Info("Built the atlases of %zu directories in %.2fs, %u failed\n", directories.size(), timer.GetDeltaTime(), atlasFailures);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "VkStructs.h"
+
+// Offline conversion of source images into mip chains stored as texture files
+// (see TextureFile) next to the source. Colors are block compressed unless
+// that's turned off, either way the texture loader copies the levels to
+// staging instead of decoding the source. main() runs CookDirectory when the
+// executable is started with --cook-textures.
+class TextureCooker
+{
+public:
+	enum class Content
+	{
+		Opaque,
+		Alpha,
+		NormalMap,
+		// every texel has equal color channels, e.g. masks and specular maps
+		Grayscale,
+		GrayscaleAlpha,
+	};
+
+	struct Settings
+	{
+		// BC7 instead of BC1 for opaque color, twice the size for noticeably smoother gradients
+		bool highQuality = false;
+		// false writes RGBA8 chains, for devices that can't sample BC formats
+		bool compress = true;
+		// packs the textures of a directory that are at most atlasMaxSize on a side
+		// into pages of at most atlasPageSize, see TextureAtlas
+		bool buildAtlases = true;
+		uint32_t atlasMaxSize = 256;
+		uint32_t atlasPageSize = 2048;
+	};
+
+public:
+	static Content Classify(const char* path, const uint8_t* rgba, uint32_t width, uint32_t height);
+	static VkFormat ChooseFormat(Content content, const Settings& settings);
+	// Turns mipLevels RGBA8 levels, tightly packed and largest first, into the levels
+	// of a texture file in format: block compressed, reduced to the gray channels or
+	// copied as they are.
+	static void EncodeLevels(VkFormat format, const uint8_t* levels, uint32_t width, uint32_t height, uint32_t mipLevels, std::vector<uint8_t>& output);
+
+	static bool Cook(const char* sourcePath, const Settings& settings);
+	// Cooks every image below directory whose texture file is missing or out of date,
+	// then rebuilds the atlases of the directories whose small images changed.
+	// Creates its own job system, the engine isn't running in this mode.
+	static void CookDirectory(const char* directory, const Settings& settings);
+};
@@ -0,0 +1,238 @@
+#include "TextureFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "Logger.h"
+#include "Renderer.h"
+
+namespace
+{
+	constexpr uint64_t LevelAlignment = 16;
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	bool RangeInFile(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+	{
+		if (offset > fileSize) return false;
+		if (elementSize != 0 && count > (fileSize - offset) / elementSize) return false;
+		return true;
+	}
+
+	void WritePadding(std::ofstream& file, uint64_t targetOffset)
+	{
+		static const char zeros[LevelAlignment] = {};
+		uint64_t current = static_cast<uint64_t>(file.tellp());
+		if (targetOffset > current)
+		{
+			file.write(zeros, static_cast<std::streamsize>(targetOffset - current));
+		}
+	}
+}
+
+uint64_t TextureFile::Texture::GetDataSize() const
+{
+	uint64_t size = 0;
+	for (uint32_t i = 0; i < mipLevels; i++)
+	{
+		size += levels[i].size;
+	}
+	return size;
+}
+
+std::string TextureFile::GetPath(const char* sourcePath)
+{
+	return std::string(sourcePath) + ".stex";
+}
+
+bool TextureFile::GetSourceStamp(const char* sourcePath, SourceStamp& stamp)
+{
+	std::error_code error;
+	const uint64_t size = std::filesystem::file_size(sourcePath, error);
+	if (error)
+	{
+		return false;
+	}
+
+	const auto time = std::filesystem::last_write_time(sourcePath, error);
+	if (error)
+	{
+		return false;
+	}
+
+	stamp.size = size;
+	stamp.time = (int64_t)time.time_since_epoch().count();
+	return true;
+}
+
+bool TextureFile::GetBlockLayout(VkFormat format, uint32_t& blockSize, uint32_t& blockBytes)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_R8G8B8A8_UNORM:
+		blockSize = 1; blockBytes = 4; return true;
+	case VK_FORMAT_R8_SRGB:
+		blockSize = 1; blockBytes = 1; return true;
+	case VK_FORMAT_R8G8_SRGB:
+		blockSize = 1; blockBytes = 2; return true;
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		blockSize = 4; blockBytes = 8; return true;
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		blockSize = 4; blockBytes = 16; return true;
+	default:
+		return false;
+	}
+}
+
+uint64_t TextureFile::GetLevelSize(VkFormat format, uint32_t width, uint32_t height, uint32_t level)
+{
+	uint32_t blockSize = 0;
+	uint32_t blockBytes = 0;
+	if (!GetBlockLayout(format, blockSize, blockBytes))
+	{
+		return 0;
+	}
+
+	const uint64_t blocksX = (std::max(1u, width >> level) + blockSize - 1) / blockSize;
+	const uint64_t blocksY = (std::max(1u, height >> level) + blockSize - 1) / blockSize;
+	return blocksX * blocksY * blockBytes;
+}
+
+bool TextureFile::IsBlockCompressed(VkFormat format)
+{
+	uint32_t blockSize = 0;
+	uint32_t blockBytes = 0;
+	return GetBlockLayout(format, blockSize, blockBytes) && blockSize > 1;
+}
+
+bool TextureFile::Write(const char* path, const SourceStamp& stamp, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, const uint8_t* levels)
+{
+	Header header{};
+	header.version = Version;
+	header.sourceSize = stamp.size;
+	header.sourceTime = stamp.time;
+	header.format = (uint32_t)format;
+	header.width = width;
+	header.height = height;
+	header.mipLevels = mipLevels;
+	header.levelIndexOffset = AlignUp(sizeof(Header), LevelAlignment);
+
+	std::vector<LevelEntry> levelIndex(mipLevels);
+	uint64_t offset = AlignUp(header.levelIndexOffset + mipLevels * sizeof(LevelEntry), LevelAlignment);
+	for (uint32_t i = 0; i < mipLevels; i++)
+	{
+		levelIndex[i].offset = offset;
+		levelIndex[i].size = GetLevelSize(format, width, height, i);
+		offset = AlignUp(offset + levelIndex[i].size, LevelAlignment);
+	}
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		Logger::Error("Failed to create texture file %s\n", path);
+		return false;
+	}
+
+	// The magic is written last so an interrupted write never produces a file that validates.
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	WritePadding(file, header.levelIndexOffset);
+	file.write(reinterpret_cast<const char*>(levelIndex.data()), levelIndex.size() * sizeof(LevelEntry));
+
+	for (const LevelEntry& level : levelIndex)
+	{
+		WritePadding(file, level.offset);
+		file.write(reinterpret_cast<const char*>(levels), level.size);
+		levels += level.size;
+	}
+
+	header.magic = Magic;
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header.magic), sizeof(header.magic));
+
+	if (!file.good())
+	{
+		Logger::Error("Failed to write texture file %s\n", path);
+		file.close();
+		std::remove(path);
+		return false;
+	}
+
+	return true;
+}
+
+bool TextureFile::Load(const char* sourcePath, MappedFile& mapping, Texture& texture)
+{
+	const std::string path = GetPath(sourcePath);
+	if (!mapping.Open(path.c_str()))
+	{
+		return false;
+	}
+
+	const uint8_t* data = mapping.GetData();
+	const uint64_t size = mapping.GetSize();
+
+	if (size < sizeof(Header))
+	{
+		mapping.Close();
+		return false;
+	}
+
+	const Header& header = *reinterpret_cast<const Header*>(data);
+
+	if (header.magic != Magic || header.version != Version)
+	{
+		Logger::Info("Texture file %s has an incompatible version, using the source image.\n", path.c_str());
+		mapping.Close();
+		return false;
+	}
+
+	SourceStamp stamp;
+	if (GetSourceStamp(sourcePath, stamp) && (header.sourceSize != stamp.size || header.sourceTime != stamp.time))
+	{
+		Logger::Info("Texture file %s is out of date, using the source image.\n", path.c_str());
+		mapping.Close();
+		return false;
+	}
+
+	const VkFormat format = (VkFormat)header.format;
+
+	bool valid =
+		GetLevelSize(format, 1, 1, 0) > 0 &&
+		header.width > 0 && header.width <= UINT16_MAX &&
+		header.height > 0 && header.height <= UINT16_MAX &&
+		header.mipLevels > 0 && header.mipLevels <= Renderer::CalculateMipMaps<uint32_t>(header.width, header.height) &&
+		RangeInFile(header.levelIndexOffset, header.mipLevels, sizeof(LevelEntry), size) &&
+		header.levelIndexOffset % alignof(LevelEntry) == 0;
+
+	const LevelEntry* levels = valid ? reinterpret_cast<const LevelEntry*>(data + header.levelIndexOffset) : nullptr;
+	for (uint32_t i = 0; valid && i < header.mipLevels; i++)
+	{
+		valid =
+			levels[i].size == GetLevelSize(format, header.width, header.height, i) &&
+			RangeInFile(levels[i].offset, levels[i].size, 1, size);
+	}
+
+	if (!valid)
+	{
+		Logger::Error("Texture file %s is corrupted, using the source image.\n", path.c_str());
+		mapping.Close();
+		return false;
+	}
+
+	texture.format = format;
+	texture.width = header.width;
+	texture.height = header.height;
+	texture.mipLevels = header.mipLevels;
+	texture.data = data;
+	texture.levels = levels;
+	return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "MappedFile.h"
+#include "VkStructs.h"
+
+// Engine texture container, stored next to the source image as "<image>.stex".
+// It holds the format, the dimensions, an index with the offset and size of
+// every mip level and the levels themselves, each tightly packed in the layout
+// vkCmdCopyBufferToImage expects. Loading is a mapping and one copy per level
+// into staging, nothing is decoded. TextureCooker writes these files.
+class TextureFile
+{
+public:
+	static constexpr uint32_t Magic = 0x58455453; // "STEX"
+	static constexpr uint32_t Version = 1;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		// size and last write time of the source, checking them doesn't read the source
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+		// mipLevels LevelEntry, largest level first
+		uint64_t levelIndexOffset;
+	};
+
+	struct LevelEntry
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	struct SourceStamp
+	{
+		uint64_t size = 0;
+		int64_t time = 0;
+	};
+
+	// View into a mapped file.
+	struct Texture
+	{
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipLevels = 0;
+		const uint8_t* data = nullptr;
+		const LevelEntry* levels = nullptr;
+
+		const uint8_t* GetLevelData(uint32_t level) const { return data + levels[level].offset; }
+		uint64_t GetDataSize() const;
+	};
+
+public:
+	static std::string GetPath(const char* sourcePath);
+	static bool GetSourceStamp(const char* sourcePath, SourceStamp& stamp);
+
+	// Size in texels of one block and its size in bytes, a texel counts as a 1x1
+	// block. False for formats other than RGBA8, the gray R8 and R8G8 and the BC
+	// formats the cooker writes.
+	static bool GetBlockLayout(VkFormat format, uint32_t& blockSize, uint32_t& blockBytes);
+	// The formats of GetBlockLayout, 0 for anything else.
+	static uint64_t GetLevelSize(VkFormat format, uint32_t width, uint32_t height, uint32_t level);
+	static bool IsBlockCompressed(VkFormat format);
+
+	// levels holds every level tightly packed, largest first.
+	static bool Write(const char* path, const SourceStamp& stamp, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, const uint8_t* levels);
+	// Maps the container of sourcePath if there is one that matches the source. A
+	// container whose source is missing is used as is, so shipping only the
+	// containers works. The mapping must outlive the use of texture.
+	static bool Load(const char* sourcePath, MappedFile& mapping, Texture& texture);
+};
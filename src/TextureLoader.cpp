@@ -0,0 +1,554 @@
+#include "TextureLoader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <thread>
+
+#include "ImageDecoder.h"
+#include "JobSystem.h"
+#include "Logger.h"
+#include "MipGenerator.h"
+#include "Renderer.h"
+#include "TextureFile.h"
+
+#include "exception/RendererException.h"
+
+class TextureLoader::Pipeline
+{
+public:
+	Pipeline(TextureLoader& loader, std::vector<Request>& requests)
+		:
+		m_Loader(loader),
+		m_Requests(requests),
+		m_Remaining((uint32_t)requests.size())
+	{}
+
+	void Decode(uint32_t requestIndex)
+	{
+		Request& request = m_Requests[requestIndex];
+
+		DecodedImage decoded;
+		decoded.request = requestIndex;
+
+		try
+		{
+			if (!m_Aborted &&
+				(m_Loader.StageFile(request, decoded.staging, decoded.levelOffsets) ||
+				 m_Loader.StageDecoded(request, decoded.staging, decoded.levelOffsets)))
+			{
+				Push(decoded);
+				return;
+			}
+
+			if (!m_Aborted)
+			{
+				Logger::Error("Failed to load image %s\n", request.path.c_str());
+			}
+		}
+		catch (const std::exception& e)
+		{
+			Logger::Error("Failed to load image %s: %s\n", request.path.c_str(), e.what());
+		}
+
+		Finish(1, true);
+	}
+
+	// uploader thread body, returns once every request is accounted for
+	void Upload()
+	{
+		std::vector<DecodedImage> batch;
+
+		for (;;)
+		{
+			batch.clear();
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_ReadyCondition.wait(lock, [this]() { return !m_Ready.empty() || m_Remaining == 0; });
+				if (m_Ready.empty())
+				{
+					return;
+				}
+
+				// take whatever finished decoding, the decoders keep going meanwhile
+				size_t count = std::min<size_t>(m_Ready.size(), m_Loader.m_Settings.maxBatchImages);
+				batch.assign(m_Ready.begin(), m_Ready.begin() + count);
+				m_Ready.erase(m_Ready.begin(), m_Ready.begin() + count);
+			}
+
+			if (m_Aborted)
+			{
+				Discard(batch);
+				Finish((uint32_t)batch.size(), true);
+				continue;
+			}
+
+			try
+			{
+				UploadBatch(batch);
+				Finish((uint32_t)batch.size(), false);
+			}
+			catch (...)
+			{
+				// keep draining, decoders blocked on the ring only wake up as ranges come back
+				m_Error = std::current_exception();
+				m_Aborted = true;
+				Discard(batch);
+				Finish((uint32_t)batch.size(), true);
+			}
+		}
+	}
+
+	const Stats& GetStats() const { return m_Stats; }
+	std::exception_ptr GetError() const { return m_Error; }
+
+private:
+	struct DecodedImage
+	{
+		uint32_t request = 0;
+		Staging staging;
+		std::vector<uint64_t> levelOffsets;
+	};
+
+	void Push(const DecodedImage& decoded)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Ready.push_back(decoded);
+		}
+		m_ReadyCondition.notify_one();
+	}
+
+	void Finish(uint32_t count, bool failed)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Remaining -= count;
+			if (failed)
+			{
+				m_Stats.failed += count;
+			}
+		}
+		m_ReadyCondition.notify_one();
+	}
+
+	void UploadBatch(std::vector<DecodedImage>& batch)
+	{
+		const Renderer* renderer = Renderer::Get();
+		const uint8_t threadId = renderer->GetUploaderThreadId();
+
+		VkCommandBuffer commandBuffer = renderer->GetTransientTransferCommandBuffer(threadId, false);
+
+		for (DecodedImage& decoded : batch)
+		{
+			Request& request = m_Requests[decoded.request];
+			TextureLoader::RecordUpload(commandBuffer, m_Loader.GetStagingBuffer(decoded.staging), decoded.staging.GetOffset(), decoded.levelOffsets, request.image);
+		}
+
+		VkFence fence = renderer->CreateFence();
+		renderer->EndTransientTransferCommandBuffer(commandBuffer, fence, threadId, false);
+		renderer->DestroyFence(fence);
+
+		for (DecodedImage& decoded : batch)
+		{
+			m_Loader.ReleaseStaging(decoded.staging);
+
+			Request& request = m_Requests[decoded.request];
+			request.loaded = true;
+			m_Stats.bytesUploaded += request.sizeInBytes;
+			m_Stats.rgbaBytes += TextureLoader::GetSizeWithMips(request.image.width, request.image.height);
+			m_Stats.fromFiles += request.fromFile ? 1 : 0;
+			m_Stats.compressed += TextureFile::IsBlockCompressed(request.image.format.format) ? 1 : 0;
+			m_Stats.reduced += !request.fromFile && request.image.format.format != VK_FORMAT_R8G8B8A8_SRGB ? 1 : 0;
+		}
+
+		m_Stats.loaded += (uint32_t)batch.size();
+		m_Stats.batches++;
+	}
+
+	void Discard(std::vector<DecodedImage>& batch)
+	{
+		const Renderer* renderer = Renderer::Get();
+		for (DecodedImage& decoded : batch)
+		{
+			m_Loader.ReleaseStaging(decoded.staging);
+
+			GPUImage& image = m_Requests[decoded.request].image;
+			renderer->DestroyImageView(image);
+			renderer->DestroyImage(image);
+			image = GPUImage();
+		}
+	}
+
+private:
+	TextureLoader&				m_Loader;
+	std::vector<Request>&		m_Requests;
+	Stats						m_Stats;
+
+	std::mutex					m_Mutex;
+	std::condition_variable		m_ReadyCondition;
+	std::vector<DecodedImage>	m_Ready;
+	uint32_t					m_Remaining;
+	std::atomic<bool>			m_Aborted{ false };
+	std::exception_ptr			m_Error;
+};
+
+TextureLoader::TextureLoader(const Settings& settings)
+	:
+	m_Settings(settings)
+{}
+
+TextureLoader::Stats TextureLoader::LoadBatch(std::vector<Request>& requests)
+{
+	Pipeline pipeline(*this, requests);
+	if (requests.empty())
+	{
+		return pipeline.GetStats();
+	}
+
+	GetRing().ResetPeakUsage();
+
+	std::thread uploader([&pipeline]()
+	{
+		pipeline.Upload();
+	});
+
+	JobSystem* jobSystem = JobSystem::Get();
+	JobCounter counter;
+
+	for (uint32_t i = 0; i < (uint32_t)requests.size(); i++)
+	{
+		jobSystem->Submit([&pipeline, i](uint32_t)
+		{
+			pipeline.Decode(i);
+		}, &counter);
+	}
+
+	jobSystem->WaitFor(counter);
+	uploader.join();
+
+	if (pipeline.GetError())
+	{
+		std::rethrow_exception(pipeline.GetError());
+	}
+
+	Stats stats = pipeline.GetStats();
+	stats.peakStagingBytes = GetRing().GetPeakUsage();
+	return stats;
+}
+
+bool TextureLoader::Load(Request& request, uint8_t threadId)
+{
+	const Renderer* renderer = Renderer::Get();
+
+	Staging staging;
+	std::vector<uint64_t> levelOffsets;
+
+	if (!StageFile(request, staging, levelOffsets) && !StageDecoded(request, staging, levelOffsets))
+	{
+		return false;
+	}
+
+	try
+	{
+		VkCommandBuffer commandBuffer = renderer->GetTransientTransferCommandBuffer(threadId, false);
+		RecordUpload(commandBuffer, GetStagingBuffer(staging), staging.GetOffset(), levelOffsets, request.image);
+
+		VkFence fence = renderer->CreateFence();
+		renderer->EndTransientTransferCommandBuffer(commandBuffer, fence, threadId, false);
+		renderer->DestroyFence(fence);
+	}
+	catch (...)
+	{
+		ReleaseStaging(staging);
+		renderer->DestroyImageView(request.image);
+		renderer->DestroyImage(request.image);
+		throw;
+	}
+
+	ReleaseStaging(staging);
+
+	request.loaded = true;
+	return true;
+}
+
+bool TextureLoader::StageFile(Request& request, Staging& staging, std::vector<uint64_t>& levelOffsets)
+{
+	if (!m_Settings.useTextureFiles)
+	{
+		return false;
+	}
+
+	MappedFile mapping;
+	TextureFile::Texture texture;
+	if (!TextureFile::Load(request.path.c_str(), mapping, texture))
+	{
+		return false;
+	}
+
+	if (!Renderer::Get()->IsSampledFormatSupported(texture.format))
+	{
+		Logger::Debug("Device can't sample the format of %s, decoding the source\n", request.path.c_str());
+		return false;
+	}
+
+	uint32_t firstLevel = 0;
+	if (m_Settings.streamedInitialSize > 0)
+	{
+		while (firstLevel + 1 < texture.mipLevels &&
+			std::max(texture.width, texture.height) >> firstLevel > m_Settings.streamedInitialSize)
+		{
+			firstLevel++;
+		}
+	}
+
+	uint64_t dataSize = 0;
+	for (uint32_t i = firstLevel; i < texture.mipLevels; i++)
+	{
+		dataSize += AlignLevel(texture.levels[i].size);
+	}
+	AcquireStaging(dataSize, staging);
+
+	// Levels go to staging back to back whatever their padding in the file, level
+	// sizes are whole blocks so every offset stays a multiple of the block size.
+	levelOffsets.resize(texture.mipLevels - firstLevel);
+	uint8_t* memory = (uint8_t*)staging.GetMemory();
+	uint64_t offset = 0;
+	for (uint32_t i = firstLevel; i < texture.mipLevels; i++)
+	{
+		levelOffsets[i - firstLevel] = offset;
+		memcpy(memory + offset, texture.GetLevelData(i), texture.levels[i].size);
+		offset += AlignLevel(texture.levels[i].size);
+	}
+	FlushStaging(staging, dataSize);
+
+	try
+	{
+		request.image = CreateTextureImage(
+			std::max(1u, texture.width >> firstLevel), std::max(1u, texture.height >> firstLevel),
+			texture.format, texture.mipLevels - firstLevel);
+	}
+	catch (...)
+	{
+		ReleaseStaging(staging);
+		throw;
+	}
+
+	request.sizeInBytes = dataSize;
+	request.fromFile = true;
+	request.firstLevel = firstLevel;
+	return true;
+}
+
+bool TextureLoader::StageDecoded(Request& request, Staging& staging, std::vector<uint64_t>& levelOffsets)
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	if (!ImageDecoder::GetInfo(request.path.c_str(), width, height))
+	{
+		return false;
+	}
+
+	const uint32_t mipLevels = Renderer::CalculateMipMaps<uint32_t>(width, height);
+
+	// blocks while the ring is full, this is what bounds the decoders
+	AcquireStaging(GetSizeWithMips(width, height), staging);
+
+	try
+	{
+		// Level 0 is decoded straight into staging. Staging memory is host cached, so the
+		// classifier and the mip filter read it back at the speed of the heap.
+		uint8_t* memory = (uint8_t*)staging.GetMemory();
+		if (!ImageDecoder::DecodeRGBA8(request.path.c_str(), memory, width, height))
+		{
+			ReleaseStaging(staging);
+			return false;
+		}
+
+		// gray images, masks and the like, keep only the channels they use
+		uint32_t channels = ImageDecoder::GetUsedChannels(memory, (uint64_t)width * height);
+		VkFormat format = GetDecodedFormat(channels);
+		if (channels < 4 && !Renderer::Get()->IsSampledFormatSupported(format))
+		{
+			channels = 4;
+			format = GetDecodedFormat(channels);
+		}
+
+		levelOffsets.resize(mipLevels);
+		uint64_t offset = 0;
+		for (uint32_t i = 0; i < mipLevels; i++)
+		{
+			levelOffsets[i] = offset;
+			offset += AlignLevel((uint64_t)std::max(1u, width >> i) * std::max(1u, height >> i) * channels);
+		}
+		request.sizeInBytes = offset;
+
+		if (channels == 4)
+		{
+			MipGenerator::Generate(memory, width, height, mipLevels, MipGenerator::Filter::Box, true, memory);
+		}
+		else
+		{
+			// The filter works on RGBA8. Each level is packed in place once the level below
+			// is built from it, which then moves from scratch to where it gets packed. Packed
+			// levels never take more room than RGBA ones, so the range always holds them.
+			std::vector<uint8_t> scratch((size_t)std::max(1u, width >> 1) * std::max(1u, height >> 1) * 4);
+			for (uint32_t i = 0; i < mipLevels; i++)
+			{
+				const uint32_t levelWidth = std::max(1u, width >> i);
+				const uint32_t levelHeight = std::max(1u, height >> i);
+				const bool last = i + 1 == mipLevels;
+				uint8_t* level = memory + levelOffsets[i];
+
+				if (!last)
+				{
+					MipGenerator::Downsample(level, levelWidth, levelHeight, MipGenerator::Filter::Box, true, scratch.data());
+				}
+				ImageDecoder::PackChannels(level, (uint64_t)levelWidth * levelHeight, channels, level);
+				if (!last)
+				{
+					memcpy(memory + levelOffsets[i + 1], scratch.data(), (size_t)std::max(1u, width >> (i + 1)) * std::max(1u, height >> (i + 1)) * 4);
+				}
+			}
+		}
+		FlushStaging(staging, request.sizeInBytes);
+
+		request.image = CreateTextureImage(width, height, format);
+	}
+	catch (...)
+	{
+		ReleaseStaging(staging);
+		throw;
+	}
+
+	return true;
+}
+
+StagingRing& TextureLoader::GetRing()
+{
+	std::call_once(m_RingCreated, [this]()
+	{
+		m_Ring.Create(m_Settings.stagingBudget);
+	});
+	return m_Ring;
+}
+
+void TextureLoader::AcquireStaging(uint64_t size, Staging& staging)
+{
+	if (GetRing().Allocate(size, staging.allocation))
+	{
+		return;
+	}
+
+	Logger::Debug("%.2f MB image doesn't fit the staging ring, using a dedicated buffer\n", size / (1024.0 * 1024.0));
+
+	const Renderer* renderer = Renderer::Get();
+	staging.dedicated = renderer->CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, GetRing().GetMemoryProperties());
+	staging.dedicated.mappedBuffer = renderer->MapBuffer(staging.dedicated);
+}
+
+void TextureLoader::FlushStaging(const Staging& staging, uint64_t size)
+{
+	if (!staging.dedicated.buffer)
+	{
+		GetRing().Flush(staging.allocation, size);
+	}
+	else if (!(GetRing().GetMemoryProperties() & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+	{
+		Renderer::Get()->FlushBuffer(staging.dedicated, 0, size);
+	}
+}
+
+void TextureLoader::ReleaseStaging(Staging& staging)
+{
+	if (staging.dedicated.buffer)
+	{
+		const Renderer* renderer = Renderer::Get();
+		renderer->UnmapBuffer(staging.dedicated);
+		renderer->DestroyBuffer(staging.dedicated);
+		staging.dedicated = GPUUniformBuffer();
+	}
+	else
+	{
+		GetRing().Free(staging.allocation);
+		staging.allocation = StagingRing::Allocation();
+	}
+}
+
+GPUImage TextureLoader::CreateTextureImage(uint32_t width, uint32_t height, VkFormat format, uint32_t mipLevels)
+{
+	const Renderer* renderer = Renderer::Get();
+
+	if (mipLevels == 0)
+	{
+		mipLevels = Renderer::CalculateMipMaps<uint32_t>(width, height);
+	}
+
+	GPUImage gpuImage = renderer->CreateImage(
+		format,
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		(uint16_t)width, (uint16_t)height,
+		(uint16_t)mipLevels, VK_SAMPLE_COUNT_1_BIT,
+		VK_IMAGE_TILING_OPTIMAL
+	);
+
+	renderer->CreateImageView(gpuImage);
+
+	return gpuImage;
+}
+
+void TextureLoader::RecordUpload(VkCommandBuffer commandBuffer, const GPUBuffer& staging, uint64_t bufferOffset, const std::vector<uint64_t>& levelOffsets, GPUImage& image)
+{
+	const Renderer* renderer = Renderer::Get();
+
+	renderer->ImageBarrier(
+		commandBuffer,
+		image,
+		VK_ACCESS_NONE,
+		VK_ACCESS_MEMORY_WRITE_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+	);
+
+	std::vector<uint64_t> bufferOffsets(levelOffsets.size());
+	for (size_t i = 0; i < levelOffsets.size(); i++)
+	{
+		bufferOffsets[i] = bufferOffset + levelOffsets[i];
+	}
+
+	renderer->CopyBufferToImageLevels(commandBuffer, staging, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, bufferOffsets);
+
+	renderer->ImageBarrier(
+		commandBuffer,
+		image,
+		VK_ACCESS_MEMORY_WRITE_BIT,
+		VK_ACCESS_MEMORY_READ_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	);
+}
+
+VkFormat TextureLoader::GetDecodedFormat(uint32_t channels)
+{
+	switch (channels)
+	{
+	case 1: return VK_FORMAT_R8_SRGB;
+	case 2: return VK_FORMAT_R8G8_SRGB;
+	default: return VK_FORMAT_R8G8B8A8_SRGB;
+	}
+}
+
+uint64_t TextureLoader::GetSizeWithMips(uint32_t width, uint32_t height)
+{
+	uint32_t mipLevels = Renderer::CalculateMipMaps<uint32_t>(width, height);
+
+	uint64_t sizeInBytes = 0;
+	for (uint32_t level = 0; level < mipLevels; level++)
+	{
+		sizeInBytes += (uint64_t)std::max(1u, width >> level) * (uint64_t)std::max(1u, height >> level) * 4;
+	}
+
+	return sizeInBytes;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "StagingRing.h"
+#include "VkStructs.h"
+
+// Loads a set of textures as a pipeline instead of one blocking round trip per
+// image. Decoding runs as jobs on the job system, each decode first takes its
+// range of a persistently mapped staging ring (blocking while the ring is full),
+// decodes into it and builds the image's whole mip chain there, and a single
+// uploader thread records whatever finished decoding into one submission on the
+// transfer queue. Ranges go back to the ring when the batch's fence signals, so
+// decoding the next images overlaps with the upload of the previous ones.
+// Images with an up to date texture file (see TextureFile) skip the decode,
+// their levels are copied from the mapping to staging as they are.
+class TextureLoader
+{
+public:
+	struct Settings
+	{
+		// size of the staging ring, i.e. the cap on decoded bytes in flight; an image
+		// bigger than the whole ring gets a staging buffer of its own
+		uint64_t stagingBudget = 256ull * 1024 * 1024;
+		uint32_t maxBatchImages = 32;
+		// upload texture files instead of decoding when the device can sample their format
+		bool useTextureFiles = true;
+		// texture files only load their levels at most this many texels on a side, the
+		// TextureStreamer brings in the rest; 0 loads every level
+		uint32_t streamedInitialSize = 0;
+	};
+
+	struct Request
+	{
+		std::string path;
+		GPUImage image;
+		// all mip levels, valid once loaded
+		uint64_t sizeInBytes = 0;
+		bool loaded = false;
+		// copied from a texture file rather than decoded
+		bool fromFile = false;
+		// file level that became the image's level 0, see streamedInitialSize
+		uint32_t firstLevel = 0;
+	};
+
+	struct Stats
+	{
+		uint32_t loaded = 0;
+		uint32_t failed = 0;
+		uint32_t batches = 0;
+		uint32_t fromFiles = 0;
+		uint32_t compressed = 0;
+		// decoded with gray content and stored with one or two channels
+		uint32_t reduced = 0;
+		uint64_t bytesUploaded = 0;
+		// what the same textures take as RGBA8 with full mip chains
+		uint64_t rgbaBytes = 0;
+		uint64_t peakStagingBytes = 0;
+	};
+
+public:
+	TextureLoader() = default;
+	explicit TextureLoader(const Settings& settings);
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	// Blocks until every request is loaded or failed to decode; failures are logged
+	// and leave the request unloaded. Only one batch load may run at a time, the
+	// uploader records into the renderer's single uploader command pool.
+	Stats LoadBatch(std::vector<Request>& requests);
+	// One texture, recorded and submitted on the calling job's command pool. Returns
+	// false if the image can't be decoded.
+	bool Load(Request& request, uint8_t threadId);
+
+	// Sampled image and its view, mipLevels 0 means a full chain.
+	static GPUImage CreateTextureImage(uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_R8G8B8A8_SRGB, uint32_t mipLevels = 0);
+	// Records one copy of every level staged at bufferOffset + levelOffsets[level] and
+	// the transition to shader read. Needs no blits, so it can go to the transfer queue.
+	static void RecordUpload(VkCommandBuffer commandBuffer, const GPUBuffer& staging, uint64_t bufferOffset, const std::vector<uint64_t>& levelOffsets, GPUImage& image);
+	static uint64_t GetSizeWithMips(uint32_t width, uint32_t height);
+	// Format of a decoded image using that many channels, see ImageDecoder::GetUsedChannels.
+	// The views of the gray formats swizzle them back to RGBA.
+	static VkFormat GetDecodedFormat(uint32_t channels);
+
+	// Copies on the transfer queue need buffer offsets that are multiples of 4, the
+	// levels of the one and two byte formats are staged this far apart.
+	static constexpr uint64_t LevelAlignment = 4;
+	static uint64_t AlignLevel(uint64_t size) { return (size + LevelAlignment - 1) & ~(LevelAlignment - 1); }
+
+private:
+	class Pipeline;
+
+	struct Staging
+	{
+		StagingRing::Allocation allocation;
+		// only for images that don't fit the ring at all
+		GPUUniformBuffer dedicated;
+
+		void* GetMemory() const { return dedicated.buffer ? dedicated.mappedBuffer : allocation.mapped; }
+		uint64_t GetOffset() const { return dedicated.buffer ? 0 : allocation.offset; }
+	};
+
+	StagingRing& GetRing();
+	void AcquireStaging(uint64_t size, Staging& staging);
+	void ReleaseStaging(Staging& staging);
+	// Before the copies read it, staging memory may not be coherent.
+	void FlushStaging(const Staging& staging, uint64_t size);
+	// Both fill staging with every mip level of request's texture and create its image.
+	// StageFile copies an up to date texture file and returns false if there is none,
+	// StageDecoded decodes the source and builds the mips, false if it can't be decoded.
+	bool StageFile(Request& request, Staging& staging, std::vector<uint64_t>& levelOffsets);
+	bool StageDecoded(Request& request, Staging& staging, std::vector<uint64_t>& levelOffsets);
+	const GPUBuffer& GetStagingBuffer(const Staging& staging) { return staging.dedicated.buffer ? staging.dedicated : GetRing().GetBuffer(); }
+
+private:
+	Settings		m_Settings;
+	// created on first use, so a loader that never runs doesn't hold the memory
+	StagingRing		m_Ring;
+	std::once_flag	m_RingCreated;
+};
@@ -0,0 +1,458 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <exception>
+
+#include "Logger.h"
+#include "Renderer.h"
+#include "TextureLoader.h"
+
+struct TextureStreamer::Stream
+{
+	MappedFile mapping;
+	TextureFile::Texture file;
+	GPUImage* image = nullptr;
+	// file level held by the image's level 0
+	uint32_t residentLevel = 0;
+	// coarsest level the texture drops to, the one it was loaded with
+	uint32_t floorLevel = 0;
+	uint64_t residentBytes = 0;
+	// residentSizes[level] is what the texture takes with level and everything below resident
+	std::vector<uint64_t> residentSizes;
+	// finest level the draws asked for since the last round, render thread only
+	float wantedLevel = FLT_MAX;
+
+	// guarded by m_Mutex
+	bool removed = false;
+	bool busy = false;
+};
+
+namespace
+{
+	constexpr uint64_t StagingAlignment = 16;
+
+	void DestroyImage(GPUImage& image)
+	{
+		const Renderer* renderer = Renderer::Get();
+		renderer->DestroyImageView(image);
+		renderer->DestroyImage(image);
+	}
+}
+
+TextureStreamer::TextureStreamer()
+	:
+	TextureStreamer(Settings())
+{}
+
+TextureStreamer::TextureStreamer(const Settings& settings)
+	:
+	m_Settings(settings)
+{
+	assert(s_Instance == nullptr);
+
+	const Renderer* renderer = Renderer::Get();
+	m_Staging = renderer->CreateBuffer(
+		m_Settings.stagingSize,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	m_Staging.mappedBuffer = renderer->MapBuffer(m_Staging);
+
+	m_Thread = std::thread([this]()
+	{
+		Run();
+	});
+
+	s_Instance = this;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_Condition.notify_all();
+	m_Thread.join();
+
+	const Renderer* renderer = Renderer::Get();
+	vkDeviceWaitIdle(renderer->GetLogicalDevice());
+
+	if (!m_Streams.empty())
+	{
+		Logger::Error("%zu textures are still streamed when the texture streamer shuts down\n", m_Streams.size());
+	}
+
+	for (Finished& finished : m_Finished)
+	{
+		DestroyImage(finished.image);
+	}
+	for (Retired& retired : m_Retired)
+	{
+		DestroyImage(retired.image);
+	}
+
+	renderer->UnmapBuffer(m_Staging);
+	renderer->DestroyBuffer(m_Staging);
+
+	s_Instance = nullptr;
+}
+
+TextureStreamer::Stream* TextureStreamer::Add(const char* sourcePath, GPUImage& image, uint32_t firstLevel)
+{
+	std::shared_ptr<Stream> stream = std::make_shared<Stream>();
+	if (!TextureFile::Load(sourcePath, stream->mapping, stream->file) || firstLevel >= stream->file.mipLevels)
+	{
+		return nullptr;
+	}
+
+	const TextureFile::Texture& file = stream->file;
+	stream->residentSizes.resize(file.mipLevels + 1);
+	for (uint32_t level = file.mipLevels; level-- > 0;)
+	{
+		// as staged, see TextureLoader::LevelAlignment
+		stream->residentSizes[level] = stream->residentSizes[level + 1] + TextureLoader::AlignLevel(file.levels[level].size);
+	}
+
+	stream->image = &image;
+	stream->residentLevel = firstLevel;
+	stream->floorLevel = firstLevel;
+	stream->residentBytes = stream->residentSizes[firstLevel];
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Streams.push_back(stream);
+	m_Stats.textures++;
+	m_Stats.residentBytes += stream->residentBytes;
+	return stream.get();
+}
+
+void TextureStreamer::Remove(Stream* stream)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	stream->removed = true;
+	m_Condition.wait(lock, [stream]() { return !stream->busy; });
+
+	// uploaded by the last round but never swapped in, nothing has used it
+	for (auto it = m_Finished.begin(); it != m_Finished.end();)
+	{
+		if (it->stream == stream)
+		{
+			DestroyImage(it->image);
+			it = m_Finished.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	m_Stats.textures--;
+	m_Stats.residentBytes -= stream->residentBytes;
+
+	// a plan being worked on may still hold a reference, it sees removed and skips it
+	auto it = std::find_if(m_Streams.begin(), m_Streams.end(), [stream](const std::shared_ptr<Stream>& s) { return s.get() == stream; });
+	assert(it != m_Streams.end());
+	m_Streams.erase(it);
+}
+
+void TextureStreamer::Request(Stream* stream, float uvDensity, float distance)
+{
+	const float size = (float)std::max(stream->file.width, stream->file.height);
+	// texels of level 0 that land on one pixel
+	const float texelsPerPixel = m_PixelScale > 0.0f ? uvDensity * size * distance / m_PixelScale : 0.0f;
+	const float level = texelsPerPixel > 0.0f ? std::log2(texelsPerPixel) + m_Settings.lodBias : 0.0f;
+
+	stream->wantedLevel = std::min(stream->wantedLevel, std::max(level, 0.0f));
+}
+
+void TextureStreamer::Update(const glm::mat4& projection, float viewportHeight)
+{
+	const Renderer* renderer = Renderer::Get();
+
+	// either may be negative when the view is flipped
+	m_PixelScale = std::abs(projection[1][1] * viewportHeight) * 0.5f;
+	m_Frame++;
+
+	// every frame that could still sample a retired image has finished once the swapchain went round
+	auto retired = std::remove_if(m_Retired.begin(), m_Retired.end(), [this, renderer](Retired& image)
+	{
+		if (m_Frame - image.frame <= renderer->GetFrameCount())
+		{
+			return false;
+		}
+		DestroyImage(image.image);
+		return true;
+	});
+	m_Retired.erase(retired, m_Retired.end());
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	for (Finished& finished : m_Finished)
+	{
+		Stream& stream = *finished.stream;
+		m_Retired.push_back({ *stream.image, m_Frame });
+		*stream.image = finished.image;
+
+		m_Stats.residentBytes += finished.bytes;
+		m_Stats.residentBytes -= stream.residentBytes;
+		stream.residentLevel = finished.level;
+		stream.residentBytes = finished.bytes;
+	}
+	m_Finished.clear();
+
+	if (m_RoundPending || m_Streams.empty() || m_Frame % std::max(1u, m_Settings.updateInterval) != 0)
+	{
+		return;
+	}
+
+	m_Plan.clear();
+	for (const std::shared_ptr<Stream>& stream : m_Streams)
+	{
+		m_Plan.push_back({ stream, stream->wantedLevel == FLT_MAX ? -1.0f : stream->wantedLevel, stream->residentLevel });
+		stream->wantedLevel = FLT_MAX;
+	}
+
+	m_RoundPending = true;
+	m_Condition.notify_all();
+}
+
+TextureStreamer::Stats TextureStreamer::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+void TextureStreamer::Run()
+{
+	std::vector<PlanEntry> entries;
+	std::vector<uint32_t> targets;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this]() { return m_Stop || m_RoundPending; });
+			if (m_Stop)
+			{
+				return;
+			}
+			entries.swap(m_Plan);
+		}
+
+		try
+		{
+			Plan(entries, targets);
+			Upload(entries, targets);
+		}
+		catch (const std::exception& e)
+		{
+			Logger::Error("Texture streaming round failed: %s\n", e.what());
+		}
+
+		// the last references to removed streams may go here, which unmaps their files
+		entries.clear();
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_RoundPending = false;
+	}
+}
+
+void TextureStreamer::Plan(std::vector<PlanEntry>& entries, std::vector<uint32_t>& targets)
+{
+	// the level the screen asks for, textures nothing drew fall back to their floor
+	std::vector<uint32_t> wanted(entries.size());
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		const Stream& stream = *entries[i].stream;
+		wanted[i] = entries[i].wantedLevel < 0.0f ? stream.floorLevel : std::min((uint32_t)entries[i].wantedLevel, stream.floorLevel);
+	}
+
+	// coarsen everything by the same number of levels until the set fits, so the
+	// budget costs every texture the same share of sharpness
+	targets.resize(entries.size());
+	uint32_t bias = 0;
+	for (;; bias++)
+	{
+		uint64_t total = 0;
+		bool canDrop = false;
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			const Stream& stream = *entries[i].stream;
+			targets[i] = std::min(wanted[i] + bias, stream.floorLevel);
+			total += stream.residentSizes[targets[i]];
+			canDrop |= targets[i] < stream.floorLevel;
+		}
+
+		if (total <= m_Settings.budget || !canDrop)
+		{
+			break;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Stats.budgetBias = bias;
+}
+
+void TextureStreamer::Upload(std::vector<PlanEntry>& entries, const std::vector<uint32_t>& targets)
+{
+	// drops first, they free memory, then the raises that gain the most levels
+	std::vector<uint32_t> order;
+	for (uint32_t i = 0; i < (uint32_t)entries.size(); i++)
+	{
+		if (targets[i] != entries[i].residentLevel)
+		{
+			order.push_back(i);
+		}
+	}
+
+	std::sort(order.begin(), order.end(), [&entries, &targets](uint32_t a, uint32_t b)
+	{
+		const int32_t gainA = (int32_t)entries[a].residentLevel - (int32_t)targets[a];
+		const int32_t gainB = (int32_t)entries[b].residentLevel - (int32_t)targets[b];
+		if ((gainA < 0) != (gainB < 0))
+		{
+			return gainA < 0;
+		}
+		return gainA > gainB;
+	});
+
+	struct Item
+	{
+		Stream* stream;
+		uint32_t level;
+		uint64_t bytes;
+		uint64_t stagingOffset;
+		GPUImage image;
+	};
+
+	// one round uploads at most a staging buffer's worth, the rest waits for the
+	// next one; a texture bigger than the whole buffer goes alone with its own
+	std::vector<Item> batch;
+	uint64_t stagingUsed = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (uint32_t i : order)
+		{
+			Stream* stream = entries[i].stream.get();
+			if (stream->removed)
+			{
+				continue;
+			}
+
+			const uint64_t bytes = stream->residentSizes[targets[i]];
+			const uint64_t alignedBytes = (bytes + StagingAlignment - 1) & ~(StagingAlignment - 1);
+			if (stagingUsed + alignedBytes > m_Staging.size && !batch.empty())
+			{
+				break;
+			}
+
+			stream->busy = true;
+			batch.push_back({ stream, targets[i], bytes, stagingUsed, GPUImage() });
+			stagingUsed += alignedBytes;
+
+			if (stagingUsed > m_Staging.size)
+			{
+				break;
+			}
+		}
+	}
+
+	if (batch.empty())
+	{
+		return;
+	}
+
+	const Renderer* renderer = Renderer::Get();
+	const uint8_t threadId = renderer->GetStreamerThreadId();
+
+	GPUUniformBuffer dedicated;
+	const bool useDedicated = stagingUsed > m_Staging.size;
+
+	try
+	{
+		uint8_t* staging = (uint8_t*)m_Staging.mappedBuffer;
+		if (useDedicated)
+		{
+			dedicated = renderer->CreateBuffer(
+				stagingUsed,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+			dedicated.mappedBuffer = renderer->MapBuffer(dedicated);
+			staging = (uint8_t*)dedicated.mappedBuffer;
+		}
+
+		VkCommandBuffer commandBuffer = renderer->GetTransientTransferCommandBuffer(threadId, false);
+
+		std::vector<uint64_t> levelOffsets;
+		for (Item& item : batch)
+		{
+			const TextureFile::Texture& file = item.stream->file;
+
+			// the levels go back to back, straight from the mapping
+			levelOffsets.clear();
+			uint64_t offset = 0;
+			for (uint32_t level = item.level; level < file.mipLevels; level++)
+			{
+				levelOffsets.push_back(offset);
+				memcpy(staging + item.stagingOffset + offset, file.GetLevelData(level), file.levels[level].size);
+				offset += TextureLoader::AlignLevel(file.levels[level].size);
+			}
+
+			item.image = TextureLoader::CreateTextureImage(
+				std::max(1u, file.width >> item.level), std::max(1u, file.height >> item.level),
+				file.format, file.mipLevels - item.level);
+
+			TextureLoader::RecordUpload(commandBuffer, useDedicated ? dedicated : m_Staging, item.stagingOffset, levelOffsets, item.image);
+		}
+
+		VkFence fence = renderer->CreateFence();
+		renderer->EndTransientTransferCommandBuffer(commandBuffer, fence, threadId, false);
+		renderer->DestroyFence(fence);
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (Item& item : batch)
+		{
+			DestroyImage(item.image);
+			item.stream->busy = false;
+		}
+		m_Condition.notify_all();
+
+		if (dedicated.buffer)
+		{
+			renderer->UnmapBuffer(dedicated);
+			renderer->DestroyBuffer(dedicated);
+		}
+		throw;
+	}
+
+	if (dedicated.buffer)
+	{
+		renderer->UnmapBuffer(dedicated);
+		renderer->DestroyBuffer(dedicated);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (Item& item : batch)
+		{
+			(item.level < item.stream->residentLevel ? m_Stats.raised : m_Stats.dropped)++;
+			m_Stats.bytesStreamed += item.bytes;
+			item.stream->busy = false;
+
+			if (item.stream->removed)
+			{
+				// Remove is waiting for it and has already let go of the stream
+				DestroyImage(item.image);
+				continue;
+			}
+
+			m_Finished.push_back({ item.stream, item.image, item.level, item.bytes });
+		}
+	}
+	m_Condition.notify_all();
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MappedFile.h"
+#include "TextureFile.h"
+#include "VkStructs.h"
+
+// Keeps only the mip levels of a texture that the screen needs resident. Textures
+// loaded from a texture file start with their smallest levels only (see
+// TextureLoader::Settings::streamedInitialSize) and are handed to the streamer,
+// meshes report each frame how far away and how densely mapped they are, and a
+// background thread periodically works out the level every texture needs,
+// biases everything coarser until the set fits the budget and rebuilds the
+// images whose level changed: a new image holding just the wanted levels is
+// filled straight from the mapped file on the transfer queue. Update swaps the
+// new images in on the render thread. A texture's image, and so its view, only
+// ever holds resident levels, so shaders can't sample a level that isn't there.
+class TextureStreamer
+{
+public:
+	struct Settings
+	{
+		// resident bytes of all streamed textures together
+		uint64_t budget = 512ull * 1024 * 1024;
+		// textures start with the levels at most this many texels on a side, and
+		// never drop below them
+		uint32_t initialSize = 128;
+		// staging for one streaming round, also the cap on the bytes a round uploads
+		uint64_t stagingSize = 64ull * 1024 * 1024;
+		// frames between streaming rounds
+		uint32_t updateInterval = 8;
+		// added to the level the screen size asks for, positive trades sharpness for memory
+		float lodBias = 0.0f;
+	};
+
+	struct Stats
+	{
+		uint32_t textures = 0;
+		uint64_t residentBytes = 0;
+		// levels every texture was made coarser by in the last round to fit the budget
+		uint32_t budgetBias = 0;
+		uint32_t raised = 0;
+		uint32_t dropped = 0;
+		uint64_t bytesStreamed = 0;
+	};
+
+	struct Stream;
+
+public:
+	TextureStreamer();
+	explicit TextureStreamer(const Settings& settings);
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+	~TextureStreamer();
+
+	// Starts streaming the texture file of sourcePath into image, which holds its
+	// levels from firstLevel down. Returns null if the file can't be mapped. image
+	// is updated by Update until the stream is removed.
+	Stream* Add(const char* sourcePath, GPUImage& image, uint32_t firstLevel);
+	// Stops streaming, afterwards the caller owns the image again. Waits if the
+	// texture is being uploaded right now.
+	void Remove(Stream* stream);
+
+	// Called when a mesh using the texture is drawn, uvDensity is the mesh's texture
+	// coordinate units per world unit and distance its distance to the camera.
+	void Request(Stream* stream, float uvDensity, float distance);
+	// Once per frame on the render thread before anything is drawn: swaps in the
+	// images the last round finished, destroys the ones no frame in flight can
+	// use any more and starts a new round every updateInterval frames.
+	void Update(const glm::mat4& projection, float viewportHeight);
+
+	const Settings& GetSettings() const { return m_Settings; }
+	Stats GetStats() const;
+
+	static TextureStreamer* Get() { return s_Instance; }
+
+private:
+	struct PlanEntry
+	{
+		std::shared_ptr<Stream> stream;
+		// level the draws asked for, negative when nothing drew the texture
+		float wantedLevel;
+		uint32_t residentLevel;
+	};
+
+	struct Finished
+	{
+		Stream* stream;
+		GPUImage image;
+		uint32_t level;
+		uint64_t bytes;
+	};
+
+	struct Retired
+	{
+		GPUImage image;
+		uint64_t frame;
+	};
+
+	void Run();
+	void Plan(std::vector<PlanEntry>& entries, std::vector<uint32_t>& targets);
+	void Upload(std::vector<PlanEntry>& entries, const std::vector<uint32_t>& targets);
+
+private:
+	Settings								m_Settings;
+	std::vector<std::shared_ptr<Stream>>	m_Streams;
+	// projected size of one world unit at distance one, in pixels
+	float									m_PixelScale = 0.0f;
+	uint64_t								m_Frame = 0;
+	std::vector<Retired>					m_Retired;
+
+	mutable std::mutex						m_Mutex;
+	std::condition_variable					m_Condition;
+	std::vector<PlanEntry>					m_Plan;
+	bool									m_RoundPending = false;
+	bool									m_Stop = false;
+	std::vector<Finished>					m_Finished;
+	Stats									m_Stats;
+
+	GPUUniformBuffer						m_Staging;
+	std::thread								m_Thread;
+
+	static inline TextureStreamer*			s_Instance = nullptr;
+};
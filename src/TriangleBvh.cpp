@@ -0,0 +1,82 @@
+#include "TriangleBvh.h"
+
+#include <cmath>
+
+void TriangleBvh::Build(const Vertex* vertices, const uint32_t* indices, uint32_t numIndices,
+	const IndexRange* ranges, uint32_t numRanges)
+{
+	const IndexRange wholeMesh = { 0, numIndices, 0 };
+	if (numRanges == 0)
+	{
+		ranges = &wholeMesh;
+		numRanges = 1;
+	}
+
+	m_Positions.clear();
+	for (uint32_t r = 0; r < numRanges; r++)
+	{
+		const IndexRange& range = ranges[r];
+		for (uint32_t i = range.firstIndex; i + 2 < range.firstIndex + range.numIndices; i += 3)
+		{
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				m_Positions.push_back(vertices[range.vertexOffset + indices[i + corner]].pos);
+			}
+		}
+	}
+
+	const uint32_t numTriangles = GetTriangleCount();
+	std::vector<Bvh::Bounds> bounds(numTriangles);
+	for (uint32_t i = 0; i < numTriangles; i++)
+	{
+		const glm::vec3* corners = &m_Positions[i * 3];
+		bounds[i].minimum = glm::min(glm::min(corners[0], corners[1]), corners[2]);
+		bounds[i].maximum = glm::max(glm::max(corners[0], corners[1]), corners[2]);
+	}
+	m_Bvh.Build(bounds.data(), numTriangles);
+}
+
+bool TriangleBvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float& maxDistance, uint32_t& triangle) const
+{
+	return m_Bvh.Raycast(origin, direction, maxDistance, [&](uint32_t item, float distance)
+	{
+		const float hitDistance = IntersectTriangle(item, origin, direction, distance);
+		if (hitDistance < distance)
+		{
+			triangle = item;
+		}
+		return hitDistance;
+	});
+}
+
+float TriangleBvh::IntersectTriangle(uint32_t triangle, const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+{
+	// Moeller, Trumbore: Fast, Minimum Storage Ray/Triangle Intersection, both sides hit
+	const glm::vec3* corners = &m_Positions[triangle * 3];
+	const glm::vec3 edge1 = corners[1] - corners[0];
+	const glm::vec3 edge2 = corners[2] - corners[0];
+	const glm::vec3 p = glm::cross(direction, edge2);
+	const float determinant = glm::dot(edge1, p);
+	if (std::abs(determinant) < 1e-12f)
+	{
+		return maxDistance;
+	}
+
+	const float inverse = 1.0f / determinant;
+	const glm::vec3 t = origin - corners[0];
+	const float u = glm::dot(t, p) * inverse;
+	if (u < 0.0f || u > 1.0f)
+	{
+		return maxDistance;
+	}
+
+	const glm::vec3 q = glm::cross(t, edge1);
+	const float v = glm::dot(direction, q) * inverse;
+	if (v < 0.0f || u + v > 1.0f)
+	{
+		return maxDistance;
+	}
+
+	const float distance = glm::dot(edge2, q) * inverse;
+	return distance >= 0.0f && distance < maxDistance ? distance : maxDistance;
+}
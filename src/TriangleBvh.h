@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Bvh.h"
+#include "VkStructs.h"
+
+// Bvh over the triangles of a mesh's full level of detail, with a copy of their
+// positions, for rays that need the exact surface instead of the mesh's box.
+class TriangleBvh
+{
+public:
+	// Without index ranges the indices address the whole mesh, see Mesh.
+	void Build(const Vertex* vertices, const uint32_t* indices, uint32_t numIndices,
+		const IndexRange* ranges, uint32_t numRanges);
+
+	// Object space, see Bvh::Raycast. triangle is the hit one's index.
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float& maxDistance, uint32_t& triangle) const;
+
+	uint32_t GetTriangleCount() const { return static_cast<uint32_t>(m_Positions.size() / 3); }
+
+private:
+	// where the ray hits the triangle, maxDistance when it doesn't before that
+	float IntersectTriangle(uint32_t triangle, const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const;
+
+private:
+	Bvh m_Bvh;
+	// three corners per triangle
+	std::vector<glm::vec3> m_Positions;
+};
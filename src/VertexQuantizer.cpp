@@ -0,0 +1,165 @@
+#include "VertexQuantizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	constexpr float UnormMax = 65535.0f;
+	constexpr float SnormMax = 32767.0f;
+
+	glm::vec2 OctahedronEncode(glm::vec3 normal)
+	{
+		normal /= std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+		glm::vec2 encoded(normal.x, normal.y);
+		if (normal.z < 0.0f)
+		{
+			// the lower half folds over the diagonals
+			encoded.x = (1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f);
+			encoded.y = (1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return encoded;
+	}
+
+	// same as the compact variant of shader.vert
+	glm::vec3 OctahedronDecode(glm::vec2 encoded)
+	{
+		glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+		float fold = std::max(-normal.z, 0.0f);
+		normal.x += normal.x >= 0.0f ? -fold : fold;
+		normal.y += normal.y >= 0.0f ? -fold : fold;
+		return glm::normalize(normal);
+	}
+
+	int16_t ToSnorm(float value)
+	{
+		return (int16_t)std::lround(std::clamp(value, -1.0f, 1.0f) * SnormMax);
+	}
+}
+
+uint16_t VertexQuantizer::FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const uint32_t magnitude = bits & 0x7FFFFFFF;
+
+	// too large for a half, or infinity and NaN
+	if (magnitude >= 0x47800000)
+	{
+		return (uint16_t)(sign | (magnitude > 0x7F800000 ? 0x7E00 : 0x7C00));
+	}
+
+	// below the smallest normal half, in steps of 2^-24
+	if (magnitude < 0x38800000)
+	{
+		float absolute;
+		memcpy(&absolute, &magnitude, sizeof(absolute));
+		return (uint16_t)(sign | (uint32_t)std::lrint(absolute * 16777216.0f));
+	}
+
+	// rebias the exponent and round the mantissa to nearest even, a carry moves into the exponent
+	uint32_t half = (magnitude - 0x38000000) >> 13;
+	const uint32_t rest = magnitude & 0x1FFF;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+	{
+		half++;
+	}
+	return (uint16_t)(sign | half);
+}
+
+float VertexQuantizer::HalfToFloat(uint16_t value)
+{
+	const uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+	const uint32_t exponent = (value >> 10) & 0x1F;
+	const uint32_t mantissa = value & 0x3FF;
+
+	if (exponent == 0)
+	{
+		float result = mantissa / 16777216.0f;
+		return sign ? -result : result;
+	}
+
+	uint32_t bits = exponent == 0x1F
+		? sign | 0x7F800000 | (mantissa << 13)
+		: sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+bool VertexQuantizer::Quantize(const Vertex* vertices, uint32_t numVertices, const Settings& settings,
+	CompactVertex* compact, glm::vec4& positionOffset, glm::vec4& positionScale)
+{
+	if (numVertices == 0)
+	{
+		return false;
+	}
+
+	glm::vec3 minimum = vertices[0].pos;
+	glm::vec3 maximum = vertices[0].pos;
+	for (uint32_t i = 1; i < numVertices; i++)
+	{
+		minimum = glm::min(minimum, vertices[i].pos);
+		maximum = glm::max(maximum, vertices[i].pos);
+	}
+	const glm::vec3 extent = maximum - minimum;
+
+	const float minNormalDot = std::cos(settings.maxNormalError);
+
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		const Vertex& vertex = vertices[i];
+		CompactVertex& packed = compact[i];
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float unit = extent[axis] > 0.0f ? (vertex.pos[axis] - minimum[axis]) / extent[axis] : 0.0f;
+			packed.pos[axis] = (uint16_t)std::lround(std::clamp(unit, 0.0f, 1.0f) * UnormMax);
+
+			float decoded = minimum[axis] + packed.pos[axis] / UnormMax * extent[axis];
+			// negated so that NaNs fail as well
+			if (!(std::abs(decoded - vertex.pos[axis]) <= settings.maxPositionError))
+			{
+				return false;
+			}
+		}
+		packed.pos[3] = 0;
+
+		for (int axis = 0; axis < 2; axis++)
+		{
+			packed.texCoord[axis] = FloatToHalf(vertex.texCoord[axis]);
+			if (!(std::abs(HalfToFloat(packed.texCoord[axis]) - vertex.texCoord[axis]) <= settings.maxTexCoordError))
+			{
+				return false;
+			}
+		}
+
+		// a degenerate normal has no direction to keep, it decodes to +z
+		const float normalLength = glm::length(vertex.normal);
+		if (!(normalLength > 0.0f))
+		{
+			packed.normal[0] = 0;
+			packed.normal[1] = 0;
+			continue;
+		}
+
+		const glm::vec3 normal = vertex.normal / normalLength;
+		const glm::vec2 encoded = OctahedronEncode(normal);
+		packed.normal[0] = ToSnorm(encoded.x);
+		packed.normal[1] = ToSnorm(encoded.y);
+
+		const glm::vec3 decoded = OctahedronDecode(glm::vec2(packed.normal[0] / SnormMax, packed.normal[1] / SnormMax));
+		if (!(glm::dot(decoded, normal) >= minNormalDot))
+		{
+			return false;
+		}
+	}
+
+	positionOffset = glm::vec4(minimum, 0.0f);
+	positionScale = glm::vec4(extent, 0.0f);
+	return true;
+}
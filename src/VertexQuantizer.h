@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+#include "VkStructs.h"
+
+// Packs a mesh's vertices into CompactVertex when that stays within the error
+// bounds, halving vertex fetch. Positions are stored relative to the mesh's
+// bounds, the vertex shader gets the offset and scale through the MVP buffer.
+// The error is measured on the decoded vertices, so meshes with a large extent
+// or heavily tiled texture coordinates keep the float format.
+class VertexQuantizer
+{
+public:
+	struct Settings
+	{
+		// object space units
+		float maxPositionError = 0.002f;
+		// radians
+		float maxNormalError = 0.002f;
+		// about a quarter texel of a 1024 texture
+		float maxTexCoordError = 1.0f / 4096.0f;
+	};
+
+public:
+	// False when any vertex is off by more than the settings allow, compact is
+	// left in an unspecified state then.
+	static bool Quantize(const Vertex* vertices, uint32_t numVertices, const Settings& settings,
+		CompactVertex* compact, glm::vec4& positionOffset, glm::vec4& positionScale);
+
+	static uint16_t FloatToHalf(float value);
+	static float HalfToFloat(uint16_t value);
+};
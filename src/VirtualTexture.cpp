@@ -0,0 +1,1091 @@
+#include "VirtualTexture.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "Logger.h"
+#include "Renderer.h"
+#include "exception/RendererException.h"
+
+struct VirtualTexture::Texture
+{
+	std::string path;
+	uint32_t references = 0;
+	MappedFile mapping;
+	TextureFile::Texture file;
+	// block of the virtual texture the texture sits in, in level 0 pages
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t blockLevel = 0;
+	// level 0 pages the texture covers
+	uint32_t pagesX = 0;
+	uint32_t pagesY = 0;
+	// coarsest level, the shorter side is one page there and its pages are pinned
+	uint32_t maxLevel = 0;
+	bool dirty = false;
+};
+
+namespace
+{
+	constexpr uint32_t SlotSize = VirtualTexture::PageSize + 2 * VirtualTexture::PageBorder;
+	constexpr uint32_t NoSlot = UINT32_MAX;
+	constexpr uint32_t PageCoordinateBits = 12;
+	constexpr uint32_t PageCoordinateMask = (1u << PageCoordinateBits) - 1;
+	constexpr uint64_t StagingAlignment = 16;
+
+	// same packing as the feedback shader writes
+	uint32_t PackPage(uint32_t x, uint32_t y, uint32_t level)
+	{
+		return x | (y << PageCoordinateBits) | (level << (2 * PageCoordinateBits));
+	}
+
+	void UnpackPage(uint32_t page, uint32_t& x, uint32_t& y, uint32_t& level)
+	{
+		x = page & PageCoordinateMask;
+		y = (page >> PageCoordinateBits) & PageCoordinateMask;
+		level = page >> (2 * PageCoordinateBits);
+	}
+
+	uint32_t GetPageLevel(uint32_t page)
+	{
+		return page >> (2 * PageCoordinateBits);
+	}
+
+	// indirection texel, R8G8B8A8_UINT: slot column, slot row, level of the page in the slot, 1 if valid
+	uint32_t PackEntry(uint32_t slotX, uint32_t slotY, uint32_t level)
+	{
+		return slotX | (slotY << 8) | (level << 16) | (1u << 24);
+	}
+
+	bool IsPowerOfTwo(uint32_t value)
+	{
+		return value != 0 && (value & (value - 1)) == 0;
+	}
+
+	uint32_t Log2(uint32_t value)
+	{
+		uint32_t log = 0;
+		while (value > 1)
+		{
+			value >>= 1;
+			log++;
+		}
+		return log;
+	}
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Renderer::ImageBarrier waits on nothing before the transfer, the page cache
+	// has to wait for the fragment shaders of the earlier frames still sampling it.
+	void Transition(VkCommandBuffer commandBuffer, GPUImage& image, VkImageLayout newLayout,
+		VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+	{
+		VkImageMemoryBarrier barrier;
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		barrier.oldLayout = image.layout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image.image;
+		barrier.subresourceRange.aspectMask = image.aspect;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = image.mipLevels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		image.layout = newLayout;
+	}
+
+	void DestroyImage(GPUImage& image)
+	{
+		const Renderer* renderer = Renderer::Get();
+		renderer->DestroyImageView(image);
+		renderer->DestroyImage(image);
+	}
+
+	VkRenderPass CreateFeedbackRenderPass(VkDevice device)
+	{
+		VkAttachmentDescription attachments[2];
+		attachments[0].flags = 0;
+		attachments[0].format = VK_FORMAT_R32_UINT;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+		attachments[1].flags = 0;
+		attachments[1].format = VK_FORMAT_D32_SFLOAT;
+		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorReference;
+		subpass.pDepthStencilAttachment = &depthReference;
+
+		VkSubpassDependency dependencies[2];
+		// the previous frame's copy out of the feedback image and its depth writes
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = 0;
+		// this frame's copy into the readback buffer
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		dependencies[1].dependencyFlags = 0;
+
+		VkRenderPassCreateInfo createInfo;
+		createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		createInfo.pNext = nullptr;
+		createInfo.flags = 0;
+		createInfo.attachmentCount = _countof(attachments);
+		createInfo.pAttachments = attachments;
+		createInfo.subpassCount = 1;
+		createInfo.pSubpasses = &subpass;
+		createInfo.dependencyCount = _countof(dependencies);
+		createInfo.pDependencies = dependencies;
+
+		VkRenderPass renderPass;
+		VkRes(vkCreateRenderPass(device, &createInfo, nullptr, &renderPass), "Failed to create virtual texture feedback renderpass!");
+		return renderPass;
+	}
+}
+
+VirtualTexture::VirtualTexture()
+	:
+	VirtualTexture(Settings())
+{}
+
+VirtualTexture::VirtualTexture(const Settings& settings)
+	:
+	m_Settings(settings)
+{
+	assert(s_Instance == nullptr);
+	assert(IsPowerOfTwo(m_Settings.virtualPages) && m_Settings.virtualPages <= PageCoordinateMask + 1);
+	assert(m_Settings.physicalPages > 0 && m_Settings.physicalPages <= 256 && m_Settings.physicalPages * SlotSize <= UINT16_MAX);
+
+	const Renderer* renderer = Renderer::Get();
+	VkDevice device = renderer->GetLogicalDevice();
+
+	if (!TextureFile::GetBlockLayout(m_Settings.format, m_BlockSize, m_BlockBytes) || !renderer->IsSampledFormatSupported(m_Settings.format))
+	{
+		Logger::Info("Virtual texture page cache format %d is not supported, using RGBA8\n", (int)m_Settings.format);
+		m_Settings.format = VK_FORMAT_R8G8B8A8_SRGB;
+		TextureFile::GetBlockLayout(m_Settings.format, m_BlockSize, m_BlockBytes);
+	}
+
+	const uint64_t slotBlocks = SlotSize / m_BlockSize;
+	m_SlotBytes = slotBlocks * slotBlocks * m_BlockBytes;
+	m_IndirectionLevels = Log2(m_Settings.virtualPages) + 1;
+
+	// the whole virtual texture is the one free block to begin with
+	m_FreeBlocks.resize(m_IndirectionLevels);
+	m_FreeBlocks.back().push_back(PackPage(0, 0, 0));
+	m_Owners.assign((size_t)m_Settings.virtualPages * m_Settings.virtualPages, nullptr);
+
+	const uint32_t slotCount = m_Settings.physicalPages * m_Settings.physicalPages;
+	m_Slots.resize(slotCount);
+	for (uint32_t slot = slotCount; slot-- > 0;)
+	{
+		m_FreeSlots.push_back(slot);
+	}
+
+	// nothing is resident, the first upload writes every level invalid
+	uint64_t indirectionBytes = 0;
+	m_Indirection.resize(m_IndirectionLevels);
+	m_DirtyRects.resize(m_IndirectionLevels);
+	for (uint32_t level = 0; level < m_IndirectionLevels; level++)
+	{
+		const uint32_t size = m_Settings.virtualPages >> level;
+		m_Indirection[level].assign((size_t)size * size, 0);
+		m_DirtyRects[level] = { 0, 0, size, size };
+		indirectionBytes += (uint64_t)size * size * sizeof(uint32_t);
+	}
+
+	const uint16_t cacheSize = (uint16_t)(m_Settings.physicalPages * SlotSize);
+	m_PageCache = renderer->CreateImage(m_Settings.format, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		cacheSize, cacheSize, 1, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL);
+	renderer->CreateImageView(m_PageCache);
+
+	m_IndirectionImage = renderer->CreateImage(VK_FORMAT_R8G8B8A8_UINT, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		(uint16_t)m_Settings.virtualPages, (uint16_t)m_Settings.virtualPages, (uint16_t)m_IndirectionLevels, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL);
+	renderer->CreateImageView(m_IndirectionImage);
+
+	// only ever read with texelFetch, integer formats can't be filtered
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod = (float)m_IndirectionLevels;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_TRANSPARENT_BLACK;
+	VkRes(vkCreateSampler(device, &samplerInfo, nullptr, &m_IndirectionSampler), "Failed to create virtual texture sampler!");
+
+	m_StagingSlotSize = AlignUp(m_Settings.maxUploadsPerFrame * m_SlotBytes + indirectionBytes, StagingAlignment);
+	m_Staging = renderer->CreateBuffer(
+		m_StagingSlotSize * renderer->GetFrameCount(),
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	m_Staging.mappedBuffer = renderer->MapBuffer(m_Staging);
+
+	m_DescriptorSet = renderer->CreateDescriptorSet(renderer->GetDescriptorPool(0), renderer->GetDescriptorSetLayout(DESCRIPTOR_SET_TYPE_VIRTUAL_TEXTURE), 1);
+
+	VkDescriptorImageInfo imageInfos[2];
+	imageInfos[0].sampler = renderer->GetSampler();
+	imageInfos[0].imageView = m_PageCache.view;
+	imageInfos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfos[1].sampler = m_IndirectionSampler;
+	imageInfos[1].imageView = m_IndirectionImage.view;
+	imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet writeSets[2];
+	for (uint32_t i = 0; i < _countof(writeSets); i++)
+	{
+		writeSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeSets[i].pNext = nullptr;
+		writeSets[i].dstSet = m_DescriptorSet;
+		writeSets[i].dstBinding = i;
+		writeSets[i].dstArrayElement = 0;
+		writeSets[i].descriptorCount = 1;
+		writeSets[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeSets[i].pImageInfo = &imageInfos[i];
+		writeSets[i].pBufferInfo = nullptr;
+		writeSets[i].pTexelBufferView = nullptr;
+	}
+	vkUpdateDescriptorSets(device, _countof(writeSets), writeSets, 0, VK_NULL_HANDLE);
+
+	m_FeedbackRenderPass = CreateFeedbackRenderPass(device);
+
+	Shader shaders[3];
+	shaders[0] = renderer->CreateShader("./Shaders/feedbackshader.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+	shaders[1] = renderer->CreateShader("./Shaders/vertexshader.spv", VK_SHADER_STAGE_VERTEX_BIT);
+	shaders[2] = renderer->CreateShader("./Shaders/compactvertexshader.spv", VK_SHADER_STAGE_VERTEX_BIT);
+	if (shaders[0].shader != VK_NULL_HANDLE && shaders[1].shader != VK_NULL_HANDLE)
+	{
+		for (uint32_t format = 0; format < VERTEX_FORMAT_MAX; format++)
+		{
+			Shader stages[] = { shaders[1 + format], shaders[0] };
+			if (stages[0].shader != VK_NULL_HANDLE)
+			{
+				m_FeedbackPipelines[format] = renderer->CreateGraphicsPipeline(stages, _countof(stages),
+					renderer->GetGraphicsPipelineLayout(GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE), m_FeedbackRenderPass, (VertexFormat)format);
+			}
+		}
+	}
+	else
+	{
+		Logger::Error("Virtual texture feedback shader is missing, run Shaders/build.bat. Only the pinned levels will be resident\n");
+	}
+	for (const Shader& shader : shaders)
+	{
+		if (shader.shader != VK_NULL_HANDLE)
+		{
+			vkDestroyShaderModule(device, shader.shader, nullptr);
+		}
+	}
+
+	s_Instance = this;
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	const Renderer* renderer = Renderer::Get();
+	VkDevice device = renderer->GetLogicalDevice();
+	vkDeviceWaitIdle(device);
+
+	if (m_Stats.textures > 0)
+	{
+		Logger::Error("%u textures are still virtualized when the virtual texture shuts down\n", m_Stats.textures);
+	}
+
+	DestroyFeedbackTargets();
+	for (VkPipeline pipeline : m_FeedbackPipelines)
+	{
+		if (pipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(device, pipeline, nullptr);
+		}
+	}
+	vkDestroyRenderPass(device, m_FeedbackRenderPass, nullptr);
+
+	vkFreeDescriptorSets(device, renderer->GetDescriptorPool(0), 1, &m_DescriptorSet);
+	vkDestroySampler(device, m_IndirectionSampler, nullptr);
+	DestroyImage(m_IndirectionImage);
+	DestroyImage(m_PageCache);
+
+	renderer->UnmapBuffer(m_Staging);
+	renderer->DestroyBuffer(m_Staging);
+
+	s_Instance = nullptr;
+}
+
+VirtualTexture::Texture* VirtualTexture::Acquire(const char* sourcePath)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	auto found = m_Textures.find(sourcePath);
+	if (found != m_Textures.end())
+	{
+		if (found->second)
+		{
+			found->second->references++;
+		}
+		return found->second.get();
+	}
+
+	std::unique_ptr<Texture>& entry = m_Textures[sourcePath];
+
+	std::unique_ptr<Texture> texture = std::make_unique<Texture>();
+	if (!TextureFile::Load(sourcePath, texture->mapping, texture->file))
+	{
+		return nullptr;
+	}
+
+	const TextureFile::Texture& file = texture->file;
+	if (file.format != m_Settings.format || !IsPowerOfTwo(file.width) || !IsPowerOfTwo(file.height) ||
+		std::min(file.width, file.height) < PageSize || std::max(file.width, file.height) > m_Settings.virtualPages * PageSize)
+	{
+		return nullptr;
+	}
+
+	texture->path = sourcePath;
+	texture->pagesX = file.width / PageSize;
+	texture->pagesY = file.height / PageSize;
+	texture->maxLevel = Log2(std::min(texture->pagesX, texture->pagesY));
+	texture->blockLevel = Log2(std::max(texture->pagesX, texture->pagesY));
+	if (file.mipLevels <= texture->maxLevel)
+	{
+		return nullptr;
+	}
+
+	if (!AllocateBlock(texture->blockLevel, texture->x, texture->y))
+	{
+		Logger::Info("Virtual texture is full, %s is not virtualized\n", sourcePath);
+		return nullptr;
+	}
+
+	for (uint32_t y = 0; y < texture->pagesY; y++)
+	{
+		for (uint32_t x = 0; x < texture->pagesX; x++)
+		{
+			m_Owners[(size_t)(texture->y + y) * m_Settings.virtualPages + texture->x + x] = texture.get();
+		}
+	}
+
+	const uint32_t level = texture->maxLevel;
+	for (uint32_t y = 0; y < texture->pagesY >> level; y++)
+	{
+		for (uint32_t x = 0; x < texture->pagesX >> level; x++)
+		{
+			m_PinnedQueue.push_back(PackPage((texture->x >> level) + x, (texture->y >> level) + y, level));
+		}
+	}
+
+	texture->references = 1;
+	m_Stats.textures++;
+	entry = std::move(texture);
+	return entry.get();
+}
+
+void VirtualTexture::Release(Texture* texture)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	if (--texture->references > 0)
+	{
+		return;
+	}
+
+	for (uint32_t level = 0; level <= texture->maxLevel; level++)
+	{
+		for (uint32_t y = texture->y >> level; y < (texture->y + texture->pagesY) >> level; y++)
+		{
+			for (uint32_t x = texture->x >> level; x < (texture->x + texture->pagesX) >> level; x++)
+			{
+				auto it = m_PageTable.find(PackPage(x, y, level));
+				if (it == m_PageTable.end())
+				{
+					continue;
+				}
+
+				Slot& slot = m_Slots[it->second];
+				if (slot.pinned)
+				{
+					m_Stats.pinnedPages--;
+				}
+				else
+				{
+					m_LRU.erase(slot.lru);
+				}
+				slot = Slot();
+				m_FreeSlots.push_back(it->second);
+				m_PageTable.erase(it);
+			}
+		}
+	}
+
+	// nothing resident any more, so this writes the whole rect invalid
+	UpdateIndirection(*texture);
+
+	m_DirtyTextures.erase(std::remove(m_DirtyTextures.begin(), m_DirtyTextures.end(), texture), m_DirtyTextures.end());
+	m_PinnedQueue.erase(std::remove_if(m_PinnedQueue.begin(), m_PinnedQueue.end(), [this, texture](uint32_t page)
+	{
+		return FindOwner(page) == texture;
+	}), m_PinnedQueue.end());
+
+	for (uint32_t y = 0; y < texture->pagesY; y++)
+	{
+		for (uint32_t x = 0; x < texture->pagesX; x++)
+		{
+			m_Owners[(size_t)(texture->y + y) * m_Settings.virtualPages + texture->x + x] = nullptr;
+		}
+	}
+	FreeBlock(texture->blockLevel, texture->x, texture->y);
+
+	m_Stats.textures--;
+	const std::string path = texture->path;
+	m_Textures.erase(path);
+}
+
+void VirtualTexture::GetShaderParameters(const Texture* texture, glm::vec4& rect, glm::vec4& info) const
+{
+	if (!texture)
+	{
+		rect = glm::vec4(0.0f);
+		info = glm::vec4(0.0f);
+		return;
+	}
+
+	const float scale = 1.0f / m_Settings.virtualPages;
+	rect = glm::vec4(texture->x * scale, texture->y * scale, texture->pagesX * scale, texture->pagesY * scale);
+	// derivatives in the feedback pass are feedbackDivisor times those of the main pass
+	info = glm::vec4((float)texture->maxLevel, 1.0f, -std::log2((float)m_Settings.feedbackDivisor), 0.0f);
+}
+
+void VirtualTexture::Update(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	m_Frame++;
+	m_PageCopies.clear();
+
+	// pinned pages first, a texture only shows from the cache once its coarsest level is in
+	size_t pinned = 0;
+	while (pinned < m_PinnedQueue.size() && m_PageCopies.size() < m_Settings.maxUploadsPerFrame)
+	{
+		if (!LoadPage(m_PinnedQueue[pinned], true, frameSlot))
+		{
+			break;
+		}
+		pinned++;
+	}
+	m_PinnedQueue.erase(m_PinnedQueue.begin(), m_PinnedQueue.begin() + pinned);
+
+	if (m_FeedbackWritten.size() > frameSlot && m_FeedbackWritten[frameSlot])
+	{
+		m_FeedbackWritten[frameSlot] = false;
+		ReadFeedback(frameSlot);
+
+		for (uint32_t page : m_Missing)
+		{
+			if (m_PageCopies.size() >= m_Settings.maxUploadsPerFrame || !LoadPage(page, false, frameSlot))
+			{
+				break;
+			}
+		}
+	}
+
+	for (Texture* texture : m_DirtyTextures)
+	{
+		UpdateIndirection(*texture);
+		texture->dirty = false;
+	}
+	m_DirtyTextures.clear();
+
+	RecordUploads(commandBuffer, frameSlot);
+}
+
+void VirtualTexture::Bind(VkCommandBuffer commandBuffer) const
+{
+	vkCmdBindDescriptorSets(
+		commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+		Renderer::Get()->GetGraphicsPipelineLayout(GRAPHICS_PIPELINE_TYPE_MVP_LIGHT_TEXTURE),
+		2, 1, &m_DescriptorSet,
+		0, nullptr
+	);
+}
+
+bool VirtualTexture::BeginFeedbackPass(VkCommandBuffer commandBuffer)
+{
+	if (m_FeedbackPipelines[VERTEX_FORMAT_FLOAT] == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_Stats.textures == 0)
+		{
+			return false;
+		}
+	}
+
+	const Renderer* renderer = Renderer::Get();
+
+	VkViewport viewport;
+	VkRect2D scissor;
+	renderer->GetViewportAndScissor(viewport, scissor);
+
+	const uint32_t width = std::max(1u, scissor.extent.width / m_Settings.feedbackDivisor);
+	const uint32_t height = std::max(1u, scissor.extent.height / m_Settings.feedbackDivisor);
+	if (width != m_FeedbackWidth || height != m_FeedbackHeight)
+	{
+		// the frames in flight may still render into or copy out of the old targets
+		vkDeviceWaitIdle(renderer->GetLogicalDevice());
+		DestroyFeedbackTargets();
+		CreateFeedbackTargets(width, height);
+	}
+
+	VkClearValue clearValues[2]{};
+	clearValues[0].color.uint32[0] = NoPage;
+	clearValues[1].depthStencil.depth = 1.0f;
+
+	VkRenderPassBeginInfo beginInfo;
+	beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	beginInfo.pNext = nullptr;
+	beginInfo.renderPass = m_FeedbackRenderPass;
+	beginInfo.framebuffer = m_FeedbackFramebuffer;
+	beginInfo.renderArea.offset = { 0, 0 };
+	beginInfo.renderArea.extent = { width, height };
+	beginInfo.clearValueCount = _countof(clearValues);
+	beginInfo.pClearValues = clearValues;
+
+	vkCmdBeginRenderPass(commandBuffer, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	// flipped like the main pass
+	viewport.x = 0.0f;
+	viewport.y = (float)height;
+	viewport.width = (float)width;
+	viewport.height = -(float)height;
+	scissor.offset = { 0, 0 };
+	scissor.extent = { width, height };
+
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	return true;
+}
+
+bool VirtualTexture::BindFeedbackPipeline(VkCommandBuffer commandBuffer, VertexFormat vertexFormat) const
+{
+	if (m_FeedbackPipelines[vertexFormat] == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_FeedbackPipelines[vertexFormat]);
+	Bind(commandBuffer);
+	return true;
+}
+
+void VirtualTexture::EndFeedbackPass(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	vkCmdEndRenderPass(commandBuffer);
+
+	VkBufferImageCopy region{};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = { m_FeedbackWidth, m_FeedbackHeight, 1 };
+
+	vkCmdCopyImageToBuffer(commandBuffer, m_FeedbackImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_Readback[frameSlot].buffer, 1, &region);
+
+	VkBufferMemoryBarrier barrier;
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = m_Readback[frameSlot].buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	m_FeedbackWritten[frameSlot] = true;
+}
+
+VirtualTexture::Stats VirtualTexture::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Stats stats = m_Stats;
+	stats.residentPages = (uint32_t)m_PageTable.size();
+	return stats;
+}
+
+bool VirtualTexture::AllocateBlock(uint32_t level, uint32_t& x, uint32_t& y)
+{
+	uint32_t from = level;
+	while (from < m_FreeBlocks.size() && m_FreeBlocks[from].empty())
+	{
+		from++;
+	}
+	if (from == m_FreeBlocks.size())
+	{
+		return false;
+	}
+
+	uint32_t unused;
+	UnpackPage(m_FreeBlocks[from].back(), x, y, unused);
+	m_FreeBlocks[from].pop_back();
+
+	// split down to the size asked for, keeping the top left quarter every time
+	while (from > level)
+	{
+		from--;
+		const uint32_t side = 1u << from;
+		m_FreeBlocks[from].push_back(PackPage(x + side, y, 0));
+		m_FreeBlocks[from].push_back(PackPage(x, y + side, 0));
+		m_FreeBlocks[from].push_back(PackPage(x + side, y + side, 0));
+	}
+	return true;
+}
+
+void VirtualTexture::FreeBlock(uint32_t level, uint32_t x, uint32_t y)
+{
+	// merge with the three other quarters of the parent for as long as they're all free
+	while (level + 1 < m_FreeBlocks.size())
+	{
+		const uint32_t side = 1u << level;
+		const uint32_t parentX = x & ~(2 * side - 1);
+		const uint32_t parentY = y & ~(2 * side - 1);
+
+		std::vector<uint32_t>& blocks = m_FreeBlocks[level];
+		const uint32_t quarters[] =
+		{
+			PackPage(parentX, parentY, 0), PackPage(parentX + side, parentY, 0),
+			PackPage(parentX, parentY + side, 0), PackPage(parentX + side, parentY + side, 0),
+		};
+
+		uint32_t freeQuarters = 0;
+		for (uint32_t quarter : quarters)
+		{
+			freeQuarters += quarter == PackPage(x, y, 0) || std::find(blocks.begin(), blocks.end(), quarter) != blocks.end() ? 1 : 0;
+		}
+		if (freeQuarters != _countof(quarters))
+		{
+			break;
+		}
+
+		blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [&quarters](uint32_t block)
+		{
+			return std::find(std::begin(quarters), std::end(quarters), block) != std::end(quarters);
+		}), blocks.end());
+
+		x = parentX;
+		y = parentY;
+		level++;
+	}
+
+	m_FreeBlocks[level].push_back(PackPage(x, y, 0));
+}
+
+VirtualTexture::Texture* VirtualTexture::FindOwner(uint32_t page) const
+{
+	uint32_t x, y, level;
+	UnpackPage(page, x, y, level);
+
+	if (level >= m_IndirectionLevels || x >= m_Settings.virtualPages >> level || y >= m_Settings.virtualPages >> level)
+	{
+		return nullptr;
+	}
+
+	Texture* texture = m_Owners[(size_t)(y << level) * m_Settings.virtualPages + (x << level)];
+	return texture && level <= texture->maxLevel ? texture : nullptr;
+}
+
+void VirtualTexture::ReadFeedback(uint32_t frameSlot)
+{
+	const uint32_t* feedback = static_cast<const uint32_t*>(m_Readback[frameSlot].mappedBuffer);
+	m_Requests.assign(feedback, feedback + (size_t)m_FeedbackWidth * m_FeedbackHeight);
+	std::sort(m_Requests.begin(), m_Requests.end());
+	m_Requests.erase(std::unique(m_Requests.begin(), m_Requests.end()), m_Requests.end());
+
+	m_Missing.clear();
+	for (uint32_t request : m_Requests)
+	{
+		// also null for pages of textures released since the feedback was drawn
+		const Texture* texture = FindOwner(request);
+		if (!texture)
+		{
+			continue;
+		}
+
+		// the page and every coarser one above it, so what a missing page falls back to stays resident too
+		uint32_t x, y, level;
+		UnpackPage(request, x, y, level);
+		for (; level <= texture->maxLevel; level++, x >>= 1, y >>= 1)
+		{
+			const uint32_t page = PackPage(x, y, level);
+			auto it = m_PageTable.find(page);
+			if (it == m_PageTable.end())
+			{
+				m_Missing.push_back(page);
+				continue;
+			}
+
+			// everything above was seen along with it
+			if (m_Slots[it->second].lastUsed == m_Frame)
+			{
+				break;
+			}
+			Touch(it->second);
+		}
+	}
+
+	// coarse first, a coarse page is what everything below it falls back to
+	std::sort(m_Missing.begin(), m_Missing.end(), [](uint32_t a, uint32_t b)
+	{
+		return GetPageLevel(a) != GetPageLevel(b) ? GetPageLevel(a) > GetPageLevel(b) : a < b;
+	});
+	m_Missing.erase(std::unique(m_Missing.begin(), m_Missing.end()), m_Missing.end());
+	m_Stats.missingPages = (uint32_t)m_Missing.size();
+}
+
+uint32_t VirtualTexture::AllocateSlot()
+{
+	if (!m_FreeSlots.empty())
+	{
+		const uint32_t slot = m_FreeSlots.back();
+		m_FreeSlots.pop_back();
+		return slot;
+	}
+
+	// a page this frame asked for isn't evicted for another one, the cache is too
+	// small for the view then and the rest keeps falling back to coarser pages
+	if (m_LRU.empty() || m_Slots[m_LRU.back()].lastUsed == m_Frame)
+	{
+		return NoSlot;
+	}
+
+	const uint32_t slot = m_LRU.back();
+	m_LRU.pop_back();
+
+	Slot& evicted = m_Slots[slot];
+	m_PageTable.erase(evicted.page);
+	MarkDirty(evicted.texture);
+	evicted = Slot();
+	m_Stats.pagesEvicted++;
+	return slot;
+}
+
+void VirtualTexture::Touch(uint32_t slot)
+{
+	Slot& touched = m_Slots[slot];
+	touched.lastUsed = m_Frame;
+	if (!touched.pinned)
+	{
+		m_LRU.splice(m_LRU.begin(), m_LRU, touched.lru);
+	}
+}
+
+bool VirtualTexture::LoadPage(uint32_t page, bool pinned, uint32_t frameSlot)
+{
+	Texture* texture = FindOwner(page);
+	if (!texture)
+	{
+		return true;
+	}
+
+	auto it = m_PageTable.find(page);
+	if (it != m_PageTable.end())
+	{
+		Slot& resident = m_Slots[it->second];
+		if (pinned && !resident.pinned)
+		{
+			m_LRU.erase(resident.lru);
+			resident.pinned = true;
+			m_Stats.pinnedPages++;
+		}
+		return true;
+	}
+
+	const uint32_t slot = AllocateSlot();
+	if (slot == NoSlot)
+	{
+		return false;
+	}
+
+	uint32_t x, y, level;
+	UnpackPage(page, x, y, level);
+
+	const uint64_t offset = frameSlot * m_StagingSlotSize + m_PageCopies.size() * m_SlotBytes;
+	ExtractPage(*texture, level, x - (texture->x >> level), y - (texture->y >> level), static_cast<uint8_t*>(m_Staging.mappedBuffer) + offset);
+
+	VkBufferImageCopy region{};
+	region.bufferOffset = offset;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset.x = (int32_t)((slot % m_Settings.physicalPages) * SlotSize);
+	region.imageOffset.y = (int32_t)((slot / m_Settings.physicalPages) * SlotSize);
+	region.imageExtent = { SlotSize, SlotSize, 1 };
+	m_PageCopies.push_back(region);
+
+	Slot& loaded = m_Slots[slot];
+	loaded.page = page;
+	loaded.texture = texture;
+	loaded.lastUsed = m_Frame;
+	loaded.pinned = pinned;
+	if (pinned)
+	{
+		m_Stats.pinnedPages++;
+	}
+	else
+	{
+		m_LRU.push_front(slot);
+		loaded.lru = m_LRU.begin();
+	}
+
+	m_PageTable.emplace(page, slot);
+	MarkDirty(texture);
+	m_Stats.pagesLoaded++;
+	return true;
+}
+
+void VirtualTexture::ExtractPage(const Texture& texture, uint32_t level, uint32_t pageX, uint32_t pageY, uint8_t* destination) const
+{
+	// the level's sides are multiples of PageSize and PageBorder of the block size, everything is copied in whole blocks
+	const uint32_t blocksX = (texture.file.width >> level) / m_BlockSize;
+	const uint32_t blocksY = (texture.file.height >> level) / m_BlockSize;
+	const uint32_t pageBlocks = PageSize / m_BlockSize;
+	const uint32_t borderBlocks = PageBorder / m_BlockSize;
+	const uint32_t slotBlocks = SlotSize / m_BlockSize;
+	const uint64_t rowBytes = (uint64_t)blocksX * m_BlockBytes;
+	const uint8_t* source = texture.file.GetLevelData(level);
+
+	for (uint32_t row = 0; row < slotBlocks; row++)
+	{
+		// the border wraps around the texture's edges like the repeating sampler does
+		const uint32_t sourceRow = (pageY * pageBlocks + row + blocksY - borderBlocks) % blocksY;
+		const uint8_t* sourceLine = source + sourceRow * rowBytes;
+
+		uint32_t column = (pageX * pageBlocks + blocksX - borderBlocks) % blocksX;
+		uint32_t remaining = slotBlocks;
+		while (remaining > 0)
+		{
+			const uint32_t run = std::min(remaining, blocksX - column);
+			memcpy(destination, sourceLine + (uint64_t)column * m_BlockBytes, (size_t)run * m_BlockBytes);
+			destination += (size_t)run * m_BlockBytes;
+			remaining -= run;
+			column = 0;
+		}
+	}
+}
+
+void VirtualTexture::MarkDirty(Texture* texture)
+{
+	if (!texture->dirty)
+	{
+		texture->dirty = true;
+		m_DirtyTextures.push_back(texture);
+	}
+}
+
+void VirtualTexture::UpdateIndirection(const Texture& texture)
+{
+	// coarse to fine, a page that isn't resident takes the entry of the page above it
+	for (uint32_t level = texture.maxLevel + 1; level-- > 0;)
+	{
+		const uint32_t size = m_Settings.virtualPages >> level;
+		const uint32_t x0 = texture.x >> level;
+		const uint32_t y0 = texture.y >> level;
+		const uint32_t x1 = (texture.x + texture.pagesX) >> level;
+		const uint32_t y1 = (texture.y + texture.pagesY) >> level;
+
+		std::vector<uint32_t>& entries = m_Indirection[level];
+		for (uint32_t y = y0; y < y1; y++)
+		{
+			for (uint32_t x = x0; x < x1; x++)
+			{
+				uint32_t entry = 0;
+				auto it = m_PageTable.find(PackPage(x, y, level));
+				if (it != m_PageTable.end())
+				{
+					entry = PackEntry(it->second % m_Settings.physicalPages, it->second / m_Settings.physicalPages, level);
+				}
+				else if (level < texture.maxLevel)
+				{
+					entry = m_Indirection[level + 1][(size_t)(y / 2) * (size / 2) + x / 2];
+				}
+				entries[(size_t)y * size + x] = entry;
+			}
+		}
+
+		Rect& dirty = m_DirtyRects[level];
+		dirty.x0 = std::min(dirty.x0, x0);
+		dirty.y0 = std::min(dirty.y0, y0);
+		dirty.x1 = std::max(dirty.x1, x1);
+		dirty.y1 = std::max(dirty.y1, y1);
+	}
+}
+
+void VirtualTexture::RecordUploads(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	uint8_t* staging = static_cast<uint8_t*>(m_Staging.mappedBuffer);
+
+	// the changed rect of every indirection level, after the space for this frame's pages
+	std::vector<VkBufferImageCopy> indirectionCopies;
+	uint64_t offset = frameSlot * m_StagingSlotSize + m_Settings.maxUploadsPerFrame * m_SlotBytes;
+	for (uint32_t level = 0; level < m_IndirectionLevels; level++)
+	{
+		Rect& dirty = m_DirtyRects[level];
+		if (dirty.x0 >= dirty.x1 || dirty.y0 >= dirty.y1)
+		{
+			continue;
+		}
+
+		const uint32_t size = m_Settings.virtualPages >> level;
+		const uint32_t width = dirty.x1 - dirty.x0;
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = offset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = level;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { (int32_t)dirty.x0, (int32_t)dirty.y0, 0 };
+		region.imageExtent = { width, dirty.y1 - dirty.y0, 1 };
+		indirectionCopies.push_back(region);
+
+		for (uint32_t y = dirty.y0; y < dirty.y1; y++)
+		{
+			memcpy(staging + offset, &m_Indirection[level][(size_t)y * size + dirty.x0], width * sizeof(uint32_t));
+			offset += width * sizeof(uint32_t);
+		}
+		dirty = Rect();
+	}
+
+	if (!m_PageCopies.empty())
+	{
+		Transition(commandBuffer, m_PageCache, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		vkCmdCopyBufferToImage(commandBuffer, m_Staging.buffer, m_PageCache.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)m_PageCopies.size(), m_PageCopies.data());
+		Transition(commandBuffer, m_PageCache, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
+	else if (m_PageCache.layout != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	{
+		// bound from the first frame on, whether or not anything is in it yet
+		Transition(commandBuffer, m_PageCache, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
+
+	if (!indirectionCopies.empty())
+	{
+		Transition(commandBuffer, m_IndirectionImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		vkCmdCopyBufferToImage(commandBuffer, m_Staging.buffer, m_IndirectionImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)indirectionCopies.size(), indirectionCopies.data());
+		Transition(commandBuffer, m_IndirectionImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
+}
+
+void VirtualTexture::CreateFeedbackTargets(uint32_t width, uint32_t height)
+{
+	const Renderer* renderer = Renderer::Get();
+
+	m_FeedbackImage = renderer->CreateImage(VK_FORMAT_R32_UINT, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		(uint16_t)width, (uint16_t)height, 1, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL);
+	renderer->CreateImageView(m_FeedbackImage);
+
+	m_FeedbackDepth = renderer->CreateImage(VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+		(uint16_t)width, (uint16_t)height, 1, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL);
+	renderer->CreateImageView(m_FeedbackDepth);
+
+	VkImageView attachments[] = { m_FeedbackImage.view, m_FeedbackDepth.view };
+
+	VkFramebufferCreateInfo createInfo;
+	createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	createInfo.pNext = nullptr;
+	createInfo.flags = 0;
+	createInfo.renderPass = m_FeedbackRenderPass;
+	createInfo.attachmentCount = _countof(attachments);
+	createInfo.pAttachments = attachments;
+	createInfo.width = width;
+	createInfo.height = height;
+	createInfo.layers = 1;
+
+	VkRes(vkCreateFramebuffer(renderer->GetLogicalDevice(), &createInfo, nullptr, &m_FeedbackFramebuffer), "Failed to create virtual texture feedback framebuffer!");
+
+	m_Readback.resize(renderer->GetFrameCount());
+	for (GPUUniformBuffer& readback : m_Readback)
+	{
+		readback = renderer->CreateBuffer(
+			(uint64_t)width * height * sizeof(uint32_t),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		readback.mappedBuffer = renderer->MapBuffer(readback);
+	}
+	m_FeedbackWritten.assign(renderer->GetFrameCount(), false);
+
+	m_FeedbackWidth = width;
+	m_FeedbackHeight = height;
+}
+
+void VirtualTexture::DestroyFeedbackTargets()
+{
+	if (m_FeedbackFramebuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	const Renderer* renderer = Renderer::Get();
+
+	for (GPUUniformBuffer& readback : m_Readback)
+	{
+		renderer->UnmapBuffer(readback);
+		renderer->DestroyBuffer(readback);
+	}
+	m_Readback.clear();
+	m_FeedbackWritten.clear();
+
+	vkDestroyFramebuffer(renderer->GetLogicalDevice(), m_FeedbackFramebuffer, nullptr);
+	m_FeedbackFramebuffer = VK_NULL_HANDLE;
+	DestroyImage(m_FeedbackDepth);
+	DestroyImage(m_FeedbackImage);
+
+	m_FeedbackWidth = 0;
+	m_FeedbackHeight = 0;
+}
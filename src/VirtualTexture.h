@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MappedFile.h"
+#include "TextureFile.h"
+#include "VkStructs.h"
+
+// Software virtual texturing, no sparse residency needed. Every texture that
+// qualifies gets a square, power of two block of pages in one large virtual
+// texture, a page being PageSize texels on a side at every mip level. Only the
+// pages the screen needs are resident, in the physical page cache: one atlas
+// image of slots, each holding a page plus PageBorder texels of its neighbours
+// so bilinear filtering never reads the slot next to it. The indirection
+// texture has a texel per virtual page and level that points at the slot
+// holding the page, or at the closest coarser resident page when it isn't
+// resident itself. The coarsest level of every texture is pinned, so a lookup
+// always resolves once a texture's first pages are in.
+//
+// Which pages are needed comes from the feedback pass: after the main pass the
+// scene is drawn again at a fraction of the resolution, writing the page every
+// pixel would sample, and the result is copied to a host buffer. When the frame
+// slot comes around again the page manager reads it, moves the pages seen to the
+// front of the LRU order and loads the missing ones, coarse first, straight from
+// the texture files, evicting the pages seen longest ago once the cache is full.
+// Uploads are recorded at the top of the frame's command buffer, which orders
+// them after every earlier frame that could still sample the slots they reuse.
+class VirtualTexture
+{
+public:
+	// texels on a side of a page and of the border around it in a slot, the shaders use the same values
+	static constexpr uint32_t PageSize = 128;
+	static constexpr uint32_t PageBorder = 4;
+	// written by the feedback pass where no virtual texture is visible
+	static constexpr uint32_t NoPage = UINT32_MAX;
+
+	struct Settings
+	{
+		// format of the page cache, only texture files stored in it are virtualized
+		VkFormat format = VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+		// pages on a side of the virtual texture at level 0, a power of two of at most 4096
+		uint32_t virtualPages = 256;
+		// slots on a side of the page cache, at most 256
+		uint32_t physicalPages = 32;
+		// the feedback pass renders at the screen size divided by this
+		uint32_t feedbackDivisor = 8;
+		// pages loaded into the cache per frame at most
+		uint32_t maxUploadsPerFrame = 16;
+	};
+
+	struct Stats
+	{
+		uint32_t textures = 0;
+		uint32_t residentPages = 0;
+		uint32_t pinnedPages = 0;
+		// pages the last feedback asked for that weren't resident
+		uint32_t missingPages = 0;
+		uint64_t pagesLoaded = 0;
+		uint64_t pagesEvicted = 0;
+	};
+
+	struct Texture;
+
+public:
+	VirtualTexture();
+	explicit VirtualTexture(const Settings& settings);
+	VirtualTexture(const VirtualTexture&) = delete;
+	VirtualTexture& operator=(const VirtualTexture&) = delete;
+	~VirtualTexture();
+
+	// Places the texture file of sourcePath in the virtual texture. Returns null if
+	// there is no file or it can't be virtualized: it has to be in the page cache's
+	// format with sides that are powers of two of at least PageSize. Textures are
+	// shared by path and reference counted.
+	Texture* Acquire(const char* sourcePath);
+	void Release(Texture* texture);
+	// For the FragmentBuffer of a mesh using texture: where its [0, 1] texture
+	// coordinates land in the virtual texture, and its coarsest level, that it's
+	// virtual and the level bias of the feedback pass.
+	void GetShaderParameters(const Texture* texture, glm::vec4& rect, glm::vec4& info) const;
+
+	// Called by the renderer at the top of a frame once its slot's fence signalled,
+	// before the main pass begins: reads the feedback the slot's last frame wrote
+	// and records the page and indirection uploads.
+	void Update(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+	// Binds the page cache and indirection texture as set 2 of the main pipeline layout.
+	void Bind(VkCommandBuffer commandBuffer) const;
+	// After the main pass: begins the feedback pass, false if there is nothing virtual
+	// to draw. The renderer binds the pipeline of every vertex format in turn and draws
+	// the meshes stored in it.
+	bool BeginFeedbackPass(VkCommandBuffer commandBuffer);
+	// False when the format's feedback pipeline couldn't be created.
+	bool BindFeedbackPipeline(VkCommandBuffer commandBuffer, VertexFormat vertexFormat) const;
+	// Ends the feedback pass and copies the feedback into the slot's readback buffer.
+	void EndFeedbackPass(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+	const Settings& GetSettings() const { return m_Settings; }
+	Stats GetStats() const;
+
+	static VirtualTexture* Get() { return s_Instance; }
+
+private:
+	struct Slot
+	{
+		uint32_t page = NoPage;
+		Texture* texture = nullptr;
+		uint64_t lastUsed = 0;
+		bool pinned = false;
+		std::list<uint32_t>::iterator lru;
+	};
+
+	struct Rect
+	{
+		uint32_t x0 = UINT32_MAX;
+		uint32_t y0 = UINT32_MAX;
+		uint32_t x1 = 0;
+		uint32_t y1 = 0;
+	};
+
+	bool AllocateBlock(uint32_t level, uint32_t& x, uint32_t& y);
+	void FreeBlock(uint32_t level, uint32_t x, uint32_t y);
+	Texture* FindOwner(uint32_t page) const;
+
+	void ReadFeedback(uint32_t frameSlot);
+	uint32_t AllocateSlot();
+	void Touch(uint32_t slot);
+	// false when no slot can be had this frame
+	bool LoadPage(uint32_t page, bool pinned, uint32_t frameSlot);
+	void ExtractPage(const Texture& texture, uint32_t level, uint32_t pageX, uint32_t pageY, uint8_t* destination) const;
+	void MarkDirty(Texture* texture);
+	void UpdateIndirection(const Texture& texture);
+	void RecordUploads(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+	void CreateFeedbackTargets(uint32_t width, uint32_t height);
+	void DestroyFeedbackTargets();
+
+private:
+	Settings										m_Settings;
+	uint32_t										m_BlockSize = 1;
+	uint32_t										m_BlockBytes = 4;
+	uint64_t										m_SlotBytes = 0;
+	uint32_t										m_IndirectionLevels = 0;
+	uint64_t										m_Frame = 0;
+
+	mutable std::mutex								m_Mutex;
+	// null for paths that were looked at and aren't virtualized
+	std::unordered_map<std::string, std::unique_ptr<Texture>> m_Textures;
+	// free blocks of the virtual texture by log2 of their side in pages
+	std::vector<std::vector<uint32_t>>				m_FreeBlocks;
+	// texture owning every level 0 page
+	std::vector<Texture*>							m_Owners;
+	std::unordered_map<uint32_t, uint32_t>			m_PageTable;
+	std::vector<Slot>								m_Slots;
+	std::vector<uint32_t>							m_FreeSlots;
+	// unpinned resident slots, most recently seen first
+	std::list<uint32_t>								m_LRU;
+	std::vector<uint32_t>							m_PinnedQueue;
+	std::vector<Texture*>							m_DirtyTextures;
+	// CPU copy of every indirection level and what changed since the last upload
+	std::vector<std::vector<uint32_t>>				m_Indirection;
+	std::vector<Rect>								m_DirtyRects;
+	std::vector<uint32_t>							m_Requests;
+	std::vector<uint32_t>							m_Missing;
+	std::vector<VkBufferImageCopy>					m_PageCopies;
+	Stats											m_Stats;
+
+	GPUImage										m_PageCache;
+	GPUImage										m_IndirectionImage;
+	VkSampler										m_IndirectionSampler = VK_NULL_HANDLE;
+	VkDescriptorSet									m_DescriptorSet = VK_NULL_HANDLE;
+	// per frame slot: page uploads followed by the indirection levels
+	GPUUniformBuffer								m_Staging;
+	uint64_t										m_StagingSlotSize = 0;
+
+	VkRenderPass									m_FeedbackRenderPass = VK_NULL_HANDLE;
+	VkPipeline										m_FeedbackPipelines[VERTEX_FORMAT_MAX] = {};
+	GPUImage										m_FeedbackImage;
+	GPUImage										m_FeedbackDepth;
+	VkFramebuffer									m_FeedbackFramebuffer = VK_NULL_HANDLE;
+	uint32_t										m_FeedbackWidth = 0;
+	uint32_t										m_FeedbackHeight = 0;
+	std::vector<GPUUniformBuffer>					m_Readback;
+	std::vector<bool>								m_FeedbackWritten;
+
+	static inline VirtualTexture*					s_Instance = nullptr;
+};
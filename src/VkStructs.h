@@ -68,6 +68,9 @@ struct MVP {
 	glm::mat4 view = glm::mat4(1.0f);
 	glm::mat4 projection = glm::mat4(1.0f);
 	glm::mat4 mvp = glm::mat4(1.0f);
+	// dequantizes CompactVertex::pos, position = offset + pos * scale, unused by Vertex
+	glm::vec4 positionOffset = glm::vec4(0.0f);
+	glm::vec4 positionScale = glm::vec4(1.0f);
 };
 
 struct alignas(64) FragmentBuffer {
@@ -76,6 +79,13 @@ struct alignas(64) FragmentBuffer {
 	glm::vec3 lightColor;
 	float linearFalloff;
 	float quadraticFalloff;
+	// std140 starts the vec4s on a 16 byte boundary
+	float padding[3];
+	// where the mesh's texture sits in the virtual texture, see VirtualTexture::GetShaderParameters
+	glm::vec4 virtualRect;
+	glm::vec4 virtualInfo;
+	// where the mesh's texture sits in its atlas page, see TextureAtlas::Entry, zero when it isn't packed
+	glm::vec4 atlasRect;
 };
 
 struct Vertex {
@@ -84,11 +94,97 @@ struct Vertex {
 	glm::vec2 texCoord;
 };
 
-struct Transform
+// Half the size of Vertex, see VertexQuantizer. Position is unorm16 within the
+// mesh's bounds (w unused), normal octahedron encoded snorm16, texCoord half floats.
+struct CompactVertex {
+	uint16_t pos[4];
+	int16_t normal[2];
+	uint16_t texCoord[2];
+};
+
+// Part of a mesh's index buffer drawn with 16-bit indices, relative to vertexOffset.
+// Meshes with more vertices than 16 bits address are cut into such ranges on import.
+struct IndexRange {
+	static constexpr uint32_t MaxVertices = 1u << 16;
+
+	uint32_t firstIndex;
+	uint32_t numIndices;
+	int32_t vertexOffset;
+};
+
+// Run of triangles within one index range with its bounds, culled on the CPU as a
+// whole. The cone holds every triangle's normal, coneCutoff is the sine of its
+// half angle or 1 when the normals spread too far to ever face away together.
+struct Meshlet {
+	static constexpr uint32_t MaxVertices = 64;
+	static constexpr uint32_t MaxTriangles = 124;
+
+	uint32_t firstIndex;
+	uint32_t numIndices;
+	glm::vec3 center;
+	float radius;
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// levels of detail of a mesh including the full one, see MeshOptimizer
+constexpr uint32_t MaxMeshLods = 4;
+
+// Object space bounds of a mesh's vertices, the sphere is centered on the box
+struct MeshBounds {
+	glm::vec3 minimum = glm::vec3(0.0f);
+	glm::vec3 maximum = glm::vec3(0.0f);
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+};
+
+class Mesh;
+struct Occluder;
+
+// Mesh instances tested and rejected by FrustumCuller and OcclusionCuller, meshlets by Mesh::Cull
+struct MeshCullStats
 {
-	glm::vec3 pos = { 0.0f, 0.0f, 0.0f };
-	glm::vec3 eulerRot = { 0.0f, 0.0f, 0.0f };
-	glm::vec3 scale = { 1.0f, 1.0f, 1.0f };
+	uint32_t meshes = 0;
+	uint32_t meshesCulled = 0;
+	uint32_t meshesOccluded = 0;
+	// rasterized into the occlusion buffer
+	uint32_t occluders = 0;
+	uint32_t occluderTriangles = 0;
+	uint32_t meshlets = 0;
+	uint32_t frustumCulled = 0;
+	uint32_t backfaceCulled = 0;
 
-	glm::mat4 model = glm::mat4(1.0f);
+	void Add(const MeshCullStats& other)
+	{
+		meshes += other.meshes;
+		meshesCulled += other.meshesCulled;
+		meshesOccluded += other.meshesOccluded;
+		occluders += other.occluders;
+		occluderTriangles += other.occluderTriangles;
+		meshlets += other.meshlets;
+		frustumCulled += other.frustumCulled;
+		backfaceCulled += other.backfaceCulled;
+	}
+};
+
+// A mesh as placed in the world this frame and what's left of it after culling
+struct MeshInstance
+{
+	const Mesh* mesh = nullptr;
+	// the node's world matrix, owned by the scene's hierarchy
+	const glm::mat4* transform = nullptr;
+	// the mesh's triangles for the occlusion buffer, see OcclusionCuller::BuildOccluder
+	const Occluder* occluder = nullptr;
+	// level drawn last frame, the next one is picked relative to it
+	uint32_t lodLevel = 0;
+	// the level's index ranges that survived culling, adjacent meshlets merged into one draw
+	std::vector<IndexRange> draws;
+};
+
+enum VertexFormat
+{
+	VERTEX_FORMAT_FLOAT,
+	VERTEX_FORMAT_COMPACT,
+
+	VERTEX_FORMAT_MAX
 };
@@ -65,6 +65,30 @@ void ImGuiManager::Draw(Renderer* renderer, float deltaTime) const
         ImGui::Text("Mouse pos: %f %f", renderer->m_CameraPitch, renderer->m_CameraYaw);
     }
     ImGui::End();
+
+    if (ImGui::Begin("Culling"))
+    {
+        const MeshCullStats& stats = renderer->m_CullStats;
+        const float meshPercent = stats.meshes > 0 ? 100.0f / stats.meshes : 0.0f;
+        const uint32_t visible = stats.meshes - stats.meshesCulled - stats.meshesOccluded;
+        ImGui::Text("Meshes: %u", stats.meshes);
+        ImGui::Text("Visible: %u (%.1f%%)", visible, visible * meshPercent);
+        ImGui::Text("Outside the frustum: %u (%.1f%%)", stats.meshesCulled, stats.meshesCulled * meshPercent);
+        ImGui::Separator();
+
+        ImGui::Checkbox("Occlusion culling", &renderer->m_OcclusionCulling);
+        ImGui::Text("Occluded: %u (%.1f%%)", stats.meshesOccluded, stats.meshesOccluded * meshPercent);
+        ImGui::Text("Occluders: %u, %u triangles", stats.occluders, stats.occluderTriangles);
+        ImGui::Text("Occlusion time: %.2f ms", renderer->m_OcclusionTime);
+        ImGui::Separator();
+
+        const float percent = stats.meshlets > 0 ? 100.0f / stats.meshlets : 0.0f;
+        ImGui::Checkbox("Meshlet culling", &renderer->m_MeshletCulling);
+        ImGui::Text("Meshlets: %u", stats.meshlets);
+        ImGui::Text("Frustum culled: %u (%.1f%%)", stats.frustumCulled, stats.frustumCulled * percent);
+        ImGui::Text("Backface culled: %u (%.1f%%)", stats.backfaceCulled, stats.backfaceCulled * percent);
+    }
+    ImGui::End();
 }
 
 void ImGuiManager::EndFrame(void* commandBuffer)
@@ -1,17 +1,76 @@
 #include "Engine.h"
 
+#include <cstring>
 #include <exception>
 #include <Windows.h>
 
+#include "BvhBenchmark.h"
+#include "HierarchyBenchmark.h"
+#include "ImportBenchmark.h"
+#include "OcclusionBenchmark.h"
+#include "TextureCooker.h"
 #include "exception/StimplyExceptionBase.h"
 
-int main() {
+int main(int argc, char** argv) {
 #ifdef _DEBUG
 	// PLEASE only use this in Debug, as it's a major security concern.
 	system(".\\Shaders\\build_debug.bat");
 #endif
 	try
 	{
+		if (argc > 1 && strcmp(argv[1], "--benchmark-import") == 0)
+		{
+			ImportBenchmark::Run();
+			return 0;
+		}
+
+		if (argc > 1 && strcmp(argv[1], "--benchmark-hierarchy") == 0)
+		{
+			HierarchyBenchmark::Run();
+			return 0;
+		}
+
+		if (argc > 1 && strcmp(argv[1], "--benchmark-bvh") == 0)
+		{
+			BvhBenchmark::Run();
+			return 0;
+		}
+
+		if (argc > 1 && strcmp(argv[1], "--benchmark-occlusion") == 0)
+		{
+			OcclusionBenchmark::Run();
+			return 0;
+		}
+
+		// --cook-textures [directory] [--high-quality] [--uncompressed] [--no-atlas]
+		if (argc > 1 && strcmp(argv[1], "--cook-textures") == 0)
+		{
+			const char* directory = "./Models";
+			TextureCooker::Settings settings;
+			for (int i = 2; i < argc; i++)
+			{
+				if (strcmp(argv[i], "--high-quality") == 0)
+				{
+					settings.highQuality = true;
+				}
+				else if (strcmp(argv[i], "--uncompressed") == 0)
+				{
+					settings.compress = false;
+				}
+				else if (strcmp(argv[i], "--no-atlas") == 0)
+				{
+					settings.buildAtlases = false;
+				}
+				else
+				{
+					directory = argv[i];
+				}
+			}
+
+			TextureCooker::CookDirectory(directory, settings);
+			return 0;
+		}
+
 		Engine engine(1800, 1000);
 		engine.Run();
 	}